@@ -6,69 +6,258 @@
 #include <string.h>
 #include <time.h>
 
-static int hex_digit(char c)
+/* Prefer the system entropy source. The rand() fallback is seeded once per
+ * process: reseeding from time() on every call handed out the same id to
+ * every object created within one second. */
+static int random_bytes(uint8_t *buf, size_t len)
 {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
-    if (c >= 'A' && c <= 'F') return 10 + (c - 'A');
-    return -1;
+    static int seeded = 0;
+    if (!buf) return BCD_ERR_INVALID_ARG;
+#ifndef _WIN32
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (f) {
+        size_t n = fread(buf, 1, len, f);
+        fclose(f);
+        if (n == len) return BCD_OK;
+    }
+#endif
+    if (!seeded) {
+        srand((unsigned int)time(NULL) ^ (unsigned int)clock());
+        seeded = 1;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        buf[i] = (uint8_t)(rand() & 0xff);
+    }
+    return BCD_OK;
 }
 
-static int parse_hex16(const char *text, uint16_t *out)
+int BcdGenerateObjectId(BCD_OBJECT_ID *id)
 {
-    uint16_t value = 0;
-    for (int i = 0; i < 4; ++i) {
-        int d = hex_digit(text[i]);
-        if (d < 0) return BCD_ERR_PARSE;
-        value = (uint16_t)((value << 4) | (uint16_t)d);
-    }
-    *out = value;
+    if (!id) return BCD_ERR_INVALID_ARG;
+    random_bytes((uint8_t *)id, sizeof(*id));
+    id->data1 &= 0x7fffffffU;
     return BCD_OK;
 }
 
-static int parse_hex32(const char *text, uint32_t *out)
+#define ARENA_ALIGN 16U
+#define ARENA_MIN_CHUNK (16U * 1024U)
+#define ARENA_MAX_CHUNK (4U * 1024U * 1024U)
+
+struct BCD_ARENA_CHUNK {
+    BCD_ARENA_CHUNK *next;
+    size_t size;
+    size_t used;
+    unsigned char *data;
+};
+
+static size_t align_up(size_t v)
 {
-    uint32_t value = 0;
-    for (int i = 0; i < 8; ++i) {
-        int d = hex_digit(text[i]);
-        if (d < 0) return BCD_ERR_PARSE;
-        value = (value << 4) | (uint32_t)d;
+    return (v + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void *arena_alloc(BCD_ARENA *arena, size_t size)
+{
+    size = align_up(size ? size : 1);
+    BCD_ARENA_CHUNK *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunkSize = chunk ? chunk->size * 2 : ARENA_MIN_CHUNK;
+        if (chunkSize > ARENA_MAX_CHUNK) chunkSize = ARENA_MAX_CHUNK;
+        if (chunkSize < size) chunkSize = size;
+        size_t headerSize = align_up(sizeof(BCD_ARENA_CHUNK));
+        unsigned char *raw = (unsigned char *)malloc(headerSize + chunkSize);
+        if (!raw) return NULL;
+        chunk = (BCD_ARENA_CHUNK *)raw;
+        chunk->data = raw + headerSize;
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
     }
-    *out = value;
+    void *p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+/* Keep the newest (largest) chunk so a reused store does not go back to malloc. */
+static void arena_rewind(BCD_ARENA *arena)
+{
+    BCD_ARENA_CHUNK *keep = arena->chunks;
+    if (!keep) return;
+    BCD_ARENA_CHUNK *c = keep->next;
+    while (c) {
+        BCD_ARENA_CHUNK *next = c->next;
+        free(c);
+        c = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+}
+
+static void arena_free(BCD_ARENA *arena)
+{
+    BCD_ARENA_CHUNK *c = arena->chunks;
+    while (c) {
+        BCD_ARENA_CHUNK *next = c->next;
+        free(c);
+        c = next;
+    }
+    arena->chunks = NULL;
+}
+
+static size_t element_payload_size(const BCD_ELEMENT *element)
+{
+    switch (element->kind) {
+    case BCD_ELEMENT_STRING:
+        return element->data.stringValue ? strlen(element->data.stringValue) + 1 : 1;
+    case BCD_ELEMENT_BINARY:
+        return element->data.binaryValue.size;
+    default:
+        return 0;
+    }
+}
+
+/* Copy element into dst, moving its payload into arena. */
+static int element_copy_into(BCD_ARENA *arena, BCD_ELEMENT *dst, const BCD_ELEMENT *src)
+{
+    size_t payloadSize = element_payload_size(src);
+    void *payload = NULL;
+    if (payloadSize > 0) {
+        payload = arena_alloc(arena, payloadSize);
+        if (!payload) return BCD_ERR_CAPACITY;
+    }
+    BCD_ELEMENT copy = *src;
+    if (src->kind == BCD_ELEMENT_STRING) {
+        if (src->data.stringValue) memcpy(payload, src->data.stringValue, payloadSize);
+        else ((char *)payload)[0] = '\0';
+        copy.data.stringValue = (const char *)payload;
+    } else if (src->kind == BCD_ELEMENT_BINARY) {
+        if (payloadSize > 0) memcpy(payload, src->data.binaryValue.data, payloadSize);
+        copy.data.binaryValue.data = (const uint8_t *)payload;
+    }
+    *dst = copy;
     return BCD_OK;
 }
 
-static int parse_hex8_pair(const char *text, uint8_t *out)
+#define ELEMENT_INDEX_THRESHOLD 8U
+
+/* Where an object's element arrays and payloads are allocated. */
+static BCD_ARENA *object_arena(BCD_OBJECT *object)
 {
-    int hi = hex_digit(text[0]);
-    int lo = hex_digit(text[1]);
-    if (hi < 0 || lo < 0) return BCD_ERR_PARSE;
-    *out = (uint8_t)((hi << 4) | lo);
+    return object->store ? &object->store->arena : &object->detachedArena;
+}
+
+static size_t hash_object_id(const BCD_OBJECT_ID *id)
+{
+    uint64_t lo = ((uint64_t)id->data1 << 32) | ((uint64_t)id->data2 << 16) | id->data3;
+    uint64_t hi = 0;
+    for (int i = 0; i < 8; ++i) hi = (hi << 8) | id->data4[i];
+    uint64_t h = lo ^ (hi * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static size_t hash_element_type(uint32_t type)
+{
+    uint32_t h = type * 0x9e3779b1U;
+    return (size_t)(h ^ (h >> 16));
+}
+
+static void object_index_insert(BCD_STORE *store, size_t objectPos)
+{
+    size_t mask = store->objectIndexSize - 1;
+    size_t slot = hash_object_id(&store->objects[objectPos].id) & mask;
+    while (store->objectIndex[slot]) slot = (slot + 1) & mask;
+    store->objectIndex[slot] = (uint32_t)(objectPos + 1);
+}
+
+/* Rebuild the GUID index, growing it so the load factor stays at or below 1/2. */
+static int object_index_rebuild(BCD_STORE *store, size_t minObjects)
+{
+    size_t size = store->objectIndexSize ? store->objectIndexSize : 32;
+    while (size < minObjects * 2) size *= 2;
+    if (size != store->objectIndexSize) {
+        uint32_t *slots = (uint32_t *)malloc(size * sizeof(uint32_t));
+        if (!slots) return BCD_ERR_CAPACITY;
+        free(store->objectIndex);
+        store->objectIndex = slots;
+        store->objectIndexSize = size;
+    }
+    memset(store->objectIndex, 0, size * sizeof(uint32_t));
+    for (size_t i = 0; i < store->objectCount; ++i) object_index_insert(store, i);
     return BCD_OK;
 }
 
-static int random_bytes(uint8_t *buf, size_t len)
+static void element_index_insert(BCD_OBJECT *object, size_t elementPos)
 {
-    if (!buf) return BCD_ERR_INVALID_ARG;
-    srand((unsigned int)time(NULL));
-    for (size_t i = 0; i < len; ++i) {
-        buf[i] = (uint8_t)(rand() & 0xff);
+    size_t mask = object->elementIndexSize - 1;
+    size_t slot = hash_element_type(object->elements[elementPos].type) & mask;
+    while (object->elementIndex[slot]) slot = (slot + 1) & mask;
+    object->elementIndex[slot] = (uint32_t)(elementPos + 1);
+}
+
+static int element_index_rebuild(BCD_OBJECT *object)
+{
+    if (object->elementCount <= ELEMENT_INDEX_THRESHOLD) {
+        object->elementIndex = NULL;
+        object->elementIndexSize = 0;
+        return BCD_OK;
     }
+    size_t size = object->elementIndexSize ? object->elementIndexSize : 32;
+    while (size < object->elementCount * 2) size *= 2;
+    if (size != object->elementIndexSize) {
+        uint32_t *slots = (uint32_t *)arena_alloc(object_arena(object), size * sizeof(uint32_t));
+        if (!slots) return BCD_ERR_CAPACITY;
+        object->elementIndex = slots;
+        object->elementIndexSize = size;
+    }
+    memset(object->elementIndex, 0, size * sizeof(uint32_t));
+    for (size_t i = 0; i < object->elementCount; ++i) element_index_insert(object, i);
     return BCD_OK;
 }
 
-int BcdGenerateObjectId(BCD_OBJECT_ID *id)
+/* Account for an element just appended at elementCount - 1. */
+static int element_index_add(BCD_OBJECT *object)
 {
-    if (!id) return BCD_ERR_INVALID_ARG;
-    random_bytes((uint8_t *)id, sizeof(*id));
-    id->data1 &= 0x7fffffffU;
+    if (object->elementIndex && object->elementCount * 2 <= object->elementIndexSize) {
+        element_index_insert(object, object->elementCount - 1);
+        return BCD_OK;
+    }
+    return element_index_rebuild(object);
+}
+
+/* Decode a pending object's elements; the object stops being pending even if
+ * decoding fails part way, keeping whatever elements were produced. Decoding
+ * does not count as a modification. */
+static int object_materialize(BCD_OBJECT *object)
+{
+    if (!object->pending) return BCD_OK;
+    object->pending = 0;
+    BCD_STORE *store = object->store;
+    if (!store || !store->materialize) return BCD_OK;
+    int status = store->materialize(object, store->materializeContext);
+    object->dirty = 0;
+    return status;
+}
+
+static int object_reserve_elements(BCD_OBJECT *object, size_t need)
+{
+    if (need <= object->elementCapacity) return BCD_OK;
+    size_t newCap = object->elementCapacity ? object->elementCapacity * 2 : 8;
+    while (newCap < need) newCap *= 2;
+    BCD_ELEMENT *elements = (BCD_ELEMENT *)arena_alloc(object_arena(object), newCap * sizeof(BCD_ELEMENT));
+    if (!elements) return BCD_ERR_CAPACITY;
+    if (object->elementCount > 0) memcpy(elements, object->elements, object->elementCount * sizeof(BCD_ELEMENT));
+    object->elements = elements;
+    object->elementCapacity = newCap;
     return BCD_OK;
 }
 
 int BcdStoreInit(BCD_STORE *store)
 {
     if (!store) return BCD_ERR_INVALID_ARG;
-    store->objectCount = 0;
+    memset(store, 0, sizeof(*store));
     return BCD_OK;
 }
 
@@ -76,6 +265,21 @@ void BcdStoreReset(BCD_STORE *store)
 {
     if (!store) return;
     store->objectCount = 0;
+    if (store->objectIndex) memset(store->objectIndex, 0, store->objectIndexSize * sizeof(uint32_t));
+    arena_rewind(&store->arena);
+    store->materialize = NULL;
+    store->materializeContext = NULL;
+    store->retiredCount = 0;
+}
+
+void BcdStoreRelease(BCD_STORE *store)
+{
+    if (!store) return;
+    free(store->objects);
+    free(store->objectIndex);
+    free(store->retiredCells);
+    arena_free(&store->arena);
+    memset(store, 0, sizeof(*store));
 }
 
 size_t BcdStoreGetObjectCount(const BCD_STORE *store)
@@ -92,9 +296,11 @@ BCD_OBJECT *BcdStoreGetObjectAt(BCD_STORE *store, size_t index)
 
 BCD_OBJECT *BcdStoreFindObjectById(BCD_STORE *store, const BCD_OBJECT_ID *id)
 {
-    if (!store || !id) return NULL;
-    for (size_t i = 0; i < store->objectCount; ++i) {
-        if (BcdIdsEqual(&store->objects[i].id, id)) return &store->objects[i];
+    if (!store || !id || !store->objectIndex) return NULL;
+    size_t mask = store->objectIndexSize - 1;
+    for (size_t slot = hash_object_id(id) & mask; store->objectIndex[slot]; slot = (slot + 1) & mask) {
+        BCD_OBJECT *obj = &store->objects[store->objectIndex[slot] - 1];
+        if (BcdIdsEqual(&obj->id, id)) return obj;
     }
     return NULL;
 }
@@ -102,8 +308,34 @@ BCD_OBJECT *BcdStoreFindObjectById(BCD_STORE *store, const BCD_OBJECT_ID *id)
 int BcdStoreAddObject(BCD_STORE *store, const BCD_OBJECT *object)
 {
     if (!store || !object) return BCD_ERR_INVALID_ARG;
-    if (store->objectCount >= BCD_MAX_OBJECTS) return BCD_ERR_CAPACITY;
-    store->objects[store->objectCount] = *object;
+    if (object->pending) object_materialize((BCD_OBJECT *)object);
+    /* object may live in store->objects, so take a copy before growing it. */
+    BCD_OBJECT src = *object;
+    if (store->objectCount == store->objectCapacity) {
+        size_t newCap = store->objectCapacity ? store->objectCapacity * 2 : 16;
+        BCD_OBJECT *objects = (BCD_OBJECT *)realloc(store->objects, newCap * sizeof(BCD_OBJECT));
+        if (!objects) return BCD_ERR_CAPACITY;
+        store->objects = objects;
+        store->objectCapacity = newCap;
+    }
+    if ((store->objectCount + 1) * 2 > store->objectIndexSize &&
+        object_index_rebuild(store, store->objectCount + 1) != BCD_OK) {
+        return BCD_ERR_CAPACITY;
+    }
+    BCD_OBJECT *dst = &store->objects[store->objectCount];
+    memset(dst, 0, sizeof(*dst));
+    dst->id = src.id;
+    dst->objectType = src.objectType;
+    dst->store = store;
+    if (src.elementCount > 0) {
+        if (object_reserve_elements(dst, src.elementCount) != BCD_OK) return BCD_ERR_CAPACITY;
+        for (size_t i = 0; i < src.elementCount; ++i) {
+            if (element_copy_into(&store->arena, &dst->elements[i], &src.elements[i]) != BCD_OK) return BCD_ERR_CAPACITY;
+        }
+        dst->elementCount = src.elementCount;
+        if (element_index_rebuild(dst) != BCD_OK) return BCD_ERR_CAPACITY;
+    }
+    object_index_insert(store, store->objectCount);
     store->objectCount++;
     return BCD_OK;
 }
@@ -111,30 +343,144 @@ int BcdStoreAddObject(BCD_STORE *store, const BCD_OBJECT *object)
 int BcdStoreDeleteObject(BCD_STORE *store, const BCD_OBJECT_ID *id)
 {
     if (!store || !id) return BCD_ERR_INVALID_ARG;
-    for (size_t i = 0; i < store->objectCount; ++i) {
-        if (BcdIdsEqual(&store->objects[i].id, id)) {
-            for (size_t j = i + 1; j < store->objectCount; ++j) {
-                store->objects[j - 1] = store->objects[j];
-            }
-            store->objectCount--;
-            return BCD_OK;
+    BCD_OBJECT *obj = BcdStoreFindObjectById(store, id);
+    if (!obj) return BCD_ERR_NOT_FOUND;
+    if (obj->sourceCell) {
+        if (store->retiredCount == store->retiredCapacity) {
+            size_t newCap = store->retiredCapacity ? store->retiredCapacity * 2 : 8;
+            uint32_t *cells = (uint32_t *)realloc(store->retiredCells, newCap * sizeof(uint32_t));
+            if (!cells) return BCD_ERR_CAPACITY;
+            store->retiredCells = cells;
+            store->retiredCapacity = newCap;
+        }
+        store->retiredCells[store->retiredCount++] = obj->sourceCell;
+    }
+    size_t i = (size_t)(obj - store->objects);
+    memmove(&store->objects[i], &store->objects[i + 1], (store->objectCount - i - 1) * sizeof(BCD_OBJECT));
+    store->objectCount--;
+    /* Positions after i shifted down; the table is already large enough. */
+    return object_index_rebuild(store, store->objectCount);
+}
+
+int BcdStoreMerge(BCD_STORE *dst, BCD_STORE *src)
+{
+    if (!dst || !src || dst == src) return BCD_ERR_INVALID_ARG;
+    size_t total = dst->objectCount + src->objectCount;
+    if (total > dst->objectCapacity) {
+        size_t newCap = dst->objectCapacity ? dst->objectCapacity : 16;
+        while (newCap < total) newCap *= 2;
+        BCD_OBJECT *objects = (BCD_OBJECT *)realloc(dst->objects, newCap * sizeof(BCD_OBJECT));
+        if (!objects) return BCD_ERR_CAPACITY;
+        dst->objects = objects;
+        dst->objectCapacity = newCap;
+    }
+    if (total * 2 > dst->objectIndexSize && object_index_rebuild(dst, total) != BCD_OK) return BCD_ERR_CAPACITY;
+    for (size_t i = 0; i < src->objectCount; ++i) {
+        BCD_OBJECT *obj = &dst->objects[dst->objectCount];
+        *obj = src->objects[i];
+        obj->store = dst;
+        object_index_insert(dst, dst->objectCount);
+        dst->objectCount++;
+    }
+
+    /* Splice src's chunks behind dst's current chunk so dst keeps bumping where it was. */
+    BCD_ARENA_CHUNK *chunks = src->arena.chunks;
+    if (chunks) {
+        BCD_ARENA_CHUNK *tail = chunks;
+        while (tail->next) tail = tail->next;
+        if (dst->arena.chunks) {
+            tail->next = dst->arena.chunks->next;
+            dst->arena.chunks->next = chunks;
+        } else {
+            dst->arena.chunks = chunks;
         }
     }
-    return BCD_ERR_NOT_FOUND;
+    src->arena.chunks = NULL;
+    src->objectCount = 0;
+    if (src->objectIndex) memset(src->objectIndex, 0, src->objectIndexSize * sizeof(uint32_t));
+    return BCD_OK;
+}
+
+int BcdStoreMaterialize(BCD_STORE *store)
+{
+    if (!store) return BCD_ERR_INVALID_ARG;
+    int status = BCD_OK;
+    for (size_t i = 0; i < store->objectCount; ++i) {
+        int rc = object_materialize(&store->objects[i]);
+        if (status == BCD_OK) status = rc;
+    }
+    return status;
+}
+
+size_t BcdObjectGetElementCount(BCD_OBJECT *object)
+{
+    if (!object) return 0;
+    object_materialize(object);
+    return object->elementCount;
+}
+
+BCD_ELEMENT *BcdObjectGetElementAt(BCD_OBJECT *object, size_t index)
+{
+    if (!object) return NULL;
+    object_materialize(object);
+    return index < object->elementCount ? &object->elements[index] : NULL;
 }
 
 int BcdObjectAddElement(BCD_OBJECT *object, const BCD_ELEMENT *element)
 {
     if (!object || !element) return BCD_ERR_INVALID_ARG;
-    if (object->elementCount >= BCD_MAX_ELEMENTS_PER_OBJECT) return BCD_ERR_CAPACITY;
-    object->elements[object->elementCount] = *element;
+    object_materialize(object);
+    if (object_reserve_elements(object, object->elementCount + 1) != BCD_OK) return BCD_ERR_CAPACITY;
+    int status = element_copy_into(object_arena(object), &object->elements[object->elementCount], element);
+    if (status != BCD_OK) return status;
     object->elementCount++;
-    return BCD_OK;
+    object->dirty = 1;
+    return element_index_add(object);
+}
+
+BCD_ELEMENT *BcdObjectReserveElement(BCD_OBJECT *object, uint32_t elementType, BCD_ELEMENT_KIND kind,
+                                     size_t payloadSize, void **outPayload)
+{
+    if (!object) return NULL;
+    object_materialize(object);
+    if (object_reserve_elements(object, object->elementCount + 1) != BCD_OK) return NULL;
+    void *payload = NULL;
+    if (kind == BCD_ELEMENT_STRING || kind == BCD_ELEMENT_BINARY) {
+        payload = arena_alloc(object_arena(object), payloadSize);
+        if (!payload) return NULL;
+    }
+    BCD_ELEMENT *el = &object->elements[object->elementCount];
+    memset(el, 0, sizeof(*el));
+    el->type = elementType;
+    el->kind = kind;
+    if (kind == BCD_ELEMENT_STRING) {
+        el->data.stringValue = (const char *)payload;
+    } else if (kind == BCD_ELEMENT_BINARY) {
+        el->data.binaryValue.data = (const uint8_t *)payload;
+        el->data.binaryValue.size = payloadSize;
+    }
+    object->elementCount++;
+    if (element_index_add(object) != BCD_OK) {
+        object->elementCount--;
+        return NULL;
+    }
+    object->dirty = 1;
+    if (outPayload) *outPayload = payload;
+    return el;
 }
 
 BCD_ELEMENT *BcdObjectFindElement(BCD_OBJECT *object, uint32_t elementType)
 {
     if (!object) return NULL;
+    object_materialize(object);
+    if (object->elementIndex) {
+        size_t mask = object->elementIndexSize - 1;
+        for (size_t slot = hash_element_type(elementType) & mask; object->elementIndex[slot]; slot = (slot + 1) & mask) {
+            BCD_ELEMENT *el = &object->elements[object->elementIndex[slot] - 1];
+            if (el->type == elementType) return el;
+        }
+        return NULL;
+    }
     for (size_t i = 0; i < object->elementCount; ++i) {
         if (object->elements[i].type == elementType) return &object->elements[i];
     }
@@ -146,8 +492,8 @@ int BcdObjectSetElement(BCD_OBJECT *object, const BCD_ELEMENT *element)
     if (!object || !element) return BCD_ERR_INVALID_ARG;
     BCD_ELEMENT *existing = BcdObjectFindElement(object, element->type);
     if (existing) {
-        *existing = *element;
-        return BCD_OK;
+        object->dirty = 1;
+        return element_copy_into(object_arena(object), existing, element);
     }
     return BcdObjectAddElement(object, element);
 }
@@ -155,16 +501,25 @@ int BcdObjectSetElement(BCD_OBJECT *object, const BCD_ELEMENT *element)
 int BcdObjectRemoveElement(BCD_OBJECT *object, uint32_t elementType)
 {
     if (!object) return BCD_ERR_INVALID_ARG;
-    for (size_t i = 0; i < object->elementCount; ++i) {
-        if (object->elements[i].type == elementType) {
-            for (size_t j = i + 1; j < object->elementCount; ++j) {
-                object->elements[j - 1] = object->elements[j];
-            }
-            object->elementCount--;
-            return BCD_OK;
-        }
-    }
-    return BCD_ERR_NOT_FOUND;
+    BCD_ELEMENT *el = BcdObjectFindElement(object, elementType);
+    if (!el) return BCD_ERR_NOT_FOUND;
+    size_t i = (size_t)(el - object->elements);
+    memmove(&object->elements[i], &object->elements[i + 1], (object->elementCount - i - 1) * sizeof(BCD_ELEMENT));
+    object->elementCount--;
+    object->dirty = 1;
+    if (!object->elementIndex) return BCD_OK;
+    return element_index_rebuild(object);
+}
+
+void BcdObjectRelease(BCD_OBJECT *object)
+{
+    if (!object || object->store) return;
+    arena_free(&object->detachedArena);
+    object->elements = NULL;
+    object->elementCount = 0;
+    object->elementCapacity = 0;
+    object->elementIndex = NULL;
+    object->elementIndexSize = 0;
 }
 
 int BcdIdsEqual(const BCD_OBJECT_ID *a, const BCD_OBJECT_ID *b)
@@ -177,72 +532,278 @@ int BcdIdsEqual(const BCD_OBJECT_ID *a, const BCD_OBJECT_ID *b)
     return 1;
 }
 
+#define HASH_PRIME 0x100000001b3ULL
+
+static uint64_t load_uint64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+uint64_t BcdHashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = seed;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) hash = (hash ^ load_uint64(bytes + i)) * HASH_PRIME;
+    if (i < size) {
+        unsigned char tail[8] = { 0 };
+        memcpy(tail, bytes + i, size - i);
+        hash = (hash ^ load_uint64(tail)) * HASH_PRIME;
+    }
+    return (hash ^ (uint64_t)size) * HASH_PRIME;
+}
+
+/* GUID text <-> binary.
+ *
+ * Both directions go through the 16 id bytes in text order (data1 and the
+ * other fields big-endian), so only the packing into BCD_OBJECT_ID is
+ * field-aware. With SSE2 (always present on x86-64) the 38 characters are
+ * checked and turned into nibbles in three overlapping 16-byte loads and the
+ * digit pairs are combined in-register; SSSE3 also gathers the pairs with
+ * shuffles. Everything else uses the table-driven scalar code, which is also
+ * used when built with -DBCD_GUID_SIMD=0. */
+
+#ifndef BCD_GUID_SIMD
+#define BCD_GUID_SIMD 1
+#endif
+
+#if BCD_GUID_SIMD && defined(__SSE2__)
+#define GUID_SSE2 1
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#endif
+
+#ifdef GUID_SSE2
+/* Nibble values of 16 characters, or 0 if a character is neither a hex digit
+ * where separators holds 0 nor equal to the separator expected there. */
+static int guid_nibbles_sse2(__m128i v, __m128i separators, __m128i *nibbles)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    __m128i hexPos = _mm_cmpeq_epi8(separators, _mm_setzero_si128());
+    __m128i ok = _mm_or_si128(_mm_and_si128(hexPos, _mm_or_si128(digit, letter)),
+                              _mm_andnot_si128(hexPos, _mm_cmpeq_epi8(v, separators)));
+    if (_mm_movemask_epi8(ok) != 0xffff) return 0;
+    __m128i value = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                                 _mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    *nibbles = _mm_and_si128(value, _mm_set1_epi8(0x0f));
+    return 1;
+}
+
+/* Byte i is digit i followed by digit i + 1; the last byte is garbage. */
+static __m128i guid_pairs_sse2(__m128i nibbles)
+{
+    return _mm_or_si128(_mm_slli_epi16(nibbles, 4), _mm_srli_si128(nibbles, 1));
+}
+
+/* Loads at 0, 15 and 22 cover the 38 characters without reading past them. */
+static int parse_guid_bytes(const char *text, uint8_t bytes[16])
+{
+    const __m128i sep0 = _mm_setr_epi8('{', 0, 0, 0, 0, 0, 0, 0, 0, '-', 0, 0, 0, 0, '-', 0);
+    const __m128i sep15 = _mm_setr_epi8(0, 0, 0, 0, '-', 0, 0, 0, 0, '-', 0, 0, 0, 0, 0, 0);
+    const __m128i sep22 = _mm_setr_epi8(0, 0, '-', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '}');
+    __m128i n0, n15, n22;
+    if (!guid_nibbles_sse2(_mm_loadu_si128((const __m128i *)text), sep0, &n0) ||
+        !guid_nibbles_sse2(_mm_loadu_si128((const __m128i *)(text + 15)), sep15, &n15) ||
+        !guid_nibbles_sse2(_mm_loadu_si128((const __m128i *)(text + 22)), sep22, &n22)) {
+        return BCD_ERR_PARSE;
+    }
+    __m128i p0 = guid_pairs_sse2(n0);
+    __m128i p15 = guid_pairs_sse2(n15);
+    __m128i p22 = guid_pairs_sse2(n22);
+#ifdef __SSSE3__
+    const __m128i from0 = _mm_setr_epi8(1, 3, 5, 7, 10, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i from15 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 0, 2, 5, 7, 10, 12, 14, -1, -1, -1);
+    const __m128i from22 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 9, 11, 13);
+    __m128i result = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, from0), _mm_shuffle_epi8(p15, from15)),
+                                  _mm_shuffle_epi8(p22, from22));
+    _mm_storeu_si128((__m128i *)bytes, result);
+#else
+    /* Offsets of the digit pairs in p0, p15 and p22 stored back to back. */
+    static const uint8_t gather[16] = { 1, 3, 5, 7, 10, 12, 16, 18, 21, 23, 26, 28, 30, 41, 43, 45 };
+    uint8_t pairs[48];
+    _mm_storeu_si128((__m128i *)pairs, p0);
+    _mm_storeu_si128((__m128i *)(pairs + 16), p15);
+    _mm_storeu_si128((__m128i *)(pairs + 32), p22);
+    for (int i = 0; i < 16; ++i) bytes[i] = pairs[gather[i]];
+#endif
+    return BCD_OK;
+}
+#else
+static const char g_hexDigits[] = "0123456789abcdef";
+
+/* Digit value plus one; 0 marks a character that is not a hex digit. */
+static const uint8_t g_hexValuePlusOne[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/* Offset of the first digit of each byte in "{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}". */
+static const uint8_t g_guidDigitOffsets[16] = { 1, 3, 5, 7, 10, 12, 15, 17, 20, 22, 25, 27, 29, 31, 33, 35 };
+
+static int guid_separators_valid(const char *text)
+{
+    return text[0] == '{' && text[9] == '-' && text[14] == '-' && text[19] == '-' && text[24] == '-' &&
+           text[37] == '}';
+}
+
+static int parse_guid_bytes(const char *text, uint8_t bytes[16])
+{
+    if (!guid_separators_valid(text)) return BCD_ERR_PARSE;
+    unsigned invalid = 0;
+    for (int i = 0; i < 16; ++i) {
+        unsigned hi = g_hexValuePlusOne[(unsigned char)text[g_guidDigitOffsets[i]]];
+        unsigned lo = g_hexValuePlusOne[(unsigned char)text[g_guidDigitOffsets[i] + 1]];
+        invalid |= (hi == 0) | (lo == 0);
+        bytes[i] = (uint8_t)(((hi - 1) << 4) | ((lo - 1) & 0xf));
+    }
+    return invalid ? BCD_ERR_PARSE : BCD_OK;
+}
+#endif
+
 int BcdParseObjectId(const char *text, BCD_OBJECT_ID *outId)
 {
     if (!text || !outId) return BCD_ERR_INVALID_ARG;
-    size_t len = strlen(text);
-    if (len != 38 || text[0] != '{' || text[37] != '}') return BCD_ERR_PARSE;
-    if (parse_hex32(text + 1, &outId->data1) != BCD_OK) return BCD_ERR_PARSE;
-    if (text[9] != '-') return BCD_ERR_PARSE;
-    if (parse_hex16(text + 10, &outId->data2) != BCD_OK) return BCD_ERR_PARSE;
-    if (text[14] != '-') return BCD_ERR_PARSE;
-    if (parse_hex16(text + 15, &outId->data3) != BCD_OK) return BCD_ERR_PARSE;
-    if (text[19] != '-') return BCD_ERR_PARSE;
-    if (parse_hex8_pair(text + 20, &outId->data4[0]) != BCD_OK) return BCD_ERR_PARSE;
-    if (parse_hex8_pair(text + 22, &outId->data4[1]) != BCD_ERR_PARSE) return BCD_ERR_PARSE;
-    if (text[24] != '-') return BCD_ERR_PARSE;
-    for (int i = 0; i < 6; ++i) {
-        if (parse_hex8_pair(text + 25 + (i * 2), &outId->data4[2 + i]) != BCD_OK) return BCD_ERR_PARSE;
-    }
+    return BcdParseObjectIdN(text, strlen(text), outId);
+}
+
+int BcdParseObjectIdN(const char *text, size_t len, BCD_OBJECT_ID *outId)
+{
+    if (!text || !outId) return BCD_ERR_INVALID_ARG;
+    if (len != BCD_ID_STRING_LENGTH) return BCD_ERR_PARSE;
+    uint8_t b[16];
+    if (parse_guid_bytes(text, b) != BCD_OK) return BCD_ERR_PARSE;
+    outId->data1 = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    outId->data2 = (uint16_t)((b[4] << 8) | b[5]);
+    outId->data3 = (uint16_t)((b[6] << 8) | b[7]);
+    memcpy(outId->data4, b + 8, 8);
     return BCD_OK;
 }
 
+/* The 32 digits as lowercase hex, in text order. */
+static void format_guid_digits(const BCD_OBJECT_ID *id, char digits[32])
+{
+    uint8_t b[16];
+    b[0] = (uint8_t)(id->data1 >> 24);
+    b[1] = (uint8_t)(id->data1 >> 16);
+    b[2] = (uint8_t)(id->data1 >> 8);
+    b[3] = (uint8_t)id->data1;
+    b[4] = (uint8_t)(id->data2 >> 8);
+    b[5] = (uint8_t)id->data2;
+    b[6] = (uint8_t)(id->data3 >> 8);
+    b[7] = (uint8_t)id->data3;
+    memcpy(b + 8, id->data4, 8);
+#ifdef GUID_SSE2
+    __m128i v = _mm_loadu_si128((const __m128i *)b);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    __m128i n0 = _mm_unpacklo_epi8(hi, lo);
+    __m128i n1 = _mm_unpackhi_epi8(hi, lo);
+#ifdef __SSSE3__
+    const __m128i table = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    _mm_storeu_si128((__m128i *)digits, _mm_shuffle_epi8(table, n0));
+    _mm_storeu_si128((__m128i *)(digits + 16), _mm_shuffle_epi8(table, n1));
+#else
+    /* '0' + n, plus 'a' - '0' - 10 for the letters. */
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+    n0 = _mm_add_epi8(_mm_add_epi8(n0, zero), _mm_and_si128(_mm_cmpgt_epi8(n0, nine), gap));
+    n1 = _mm_add_epi8(_mm_add_epi8(n1, zero), _mm_and_si128(_mm_cmpgt_epi8(n1, nine), gap));
+    _mm_storeu_si128((__m128i *)digits, n0);
+    _mm_storeu_si128((__m128i *)(digits + 16), n1);
+#endif
+#else
+    for (int i = 0; i < 16; ++i) {
+        digits[2 * i] = g_hexDigits[b[i] >> 4];
+        digits[2 * i + 1] = g_hexDigits[b[i] & 0xf];
+    }
+#endif
+}
+
 int BcdFormatObjectId(const BCD_OBJECT_ID *id, char *buffer, size_t bufferSize)
 {
     if (!id || !buffer || bufferSize < (BCD_ID_STRING_LENGTH + 1)) return BCD_ERR_INVALID_ARG;
-    int n = snprintf(buffer, bufferSize,
-                     "{%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x}",
-                     id->data1, id->data2, id->data3,
-                     id->data4[0], id->data4[1], id->data4[2], id->data4[3],
-                     id->data4[4], id->data4[5], id->data4[6], id->data4[7]);
-    if (n < 0 || (size_t)n >= bufferSize) return BCD_ERR_INVALID_ARG;
+    char digits[32];
+    format_guid_digits(id, digits);
+    buffer[0] = '{';
+    memcpy(buffer + 1, digits, 8);
+    buffer[9] = '-';
+    memcpy(buffer + 10, digits + 8, 4);
+    buffer[14] = '-';
+    memcpy(buffer + 15, digits + 12, 4);
+    buffer[19] = '-';
+    memcpy(buffer + 20, digits + 16, 4);
+    buffer[24] = '-';
+    memcpy(buffer + 25, digits + 20, 12);
+    buffer[37] = '}';
+    buffer[38] = '\0';
     return BCD_OK;
 }
 
-static const BCD_ELEMENT_META g_elementTable[] = {
-    {"description", BCD_ELEMENT_DESCRIPTION, BCD_ELEMENT_STRING},
-    {"device", BCD_ELEMENT_APPLICATION_DEVICE, BCD_ELEMENT_STRING},
-    {"osdevice", BCD_ELEMENT_OSDEVICE, BCD_ELEMENT_STRING},
-    {"path", BCD_ELEMENT_APPLICATION_PATH, BCD_ELEMENT_STRING},
-    {"systemroot", BCD_ELEMENT_SYSTEMROOT, BCD_ELEMENT_STRING},
-    {"locale", BCD_ELEMENT_LOCALE, BCD_ELEMENT_STRING},
-    {"inherit", BCD_ELEMENT_INHERIT, BCD_ELEMENT_BINARY},
-    {"recoverysequence", BCD_ELEMENT_RECOVERY_SEQUENCE, BCD_ELEMENT_BINARY},
-    {"displayorder", BCD_ELEMENT_DISPLAY_ORDER, BCD_ELEMENT_BINARY},
-    {"bootsequence", BCD_ELEMENT_BOOT_SEQUENCE, BCD_ELEMENT_BINARY},
-    {"toolsdisplayorder", BCD_ELEMENT_TOOLS_DISPLAY_ORDER, BCD_ELEMENT_BINARY},
-    {"timeout", BCD_ELEMENT_TIMEOUT, BCD_ELEMENT_INTEGER},
-    {"default", BCD_ELEMENT_BOOTMANAGER_DEFAULT, BCD_ELEMENT_BINARY},
-    {"bootdebug", BCD_ELEMENT_BOOLEAN_BOOTDEBUG, BCD_ELEMENT_BOOLEAN},
-    {"bootems", BCD_ELEMENT_BOOLEAN_BOOTEMS, BCD_ELEMENT_BOOLEAN},
-    {"ems", BCD_ELEMENT_BOOLEAN_EMS, BCD_ELEMENT_BOOLEAN},
-    {"debug", BCD_ELEMENT_BOOLEAN_DEBUG, BCD_ELEMENT_BOOLEAN},
-    {NULL, 0, BCD_ELEMENT_UNKNOWN}
-};
+/* Hash-and-displace perfect hashing over the catalog in
+ * bcd_element_table.h. A key (element id, or FNV-1a of a name) picks a bucket
+ * with seed 0; the bucket's seed then picks the one slot the key can occupy,
+ * so a lookup is two hashes and one comparison. gen_element_table.py mirrors
+ * this mixer when it searches for the seeds. */
+static uint32_t element_hash(uint32_t key, uint32_t seed)
+{
+    uint32_t h = key ^ (seed * 0x9e3779b9U);
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t element_name_key(const char *name)
+{
+    uint32_t h = 0x811c9dc5U;
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p) h = (h ^ *p) * 0x01000193U;
+    return h;
+}
+
+#include "bcd_element_table.h"
 
 const BCD_ELEMENT_META *BcdLookupElementByName(const char *name)
 {
     if (!name) return NULL;
-    for (size_t i = 0; g_elementTable[i].name; ++i) {
-        if (strcmp(g_elementTable[i].name, name) == 0) return &g_elementTable[i];
-    }
-    return NULL;
+    uint32_t key = element_name_key(name);
+    uint32_t seed = g_elementNameSeeds[element_hash(key, 0) & (ELEMENT_NAME_BUCKETS - 1)];
+    unsigned slot = g_elementNameSlots[element_hash(key, seed) & (ELEMENT_NAME_SLOTS - 1)];
+    if (slot == 0 || strcmp(g_elementNames[slot - 1].name, name) != 0) return NULL;
+    return &g_elementTable[g_elementNames[slot - 1].element];
 }
 
 const BCD_ELEMENT_META *BcdLookupElementById(uint32_t id)
 {
-    for (size_t i = 0; g_elementTable[i].name; ++i) {
-        if (g_elementTable[i].id == id) return &g_elementTable[i];
+    uint32_t seed = g_elementIdSeeds[element_hash(id, 0) & (ELEMENT_ID_BUCKETS - 1)];
+    unsigned slot = g_elementIdSlots[element_hash(id, seed) & (ELEMENT_ID_SLOTS - 1)];
+    if (slot == 0 || g_elementTable[slot - 1].id != id) return NULL;
+    return &g_elementTable[slot - 1];
+}
+
+uint32_t BcdMigrateLegacyElementId(uint32_t id)
+{
+    switch (id) {
+    case 0x14000003U: return BCD_ELEMENT_INHERIT;
+    case 0x24000001U: return BCD_ELEMENT_RECOVERY_SEQUENCE;
+    case 0x24000002U: return BCD_ELEMENT_DISPLAY_ORDER;
+    case 0x24000003U: return BCD_ELEMENT_BOOT_SEQUENCE;
+    case 0x24000004U: return BCD_ELEMENT_TOOLS_DISPLAY_ORDER;
+    case 0x26000010U: return BCD_ELEMENT_BOOLEAN_BOOTDEBUG;
+    case 0x26000020U: return BCD_ELEMENT_BOOLEAN_BOOTEMS;
+    case 0x26000022U: return BCD_ELEMENT_BOOLEAN_EMS;
+    case 0x260000E0U: return BCD_ELEMENT_BOOLEAN_DEBUG;
+    default: return id;
     }
-    return NULL;
 }
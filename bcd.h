@@ -4,11 +4,6 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define BCD_MAX_OBJECTS 128
-#define BCD_MAX_ELEMENTS_PER_OBJECT 64
-#define BCD_MAX_STRING_LEN 256
-#define BCD_MAX_BINARY_SIZE 1024
-
 #define BCD_OK 0
 #define BCD_ERR_INVALID_ARG -1
 #define BCD_ERR_NOT_FOUND -2
@@ -22,27 +17,44 @@
 #define BCD_OBJECT_RESUME 0x10300006U
 #define BCD_OBJECT_INHERITANCE 0x12000004U
 
-/* Frequently used element identifiers (subset). */
+/* Frequently used element identifiers (subset; the full catalog is in
+ * bcd_element_table.h). */
 #define BCD_ELEMENT_DESCRIPTION 0x12000004U
 #define BCD_ELEMENT_APPLICATION_DEVICE 0x11000001U
 #define BCD_ELEMENT_APPLICATION_PATH 0x12000002U
 #define BCD_ELEMENT_OSDEVICE 0x21000001U
 #define BCD_ELEMENT_SYSTEMROOT 0x22000002U
 #define BCD_ELEMENT_LOCALE 0x12000005U
-#define BCD_ELEMENT_INHERIT 0x14000003U
-#define BCD_ELEMENT_RECOVERY_SEQUENCE 0x24000001U
-#define BCD_ELEMENT_DISPLAY_ORDER 0x24000002U
-#define BCD_ELEMENT_BOOT_SEQUENCE 0x24000003U
-#define BCD_ELEMENT_TOOLS_DISPLAY_ORDER 0x24000004U
+#define BCD_ELEMENT_INHERIT 0x14000006U
+#define BCD_ELEMENT_RECOVERY_SEQUENCE 0x14000008U
+#define BCD_ELEMENT_DISPLAY_ORDER 0x24000001U
+#define BCD_ELEMENT_BOOT_SEQUENCE 0x24000002U
+#define BCD_ELEMENT_TOOLS_DISPLAY_ORDER 0x24000010U
 #define BCD_ELEMENT_TIMEOUT 0x25000004U
 #define BCD_ELEMENT_BOOTMANAGER_DEFAULT 0x23000003U
-#define BCD_ELEMENT_BOOLEAN_BOOTDEBUG 0x26000010U
-#define BCD_ELEMENT_BOOLEAN_BOOTEMS 0x26000020U
-#define BCD_ELEMENT_BOOLEAN_EMS 0x26000022U
-#define BCD_ELEMENT_BOOLEAN_DEBUG 0x260000E0U
+#define BCD_ELEMENT_BOOLEAN_BOOTDEBUG 0x16000010U
+#define BCD_ELEMENT_BOOLEAN_BOOTEMS 0x16000020U
+#define BCD_ELEMENT_BOOLEAN_EMS 0x260000B0U
+#define BCD_ELEMENT_BOOLEAN_DEBUG 0x260000A0U
+
+/* Bits 24-27 of an element identifier give the format of its value. */
+#define BCD_ELEMENT_FORMAT(type) (((uint32_t)(type) >> 24) & 0x0fU)
+#define BCD_ELEMENT_FORMAT_DEVICE 1U
+#define BCD_ELEMENT_FORMAT_STRING 2U
+#define BCD_ELEMENT_FORMAT_OBJECT 3U
+#define BCD_ELEMENT_FORMAT_OBJECT_LIST 4U
+#define BCD_ELEMENT_FORMAT_INTEGER 5U
+#define BCD_ELEMENT_FORMAT_BOOLEAN 6U
+#define BCD_ELEMENT_FORMAT_INTEGER_LIST 7U
 
 #define BCD_ID_STRING_LENGTH 38
 
+/* Well-known objects. */
+#define BCD_BOOTMGR_ID_STRING "{9dea862c-5cdd-4e70-acc1-f32b344d4795}"
+
+/* Name of the DWORD value that persists BCD_OBJECT.objectType in an object key. */
+#define BCD_OBJECT_TYPE_VALUE "Type"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -62,30 +74,76 @@ typedef enum {
     BCD_ELEMENT_BINARY
 } BCD_ELEMENT_KIND;
 
+/* String and binary payloads are referenced, not embedded. Elements passed in
+ * by callers may point anywhere; elements held by a store point into the
+ * store's arena and stay valid until the store is reset or released. */
 typedef struct BCD_ELEMENT {
     uint32_t type;
     BCD_ELEMENT_KIND kind;
     union {
         uint64_t integerValue;
-        char stringValue[BCD_MAX_STRING_LEN];
+        const char *stringValue;
         int boolValue;
         struct {
-            uint8_t data[BCD_MAX_BINARY_SIZE];
+            const uint8_t *data;
             size_t size;
         } binaryValue;
     } data;
 } BCD_ELEMENT;
 
+struct BCD_STORE;
+
+typedef struct BCD_ARENA_CHUNK BCD_ARENA_CHUNK;
+
+/* Bump allocator backing element arrays and payloads. Memory is only
+ * reclaimed wholesale by BcdStoreReset/BcdStoreRelease. */
+typedef struct BCD_ARENA {
+    BCD_ARENA_CHUNK *chunks;
+} BCD_ARENA;
+
+/* Objects owned by a store (see BcdStoreAddObject) keep their elements in
+ * the store's arena. A detached object (store == NULL, e.g. zero-initialized
+ * by the caller) gets a heap arena of its own on its first element, which
+ * BcdObjectRelease frees; adding it to a store copies the elements over.
+ * Objects of a lazily loaded store start out pending: their elements are
+ * decoded on first use through the accessors below, so prefer
+ * BcdObjectGetElementCount/BcdObjectGetElementAt over the raw fields. */
 typedef struct BCD_OBJECT {
     BCD_OBJECT_ID id;
     uint32_t objectType;
-    BCD_ELEMENT elements[BCD_MAX_ELEMENTS_PER_OBJECT];
+    uint32_t sourceCell;    /* nk cell the object was loaded from, 0 if none */
+    int pending;
+    int dirty;              /* elements changed since the object was loaded */
+    BCD_ELEMENT *elements;
     size_t elementCount;
+    size_t elementCapacity;
+    /* Open-addressing index by element type (slot = element index + 1);
+     * only built once the object outgrows a short linear scan. */
+    uint32_t *elementIndex;
+    size_t elementIndexSize;
+    struct BCD_STORE *store;
+    BCD_ARENA detachedArena;    /* element storage while store is NULL */
 } BCD_OBJECT;
 
+/* Object pointers returned by the store are invalidated by any later
+ * BcdStoreAddObject or BcdStoreDeleteObject call. */
+typedef int (*BCD_MATERIALIZE_FN)(BCD_OBJECT *object, void *context);
+
 typedef struct BCD_STORE {
-    BCD_OBJECT objects[BCD_MAX_OBJECTS];
+    BCD_OBJECT *objects;
     size_t objectCount;
+    size_t objectCapacity;
+    /* Open-addressing index by GUID (slot = object index + 1). */
+    uint32_t *objectIndex;
+    size_t objectIndexSize;
+    BCD_ARENA arena;
+    /* Decodes a pending object's elements (lazy stores only). */
+    BCD_MATERIALIZE_FN materialize;
+    void *materializeContext;
+    /* Source cells of deleted objects, kept for incremental writers. */
+    uint32_t *retiredCells;
+    size_t retiredCount;
+    size_t retiredCapacity;
 } BCD_STORE;
 
 /* Mapping helpers */
@@ -97,24 +155,53 @@ typedef struct BCD_ELEMENT_META {
 
 int BcdStoreInit(BCD_STORE *store);
 void BcdStoreReset(BCD_STORE *store);
+void BcdStoreRelease(BCD_STORE *store);
 size_t BcdStoreGetObjectCount(const BCD_STORE *store);
 BCD_OBJECT *BcdStoreGetObjectAt(BCD_STORE *store, size_t index);
 BCD_OBJECT *BcdStoreFindObjectById(BCD_STORE *store, const BCD_OBJECT_ID *id);
 int BcdStoreAddObject(BCD_STORE *store, const BCD_OBJECT *object);
 int BcdStoreDeleteObject(BCD_STORE *store, const BCD_OBJECT_ID *id);
+/* Append all of src's objects to dst and hand src's arena over to dst without
+ * copying payloads. src is left empty but initialized. */
+int BcdStoreMerge(BCD_STORE *dst, BCD_STORE *src);
+/* Decode every pending object; a no-op for eagerly loaded stores. */
+int BcdStoreMaterialize(BCD_STORE *store);
 
 int BcdGenerateObjectId(BCD_OBJECT_ID *id);
 int BcdParseObjectId(const char *text, BCD_OBJECT_ID *outId);
+int BcdParseObjectIdN(const char *text, size_t length, BCD_OBJECT_ID *outId);
 int BcdFormatObjectId(const BCD_OBJECT_ID *id, char *buffer, size_t bufferSize);
 int BcdIdsEqual(const BCD_OBJECT_ID *a, const BCD_OBJECT_ID *b);
 
+/* Fast non-cryptographic 64-bit hash: FNV-1a over little-endian 64-bit words
+ * (the tail zero-padded), folding in the length. A change confined to one
+ * word always changes the result. Pass BCD_HASH_SEED, or a previous result to
+ * chain inputs. */
+#define BCD_HASH_SEED 0xcbf29ce484222325ULL
+uint64_t BcdHashBytes(const void *data, size_t size, uint64_t seed);
+
+size_t BcdObjectGetElementCount(BCD_OBJECT *object);
+BCD_ELEMENT *BcdObjectGetElementAt(BCD_OBJECT *object, size_t index);
 int BcdObjectAddElement(BCD_OBJECT *object, const BCD_ELEMENT *element);
 BCD_ELEMENT *BcdObjectFindElement(BCD_OBJECT *object, uint32_t elementType);
 int BcdObjectSetElement(BCD_OBJECT *object, const BCD_ELEMENT *element);
 int BcdObjectRemoveElement(BCD_OBJECT *object, uint32_t elementType);
-
+/* Free the elements of a detached object; objects owned by a store are left
+ * alone, their memory goes with the store. */
+void BcdObjectRelease(BCD_OBJECT *object);
+/* Append an element whose payload (payloadSize bytes, for string and binary
+ * kinds) is carved from the store arena and filled in by the caller. */
+BCD_ELEMENT *BcdObjectReserveElement(BCD_OBJECT *object, uint32_t elementType, BCD_ELEMENT_KIND kind,
+                                     size_t payloadSize, void **outPayload);
+
+/* Catalog lookups, constant time through generated perfect hashes. Names
+ * include aliases; the returned entry always carries the canonical name. */
 const BCD_ELEMENT_META *BcdLookupElementByName(const char *name);
 const BCD_ELEMENT_META *BcdLookupElementById(uint32_t id);
+/* Current id of an element read from a legacy store (RegfIsLegacyBcdHive),
+ * whose ids for inherit, the boot sequences and the debug/EMS switches
+ * predate the catalog. Other ids are returned unchanged. */
+uint32_t BcdMigrateLegacyElementId(uint32_t id);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,497 @@
+/* Benchmarks for the regf reader, the loader and the serializer (POSIX only).
+ *
+ * Each run generates synthetic stores of the requested sizes, serializes them
+ * to hive images and times every benchmark until --min-time has elapsed. The
+ * results go to stdout as one JSON document: time per operation, heap
+ * allocations per operation and the process's peak RSS so far. Build and run
+ * with `make bench`.
+ *
+ * bcdedit.c is compiled in (without its main) so the /enum formatter and the
+ * store save path are measured exactly as the command line runs them. */
+#define BCDEDIT_NO_MAIN
+#include "bcdedit.c"
+
+#include <sys/resource.h>
+#include <time.h>
+
+#ifdef BENCH_COUNT_ALLOCS
+/* Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc: every heap
+ * request made by the tool's code is counted. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long long allocCount;
+static unsigned long long allocBytes;
+
+void *__wrap_malloc(size_t size)
+{
+    ++allocCount;
+    allocBytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    ++allocCount;
+    allocBytes += (unsigned long long)count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    ++allocCount;
+    allocBytes += size;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+#define DEFAULT_MIN_TIME 0.2
+#define DEFAULT_BLOB_SIZE 20000U
+#define BLOB_INTERVAL 100
+#define DISPLAY_ORDER_LIMIT 64
+#define LOOKUPS_PER_OP 1000
+
+typedef struct BENCH_CONTEXT {
+    size_t objectCount;
+    unsigned char *image;       /* serialized synthetic hive */
+    size_t imageSize;
+    REGF_HIVE *hive;            /* image, opened once */
+    BCD_STORE loaded;           /* image, fully loaded once */
+    BCD_OBJECT_ID *ids;
+    char (*names)[BCD_ID_STRING_LENGTH + 1];
+    const char *tempPath;
+    int snapshotWritten;        /* tempPath holds a snapshot of loaded */
+    FILE *sink;
+} BENCH_CONTEXT;
+
+/* One iteration; *ops is the number of operations it performed. */
+typedef int (*BENCH_FN)(BENCH_CONTEXT *ctx, size_t *ops);
+
+typedef struct BENCH {
+    const char *name;
+    BENCH_FN run;
+} BENCH;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+}
+
+/* xorshift64: reproducible ids and blob bytes across runs. */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static int add_element(BCD_OBJECT *obj, uint32_t type, BCD_ELEMENT_KIND kind, const void *data, size_t size,
+                       uint64_t integer)
+{
+    BCD_ELEMENT el;
+    memset(&el, 0, sizeof(el));
+    el.type = type;
+    el.kind = kind;
+    if (kind == BCD_ELEMENT_STRING) el.data.stringValue = (const char *)data;
+    else if (kind == BCD_ELEMENT_INTEGER) el.data.integerValue = integer;
+    else if (kind == BCD_ELEMENT_BOOLEAN) el.data.boolValue = integer != 0;
+    else {
+        el.data.binaryValue.data = (const uint8_t *)data;
+        el.data.binaryValue.size = size;
+    }
+    return BcdObjectAddElement(obj, &el);
+}
+
+/* A boot manager whose display order lists the first entries, followed by OS
+ * loader entries with string, integer, boolean and small binary elements;
+ * every BLOB_INTERVAL-th entry also carries a blobSize-byte binary, stored as
+ * big data once it exceeds one cell. */
+static int generate_store(BCD_STORE *store, size_t objectCount, size_t blobSize, BCD_OBJECT_ID *ids)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    unsigned char *blob = (unsigned char *)malloc(blobSize ? blobSize : 1);
+    if (!blob) return BCD_ERR_CAPACITY;
+    for (size_t i = 0; i < blobSize; ++i) blob[i] = (unsigned char)next_random(&state);
+    for (size_t i = 0; i < objectCount; ++i) {
+        if (i == 0) {
+            BcdParseObjectId(BCD_BOOTMGR_ID_STRING, &ids[i]);
+        } else {
+            uint64_t a = next_random(&state);
+            uint64_t b = next_random(&state);
+            memcpy(&ids[i], &a, 8);
+            memcpy((unsigned char *)&ids[i] + 8, &b, 8);
+        }
+    }
+
+    int status = BCD_OK;
+    char text[64];
+    for (size_t i = 0; i < objectCount && status == BCD_OK; ++i) {
+        BCD_OBJECT header;
+        memset(&header, 0, sizeof(header));
+        header.id = ids[i];
+        header.objectType = i == 0 ? BCD_OBJECT_BOOTMGR : BCD_OBJECT_OSLOADER;
+        if ((status = BcdStoreAddObject(store, &header)) != BCD_OK) break;
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(store, BcdStoreGetObjectCount(store) - 1);
+        snprintf(text, sizeof(text), "Synthetic entry %zu", i);
+        status = add_element(obj, BCD_ELEMENT_DESCRIPTION, BCD_ELEMENT_STRING, text, 0, 0);
+        if (status == BCD_OK) status = add_element(obj, BCD_ELEMENT_TIMEOUT, BCD_ELEMENT_INTEGER, NULL, 0, i % 30);
+        if (i == 0) {
+            size_t entries = objectCount - 1 < DISPLAY_ORDER_LIMIT ? objectCount - 1 : DISPLAY_ORDER_LIMIT;
+            if (status == BCD_OK && entries > 0) {
+                status = add_element(obj, BCD_ELEMENT_DISPLAY_ORDER, BCD_ELEMENT_BINARY, &ids[1],
+                                     entries * sizeof(BCD_OBJECT_ID), 0);
+            }
+            continue;
+        }
+        if (status == BCD_OK) {
+            status = add_element(obj, BCD_ELEMENT_APPLICATION_PATH, BCD_ELEMENT_STRING,
+                                 "\\Windows\\system32\\winload.efi", 0, 0);
+        }
+        if (status == BCD_OK) status = add_element(obj, BCD_ELEMENT_SYSTEMROOT, BCD_ELEMENT_STRING, "\\Windows", 0, 0);
+        if (status == BCD_OK) status = add_element(obj, BCD_ELEMENT_BOOLEAN_BOOTDEBUG, BCD_ELEMENT_BOOLEAN, NULL, 0, i & 1);
+        if (status == BCD_OK) {
+            status = add_element(obj, BCD_ELEMENT_RECOVERY_SEQUENCE, BCD_ELEMENT_BINARY, &ids[0],
+                                 sizeof(BCD_OBJECT_ID), 0);
+        }
+        if (status == BCD_OK && i % BLOB_INTERVAL == 1 && blobSize > 0) {
+            status = add_element(obj, BCD_ELEMENT_APPLICATION_DEVICE, BCD_ELEMENT_BINARY, blob, blobSize, 0);
+        }
+    }
+    free(blob);
+    return status;
+}
+
+/* -------------------- Benchmarks -------------------- */
+
+static int bench_regf_open(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    REGF_HIVE *hive = RegfOpen(ctx->image, ctx->imageSize);
+    if (!hive) return BCD_ERR_PARSE;
+    RegfClose(hive);
+    *ops = 1;
+    return BCD_OK;
+}
+
+static int bench_load_full(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    int status = BcdStoreLoadFromHive(&store, ctx->hive);
+    BcdStoreRelease(&store);
+    *ops = 1;
+    return status;
+}
+
+static int bench_load_lazy(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    int status = BcdStoreLoadFromHiveLazy(&store, ctx->hive);
+    BcdStoreRelease(&store);
+    *ops = 1;
+    return status;
+}
+
+/* Open a snapshot of the store and decode every object, for comparison with
+ * load_full. The snapshot is written to the scratch file on the first run. */
+static int bench_load_snapshot(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    *ops = 1;
+    if (!ctx->snapshotWritten) {
+        size_t size = 0;
+        struct snapshot_fill fill = { &ctx->loaded, NULL };
+        int status = BcdSnapshotMeasure(&ctx->loaded, NULL, &size);
+        if (status == BCD_OK) status = replace_file(ctx->tempPath, size, fill_from_snapshot, &fill);
+        if (status != BCD_OK) return status;
+        ctx->snapshotWritten = 1;
+    }
+    BCD_SNAPSHOT *snapshot = NULL;
+    int status = BcdSnapshotOpen(ctx->tempPath, &snapshot);
+    if (status != BCD_OK) return status;
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    status = BcdStoreLoadFromSnapshot(&store, snapshot);
+    if (status == BCD_OK) status = BcdStoreMaterialize(&store);
+    BcdStoreRelease(&store);
+    BcdSnapshotClose(snapshot);
+    return status;
+}
+
+static int bench_lookup_store(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    for (size_t i = 0; i < LOOKUPS_PER_OP; ++i) {
+        if (!BcdStoreFindObjectById(&ctx->loaded, &ctx->ids[(i * 7919) % ctx->objectCount])) return BCD_ERR_NOT_FOUND;
+    }
+    *ops = LOOKUPS_PER_OP;
+    return BCD_OK;
+}
+
+static int bench_lookup_hive(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    REGF_KEY *root = RegfGetRootKey(ctx->hive);
+    for (size_t i = 0; i < LOOKUPS_PER_OP; ++i) {
+        REGF_KEY *key = RegfFindSubKey(root, ctx->names[(i * 7919) % ctx->objectCount]);
+        if (!key) return BCD_ERR_NOT_FOUND;
+        RegfReleaseKey(key);
+    }
+    *ops = LOOKUPS_PER_OP;
+    return BCD_OK;
+}
+
+static int bench_guid_parse(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    for (size_t i = 0, j = 0; i < LOOKUPS_PER_OP; ++i, j = j + 1 < ctx->objectCount ? j + 1 : 0) {
+        BCD_OBJECT_ID id;
+        int status = BcdParseObjectIdN(ctx->names[j], BCD_ID_STRING_LENGTH, &id);
+        if (status != BCD_OK) return status;
+    }
+    *ops = LOOKUPS_PER_OP;
+    return BCD_OK;
+}
+
+static int bench_guid_format(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    char text[BCD_ID_STRING_LENGTH + 1];
+    unsigned sum = 0;
+    for (size_t i = 0, j = 0; i < LOOKUPS_PER_OP; ++i, j = j + 1 < ctx->objectCount ? j + 1 : 0) {
+        int status = BcdFormatObjectId(&ctx->ids[j], text, sizeof(text));
+        if (status != BCD_OK) return status;
+        sum += (unsigned char)text[1];
+    }
+    *ops = LOOKUPS_PER_OP;
+    return sum ? BCD_OK : BCD_ERR_PARSE;
+}
+
+/* Element ids and names seen by /enum and /set; the last of each misses. */
+static const uint32_t g_lookupIds[] = {
+    BCD_ELEMENT_DESCRIPTION, BCD_ELEMENT_TIMEOUT, BCD_ELEMENT_DISPLAY_ORDER, BCD_ELEMENT_SYSTEMROOT,
+    BCD_ELEMENT_BOOLEAN_BOOTDEBUG, BCD_ELEMENT_RECOVERY_SEQUENCE, 0x250000f0U, 0x2f000001U
+};
+static const char *const g_lookupNames[] = {
+    "description", "timeout", "displayorder", "systemroot", "bootdebug", "recoverysequence",
+    "hypervisorlaunchtype", "nosuchelement"
+};
+
+static int bench_element_lookup(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    size_t hits = 0;
+    (void)ctx;
+    for (size_t i = 0, j = 0; i < LOOKUPS_PER_OP; ++i, j = (j + 1) & 7) {
+        hits += BcdLookupElementById(g_lookupIds[j]) != NULL;
+        hits += BcdLookupElementByName(g_lookupNames[j]) != NULL;
+    }
+    *ops = 2 * LOOKUPS_PER_OP;
+    return hits == 2 * LOOKUPS_PER_OP * 7 / 8 ? BCD_OK : BCD_ERR_NOT_FOUND;
+}
+
+static int enum_store(BENCH_CONTEXT *ctx, BCD_OUTPUT_FORMAT format, size_t *ops)
+{
+    OPTIONS opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.command = CMD_ENUM;
+    opts.verbose = 1;
+    opts.format = format;
+    opts.out = ctx->sink;
+    opts.err = stderr;
+    *ops = 1;
+    return cmd_enum(&opts, &ctx->loaded);
+}
+
+static int bench_enum_format(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    return enum_store(ctx, BCD_FORMAT_TEXT, ops);
+}
+
+static int bench_enum_json(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    return enum_store(ctx, BCD_FORMAT_JSON, ops);
+}
+
+static int bench_serialize(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    unsigned char *buffer = NULL;
+    size_t size = 0;
+    int status = RegfSerializeBcdStore(&ctx->loaded, &buffer, &size);
+    free(buffer);
+    *ops = 1;
+    return status;
+}
+
+static int bench_serialize_write(BENCH_CONTEXT *ctx, size_t *ops)
+{
+    *ops = 1;
+    ctx->snapshotWritten = 0;
+    return save_bcd_store(ctx->tempPath, &ctx->loaded);
+}
+
+static const BENCH g_benches[] = {
+    {"regf_open", bench_regf_open},
+    {"load_full", bench_load_full},
+    {"load_lazy", bench_load_lazy},
+    {"load_snapshot", bench_load_snapshot},
+    {"lookup_store", bench_lookup_store},
+    {"lookup_hive", bench_lookup_hive},
+    {"guid_parse", bench_guid_parse},
+    {"guid_format", bench_guid_format},
+    {"element_lookup", bench_element_lookup},
+    {"enum_format", bench_enum_format},
+    {"enum_json", bench_enum_json},
+    {"serialize", bench_serialize},
+    {"serialize_write", bench_serialize_write},
+};
+
+static int setup_context(BENCH_CONTEXT *ctx, size_t objectCount, size_t blobSize)
+{
+    ctx->objectCount = objectCount;
+    ctx->ids = (BCD_OBJECT_ID *)calloc(objectCount, sizeof(BCD_OBJECT_ID));
+    ctx->names = (char (*)[BCD_ID_STRING_LENGTH + 1])calloc(objectCount, BCD_ID_STRING_LENGTH + 1);
+    if (!ctx->ids || !ctx->names) return BCD_ERR_CAPACITY;
+    BCD_STORE generated;
+    BcdStoreInit(&generated);
+    int status = generate_store(&generated, objectCount, blobSize, ctx->ids);
+    if (status == BCD_OK) status = RegfSerializeBcdStore(&generated, &ctx->image, &ctx->imageSize);
+    BcdStoreRelease(&generated);
+    if (status != BCD_OK) return status;
+    for (size_t i = 0; i < objectCount; ++i) BcdFormatObjectId(&ctx->ids[i], ctx->names[i], BCD_ID_STRING_LENGTH + 1);
+    ctx->hive = RegfOpen(ctx->image, ctx->imageSize);
+    if (!ctx->hive) return BCD_ERR_PARSE;
+    BcdStoreInit(&ctx->loaded);
+    return BcdStoreLoadFromHive(&ctx->loaded, ctx->hive);
+}
+
+static void release_context(BENCH_CONTEXT *ctx)
+{
+    BcdStoreRelease(&ctx->loaded);
+    RegfClose(ctx->hive);
+    free(ctx->image);
+    free(ctx->names);
+    free(ctx->ids);
+}
+
+static int run_bench(const BENCH *bench, BENCH_CONTEXT *ctx, double minTime, int *first)
+{
+    size_t ops = 0;
+    int status = bench->run(ctx, &ops);     /* warm-up */
+    if (status != BCD_OK) {
+        fprintf(stderr, "%s failed with %d\n", bench->name, status);
+        return status;
+    }
+#ifdef BENCH_COUNT_ALLOCS
+    unsigned long long countBefore = allocCount;
+    unsigned long long bytesBefore = allocBytes;
+#endif
+    uint64_t budget = (uint64_t)(minTime * 1e9);
+    uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    unsigned long long iterations = 0;
+    unsigned long long totalOps = 0;
+    do {
+        if ((status = bench->run(ctx, &ops)) != BCD_OK) return status;
+        ++iterations;
+        totalOps += ops;
+        elapsed = now_ns() - start;
+    } while (elapsed < budget);
+
+    printf("%s    {\"name\": \"%s\", \"objects\": %zu, \"hive_bytes\": %zu, \"iterations\": %llu, "
+           "\"ns_per_op\": %.1f, ",
+           *first ? "" : ",\n", bench->name, ctx->objectCount, ctx->imageSize, iterations,
+           (double)elapsed / (double)totalOps);
+#ifdef BENCH_COUNT_ALLOCS
+    printf("\"allocs_per_op\": %.2f, \"bytes_allocated_per_op\": %.1f, ",
+           (double)(allocCount - countBefore) / (double)totalOps, (double)(allocBytes - bytesBefore) / (double)totalOps);
+#else
+    printf("\"allocs_per_op\": null, \"bytes_allocated_per_op\": null, ");
+#endif
+    printf("\"peak_rss_kb\": %ld}", peak_rss_kb());
+    fflush(stdout);
+    *first = 0;
+    return BCD_OK;
+}
+
+static void print_bench_usage(void)
+{
+    fprintf(stderr, "usage: bcd_bench [--objects n[,n...]] [--min-time seconds] [--blob-size bytes]\n");
+    fprintf(stderr, "                 [--filter name] [--generate hive-file]\n");
+    fprintf(stderr, "Defaults: --objects 10,1000,10000,100000 --min-time %.1f --blob-size %u\n", DEFAULT_MIN_TIME,
+            DEFAULT_BLOB_SIZE);
+    fprintf(stderr, "--generate writes the synthetic hive for the first size instead of benchmarking.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *sizes = "10,1000,10000,100000";
+    const char *filter = NULL;
+    const char *generatePath = NULL;
+    double minTime = DEFAULT_MIN_TIME;
+    size_t blobSize = DEFAULT_BLOB_SIZE;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp(argv[i], "--objects") == 0) sizes = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--min-time") == 0) minTime = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--blob-size") == 0) blobSize = (size_t)strtoul(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--filter") == 0) filter = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--generate") == 0) generatePath = argv[++i];
+        else {
+            print_bench_usage();
+            return 1;
+        }
+    }
+
+    char tempPath[] = "/tmp/bcd_bench.XXXXXX";
+    int tempFd = mkstemp(tempPath);
+    FILE *sink = fopen("/dev/null", "w");
+    if (tempFd < 0 || !sink) {
+        fprintf(stderr, "Failed to create scratch files\n");
+        return 1;
+    }
+    close(tempFd);
+
+    int status = BCD_OK;
+    int first = 1;
+    if (!generatePath) printf("{\n  \"min_time_s\": %.3f,\n  \"blob_size\": %zu,\n  \"benchmarks\": [\n", minTime, blobSize);
+    for (const char *p = sizes; *p && status == BCD_OK;) {
+        char *end = NULL;
+        size_t objectCount = (size_t)strtoul(p, &end, 10);
+        if (end == p || objectCount == 0) {
+            print_bench_usage();
+            status = BCD_ERR_INVALID_ARG;
+            break;
+        }
+        p = *end == ',' ? end + 1 : end;
+
+        BENCH_CONTEXT ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.tempPath = tempPath;
+        ctx.sink = sink;
+        status = setup_context(&ctx, objectCount, blobSize);
+        if (status != BCD_OK) {
+            fprintf(stderr, "Failed to build a %zu-object hive: %d\n", objectCount, status);
+        } else if (generatePath) {
+            status = replace_file(generatePath, ctx.imageSize, fill_from_buffer, ctx.image);
+            if (status != BCD_OK) fprintf(stderr, "Failed to write %s\n", generatePath);
+            release_context(&ctx);
+            break;
+        }
+        for (size_t b = 0; b < sizeof(g_benches) / sizeof(g_benches[0]) && status == BCD_OK; ++b) {
+            if (filter && !strstr(g_benches[b].name, filter)) continue;
+            status = run_bench(&g_benches[b], &ctx, minTime, &first);
+        }
+        release_context(&ctx);
+    }
+    if (!generatePath) printf("\n  ]\n}\n");
+    fclose(sink);
+    unlink(tempPath);
+    return status == BCD_OK ? 0 : 1;
+}
@@ -0,0 +1,568 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifdef __linux__
+#define _GNU_SOURCE /* struct ucred for SO_PEERCRED */
+#endif
+
+#include "bcd_daemon.h"
+
+#include "bcd_parser.h"
+#include "bcd_stats.h"
+#include "regf.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define MAX_FRAME_SIZE (64U * 1024U * 1024U)
+#define MAX_CACHED_STORES 256
+#define CLIENT_TIMEOUT_SECONDS 5
+
+struct cached_store {
+    char *path;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec mtime;
+    unsigned char *image;   /* private copy of the file backing hive */
+    REGF_HIVE *hive;
+    BCD_STORE store;
+    int watch;              /* inotify watch descriptor, or -1 */
+    unsigned long lastUsed;
+};
+
+struct BCD_DAEMON {
+    struct cached_store *entries;
+    size_t count;
+    size_t capacity;
+    unsigned long clock;
+    int inotifyFd;          /* -1 where inotify is unavailable */
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stopRequested = 1;
+}
+
+static void put_uint32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+    p[2] = (unsigned char)((v >> 16) & 0xff);
+    p[3] = (unsigned char)((v >> 24) & 0xff);
+}
+
+static uint32_t read_uint32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* -------------------- Framing -------------------- */
+
+static int write_all(int fd, const unsigned char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return BCD_ERR_IO;
+        data += n;
+        size -= (size_t)n;
+    }
+    return BCD_OK;
+}
+
+static int read_all(int fd, unsigned char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return BCD_ERR_IO;
+        data += n;
+        size -= (size_t)n;
+    }
+    return BCD_OK;
+}
+
+static int send_frame(int fd, const unsigned char *payload, size_t size)
+{
+    unsigned char header[4];
+    if (size > MAX_FRAME_SIZE) return BCD_ERR_CAPACITY;
+    put_uint32(header, (uint32_t)size);
+    int status = write_all(fd, header, sizeof(header));
+    if (status == BCD_OK && size > 0) status = write_all(fd, payload, size);
+    return status;
+}
+
+/* The payload is NUL-terminated for convenience; the caller frees it. */
+static int recv_frame(int fd, unsigned char **outPayload, size_t *outSize)
+{
+    unsigned char header[4];
+    int status = read_all(fd, header, sizeof(header));
+    if (status != BCD_OK) return status;
+    size_t size = read_uint32(header);
+    if (size > MAX_FRAME_SIZE) return BCD_ERR_CAPACITY;
+    unsigned char *payload = (unsigned char *)malloc(size + 1);
+    if (!payload) return BCD_ERR_CAPACITY;
+    if (size > 0 && (status = read_all(fd, payload, size)) != BCD_OK) {
+        free(payload);
+        return status;
+    }
+    payload[size] = '\0';
+    *outPayload = payload;
+    *outSize = size;
+    return BCD_OK;
+}
+
+static int socket_address(const char *socketPath, struct sockaddr_un *addr)
+{
+    if (!socketPath || strlen(socketPath) >= sizeof(addr->sun_path)) return BCD_ERR_INVALID_ARG;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, socketPath);
+    return BCD_OK;
+}
+
+static int connect_socket(const char *socketPath)
+{
+    struct sockaddr_un addr;
+    if (socket_address(socketPath, &addr) != BCD_OK) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* -------------------- Store cache -------------------- */
+
+static int same_file(const struct cached_store *entry, const struct stat *st)
+{
+    return entry->device == st->st_dev && entry->inode == st->st_ino && entry->size == st->st_size &&
+           entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void free_entry(struct cached_store *entry)
+{
+    BcdStoreRelease(&entry->store);
+    RegfClose(entry->hive);
+    free(entry->image);
+    free(entry->path);
+}
+
+static void release_entry(BCD_DAEMON *daemon, size_t index)
+{
+    struct cached_store *entry = &daemon->entries[index];
+#ifdef __linux__
+    if (entry->watch >= 0) {
+        int shared = 0;
+        for (size_t i = 0; i < daemon->count; ++i) {
+            if (i != index && daemon->entries[i].watch == entry->watch) shared = 1;
+        }
+        if (!shared) inotify_rm_watch(daemon->inotifyFd, entry->watch);
+    }
+#endif
+    free_entry(entry);
+    daemon->entries[index] = daemon->entries[--daemon->count];
+}
+
+static struct cached_store *find_entry(BCD_DAEMON *daemon, const char *path, size_t *outIndex)
+{
+    for (size_t i = 0; i < daemon->count; ++i) {
+        if (strcmp(daemon->entries[i].path, path) == 0) {
+            *outIndex = i;
+            return &daemon->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Read the whole file through one descriptor so the identity recorded for the
+ * cache matches the bytes that were loaded. */
+static int read_image(const char *path, unsigned char **outImage, size_t *outSize, struct stat *st)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return BCD_ERR_IO;
+    if (fstat(fd, st) != 0 || !S_ISREG(st->st_mode) || (uintmax_t)st->st_size > (uintmax_t)SIZE_MAX) {
+        close(fd);
+        return BCD_ERR_IO;
+    }
+    size_t size = (size_t)st->st_size;
+    unsigned char *image = (unsigned char *)malloc(size ? size : 1);
+    int status = image ? read_all(fd, image, size) : BCD_ERR_CAPACITY;
+    close(fd);
+    if (status != BCD_OK) {
+        free(image);
+        return status;
+    }
+    *outImage = image;
+    *outSize = size;
+    return BCD_OK;
+}
+
+static int load_entry(BCD_DAEMON *daemon, const char *path, struct cached_store *entry)
+{
+    struct stat st;
+    size_t size = 0;
+    memset(entry, 0, sizeof(*entry));
+    entry->watch = -1;
+    BcdStoreInit(&entry->store);
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_READ);
+    int status = read_image(path, &entry->image, &size, &st);
+    BCD_STATS_PHASE_END(outer);
+    if (status != BCD_OK) return status;
+    BCD_STATS_ADD(BCD_STAT_BYTES_READ, size);
+    entry->device = st.st_dev;
+    entry->inode = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    if (RegfReplayLogs(path, &entry->image, &size) < 0) return BCD_ERR_CAPACITY;
+    entry->hive = RegfOpen(entry->image, size);
+    if (!entry->hive) return BCD_ERR_PARSE;
+    status = BcdStoreLoadFromHiveLazy(&entry->store, entry->hive);
+    if (status != BCD_OK) return status;
+    entry->path = strdup(path);
+    if (!entry->path) return BCD_ERR_CAPACITY;
+#ifdef __linux__
+    if (daemon->inotifyFd >= 0) {
+        entry->watch = inotify_add_watch(daemon->inotifyFd, path,
+                                         IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+#else
+    (void)daemon;
+#endif
+    return BCD_OK;
+}
+
+int BcdDaemonGetStore(BCD_DAEMON *daemon, const char *path, BCD_STORE **outStore)
+{
+    if (!daemon || !path || !outStore) return BCD_ERR_INVALID_ARG;
+    size_t index = 0;
+    struct cached_store *entry = find_entry(daemon, path, &index);
+    if (entry) {
+        struct stat st;
+        if (stat(path, &st) == 0 && same_file(entry, &st)) {
+            entry->lastUsed = ++daemon->clock;
+            *outStore = &entry->store;
+            return BCD_OK;
+        }
+        release_entry(daemon, index);
+    }
+    if (daemon->count == MAX_CACHED_STORES) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < daemon->count; ++i) {
+            if (daemon->entries[i].lastUsed < daemon->entries[oldest].lastUsed) oldest = i;
+        }
+        release_entry(daemon, oldest);
+    }
+    if (daemon->count == daemon->capacity) {
+        size_t newCap = daemon->capacity ? daemon->capacity * 2 : 16;
+        struct cached_store *entries =
+            (struct cached_store *)realloc(daemon->entries, newCap * sizeof(struct cached_store));
+        if (!entries) return BCD_ERR_CAPACITY;
+        daemon->entries = entries;
+        daemon->capacity = newCap;
+    }
+    entry = &daemon->entries[daemon->count++];
+    int status = load_entry(daemon, path, entry);
+    if (status != BCD_OK) {
+        free_entry(entry);
+        daemon->count--;
+        return status;
+    }
+    entry->lastUsed = ++daemon->clock;
+    *outStore = &entry->store;
+    return BCD_OK;
+}
+
+void BcdDaemonInvalidate(BCD_DAEMON *daemon, const char *path)
+{
+    size_t index = 0;
+    if (daemon && path && find_entry(daemon, path, &index)) release_entry(daemon, index);
+}
+
+#ifdef __linux__
+/* Drop every entry whose watched file reported a change. */
+static void drain_file_events(BCD_DAEMON *daemon)
+{
+    if (daemon->inotifyFd < 0) return;
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+    for (;;) {
+        ssize_t n = read(daemon->inotifyFd, buffer.bytes, sizeof(buffer.bytes));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        for (ssize_t pos = 0; pos < n;) {
+            const struct inotify_event *event = (const struct inotify_event *)(buffer.bytes + pos);
+            for (size_t i = daemon->count; i-- > 0;) {
+                if (daemon->entries[i].watch != event->wd) continue;
+                if (event->mask & IN_IGNORED) daemon->entries[i].watch = -1;
+                release_entry(daemon, i);
+            }
+            pos += (ssize_t)(sizeof(struct inotify_event) + event->len);
+        }
+    }
+}
+#else
+static void drain_file_events(BCD_DAEMON *daemon)
+{
+    (void)daemon;
+}
+#endif
+
+/* -------------------- Server -------------------- */
+
+/* Split a request payload into argv behind a stand-in program name. */
+static char **request_arguments(unsigned char *payload, size_t size, int *outArgc)
+{
+    static char programName[] = "bcdedit";
+    if (size > 0 && payload[size - 1] != '\0') return NULL;
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i) count += payload[i] == '\0';
+    if (count > (size_t)INT32_MAX - 2) return NULL;
+    char **argv = (char **)malloc((count + 2) * sizeof(char *));
+    if (!argv) return NULL;
+    argv[0] = programName;
+    char *arg = (char *)payload;
+    for (size_t i = 1; i <= count; ++i) {
+        argv[i] = arg;
+        arg += strlen(arg) + 1;
+    }
+    argv[count + 1] = NULL;
+    *outArgc = (int)count + 1;
+    return argv;
+}
+
+/* Only the daemon's own user may send requests: the socket file is already
+ * 0600, and the peer's credentials are checked too because some systems
+ * ignore permissions on socket files. Platforms without a way to read them
+ * turn every peer away. */
+static int peer_is_owner(int fd)
+{
+#if defined(__linux__) && defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0 || length != sizeof(cred)) return 0;
+    return cred.uid == geteuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) return 0;
+    return uid == geteuid();
+#else
+    (void)fd;
+    return 0;
+#endif
+}
+
+static void serve_connection(BCD_DAEMON *daemon, int fd, BCD_DAEMON_HANDLER handler, void *context)
+{
+    struct timeval timeout = {CLIENT_TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    unsigned char *request = NULL;
+    size_t requestSize = 0;
+    if (recv_frame(fd, &request, &requestSize) != BCD_OK) return;
+
+    char *outText = NULL;
+    char *errText = NULL;
+    size_t outLength = 0;
+    size_t errLength = 0;
+    FILE *out = open_memstream(&outText, &outLength);
+    FILE *err = open_memstream(&errText, &errLength);
+    int argc = 0;
+    char **argv = request_arguments(request, requestSize, &argc);
+    int status = BCD_ERR_INVALID_ARG;
+    if (!peer_is_owner(fd)) {
+        if (err) fprintf(err, "Permission denied\n");
+    } else if (out && err && argv) {
+        drain_file_events(daemon);
+        status = handler(daemon, argc, argv, out, err, context);
+    } else if (err) {
+        fprintf(err, "Malformed request\n");
+    }
+    if (out) fclose(out);
+    if (err) fclose(err);
+
+    size_t responseSize = 8 + outLength + errLength;
+    unsigned char *response = (unsigned char *)malloc(responseSize);
+    if (response) {
+        put_uint32(response, (uint32_t)status);
+        put_uint32(response + 4, (uint32_t)outLength);
+        if (outLength) memcpy(response + 8, outText, outLength);
+        if (errLength) memcpy(response + 8 + outLength, errText, errLength);
+        send_frame(fd, response, responseSize);
+        free(response);
+    }
+    free(argv);
+    free(outText);
+    free(errText);
+    free(request);
+}
+
+static int open_listener(const char *socketPath)
+{
+    struct sockaddr_un addr;
+    if (socket_address(socketPath, &addr) != BCD_OK) return -1;
+    int live = connect_socket(socketPath);
+    if (live >= 0) {
+        close(live);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    unlink(socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    /* Create the socket file owner-only from the start rather than chmod'ing
+     * it after bind, which would leave a window where others could connect. */
+    mode_t mask = umask(077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound != 0 || chmod(socketPath, 0600) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int BcdDaemonRun(const char *socketPath, BCD_DAEMON_HANDLER handler, void *context)
+{
+    if (!socketPath || !handler) return BCD_ERR_INVALID_ARG;
+    int listenFd = open_listener(socketPath);
+    if (listenFd < 0) return BCD_ERR_IO;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    BCD_DAEMON daemon;
+    memset(&daemon, 0, sizeof(daemon));
+    daemon.inotifyFd = -1;
+#ifdef __linux__
+    daemon.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    stopRequested = 0;
+    while (!stopRequested) {
+        struct pollfd fds[2];
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = daemon.inotifyFd;
+        fds[1].events = POLLIN;
+        int ready = poll(fds, daemon.inotifyFd >= 0 ? 2 : 1, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (daemon.inotifyFd >= 0 && (fds[1].revents & POLLIN)) drain_file_events(&daemon);
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0) continue;
+            serve_connection(&daemon, fd, handler, context);
+            close(fd);
+        }
+    }
+
+    while (daemon.count > 0) release_entry(&daemon, daemon.count - 1);
+    free(daemon.entries);
+    if (daemon.inotifyFd >= 0) close(daemon.inotifyFd);
+    close(listenFd);
+    unlink(socketPath);
+    return BCD_OK;
+}
+
+/* -------------------- Client -------------------- */
+
+int BcdDaemonRequest(const char *socketPath, int argc, char **argv, FILE *out, FILE *err, int *outStatus)
+{
+    if (!socketPath || argc < 0 || (argc > 0 && !argv) || !out || !err || !outStatus) return BCD_ERR_INVALID_ARG;
+    size_t size = 0;
+    for (int i = 0; i < argc; ++i) size += strlen(argv[i]) + 1;
+    unsigned char *request = (unsigned char *)malloc(size ? size : 1);
+    if (!request) return BCD_ERR_CAPACITY;
+    size_t pos = 0;
+    for (int i = 0; i < argc; ++i) {
+        size_t len = strlen(argv[i]) + 1;
+        memcpy(request + pos, argv[i], len);
+        pos += len;
+    }
+
+    int fd = connect_socket(socketPath);
+    int status = fd < 0 ? BCD_ERR_IO : send_frame(fd, request, size);
+    free(request);
+    unsigned char *response = NULL;
+    size_t responseSize = 0;
+    if (status == BCD_OK) status = recv_frame(fd, &response, &responseSize);
+    if (fd >= 0) close(fd);
+    if (status != BCD_OK) return BCD_ERR_IO;
+    size_t outLength = responseSize >= 8 ? read_uint32(response + 4) : 0;
+    if (responseSize < 8 || outLength > responseSize - 8) {
+        free(response);
+        return BCD_ERR_PARSE;
+    }
+    fwrite(response + 8, 1, outLength, out);
+    fwrite(response + 8 + outLength, 1, responseSize - 8 - outLength, err);
+    *outStatus = (int)(int32_t)read_uint32(response);
+    free(response);
+    return BCD_OK;
+}
+
+#else
+int BcdDaemonRun(const char *socketPath, BCD_DAEMON_HANDLER handler, void *context)
+{
+    (void)socketPath;
+    (void)handler;
+    (void)context;
+    return BCD_ERR_INVALID_ARG;
+}
+
+int BcdDaemonGetStore(BCD_DAEMON *daemon, const char *path, BCD_STORE **outStore)
+{
+    (void)daemon;
+    (void)path;
+    (void)outStore;
+    return BCD_ERR_INVALID_ARG;
+}
+
+void BcdDaemonInvalidate(BCD_DAEMON *daemon, const char *path)
+{
+    (void)daemon;
+    (void)path;
+}
+
+int BcdDaemonRequest(const char *socketPath, int argc, char **argv, FILE *out, FILE *err, int *outStatus)
+{
+    (void)socketPath;
+    (void)argc;
+    (void)argv;
+    (void)out;
+    (void)err;
+    (void)outStatus;
+    return BCD_ERR_INVALID_ARG;
+}
+#endif
@@ -0,0 +1,46 @@
+#ifndef BCD_DAEMON_H
+#define BCD_DAEMON_H
+
+#include <stdio.h>
+
+#include "bcd.h"
+
+/* Long-running request server on a Unix domain socket (POSIX only).
+ *
+ * Each connection carries one request and one response, both framed as a
+ * 4-byte little-endian payload length followed by the payload. A request is
+ * the command line without the program name, as NUL-terminated arguments. A
+ * response is the int32 command status, the uint32 length of the command's
+ * output, the output itself and then its diagnostics.
+ *
+ * Loaded stores are cached by path and revalidated against the file's
+ * device, inode, size and mtime on every use; on Linux, inotify also drops a
+ * cached store as soon as its file changes. */
+
+typedef struct BCD_DAEMON BCD_DAEMON;
+
+/* Runs one request. argv[0] is a stand-in program name and argv[argc] is
+ * NULL. Whatever is written to out and err is returned to the client. */
+typedef int (*BCD_DAEMON_HANDLER)(BCD_DAEMON *daemon, int argc, char **argv, FILE *out, FILE *err, void *context);
+
+/* Serve requests on socketPath until SIGINT or SIGTERM. Fails if another
+ * daemon is already listening there; a stale socket file is replaced. The
+ * socket is created mode 0600 and peers running as another user are refused
+ * with "Permission denied". */
+int BcdDaemonRun(const char *socketPath, BCD_DAEMON_HANDLER handler, void *context);
+
+/* Lazily loaded store for the hive at path, taken from the cache when the
+ * file is unchanged. The daemon keeps its own copy of the file, so the store
+ * is unaffected by later writes. Owned by the daemon; valid until the handler
+ * returns. */
+int BcdDaemonGetStore(BCD_DAEMON *daemon, const char *path, BCD_STORE **outStore);
+
+/* Drop the cached store for path, e.g. after the handler wrote to the file. */
+void BcdDaemonInvalidate(BCD_DAEMON *daemon, const char *path);
+
+/* Client side: send argv[0..argc) to the daemon, copy the returned output and
+ * diagnostics to out and err, and store the command's status in *outStatus.
+ * Returns BCD_ERR_IO when the daemon cannot be reached. */
+int BcdDaemonRequest(const char *socketPath, int argc, char **argv, FILE *out, FILE *err, int *outStatus);
+
+#endif /* BCD_DAEMON_H */
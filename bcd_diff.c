@@ -0,0 +1,189 @@
+#include "bcd_diff.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Final avalanche, so element hashes can be summed without patterns in their
+ * low bits cancelling out. */
+static uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_element(const BCD_ELEMENT *el)
+{
+    uint64_t seed = BCD_HASH_SEED ^ mix64(((uint64_t)el->type << 32) | (uint32_t)el->kind);
+    unsigned char scalar[8];
+    switch (el->kind) {
+    case BCD_ELEMENT_STRING:
+        if (!el->data.stringValue) return mix64(BcdHashBytes(NULL, 0, seed));
+        return mix64(BcdHashBytes(el->data.stringValue, strlen(el->data.stringValue), seed));
+    case BCD_ELEMENT_BINARY:
+        return mix64(BcdHashBytes(el->data.binaryValue.data, el->data.binaryValue.size, seed));
+    case BCD_ELEMENT_INTEGER:
+        for (int i = 0; i < 8; ++i) scalar[i] = (unsigned char)(el->data.integerValue >> (8 * i));
+        return mix64(BcdHashBytes(scalar, 8, seed));
+    case BCD_ELEMENT_BOOLEAN:
+        scalar[0] = el->data.boolValue ? 1 : 0;
+        return mix64(BcdHashBytes(scalar, 1, seed));
+    default:
+        return mix64(BcdHashBytes(NULL, 0, seed));
+    }
+}
+
+static int compare_element_digests(const void *a, const void *b)
+{
+    const BCD_ELEMENT_DIGEST *x = (const BCD_ELEMENT_DIGEST *)a;
+    const BCD_ELEMENT_DIGEST *y = (const BCD_ELEMENT_DIGEST *)b;
+    if (x->type != y->type) return x->type < y->type ? -1 : 1;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return 0;
+}
+
+static size_t hash_object_id(const BCD_OBJECT_ID *id)
+{
+    uint64_t lo = ((uint64_t)id->data1 << 32) | ((uint64_t)id->data2 << 16) | id->data3;
+    uint64_t hi = 0;
+    for (int i = 0; i < 8; ++i) hi = (hi << 8) | id->data4[i];
+    return (size_t)mix64(lo ^ (hi * 0x9e3779b97f4a7c15ULL));
+}
+
+/* Load factor at most 1/2; an object whose GUID is already indexed keeps the
+ * first entry. */
+static int build_index(BCD_STORE_DIGEST *digest)
+{
+    size_t size = 16;
+    while (size < digest->objectCount * 2) size *= 2;
+    digest->index = (uint32_t *)calloc(size, sizeof(uint32_t));
+    if (!digest->index) return BCD_ERR_CAPACITY;
+    digest->indexSize = size;
+    size_t mask = size - 1;
+    for (size_t i = 0; i < digest->objectCount; ++i) {
+        const BCD_OBJECT_ID *id = &digest->objects[i].id;
+        size_t slot = hash_object_id(id) & mask;
+        while (digest->index[slot] && !BcdIdsEqual(&digest->objects[digest->index[slot] - 1].id, id)) {
+            slot = (slot + 1) & mask;
+        }
+        if (!digest->index[slot]) digest->index[slot] = (uint32_t)(i + 1);
+    }
+    return BCD_OK;
+}
+
+int BcdDigestStore(BCD_STORE *store, BCD_STORE_DIGEST *digest)
+{
+    if (!store || !digest) return BCD_ERR_INVALID_ARG;
+    memset(digest, 0, sizeof(*digest));
+    int status = BcdStoreMaterialize(store);
+    if (status != BCD_OK) return status;
+    size_t objectCount = BcdStoreGetObjectCount(store);
+    if (objectCount > UINT32_MAX - 1) return BCD_ERR_CAPACITY;
+    size_t elementCount = 0;
+    for (size_t i = 0; i < objectCount; ++i) elementCount += BcdObjectGetElementCount(BcdStoreGetObjectAt(store, i));
+
+    digest->objects = (BCD_OBJECT_DIGEST *)malloc((objectCount ? objectCount : 1) * sizeof(BCD_OBJECT_DIGEST));
+    digest->elements = (BCD_ELEMENT_DIGEST *)malloc((elementCount ? elementCount : 1) * sizeof(BCD_ELEMENT_DIGEST));
+    if (!digest->objects || !digest->elements) {
+        BcdDigestRelease(digest);
+        return BCD_ERR_CAPACITY;
+    }
+    for (size_t i = 0; i < objectCount; ++i) {
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(store, i);
+        BCD_OBJECT_DIGEST *od = &digest->objects[i];
+        size_t count = BcdObjectGetElementCount(obj);
+        BCD_ELEMENT_DIGEST *elements = &digest->elements[digest->elementCount];
+        uint64_t sum = 0;
+        for (size_t e = 0; e < count; ++e) {
+            const BCD_ELEMENT *el = BcdObjectGetElementAt(obj, e);
+            elements[e].type = el->type;
+            elements[e].kind = el->kind;
+            elements[e].hash = hash_element(el);
+            sum += elements[e].hash;
+        }
+        qsort(elements, count, sizeof(BCD_ELEMENT_DIGEST), compare_element_digests);
+        od->id = obj->id;
+        od->objectType = obj->objectType;
+        od->hash = mix64(sum + mix64(((uint64_t)count << 32) | obj->objectType));
+        od->firstElement = digest->elementCount;
+        od->elementCount = count;
+        digest->elementCount += count;
+    }
+    digest->objectCount = objectCount;
+    status = build_index(digest);
+    if (status != BCD_OK) BcdDigestRelease(digest);
+    return status;
+}
+
+void BcdDigestRelease(BCD_STORE_DIGEST *digest)
+{
+    if (!digest) return;
+    free(digest->objects);
+    free(digest->elements);
+    free(digest->index);
+    memset(digest, 0, sizeof(*digest));
+}
+
+const BCD_OBJECT_DIGEST *BcdDigestFindObject(const BCD_STORE_DIGEST *digest, const BCD_OBJECT_ID *id)
+{
+    if (!digest || !id || !digest->index) return NULL;
+    size_t mask = digest->indexSize - 1;
+    for (size_t slot = hash_object_id(id) & mask; digest->index[slot]; slot = (slot + 1) & mask) {
+        const BCD_OBJECT_DIGEST *od = &digest->objects[digest->index[slot] - 1];
+        if (BcdIdsEqual(&od->id, id)) return od;
+    }
+    return NULL;
+}
+
+/* Both element runs are ordered by type, so one merge pass pairs them up. */
+static int diff_elements(const BCD_STORE_DIGEST *a, const BCD_OBJECT_DIGEST *ao, const BCD_STORE_DIGEST *b,
+                         const BCD_OBJECT_DIGEST *bo, BCD_DIFF_VISITOR visit, void *context)
+{
+    const BCD_ELEMENT_DIGEST *x = &a->elements[ao->firstElement];
+    const BCD_ELEMENT_DIGEST *y = &b->elements[bo->firstElement];
+    size_t i = 0;
+    size_t j = 0;
+    int status = BCD_OK;
+    while (status == BCD_OK && (i < ao->elementCount || j < bo->elementCount)) {
+        BCD_DIFF_ENTRY entry = { BCD_DIFF_ELEMENT_CHANGED, ao, bo, NULL, NULL };
+        if (j == bo->elementCount || (i < ao->elementCount && x[i].type < y[j].type)) {
+            entry.kind = BCD_DIFF_ELEMENT_REMOVED;
+            entry.oldElement = &x[i++];
+        } else if (i == ao->elementCount || y[j].type < x[i].type) {
+            entry.kind = BCD_DIFF_ELEMENT_ADDED;
+            entry.newElement = &y[j++];
+        } else {
+            entry.oldElement = &x[i++];
+            entry.newElement = &y[j++];
+            if (entry.oldElement->hash == entry.newElement->hash && entry.oldElement->kind == entry.newElement->kind) {
+                continue;
+            }
+        }
+        status = visit(&entry, context);
+    }
+    return status;
+}
+
+int BcdDiffDigests(const BCD_STORE_DIGEST *a, const BCD_STORE_DIGEST *b, BCD_DIFF_VISITOR visit, void *context)
+{
+    if (!a || !b || !visit) return BCD_ERR_INVALID_ARG;
+    int status = BCD_OK;
+    for (size_t i = 0; i < a->objectCount && status == BCD_OK; ++i) {
+        const BCD_OBJECT_DIGEST *ao = &a->objects[i];
+        const BCD_OBJECT_DIGEST *bo = BcdDigestFindObject(b, &ao->id);
+        if (bo && bo->hash == ao->hash && bo->objectType == ao->objectType) continue;
+        BCD_DIFF_ENTRY entry = { bo ? BCD_DIFF_OBJECT_CHANGED : BCD_DIFF_OBJECT_REMOVED, ao, bo, NULL, NULL };
+        status = visit(&entry, context);
+        if (status == BCD_OK && bo) status = diff_elements(a, ao, b, bo, visit, context);
+    }
+    for (size_t j = 0; j < b->objectCount && status == BCD_OK; ++j) {
+        const BCD_OBJECT_DIGEST *bo = &b->objects[j];
+        if (BcdDigestFindObject(a, &bo->id)) continue;
+        BCD_DIFF_ENTRY entry = { BCD_DIFF_OBJECT_ADDED, NULL, bo, NULL, NULL };
+        status = visit(&entry, context);
+    }
+    return status;
+}
@@ -0,0 +1,77 @@
+#ifndef BCD_DIFF_H
+#define BCD_DIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bcd.h"
+
+/* Content digests of stores, and differences between them.
+ *
+ * A digest keeps a 64-bit hash per element, taken over its type, kind and
+ * payload, and per object one combining its type and element hashes. It owns
+ * its memory and does not refer back to the store, so a digest can be kept
+ * and compared against many others after the store is released. Comparing
+ * two digests is linear in their sizes: objects are matched by GUID through a
+ * hash index, and elements are only looked at for objects whose hashes
+ * differ. */
+
+typedef struct BCD_ELEMENT_DIGEST {
+    uint32_t type;
+    BCD_ELEMENT_KIND kind;
+    uint64_t hash;
+} BCD_ELEMENT_DIGEST;
+
+/* Elements of an object are stored contiguously, ordered by type. */
+typedef struct BCD_OBJECT_DIGEST {
+    BCD_OBJECT_ID id;
+    uint32_t objectType;
+    uint64_t hash;
+    size_t firstElement;
+    size_t elementCount;
+} BCD_OBJECT_DIGEST;
+
+typedef struct BCD_STORE_DIGEST {
+    BCD_OBJECT_DIGEST *objects;     /* in store order */
+    size_t objectCount;
+    BCD_ELEMENT_DIGEST *elements;
+    size_t elementCount;
+    /* Open-addressing index by GUID (slot = object index + 1). */
+    uint32_t *index;
+    size_t indexSize;
+} BCD_STORE_DIGEST;
+
+/* Digest every object of store, materializing lazily loaded ones. On failure
+ * the digest is left empty. */
+int BcdDigestStore(BCD_STORE *store, BCD_STORE_DIGEST *digest);
+void BcdDigestRelease(BCD_STORE_DIGEST *digest);
+const BCD_OBJECT_DIGEST *BcdDigestFindObject(const BCD_STORE_DIGEST *digest, const BCD_OBJECT_ID *id);
+
+typedef enum {
+    BCD_DIFF_OBJECT_REMOVED,    /* only in the first store */
+    BCD_DIFF_OBJECT_ADDED,      /* only in the second store */
+    BCD_DIFF_OBJECT_CHANGED,    /* in both, with a different type or elements */
+    BCD_DIFF_ELEMENT_REMOVED,
+    BCD_DIFF_ELEMENT_ADDED,
+    BCD_DIFF_ELEMENT_CHANGED    /* same type, different kind or payload */
+} BCD_DIFF_KIND;
+
+/* oldObject and newObject are NULL on the side an object is missing from.
+ * Element entries follow the OBJECT_CHANGED entry of their object and carry
+ * the element digests in oldElement/newElement the same way. */
+typedef struct BCD_DIFF_ENTRY {
+    BCD_DIFF_KIND kind;
+    const BCD_OBJECT_DIGEST *oldObject;
+    const BCD_OBJECT_DIGEST *newObject;
+    const BCD_ELEMENT_DIGEST *oldElement;
+    const BCD_ELEMENT_DIGEST *newElement;
+} BCD_DIFF_ENTRY;
+
+typedef int (*BCD_DIFF_VISITOR)(const BCD_DIFF_ENTRY *entry, void *context);
+
+/* Report the differences from a to b: removed and changed objects in a's
+ * order, then added objects in b's order. A visit result other than BCD_OK
+ * ends the comparison and is returned. */
+int BcdDiffDigests(const BCD_STORE_DIGEST *a, const BCD_STORE_DIGEST *b, BCD_DIFF_VISITOR visit, void *context);
+
+#endif /* BCD_DIFF_H */
@@ -0,0 +1,480 @@
+/* Generated by gen_element_table.py; edit the catalog there and run
+ * `make element-table`. Included by bcd.c and bcd_test.c. */
+
+#define ELEMENT_COUNT 172
+#define ELEMENT_ID_BUCKETS 64
+#define ELEMENT_ID_SLOTS 512
+#define ELEMENT_NAME_BUCKETS 64
+#define ELEMENT_NAME_SLOTS 512
+
+static const BCD_ELEMENT_META g_elementTable[ELEMENT_COUNT] = {
+    {"device", 0x11000001U, BCD_ELEMENT_STRING},
+    {"path", 0x12000002U, BCD_ELEMENT_STRING},
+    {"description", 0x12000004U, BCD_ELEMENT_STRING},
+    {"locale", 0x12000005U, BCD_ELEMENT_STRING},
+    {"inherit", 0x14000006U, BCD_ELEMENT_BINARY},
+    {"truncatememory", 0x15000007U, BCD_ELEMENT_INTEGER},
+    {"recoverysequence", 0x14000008U, BCD_ELEMENT_BINARY},
+    {"recoveryenabled", 0x16000009U, BCD_ELEMENT_BOOLEAN},
+    {"badmemorylist", 0x1700000aU, BCD_ELEMENT_BINARY},
+    {"badmemoryaccess", 0x1600000bU, BCD_ELEMENT_BOOLEAN},
+    {"firstmegabytepolicy", 0x1500000cU, BCD_ELEMENT_INTEGER},
+    {"relocatephysical", 0x1500000dU, BCD_ELEMENT_INTEGER},
+    {"avoidlowmemory", 0x1500000eU, BCD_ELEMENT_INTEGER},
+    {"traditionalkseg", 0x1600000fU, BCD_ELEMENT_BOOLEAN},
+    {"bootdebug", 0x16000010U, BCD_ELEMENT_BOOLEAN},
+    {"debugtype", 0x15000011U, BCD_ELEMENT_INTEGER},
+    {"debugaddress", 0x15000012U, BCD_ELEMENT_INTEGER},
+    {"debugport", 0x15000013U, BCD_ELEMENT_INTEGER},
+    {"baudrate", 0x15000014U, BCD_ELEMENT_INTEGER},
+    {"channel", 0x15000015U, BCD_ELEMENT_INTEGER},
+    {"targetname", 0x12000016U, BCD_ELEMENT_STRING},
+    {"noumex", 0x16000017U, BCD_ELEMENT_BOOLEAN},
+    {"debugstart", 0x15000018U, BCD_ELEMENT_INTEGER},
+    {"busparams", 0x12000019U, BCD_ELEMENT_STRING},
+    {"hostip", 0x1500001aU, BCD_ELEMENT_INTEGER},
+    {"port", 0x1500001bU, BCD_ELEMENT_INTEGER},
+    {"dhcp", 0x1600001cU, BCD_ELEMENT_BOOLEAN},
+    {"key", 0x1200001dU, BCD_ELEMENT_STRING},
+    {"vm", 0x1600001eU, BCD_ELEMENT_BOOLEAN},
+    {"bootems", 0x16000020U, BCD_ELEMENT_BOOLEAN},
+    {"emsport", 0x15000022U, BCD_ELEMENT_INTEGER},
+    {"emsbaudrate", 0x15000023U, BCD_ELEMENT_INTEGER},
+    {"loadoptions", 0x12000030U, BCD_ELEMENT_STRING},
+    {"advancedoptions", 0x16000040U, BCD_ELEMENT_BOOLEAN},
+    {"optionsedit", 0x16000041U, BCD_ELEMENT_BOOLEAN},
+    {"keyringaddress", 0x15000042U, BCD_ELEMENT_INTEGER},
+    {"bsdlogdevice", 0x11000043U, BCD_ELEMENT_STRING},
+    {"bsdlogpath", 0x12000044U, BCD_ELEMENT_STRING},
+    {"bsdpreservelog", 0x16000045U, BCD_ELEMENT_BOOLEAN},
+    {"graphicsmodedisabled", 0x16000046U, BCD_ELEMENT_BOOLEAN},
+    {"configaccesspolicy", 0x15000047U, BCD_ELEMENT_INTEGER},
+    {"nointegritychecks", 0x16000048U, BCD_ELEMENT_BOOLEAN},
+    {"testsigning", 0x16000049U, BCD_ELEMENT_BOOLEAN},
+    {"fontpath", 0x1200004aU, BCD_ELEMENT_STRING},
+    {"integrityservices", 0x1500004bU, BCD_ELEMENT_INTEGER},
+    {"volumebandid", 0x1500004cU, BCD_ELEMENT_INTEGER},
+    {"extendedinput", 0x16000050U, BCD_ELEMENT_BOOLEAN},
+    {"initialconsoleinput", 0x15000051U, BCD_ELEMENT_INTEGER},
+    {"graphicsresolution", 0x15000052U, BCD_ELEMENT_INTEGER},
+    {"restartonfailure", 0x16000053U, BCD_ELEMENT_BOOLEAN},
+    {"highestmode", 0x16000054U, BCD_ELEMENT_BOOLEAN},
+    {"isolatedcontext", 0x16000060U, BCD_ELEMENT_BOOLEAN},
+    {"displaymessage", 0x15000065U, BCD_ELEMENT_INTEGER},
+    {"displaymessageoverride", 0x15000066U, BCD_ELEMENT_INTEGER},
+    {"nobootuxlogo", 0x16000067U, BCD_ELEMENT_BOOLEAN},
+    {"nobootuxtext", 0x16000068U, BCD_ELEMENT_BOOLEAN},
+    {"nobootuxprogress", 0x16000069U, BCD_ELEMENT_BOOLEAN},
+    {"nobootuxfade", 0x1600006aU, BCD_ELEMENT_BOOLEAN},
+    {"bootuxdisabled", 0x1600006cU, BCD_ELEMENT_BOOLEAN},
+    {"bootshutdowndisabled", 0x16000074U, BCD_ELEMENT_BOOLEAN},
+    {"allowedinmemorysettings", 0x17000077U, BCD_ELEMENT_BINARY},
+    {"forcefipscrypto", 0x16000079U, BCD_ELEMENT_BOOLEAN},
+    {"displayorder", 0x24000001U, BCD_ELEMENT_BINARY},
+    {"bootsequence", 0x24000002U, BCD_ELEMENT_BINARY},
+    {"default", 0x23000003U, BCD_ELEMENT_BINARY},
+    {"timeout", 0x25000004U, BCD_ELEMENT_INTEGER},
+    {"resume", 0x26000005U, BCD_ELEMENT_BOOLEAN},
+    {"resumeobject", 0x23000006U, BCD_ELEMENT_BINARY},
+    {"toolsdisplayorder", 0x24000010U, BCD_ELEMENT_BINARY},
+    {"displaybootmenu", 0x26000020U, BCD_ELEMENT_BOOLEAN},
+    {"noerrordisplay", 0x26000021U, BCD_ELEMENT_BOOLEAN},
+    {"bcddevice", 0x21000022U, BCD_ELEMENT_STRING},
+    {"bcdfilepath", 0x22000023U, BCD_ELEMENT_STRING},
+    {"processcustomactionsfirst", 0x26000028U, BCD_ELEMENT_BOOLEAN},
+    {"customactions", 0x27000030U, BCD_ELEMENT_BINARY},
+    {"persistbootsequence", 0x26000031U, BCD_ELEMENT_BOOLEAN},
+    {"osdevice", 0x21000001U, BCD_ELEMENT_STRING},
+    {"systemroot", 0x22000002U, BCD_ELEMENT_STRING},
+    {"detecthal", 0x26000010U, BCD_ELEMENT_BOOLEAN},
+    {"kernel", 0x22000011U, BCD_ELEMENT_STRING},
+    {"hal", 0x22000012U, BCD_ELEMENT_STRING},
+    {"dbgtransport", 0x22000013U, BCD_ELEMENT_STRING},
+    {"nx", 0x25000020U, BCD_ELEMENT_INTEGER},
+    {"pae", 0x25000021U, BCD_ELEMENT_INTEGER},
+    {"winpe", 0x26000022U, BCD_ELEMENT_BOOLEAN},
+    {"nocrashautoreboot", 0x26000024U, BCD_ELEMENT_BOOLEAN},
+    {"lastknowngood", 0x26000025U, BCD_ELEMENT_BOOLEAN},
+    {"oslnointegritychecks", 0x26000026U, BCD_ELEMENT_BOOLEAN},
+    {"osltestsigning", 0x26000027U, BCD_ELEMENT_BOOLEAN},
+    {"nolowmem", 0x26000030U, BCD_ELEMENT_BOOLEAN},
+    {"removememory", 0x25000031U, BCD_ELEMENT_INTEGER},
+    {"increaseuserva", 0x25000032U, BCD_ELEMENT_INTEGER},
+    {"perfmem", 0x25000033U, BCD_ELEMENT_INTEGER},
+    {"vga", 0x26000040U, BCD_ELEMENT_BOOLEAN},
+    {"quietboot", 0x26000041U, BCD_ELEMENT_BOOLEAN},
+    {"novesa", 0x26000042U, BCD_ELEMENT_BOOLEAN},
+    {"novga", 0x26000043U, BCD_ELEMENT_BOOLEAN},
+    {"clustermodeaddressing", 0x25000050U, BCD_ELEMENT_INTEGER},
+    {"usephysicaldestination", 0x26000051U, BCD_ELEMENT_BOOLEAN},
+    {"restrictapiccluster", 0x25000052U, BCD_ELEMENT_INTEGER},
+    {"uselegacyapicmode", 0x26000054U, BCD_ELEMENT_BOOLEAN},
+    {"x2apicpolicy", 0x25000055U, BCD_ELEMENT_INTEGER},
+    {"onecpu", 0x26000060U, BCD_ELEMENT_BOOLEAN},
+    {"numproc", 0x25000061U, BCD_ELEMENT_INTEGER},
+    {"maxproc", 0x26000062U, BCD_ELEMENT_BOOLEAN},
+    {"configflags", 0x25000063U, BCD_ELEMENT_INTEGER},
+    {"maxgroup", 0x26000064U, BCD_ELEMENT_BOOLEAN},
+    {"groupaware", 0x26000065U, BCD_ELEMENT_BOOLEAN},
+    {"groupsize", 0x25000066U, BCD_ELEMENT_INTEGER},
+    {"usefirmwarepcisettings", 0x26000070U, BCD_ELEMENT_BOOLEAN},
+    {"msi", 0x25000071U, BCD_ELEMENT_INTEGER},
+    {"pciexpress", 0x25000072U, BCD_ELEMENT_INTEGER},
+    {"safeboot", 0x25000080U, BCD_ELEMENT_INTEGER},
+    {"safebootalternateshell", 0x26000081U, BCD_ELEMENT_BOOLEAN},
+    {"bootlog", 0x26000090U, BCD_ELEMENT_BOOLEAN},
+    {"sos", 0x26000091U, BCD_ELEMENT_BOOLEAN},
+    {"debug", 0x260000a0U, BCD_ELEMENT_BOOLEAN},
+    {"halbreakpoint", 0x260000a1U, BCD_ELEMENT_BOOLEAN},
+    {"useplatformclock", 0x260000a2U, BCD_ELEMENT_BOOLEAN},
+    {"forcelegacyplatform", 0x260000a3U, BCD_ELEMENT_BOOLEAN},
+    {"useplatformtick", 0x260000a4U, BCD_ELEMENT_BOOLEAN},
+    {"disabledynamictick", 0x260000a5U, BCD_ELEMENT_BOOLEAN},
+    {"tscsyncpolicy", 0x250000a6U, BCD_ELEMENT_INTEGER},
+    {"ems", 0x260000b0U, BCD_ELEMENT_BOOLEAN},
+    {"forcefailure", 0x250000c0U, BCD_ELEMENT_INTEGER},
+    {"driverloadfailurepolicy", 0x250000c1U, BCD_ELEMENT_INTEGER},
+    {"bootmenupolicy", 0x250000c2U, BCD_ELEMENT_INTEGER},
+    {"onetimeadvancedoptions", 0x260000c3U, BCD_ELEMENT_BOOLEAN},
+    {"bootstatuspolicy", 0x250000e0U, BCD_ELEMENT_INTEGER},
+    {"disableelamdrivers", 0x260000e1U, BCD_ELEMENT_BOOLEAN},
+    {"hypervisorlaunchtype", 0x250000f0U, BCD_ELEMENT_INTEGER},
+    {"hypervisordebug", 0x260000f2U, BCD_ELEMENT_BOOLEAN},
+    {"hypervisordebugtype", 0x250000f3U, BCD_ELEMENT_INTEGER},
+    {"hypervisordebugport", 0x250000f4U, BCD_ELEMENT_INTEGER},
+    {"hypervisorbaudrate", 0x250000f5U, BCD_ELEMENT_INTEGER},
+    {"hypervisorchannel", 0x250000f6U, BCD_ELEMENT_INTEGER},
+    {"bootux", 0x250000f7U, BCD_ELEMENT_INTEGER},
+    {"hypervisordisableslat", 0x260000f8U, BCD_ELEMENT_BOOLEAN},
+    {"hypervisorbusparams", 0x220000f9U, BCD_ELEMENT_STRING},
+    {"hypervisornumproc", 0x250000faU, BCD_ELEMENT_INTEGER},
+    {"hypervisorrootprocpernode", 0x250000fbU, BCD_ELEMENT_INTEGER},
+    {"hypervisoruselargevtlb", 0x260000fcU, BCD_ELEMENT_BOOLEAN},
+    {"hypervisorhostip", 0x250000fdU, BCD_ELEMENT_INTEGER},
+    {"hypervisorhostport", 0x250000feU, BCD_ELEMENT_INTEGER},
+    {"hypervisordebugpages", 0x250000ffU, BCD_ELEMENT_INTEGER},
+    {"tpmbootentropy", 0x25000100U, BCD_ELEMENT_INTEGER},
+    {"hypervisorusekey", 0x22000110U, BCD_ELEMENT_STRING},
+    {"hypervisordhcp", 0x26000114U, BCD_ELEMENT_BOOLEAN},
+    {"hypervisoriommupolicy", 0x25000115U, BCD_ELEMENT_INTEGER},
+    {"hypervisorusevapic", 0x26000116U, BCD_ELEMENT_BOOLEAN},
+    {"hypervisorloadoptions", 0x22000117U, BCD_ELEMENT_STRING},
+    {"hypervisormsrfilterpolicy", 0x25000118U, BCD_ELEMENT_INTEGER},
+    {"hypervisormmionxpolicy", 0x25000119U, BCD_ELEMENT_INTEGER},
+    {"hypervisorschedulertype", 0x2500011aU, BCD_ELEMENT_INTEGER},
+    {"xsavepolicy", 0x25000120U, BCD_ELEMENT_INTEGER},
+    {"xsavedisable", 0x2500012bU, BCD_ELEMENT_INTEGER},
+    {"vsmlaunchtype", 0x25000142U, BCD_ELEMENT_INTEGER},
+    {"customsettings", 0x26000003U, BCD_ELEMENT_BOOLEAN},
+    {"debugoptionenabled", 0x26000006U, BCD_ELEMENT_BOOLEAN},
+    {"passcount", 0x25000001U, BCD_ELEMENT_INTEGER},
+    {"testmix", 0x25000002U, BCD_ELEMENT_INTEGER},
+    {"ramdiskimageoffset", 0x35000001U, BCD_ELEMENT_INTEGER},
+    {"ramdisktftpclientport", 0x35000002U, BCD_ELEMENT_INTEGER},
+    {"ramdisksdidevice", 0x31000003U, BCD_ELEMENT_STRING},
+    {"ramdisksdipath", 0x32000004U, BCD_ELEMENT_STRING},
+    {"ramdiskimagelength", 0x35000005U, BCD_ELEMENT_INTEGER},
+    {"exportascd", 0x36000006U, BCD_ELEMENT_BOOLEAN},
+    {"ramdisktftpblocksize", 0x35000007U, BCD_ELEMENT_INTEGER},
+    {"ramdisktftpwindowsize", 0x35000008U, BCD_ELEMENT_INTEGER},
+    {"ramdiskmcenabled", 0x36000009U, BCD_ELEMENT_BOOLEAN},
+    {"ramdiskmctftpfallback", 0x3600000aU, BCD_ELEMENT_BOOLEAN},
+    {"ramdisktftpvarwindow", 0x3600000bU, BCD_ELEMENT_BOOLEAN},
+};
+
+/* Canonical names and aliases, with the index of their element. */
+struct element_name {
+    const char *name;
+    uint16_t element;
+};
+
+static const struct element_name g_elementNames[178] = {
+    {"device", 0},
+    {"path", 1},
+    {"description", 2},
+    {"locale", 3},
+    {"inherit", 4},
+    {"truncatememory", 5},
+    {"recoverysequence", 6},
+    {"recoveryenabled", 7},
+    {"badmemorylist", 8},
+    {"badmemoryaccess", 9},
+    {"firstmegabytepolicy", 10},
+    {"relocatephysical", 11},
+    {"avoidlowmemory", 12},
+    {"traditionalkseg", 13},
+    {"bootdebug", 14},
+    {"debugtype", 15},
+    {"debugaddress", 16},
+    {"debugport", 17},
+    {"baudrate", 18},
+    {"channel", 19},
+    {"targetname", 20},
+    {"noumex", 21},
+    {"debugstart", 22},
+    {"busparams", 23},
+    {"hostip", 24},
+    {"port", 25},
+    {"dhcp", 26},
+    {"key", 27},
+    {"vm", 28},
+    {"bootems", 29},
+    {"emsport", 30},
+    {"emsbaudrate", 31},
+    {"loadoptions", 32},
+    {"advancedoptions", 33},
+    {"optionsedit", 34},
+    {"keyringaddress", 35},
+    {"bsdlogdevice", 36},
+    {"bootstatusdatalogdevice", 36},
+    {"bsdlogpath", 37},
+    {"bootstatusdatalogfile", 37},
+    {"bsdpreservelog", 38},
+    {"bootstatusdatalogappend", 38},
+    {"graphicsmodedisabled", 39},
+    {"configaccesspolicy", 40},
+    {"nointegritychecks", 41},
+    {"testsigning", 42},
+    {"fontpath", 43},
+    {"integrityservices", 44},
+    {"volumebandid", 45},
+    {"extendedinput", 46},
+    {"initialconsoleinput", 47},
+    {"graphicsresolution", 48},
+    {"restartonfailure", 49},
+    {"highestmode", 50},
+    {"isolatedcontext", 51},
+    {"displaymessage", 52},
+    {"displaymessageoverride", 53},
+    {"nobootuxlogo", 54},
+    {"nobootuxtext", 55},
+    {"nobootuxprogress", 56},
+    {"nobootuxfade", 57},
+    {"bootuxdisabled", 58},
+    {"bootshutdowndisabled", 59},
+    {"allowedinmemorysettings", 60},
+    {"forcefipscrypto", 61},
+    {"displayorder", 62},
+    {"bootsequence", 63},
+    {"default", 64},
+    {"timeout", 65},
+    {"resume", 66},
+    {"attemptresume", 66},
+    {"resumeobject", 67},
+    {"toolsdisplayorder", 68},
+    {"displaybootmenu", 69},
+    {"noerrordisplay", 70},
+    {"bcddevice", 71},
+    {"bcdfilepath", 72},
+    {"processcustomactionsfirst", 73},
+    {"customactions", 74},
+    {"persistbootsequence", 75},
+    {"osdevice", 76},
+    {"filedevice", 76},
+    {"systemroot", 77},
+    {"filepath", 77},
+    {"detecthal", 78},
+    {"kernel", 79},
+    {"hal", 80},
+    {"dbgtransport", 81},
+    {"nx", 82},
+    {"pae", 83},
+    {"winpe", 84},
+    {"nocrashautoreboot", 85},
+    {"lastknowngood", 86},
+    {"oslnointegritychecks", 87},
+    {"osltestsigning", 88},
+    {"nolowmem", 89},
+    {"removememory", 90},
+    {"increaseuserva", 91},
+    {"perfmem", 92},
+    {"vga", 93},
+    {"quietboot", 94},
+    {"novesa", 95},
+    {"novga", 96},
+    {"clustermodeaddressing", 97},
+    {"usephysicaldestination", 98},
+    {"restrictapiccluster", 99},
+    {"uselegacyapicmode", 100},
+    {"x2apicpolicy", 101},
+    {"onecpu", 102},
+    {"numproc", 103},
+    {"maxproc", 104},
+    {"configflags", 105},
+    {"maxgroup", 106},
+    {"groupaware", 107},
+    {"groupsize", 108},
+    {"usefirmwarepcisettings", 109},
+    {"msi", 110},
+    {"pciexpress", 111},
+    {"safeboot", 112},
+    {"safebootalternateshell", 113},
+    {"bootlog", 114},
+    {"sos", 115},
+    {"debug", 116},
+    {"halbreakpoint", 117},
+    {"useplatformclock", 118},
+    {"forcelegacyplatform", 119},
+    {"useplatformtick", 120},
+    {"disabledynamictick", 121},
+    {"tscsyncpolicy", 122},
+    {"ems", 123},
+    {"forcefailure", 124},
+    {"driverloadfailurepolicy", 125},
+    {"bootmenupolicy", 126},
+    {"onetimeadvancedoptions", 127},
+    {"bootstatuspolicy", 128},
+    {"disableelamdrivers", 129},
+    {"hypervisorlaunchtype", 130},
+    {"hypervisordebug", 131},
+    {"hypervisordebugtype", 132},
+    {"hypervisordebugport", 133},
+    {"hypervisorbaudrate", 134},
+    {"hypervisorchannel", 135},
+    {"bootux", 136},
+    {"hypervisordisableslat", 137},
+    {"hypervisorbusparams", 138},
+    {"hypervisornumproc", 139},
+    {"hypervisorrootprocpernode", 140},
+    {"hypervisoruselargevtlb", 141},
+    {"hypervisorhostip", 142},
+    {"hypervisorhostport", 143},
+    {"hypervisordebugpages", 144},
+    {"tpmbootentropy", 145},
+    {"hypervisorusekey", 146},
+    {"hypervisordhcp", 147},
+    {"hypervisoriommupolicy", 148},
+    {"hypervisorusevapic", 149},
+    {"hypervisorloadoptions", 150},
+    {"hypervisormsrfilterpolicy", 151},
+    {"hypervisormmionxpolicy", 152},
+    {"hypervisorschedulertype", 153},
+    {"xsavepolicy", 154},
+    {"xsavedisable", 155},
+    {"vsmlaunchtype", 156},
+    {"customsettings", 157},
+    {"debugoptionenabled", 158},
+    {"passcount", 159},
+    {"testmix", 160},
+    {"ramdiskimageoffset", 161},
+    {"ramdisktftpclientport", 162},
+    {"ramdisksdidevice", 163},
+    {"ramdisksdipath", 164},
+    {"ramdiskimagelength", 165},
+    {"exportascd", 166},
+    {"ramdisktftpblocksize", 167},
+    {"ramdisktftpwindowsize", 168},
+    {"ramdiskmcenabled", 169},
+    {"ramdiskmctftpfallback", 170},
+    {"ramdisktftpvarwindow", 171},
+};
+
+static const uint16_t g_elementIdSeeds[64] = {
+    1, 2, 2, 1, 1, 1, 1, 1, 1, 4, 0, 2,
+    1, 1, 1, 1, 6, 1, 1, 2, 0, 0, 1, 1,
+    1, 1, 1, 1, 0, 4, 2, 3, 1, 1, 4, 2,
+    2, 0, 3, 2, 2, 1, 2, 0, 2, 1, 1, 1,
+    2, 3, 3, 1, 1, 3, 3, 1, 1, 1, 1, 4,
+    1, 1, 3, 2,
+};
+
+static const uint16_t g_elementIdSlots[512] = {
+    0, 0, 65, 0, 0, 0, 151, 0, 0, 0, 0, 0,
+    0, 32, 0, 0, 0, 127, 165, 0, 0, 157, 62, 0,
+    0, 5, 0, 90, 106, 0, 0, 0, 0, 0, 69, 0,
+    0, 0, 0, 0, 0, 0, 171, 0, 0, 0, 0, 146,
+    0, 0, 129, 0, 0, 0, 156, 0, 118, 0, 0, 100,
+    0, 0, 0, 86, 0, 0, 0, 97, 0, 147, 21, 0,
+    0, 0, 114, 141, 0, 0, 0, 94, 0, 0, 0, 0,
+    0, 0, 0, 138, 166, 0, 0, 0, 0, 0, 0, 0,
+    155, 107, 9, 0, 23, 0, 71, 0, 0, 164, 54, 0,
+    0, 2, 0, 154, 0, 0, 0, 0, 0, 0, 0, 0,
+    88, 0, 11, 74, 17, 0, 0, 0, 0, 109, 0, 139,
+    0, 0, 135, 117, 0, 145, 0, 0, 0, 0, 0, 0,
+    122, 0, 0, 0, 0, 113, 0, 0, 0, 42, 105, 63,
+    89, 0, 0, 0, 0, 14, 35, 0, 0, 0, 121, 0,
+    0, 0, 0, 0, 0, 38, 93, 55, 0, 0, 68, 0,
+    0, 0, 96, 0, 64, 0, 70, 0, 123, 0, 0, 0,
+    76, 0, 0, 0, 0, 0, 0, 0, 58, 150, 153, 0,
+    37, 0, 22, 34, 116, 99, 79, 0, 95, 0, 120, 0,
+    6, 0, 170, 0, 0, 159, 0, 25, 4, 104, 0, 0,
+    132, 0, 80, 0, 0, 0, 48, 0, 137, 0, 167, 20,
+    136, 0, 13, 0, 0, 0, 43, 0, 0, 0, 0, 0,
+    0, 140, 0, 115, 0, 0, 44, 0, 1, 0, 0, 0,
+    0, 102, 0, 0, 0, 7, 161, 0, 0, 0, 0, 0,
+    0, 0, 82, 0, 0, 101, 0, 0, 0, 0, 143, 0,
+    87, 168, 0, 0, 144, 130, 0, 0, 119, 0, 59, 160,
+    0, 0, 0, 72, 103, 0, 10, 0, 0, 31, 81, 33,
+    0, 0, 0, 0, 163, 0, 0, 0, 0, 0, 98, 0,
+    0, 0, 52, 77, 111, 0, 0, 41, 27, 0, 49, 0,
+    45, 134, 0, 50, 61, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 149, 12, 124, 53, 0, 0, 29, 60, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 24, 148,
+    0, 0, 19, 0, 112, 0, 0, 0, 0, 67, 0, 0,
+    0, 0, 40, 0, 110, 0, 0, 0, 0, 0, 0, 75,
+    0, 0, 0, 0, 18, 0, 0, 0, 0, 46, 0, 0,
+    162, 0, 0, 0, 92, 0, 0, 91, 0, 0, 0, 0,
+    125, 0, 0, 169, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 83, 39, 0, 0, 0, 0, 128, 0, 0, 57, 0,
+    108, 15, 0, 131, 0, 30, 0, 36, 0, 0, 152, 0,
+    78, 0, 0, 0, 56, 0, 0, 0, 0, 0, 0, 66,
+    0, 0, 0, 51, 0, 3, 47, 85, 73, 0, 0, 0,
+    0, 0, 0, 126, 0, 0, 8, 142, 0, 133, 0, 0,
+    0, 0, 26, 0, 0, 0, 28, 0, 0, 0, 16, 84,
+    172, 0, 0, 158, 0, 0, 0, 0,
+};
+
+static const uint16_t g_elementNameSeeds[64] = {
+    5, 1, 3, 2, 1, 3, 1, 7, 2, 1, 3, 1,
+    1, 3, 1, 3, 5, 1, 0, 1, 1, 2, 1, 1,
+    2, 2, 1, 3, 3, 1, 4, 2, 2, 2, 1, 3,
+    1, 11, 1, 1, 2, 1, 2, 2, 2, 2, 4, 6,
+    1, 1, 0, 0, 1, 2, 2, 0, 2, 5, 1, 1,
+    1, 7, 0, 2,
+};
+
+static const uint16_t g_elementNameSlots[512] = {
+    0, 0, 161, 110, 84, 152, 170, 60, 0, 0, 0, 5,
+    0, 0, 0, 0, 138, 133, 0, 0, 1, 0, 0, 159,
+    0, 0, 124, 0, 85, 90, 44, 0, 0, 0, 0, 0,
+    0, 96, 174, 0, 0, 30, 87, 13, 0, 24, 0, 0,
+    178, 142, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 88, 3, 0, 0, 0, 0, 0, 64, 0, 0, 165,
+    0, 0, 158, 0, 0, 0, 0, 0, 20, 164, 100, 0,
+    0, 55, 25, 0, 56, 0, 0, 0, 66, 0, 0, 0,
+    93, 79, 0, 75, 0, 0, 0, 122, 113, 0, 0, 0,
+    0, 0, 0, 18, 0, 0, 147, 76, 0, 0, 0, 0,
+    0, 168, 151, 118, 129, 0, 0, 0, 0, 53, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 99, 23, 0, 0,
+    0, 83, 0, 0, 28, 0, 0, 0, 0, 47, 78, 0,
+    31, 0, 163, 0, 29, 0, 0, 0, 0, 144, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 49, 67, 8, 141, 112,
+    0, 0, 0, 0, 0, 89, 0, 0, 0, 0, 0, 0,
+    0, 131, 4, 0, 0, 0, 0, 0, 0, 0, 126, 0,
+    0, 0, 0, 0, 0, 0, 0, 77, 2, 12, 0, 0,
+    0, 145, 0, 0, 0, 137, 119, 0, 27, 33, 0, 0,
+    0, 7, 73, 32, 0, 0, 37, 0, 0, 45, 105, 38,
+    0, 39, 0, 0, 0, 0, 0, 0, 0, 0, 63, 0,
+    0, 69, 108, 0, 177, 50, 132, 0, 0, 0, 0, 92,
+    0, 0, 0, 0, 65, 0, 0, 22, 0, 0, 0, 97,
+    140, 115, 157, 0, 150, 19, 0, 36, 0, 0, 0, 0,
+    0, 52, 0, 0, 0, 0, 0, 0, 156, 0, 107, 51,
+    0, 0, 130, 139, 176, 0, 61, 0, 0, 136, 0, 15,
+    172, 0, 120, 148, 0, 0, 0, 117, 0, 0, 0, 155,
+    0, 121, 35, 153, 0, 0, 175, 0, 0, 0, 0, 0,
+    0, 95, 109, 0, 0, 0, 0, 70, 0, 0, 41, 62,
+    0, 0, 0, 91, 0, 0, 48, 0, 26, 0, 0, 0,
+    0, 68, 0, 82, 0, 11, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 9, 146, 0, 16, 0, 0, 0, 114, 0,
+    0, 0, 0, 0, 0, 0, 0, 116, 0, 0, 0, 0,
+    104, 160, 0, 0, 135, 42, 0, 0, 173, 0, 58, 0,
+    0, 0, 0, 0, 125, 54, 94, 80, 0, 81, 0, 0,
+    0, 0, 0, 0, 127, 0, 43, 34, 0, 0, 162, 0,
+    40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 101, 143,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 106,
+    0, 72, 6, 86, 14, 0, 0, 102, 0, 0, 0, 0,
+    0, 0, 0, 0, 21, 0, 0, 59, 0, 0, 74, 0,
+    0, 111, 71, 46, 103, 0, 134, 154, 167, 166, 0, 0,
+    123, 0, 171, 0, 0, 0, 0, 0, 0, 128, 0, 0,
+    17, 0, 98, 57, 0, 0, 149, 169,
+};
@@ -0,0 +1,363 @@
+#include "bcd_format.h"
+
+#include <string.h>
+
+static const char g_hexDigits[] = "0123456789abcdef";
+
+static const char *const g_kindNames[] = { "unknown", "integer", "string", "boolean", "binary" };
+
+int BcdFormatterFlush(BCD_FORMATTER *formatter)
+{
+    if (formatter->length > 0 &&
+        fwrite(formatter->buffer, 1, formatter->length, formatter->out) != formatter->length) {
+        formatter->status = BCD_ERR_IO;
+    }
+    formatter->length = 0;
+    return formatter->status;
+}
+
+/* Room for n more bytes, n <= BCD_FORMATTER_BUFFER_SIZE. */
+static char *reserve(BCD_FORMATTER *formatter, size_t n)
+{
+    if (formatter->length + n > sizeof(formatter->buffer)) BcdFormatterFlush(formatter);
+    return formatter->buffer + formatter->length;
+}
+
+static void put_bytes(BCD_FORMATTER *formatter, const char *data, size_t n)
+{
+    while (n > 0) {
+        size_t room = sizeof(formatter->buffer) - formatter->length;
+        if (room == 0) {
+            BcdFormatterFlush(formatter);
+            room = sizeof(formatter->buffer);
+        }
+        size_t chunk = n < room ? n : room;
+        memcpy(formatter->buffer + formatter->length, data, chunk);
+        formatter->length += chunk;
+        data += chunk;
+        n -= chunk;
+    }
+}
+
+static void put_text(BCD_FORMATTER *formatter, const char *text)
+{
+    put_bytes(formatter, text, strlen(text));
+}
+
+static void put_char(BCD_FORMATTER *formatter, char c)
+{
+    *reserve(formatter, 1) = c;
+    formatter->length++;
+}
+
+static void encode_hex(char *p, uint32_t value, int digits)
+{
+    for (int i = digits - 1; i >= 0; --i) {
+        p[i] = g_hexDigits[value & 0xf];
+        value >>= 4;
+    }
+}
+
+/* 0x followed by eight lowercase digits, as %#010x would print. */
+static void put_hex32(BCD_FORMATTER *formatter, uint32_t value)
+{
+    char *p = reserve(formatter, 10);
+    p[0] = '0';
+    p[1] = 'x';
+    encode_hex(p + 2, value, 8);
+    formatter->length += 10;
+}
+
+static void put_decimal(BCD_FORMATTER *formatter, uint64_t value)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    put_bytes(formatter, digits + sizeof(digits) - n, n);
+}
+
+static void put_guid(BCD_FORMATTER *formatter, const BCD_OBJECT_ID *id)
+{
+    BcdFormatObjectId(id, reserve(formatter, BCD_ID_STRING_LENGTH + 1), BCD_ID_STRING_LENGTH + 1);
+    formatter->length += BCD_ID_STRING_LENGTH;
+}
+
+static void put_hex_bytes(BCD_FORMATTER *formatter, const uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        size_t chunk = size < sizeof(formatter->buffer) / 4 ? size : sizeof(formatter->buffer) / 4;
+        char *p = reserve(formatter, chunk * 2);
+        for (size_t i = 0; i < chunk; ++i) encode_hex(p + 2 * i, data[i], 2);
+        formatter->length += chunk * 2;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+/* Runs of bytes that need no escaping are copied as they are. */
+static void put_json_string(BCD_FORMATTER *formatter, const char *text)
+{
+    put_char(formatter, '"');
+    const char *run = text;
+    for (const char *p = text; *p; ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        put_bytes(formatter, run, (size_t)(p - run));
+        run = p + 1;
+        char *e = reserve(formatter, 6);
+        e[0] = '\\';
+        switch (c) {
+        case '"': e[1] = '"'; break;
+        case '\\': e[1] = '\\'; break;
+        case '\n': e[1] = 'n'; break;
+        case '\r': e[1] = 'r'; break;
+        case '\t': e[1] = 't'; break;
+        default:
+            memcpy(e + 1, "u00", 3);
+            encode_hex(e + 4, c, 2);
+            formatter->length += 6;
+            continue;
+        }
+        formatter->length += 2;
+    }
+    put_text(formatter, run);
+    put_char(formatter, '"');
+}
+
+/* Quoted only when it has to be, with quotes doubled. */
+static void put_csv_field(BCD_FORMATTER *formatter, const char *text)
+{
+    if (!text[strcspn(text, ",\"\r\n")]) {
+        put_text(formatter, text);
+        return;
+    }
+    put_char(formatter, '"');
+    for (const char *quote; (quote = strchr(text, '"')) != NULL; text = quote + 1) {
+        put_bytes(formatter, text, (size_t)(quote - text) + 1);
+        put_char(formatter, '"');
+    }
+    put_text(formatter, text);
+    put_char(formatter, '"');
+}
+
+static const char *element_string(const BCD_ELEMENT *el)
+{
+    return el->data.stringValue ? el->data.stringValue : "";
+}
+
+static void write_text_object(BCD_FORMATTER *formatter, BCD_OBJECT *obj)
+{
+    put_text(formatter, "identifier ");
+    put_guid(formatter, &obj->id);
+    put_char(formatter, '\n');
+    if (formatter->verbose) {
+        put_text(formatter, "type ");
+        put_hex32(formatter, obj->objectType);
+        put_char(formatter, '\n');
+    }
+    size_t count = BcdObjectGetElementCount(obj);
+    for (size_t i = 0; i < count; ++i) {
+        const BCD_ELEMENT *el = BcdObjectGetElementAt(obj, i);
+        if (!el) continue;
+        const BCD_ELEMENT_META *meta = BcdLookupElementById(el->type);
+        put_text(formatter, "  ");
+        if (meta) {
+            put_text(formatter, meta->name);
+            if (formatter->verbose) {
+                put_text(formatter, " (");
+                put_hex32(formatter, el->type);
+                put_char(formatter, ')');
+            }
+        } else {
+            put_hex32(formatter, el->type);
+        }
+        put_text(formatter, ": ");
+        switch (el->kind) {
+        case BCD_ELEMENT_INTEGER:
+            put_decimal(formatter, el->data.integerValue);
+            break;
+        case BCD_ELEMENT_STRING:
+            put_text(formatter, element_string(el));
+            break;
+        case BCD_ELEMENT_BOOLEAN:
+            put_text(formatter, el->data.boolValue ? "ON" : "OFF");
+            break;
+        case BCD_ELEMENT_BINARY:
+            put_decimal(formatter, el->data.binaryValue.size);
+            put_text(formatter, " bytes");
+            break;
+        default:
+            put_text(formatter, "unknown");
+            break;
+        }
+        put_char(formatter, '\n');
+    }
+    put_char(formatter, '\n');
+}
+
+static const char *kind_name(BCD_ELEMENT_KIND kind)
+{
+    return (unsigned)kind < sizeof(g_kindNames) / sizeof(g_kindNames[0]) ? g_kindNames[kind] : "unknown";
+}
+
+static void write_json_object(BCD_FORMATTER *formatter, BCD_OBJECT *obj)
+{
+    put_text(formatter, "{\"identifier\":\"");
+    put_guid(formatter, &obj->id);
+    put_text(formatter, "\",\"type\":\"");
+    put_hex32(formatter, obj->objectType);
+    put_text(formatter, "\",\"elements\":[");
+    size_t count = BcdObjectGetElementCount(obj);
+    size_t written = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const BCD_ELEMENT *el = BcdObjectGetElementAt(obj, i);
+        if (!el) continue;
+        const BCD_ELEMENT_META *meta = BcdLookupElementById(el->type);
+        put_text(formatter, written++ ? ",{\"type\":\"" : "{\"type\":\"");
+        put_hex32(formatter, el->type);
+        put_text(formatter, "\",\"name\":");
+        if (meta) put_json_string(formatter, meta->name);
+        else put_text(formatter, "null");
+        put_text(formatter, ",\"kind\":\"");
+        put_text(formatter, kind_name(el->kind));
+        put_text(formatter, "\",\"value\":");
+        switch (el->kind) {
+        case BCD_ELEMENT_INTEGER:
+            put_decimal(formatter, el->data.integerValue);
+            break;
+        case BCD_ELEMENT_STRING:
+            put_json_string(formatter, element_string(el));
+            break;
+        case BCD_ELEMENT_BOOLEAN:
+            put_text(formatter, el->data.boolValue ? "true" : "false");
+            break;
+        case BCD_ELEMENT_BINARY:
+            put_char(formatter, '"');
+            put_hex_bytes(formatter, el->data.binaryValue.data, el->data.binaryValue.size);
+            put_char(formatter, '"');
+            break;
+        default:
+            put_text(formatter, "null");
+            break;
+        }
+        put_char(formatter, '}');
+    }
+    put_text(formatter, "]}");
+}
+
+/* The store, identifier and type columns of a row. */
+static void put_csv_object_columns(BCD_FORMATTER *formatter, const BCD_OBJECT *obj)
+{
+    if (formatter->store) {
+        put_csv_field(formatter, formatter->store);
+        put_char(formatter, ',');
+    }
+    put_guid(formatter, &obj->id);
+    put_char(formatter, ',');
+    put_hex32(formatter, obj->objectType);
+    put_char(formatter, ',');
+}
+
+static void write_csv_object(BCD_FORMATTER *formatter, BCD_OBJECT *obj)
+{
+    size_t count = BcdObjectGetElementCount(obj);
+    size_t rows = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const BCD_ELEMENT *el = BcdObjectGetElementAt(obj, i);
+        if (!el) continue;
+        const BCD_ELEMENT_META *meta = BcdLookupElementById(el->type);
+        put_csv_object_columns(formatter, obj);
+        put_hex32(formatter, el->type);
+        put_char(formatter, ',');
+        if (meta) put_csv_field(formatter, meta->name);
+        put_char(formatter, ',');
+        put_text(formatter, kind_name(el->kind));
+        put_char(formatter, ',');
+        switch (el->kind) {
+        case BCD_ELEMENT_INTEGER:
+            put_decimal(formatter, el->data.integerValue);
+            break;
+        case BCD_ELEMENT_STRING:
+            put_csv_field(formatter, element_string(el));
+            break;
+        case BCD_ELEMENT_BOOLEAN:
+            put_text(formatter, el->data.boolValue ? "true" : "false");
+            break;
+        case BCD_ELEMENT_BINARY:
+            put_hex_bytes(formatter, el->data.binaryValue.data, el->data.binaryValue.size);
+            break;
+        default:
+            break;
+        }
+        put_char(formatter, '\n');
+        ++rows;
+    }
+    if (rows == 0) {
+        put_csv_object_columns(formatter, obj);
+        put_text(formatter, ",,,\n");
+    }
+}
+
+void BcdFormatterBegin(BCD_FORMATTER *formatter, FILE *out, BCD_OUTPUT_FORMAT format, int verbose,
+                       const char *store)
+{
+    formatter->out = out;
+    formatter->format = format;
+    formatter->verbose = verbose;
+    formatter->store = store;
+    formatter->objectCount = 0;
+    formatter->status = BCD_OK;
+    formatter->length = 0;
+    switch (format) {
+    case BCD_FORMAT_JSON:
+        if (store) {
+            put_text(formatter, "{\"store\":");
+            put_json_string(formatter, store);
+            put_text(formatter, ",\"objects\":[");
+        } else {
+            put_char(formatter, '[');
+        }
+        break;
+    case BCD_FORMAT_CSV:
+        if (!store) put_text(formatter, BCD_CSV_HEADER);
+        break;
+    default:
+        if (store) {
+            put_text(formatter, "==> ");
+            put_text(formatter, store);
+            put_text(formatter, " <==\n");
+        }
+        break;
+    }
+}
+
+void BcdFormatterWriteObject(BCD_FORMATTER *formatter, BCD_OBJECT *object)
+{
+    if (!object) return;
+    switch (formatter->format) {
+    case BCD_FORMAT_JSON:
+        if (formatter->objectCount) put_text(formatter, formatter->store ? "," : ",\n");
+        else if (!formatter->store) put_char(formatter, '\n');
+        write_json_object(formatter, object);
+        break;
+    case BCD_FORMAT_CSV:
+        write_csv_object(formatter, object);
+        break;
+    default:
+        write_text_object(formatter, object);
+        break;
+    }
+    formatter->objectCount++;
+}
+
+int BcdFormatterEnd(BCD_FORMATTER *formatter)
+{
+    if (formatter->format == BCD_FORMAT_JSON) {
+        if (formatter->store) put_text(formatter, "]}\n");
+        else put_text(formatter, formatter->objectCount ? "\n]\n" : "]\n");
+    }
+    return BcdFormatterFlush(formatter);
+}
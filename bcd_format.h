@@ -0,0 +1,62 @@
+#ifndef BCD_FORMAT_H
+#define BCD_FORMAT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "bcd.h"
+
+/* Buffered renderer for /enum output.
+ *
+ * Objects are rendered into a fixed buffer inside the formatter with
+ * hand-rolled hex and decimal encoders (GUIDs through BcdFormatObjectId),
+ * and the buffer goes to the stream in one fwrite whenever it fills and at
+ * the end, so printing a store makes no allocations and no per-line stdio
+ * calls.
+ *
+ * Text is the human /enum layout. JSON is an array with one object per line:
+ *   {"identifier":"{...}","type":"0x10100002","elements":[
+ *    {"type":"0x12000004","name":"description","kind":"string","value":"..."}]}
+ * (without the line break), where integer values are numbers, booleans are
+ * true/false, binary values are hex strings and unknown ones null. CSV has one
+ * row per element (or one with empty element columns for an object without
+ * elements) under the header BCD_CSV_HEADER, with values as in JSON.
+ *
+ * Output tagged with a store path is meant for output from many stores: text
+ * starts with "==> path <==", JSON is a single line {"store":"path",
+ * "objects":[...]}, and CSV rows get a leading store column (header
+ * BCD_CSV_TAGGED_HEADER, which is left to the caller). */
+
+#define BCD_CSV_HEADER "identifier,type,element,name,kind,value\n"
+#define BCD_CSV_TAGGED_HEADER "store,identifier,type,element,name,kind,value\n"
+
+#define BCD_FORMATTER_BUFFER_SIZE 32768
+
+typedef enum {
+    BCD_FORMAT_TEXT = 0,
+    BCD_FORMAT_JSON,
+    BCD_FORMAT_CSV
+} BCD_OUTPUT_FORMAT;
+
+typedef struct BCD_FORMATTER {
+    FILE *out;
+    BCD_OUTPUT_FORMAT format;
+    int verbose;            /* text: element ids and object types */
+    const char *store;      /* tag, or NULL */
+    size_t objectCount;     /* objects written so far */
+    int status;             /* BCD_ERR_IO once a write has failed */
+    size_t length;
+    char buffer[BCD_FORMATTER_BUFFER_SIZE];
+} BCD_FORMATTER;
+
+/* Writes the opening of the output (JSON bracket, CSV header, text tag). */
+void BcdFormatterBegin(BCD_FORMATTER *formatter, FILE *out, BCD_OUTPUT_FORMAT format, int verbose,
+                       const char *store);
+/* Renders an object, materializing it if it is pending. */
+void BcdFormatterWriteObject(BCD_FORMATTER *formatter, BCD_OBJECT *object);
+int BcdFormatterFlush(BCD_FORMATTER *formatter);
+/* Writes the closing of the output and flushes; returns BCD_OK or BCD_ERR_IO
+ * if any write failed. */
+int BcdFormatterEnd(BCD_FORMATTER *formatter);
+
+#endif /* BCD_FORMAT_H */
@@ -1,5 +1,13 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "bcd_parser.h"
+#include "bcd_stats.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,104 +20,317 @@
 #define REG_TYPE_MULTI_SZ 7
 #define REG_TYPE_QWORD 11
 
-static uint32_t parse_hex_to_uint32(const char *text, size_t len, int *ok)
-{
-    uint32_t value = 0;
-    *ok = 0;
-    for (size_t i = 0; i < len; ++i) {
-        char c = text[i];
-        int digit;
-        if (c >= '0' && c <= '9') digit = c - '0';
-        else if (c >= 'a' && c <= 'f') digit = 10 + (c - 'a');
-        else if (c >= 'A' && c <= 'F') digit = 10 + (c - 'A');
-        else return 0;
-        value = (value << 4) | (uint32_t)digit;
-    }
-    *ok = 1;
-    return value;
+static int parse_object_name(REGF_NAME name, BCD_OBJECT_ID *id)
+{
+    if (!name.wide) return BcdParseObjectIdN(name.data, name.length, id);
+    char text[BCD_ID_STRING_LENGTH + 2];
+    if (RegfNameCopy(name, text, sizeof(text)) != BCD_ID_STRING_LENGTH) return BCD_ERR_PARSE;
+    return BcdParseObjectId(text, id);
 }
 
-static void fill_object_defaults(BCD_OBJECT *obj)
+/* Copy a value's data, segment by segment, into a payload of dataSize bytes. */
+static int stream_value_data(REGF_DATA_CURSOR *cursor, unsigned char *payload, size_t dataSize)
 {
-    memset(obj, 0, sizeof(*obj));
+    size_t copied = 0;
+    const void *chunk = NULL;
+    size_t chunkSize = 0;
+    int rc;
+    while ((rc = RegfValueDataNext(cursor, &chunk, &chunkSize)) == 1) {
+        if (chunkSize > dataSize - copied) return BCD_ERR_PARSE;
+        memcpy(payload + copied, chunk, chunkSize);
+        copied += chunkSize;
+    }
+    return (rc == 0 && copied == dataSize) ? BCD_OK : BCD_ERR_PARSE;
 }
 
-int BcdStoreLoadFromHive(BCD_STORE *store, REGF_HIVE *hive)
+/* Add the object described by objKey (id, type, source cell) without its
+ * elements. *outObj is NULL when the key is not an object and was skipped. */
+static int load_object_header(BCD_STORE *store, REGF_KEY *objKey, BCD_OBJECT **outObj)
 {
-    if (!store || !hive) return BCD_ERR_INVALID_ARG;
-    BcdStoreReset(store);
-    REGF_KEY *root = RegfGetRootKey(hive);
-    if (!root) return BCD_ERR_PARSE;
+    *outObj = NULL;
+    BCD_OBJECT header;
+    memset(&header, 0, sizeof(header));
+    if (parse_object_name(RegfGetKeyName(objKey), &header.id) != BCD_OK) return BCD_OK;
+    REGF_VALUE *typeValue = RegfFindValue(objKey, BCD_OBJECT_TYPE_VALUE);
+    if (typeValue) {
+        int ok = 0;
+        uint32_t type = RegfGetValueDataAsUint32(typeValue, &ok);
+        if (ok) header.objectType = type;
+        RegfReleaseValue(typeValue);
+    }
+    if (BcdStoreAddObject(store, &header) != BCD_OK) return BCD_ERR_CAPACITY;
+    BCD_OBJECT *obj = BcdStoreGetObjectAt(store, BcdStoreGetObjectCount(store) - 1);
+    obj->sourceCell = (uint32_t)RegfGetKeyOffset(objKey);
+    *outObj = obj;
+    return BCD_OK;
+}
 
-    int objectCount = RegfGetSubKeyCount(root);
-    for (int i = 0; i < objectCount; ++i) {
-        REGF_KEY *objKey = RegfGetSubKeyAt(root, i);
-        if (!objKey) continue;
-        BCD_OBJECT obj;
-        fill_object_defaults(&obj);
-        if (BcdParseObjectId(RegfGetKeyName(objKey), &obj.id) != BCD_OK) {
-            RegfReleaseKey(objKey);
+/* objKey is borrowed: every caller releases it exactly once, including when
+ * decoding fails part way, so no path here may release it. legacy is set for
+ * stores whose element ids predate the catalog. */
+static int load_elements(BCD_OBJECT *obj, REGF_KEY *objKey, int legacy)
+{
+    int valCount = RegfGetValueCount(objKey);
+    for (int v = 0; v < valCount; ++v) {
+        REGF_VALUE *val = RegfGetValueAt(objKey, v);
+        if (!val) {
+            BCD_STATS_INC(BCD_STAT_ELEMENTS_SKIPPED);
+            continue;
+        }
+        int ok = 0;
+        uint32_t elementType = 0;
+        REGF_NAME name = RegfGetValueName(val);
+        if (RegfNameParseHex32(name, &elementType) != BCD_OK) {
+            if (!RegfNameEquals(name, BCD_OBJECT_TYPE_VALUE)) BCD_STATS_INC(BCD_STAT_ELEMENTS_SKIPPED);
+            RegfReleaseValue(val);
             continue;
         }
-        obj.objectType = 0;
-
-        int valCount = RegfGetValueCount(objKey);
-        for (int v = 0; v < valCount; ++v) {
-            REGF_VALUE *val = RegfGetValueAt(objKey, v);
-            if (!val) continue;
-            BCD_ELEMENT element;
-            memset(&element, 0, sizeof(element));
-            const char *name = RegfGetValueName(val);
-            int ok = 0;
-            element.type = parse_hex_to_uint32(name, strlen(name), &ok);
-            if (!ok) {
-                RegfReleaseValue(val);
-                continue;
+        if (legacy) elementType = BcdMigrateLegacyElementId(elementType);
+        uint32_t regType = RegfGetValueType(val);
+        size_t dataSize = RegfGetValueDataSize(val);
+        const void *data = NULL;
+        BCD_ELEMENT *element = NULL;
+        void *payload = NULL;
+        REGF_DATA_CURSOR cursor;
+        int isVariable = regType == REG_TYPE_SZ || regType == REG_TYPE_EXPAND_SZ ||
+                         regType == REG_TYPE_MULTI_SZ || regType == REG_TYPE_BINARY;
+        if (isVariable && RegfValueDataBegin(val, &cursor) != BCD_OK) {
+            element = BcdObjectReserveElement(obj, elementType, BCD_ELEMENT_UNKNOWN, 0, NULL);
+        } else if (isVariable) {
+            int isString = regType != REG_TYPE_BINARY;
+            element = BcdObjectReserveElement(obj, elementType, isString ? BCD_ELEMENT_STRING : BCD_ELEMENT_BINARY,
+                                              dataSize + (isString ? 1 : 0), &payload);
+            if (element && stream_value_data(&cursor, (unsigned char *)payload, dataSize) != BCD_OK) {
+                memset(&element->data, 0, sizeof(element->data));
+                element->kind = BCD_ELEMENT_UNKNOWN;
+            } else if (element && isString) {
+                ((char *)payload)[dataSize] = '\0';
             }
-            uint32_t regType = RegfGetValueType(val);
-            size_t dataSize = 0;
-            const void *data = RegfGetValueData(val, &dataSize);
-            if (!data) {
-                element.kind = BCD_ELEMENT_UNKNOWN;
-            } else if (regType == REG_TYPE_SZ || regType == REG_TYPE_EXPAND_SZ || regType == REG_TYPE_MULTI_SZ) {
-                element.kind = BCD_ELEMENT_STRING;
-                size_t copyLen = dataSize < (BCD_MAX_STRING_LEN - 1) ? dataSize : (BCD_MAX_STRING_LEN - 1);
-                memcpy(element.data.stringValue, data, copyLen);
-                element.data.stringValue[copyLen] = '\0';
-            } else if (regType == REG_TYPE_DWORD) {
-                element.kind = BCD_ELEMENT_INTEGER;
-                element.data.integerValue = (uint64_t)RegfGetValueDataAsUint32(val, &ok);
-                if (!ok) element.kind = BCD_ELEMENT_UNKNOWN;
-            } else if (regType == REG_TYPE_QWORD && dataSize >= 8) {
-                element.kind = BCD_ELEMENT_INTEGER;
+        } else if (!(data = RegfGetValueData(val, &dataSize))) {
+            element = BcdObjectReserveElement(obj, elementType, BCD_ELEMENT_UNKNOWN, 0, NULL);
+        } else if (regType == REG_TYPE_DWORD) {
+            uint32_t dword = RegfGetValueDataAsUint32(val, &ok);
+            element = BcdObjectReserveElement(obj, elementType, ok ? BCD_ELEMENT_INTEGER : BCD_ELEMENT_UNKNOWN, 0, NULL);
+            if (element && ok) element->data.integerValue = (uint64_t)dword;
+        } else if (regType == REG_TYPE_QWORD && dataSize >= 8) {
+            element = BcdObjectReserveElement(obj, elementType, BCD_ELEMENT_INTEGER, 0, NULL);
+            if (element) {
                 const unsigned char *p = (const unsigned char *)data;
-                element.data.integerValue = (uint64_t)p[0] | ((uint64_t)p[1] << 8) |
-                                            ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
-                                            ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
-                                            ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
-            } else if (regType == REG_TYPE_BINARY) {
-                element.kind = BCD_ELEMENT_BINARY;
-                size_t copyLen = dataSize < BCD_MAX_BINARY_SIZE ? dataSize : BCD_MAX_BINARY_SIZE;
-                memcpy(element.data.binaryValue.data, data, copyLen);
-                element.data.binaryValue.size = copyLen;
-            } else {
-                element.kind = BCD_ELEMENT_UNKNOWN;
-            }
-            if (BcdObjectAddElement(&obj, &element) != BCD_OK) {
-                RegfReleaseValue(val);
-                break;
+                element->data.integerValue = (uint64_t)p[0] | ((uint64_t)p[1] << 8) |
+                                             ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+                                             ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+                                             ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
             }
-            RegfReleaseValue(val);
+        } else {
+            element = BcdObjectReserveElement(obj, elementType, BCD_ELEMENT_UNKNOWN, 0, NULL);
+        }
+        RegfReleaseValue(val);
+        if (!element) return BCD_ERR_CAPACITY;
+        BCD_STATS_INC(BCD_STAT_ELEMENTS_LOADED);
+        if (element->kind == BCD_ELEMENT_UNKNOWN) BCD_STATS_INC(BCD_STAT_ELEMENTS_UNKNOWN);
+    }
+    return BCD_OK;
+}
+
+/* Lazy stores defer load_elements until the object is first touched. */
+static int materialize_object(BCD_OBJECT *obj, void *context)
+{
+    REGF_KEY *objKey = RegfGetKeyAtOffset((REGF_HIVE *)context, (int32_t)obj->sourceCell);
+    if (!objKey) return BCD_ERR_PARSE;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_LOAD);
+    int status = load_elements(obj, objKey, RegfIsLegacyBcdHive((REGF_HIVE *)context));
+    BCD_STATS_PHASE_END(outer);
+    RegfReleaseKey(objKey);
+    return status;
+}
+
+static int load_range(BCD_STORE *store, REGF_KEY *root, int begin, int end, int lazy, int legacy)
+{
+    for (int i = begin; i < end; ++i) {
+        REGF_KEY *objKey = RegfGetSubKeyAt(root, i);
+        if (!objKey) {
+            BCD_STATS_INC(BCD_STAT_OBJECTS_SKIPPED);
+            continue;
         }
-        if (BcdStoreAddObject(store, &obj) != BCD_OK) {
-            RegfReleaseKey(objKey);
-            return BCD_ERR_CAPACITY;
+        BCD_OBJECT *obj = NULL;
+        int status = load_object_header(store, objKey, &obj);
+        if (status == BCD_OK && obj) {
+            BCD_STATS_INC(BCD_STAT_OBJECTS_LOADED);
+            if (lazy) obj->pending = 1;
+            else status = load_elements(obj, objKey, legacy);
+            obj->dirty = 0;
+        } else if (status == BCD_OK) {
+            BCD_STATS_INC(BCD_STAT_OBJECTS_SKIPPED);
         }
         RegfReleaseKey(objKey);
+        if (status != BCD_OK) return status;
     }
     return BCD_OK;
 }
 
+static int load_store(BCD_STORE *store, REGF_HIVE *hive, int lazy)
+{
+    BcdStoreReset(store);
+    REGF_KEY *root = RegfGetRootKey(hive);
+    if (!root) return BCD_ERR_PARSE;
+    if (lazy) {
+        store->materialize = materialize_object;
+        store->materializeContext = hive;
+    }
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_LOAD);
+    int status = load_range(store, root, 0, RegfGetSubKeyCount(root), lazy, RegfIsLegacyBcdHive(hive));
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+int BcdStoreLoadFromHive(BCD_STORE *store, REGF_HIVE *hive)
+{
+    if (!store || !hive) return BCD_ERR_INVALID_ARG;
+    return load_store(store, hive, 0);
+}
+
+int BcdStoreLoadFromHiveLazy(BCD_STORE *store, REGF_HIVE *hive)
+{
+    if (!store || !hive) return BCD_ERR_INVALID_ARG;
+    return load_store(store, hive, 1);
+}
+
+struct object_stream {
+    BCD_STORE scratch;
+    uint32_t objectType;
+    BCD_OBJECT_VISITOR visit;
+    void *context;
+    int legacy;
+    int status;
+};
+
+static int stream_object(REGF_KEY *objKey, int depth, void *context)
+{
+    struct object_stream *stream = (struct object_stream *)context;
+    if (depth == 0) return REGF_VISIT_CONTINUE;
+    BcdStoreReset(&stream->scratch);
+    BCD_OBJECT *obj = NULL;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_LOAD);
+    int status = load_object_header(&stream->scratch, objKey, &obj);
+    if (status == BCD_OK && !obj) BCD_STATS_INC(BCD_STAT_OBJECTS_SKIPPED);
+    if (obj && stream->objectType && obj->objectType != stream->objectType) obj = NULL;
+    if (status == BCD_OK && obj) {
+        BCD_STATS_INC(BCD_STAT_OBJECTS_LOADED);
+        status = load_elements(obj, objKey, stream->legacy);
+    }
+    BCD_STATS_PHASE_END(outer);
+    if (status == BCD_OK && obj) status = stream->visit(obj, stream->context);
+    if (status != BCD_OK) {
+        stream->status = status;
+        return REGF_VISIT_STOP;
+    }
+    return REGF_VISIT_SKIP;
+}
+
+int BcdStreamObjectsFromHive(REGF_HIVE *hive, uint32_t objectType, BCD_OBJECT_VISITOR visit, void *context)
+{
+    if (!hive || !visit) return BCD_ERR_INVALID_ARG;
+    REGF_KEY *root = RegfGetRootKey(hive);
+    if (!root) return BCD_ERR_PARSE;
+    struct object_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (BcdStoreInit(&stream.scratch) != BCD_OK) return BCD_ERR_CAPACITY;
+    stream.objectType = objectType;
+    stream.visit = visit;
+    stream.context = context;
+    stream.legacy = RegfIsLegacyBcdHive(hive);
+    REGF_WALK_VISITOR visitor = { stream_object, NULL, &stream };
+    int status = RegfWalk(root, REGF_WALK_DEPTH_FIRST, 1, &visitor);
+    BcdStoreRelease(&stream.scratch);
+    return status != BCD_OK ? status : stream.status;
+}
+
+#ifndef _WIN32
+#define MIN_OBJECTS_PER_WORKER 16
+
+struct load_worker {
+    pthread_t thread;
+    REGF_KEY *root;
+    int begin;
+    int end;
+    int legacy;
+    BCD_STORE store;
+    int status;
+    BCD_STATS stats;        /* counters of a worker run on its own thread */
+};
+
+static void *load_worker_main(void *arg)
+{
+    struct load_worker *worker = (struct load_worker *)arg;
+    worker->status = load_range(&worker->store, worker->root, worker->begin, worker->end, 0, worker->legacy);
+    return NULL;
+}
+
+static void *load_thread_main(void *arg)
+{
+    load_worker_main(arg);
+    BcdStatsSnapshot(&((struct load_worker *)arg)->stats);
+    return NULL;
+}
+
+/* Each worker decodes a contiguous slice of the root's subkeys into its own
+ * store; merging the slices in order reproduces the serial load exactly. */
+int BcdStoreLoadFromHiveParallel(BCD_STORE *store, REGF_HIVE *hive, int threadCount)
+{
+    if (!store || !hive) return BCD_ERR_INVALID_ARG;
+    REGF_KEY *root = RegfGetRootKey(hive);
+    if (!root) return BCD_ERR_PARSE;
+    int objectCount = RegfGetSubKeyCount(root);
+    if (threadCount > objectCount / MIN_OBJECTS_PER_WORKER) threadCount = objectCount / MIN_OBJECTS_PER_WORKER;
+    if (threadCount <= 1) return BcdStoreLoadFromHive(store, hive);
+
+    struct load_worker *workers = (struct load_worker *)calloc((size_t)threadCount, sizeof(struct load_worker));
+    if (!workers) return BCD_ERR_CAPACITY;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_LOAD);
+    BcdStoreReset(store);
+    for (int t = 0; t < threadCount; ++t) {
+        struct load_worker *worker = &workers[t];
+        worker->root = root;
+        worker->begin = (int)((long long)objectCount * t / threadCount);
+        worker->end = (int)((long long)objectCount * (t + 1) / threadCount);
+        worker->legacy = RegfIsLegacyBcdHive(hive);
+        BcdStoreInit(&worker->store);
+    }
+    /* The first slice runs on the calling thread; slices whose thread could
+     * not be started are decoded serially while joining. */
+    int started = 1;
+    while (started < threadCount && pthread_create(&workers[started].thread, NULL, load_thread_main, &workers[started]) == 0) {
+        ++started;
+    }
+    load_worker_main(&workers[0]);
+
+    int status = BCD_OK;
+    for (int t = 0; t < threadCount; ++t) {
+        struct load_worker *worker = &workers[t];
+        if (t > 0 && t < started) {
+            pthread_join(worker->thread, NULL);
+            BcdStatsMerge(&worker->stats);
+        } else if (t >= started) {
+            load_worker_main(worker);
+        }
+        if (status == BCD_OK) {
+            status = BcdStoreMerge(store, &worker->store);
+            if (status == BCD_OK) status = worker->status;
+        }
+        BcdStoreRelease(&worker->store);
+    }
+    free(workers);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+#else
+int BcdStoreLoadFromHiveParallel(BCD_STORE *store, REGF_HIVE *hive, int threadCount)
+{
+    (void)threadCount;
+    return BcdStoreLoadFromHive(store, hive);
+}
+#endif
+
 int BcdStoreSerializeToHive(const BCD_STORE *store, unsigned char **outBuffer, size_t *outSize)
 {
     return RegfSerializeBcdStore(store, outBuffer, outSize);
@@ -5,6 +5,19 @@
 #include "regf.h"
 
 int BcdStoreLoadFromHive(BCD_STORE *store, REGF_HIVE *hive);
+/* Opt-in multi-threaded load; produces the same store as BcdStoreLoadFromHive.
+ * Falls back to the serial loader for small hives or threadCount <= 1. */
+int BcdStoreLoadFromHiveParallel(BCD_STORE *store, REGF_HIVE *hive, int threadCount);
+/* Load object ids and types only; each object's elements are decoded from the
+ * hive on first access. The hive must stay open while the store is in use. */
+int BcdStoreLoadFromHiveLazy(BCD_STORE *store, REGF_HIVE *hive);
+/* Hand the hive's objects to visit one at a time, in key order, without
+ * building a store: each object (of objectType, or any type when 0) is decoded
+ * into a scratch store that is reset before the next one, so memory use does
+ * not grow with the hive. A visit result other than BCD_OK ends the walk and
+ * is returned. */
+typedef int (*BCD_OBJECT_VISITOR)(BCD_OBJECT *object, void *context);
+int BcdStreamObjectsFromHive(REGF_HIVE *hive, uint32_t objectType, BCD_OBJECT_VISITOR visit, void *context);
 int BcdStoreSerializeToHive(const BCD_STORE *store, unsigned char **outBuffer, size_t *outSize);
 
 #endif /* BCD_PARSER_H */
@@ -0,0 +1,253 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "bcd_scan.h"
+
+#include "bcd_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+
+/* Tasks a worker has yet to start, [next, end). */
+struct scan_range {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+};
+
+enum {
+    RESULT_PENDING,
+    RESULT_DONE,
+    RESULT_FAILED
+};
+
+struct scan_result {
+    char *text;
+    size_t length;
+    int state;
+};
+
+struct scan_pool {
+    size_t taskCount;
+    BCD_SCAN_TASK task;
+    void *context;
+    FILE *out;
+    struct scan_range *ranges;
+    int workerCount;
+    struct scan_result *results;
+    pthread_mutex_t outputLock;     /* results, nextToEmit, status and failedTask */
+    size_t nextToEmit;
+    int status;
+    size_t failedTask;
+};
+
+struct scan_worker {
+    pthread_t thread;
+    struct scan_pool *pool;
+    int index;
+    BCD_STATS stats;        /* counters of a worker run on its own thread */
+};
+
+static int is_cancelled(struct scan_pool *pool)
+{
+    pthread_mutex_lock(&pool->outputLock);
+    int cancelled = pool->status != BCD_OK;
+    pthread_mutex_unlock(&pool->outputLock);
+    return cancelled;
+}
+
+static size_t range_remaining(struct scan_range *range)
+{
+    pthread_mutex_lock(&range->lock);
+    size_t remaining = range->end - range->next;
+    pthread_mutex_unlock(&range->lock);
+    return remaining;
+}
+
+/* Move the back half of the fullest other range into the worker's own, which
+ * is empty, and take its first task. Only one range lock is held at a time,
+ * so a victim drained between the survey and the steal just means another
+ * survey. */
+static int steal_task(struct scan_pool *pool, int worker, size_t *index)
+{
+    for (;;) {
+        int victim = -1;
+        size_t most = 0;
+        for (int w = 0; w < pool->workerCount; ++w) {
+            if (w == worker) continue;
+            size_t remaining = range_remaining(&pool->ranges[w]);
+            if (remaining > most) {
+                most = remaining;
+                victim = w;
+            }
+        }
+        if (victim < 0) return 0;
+
+        struct scan_range *from = &pool->ranges[victim];
+        pthread_mutex_lock(&from->lock);
+        size_t remaining = from->end - from->next;
+        size_t begin = from->end - (remaining + 1) / 2;
+        size_t end = from->end;
+        from->end = begin;
+        pthread_mutex_unlock(&from->lock);
+        if (remaining == 0) continue;
+
+        struct scan_range *own = &pool->ranges[worker];
+        pthread_mutex_lock(&own->lock);
+        own->next = begin + 1;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        *index = begin;
+        return 1;
+    }
+}
+
+static int take_task(struct scan_pool *pool, int worker, size_t *index)
+{
+    if (is_cancelled(pool)) return 0;
+    struct scan_range *own = &pool->ranges[worker];
+    pthread_mutex_lock(&own->lock);
+    int found = own->next < own->end;
+    if (found) *index = own->next++;
+    pthread_mutex_unlock(&own->lock);
+    return found || steal_task(pool, worker, index);
+}
+
+/* Record a task's result and write out every finished task that is now next
+ * in line. */
+static void finish_task(struct scan_pool *pool, size_t index, int status, char *text, size_t length)
+{
+    pthread_mutex_lock(&pool->outputLock);
+    struct scan_result *result = &pool->results[index];
+    result->text = text;
+    result->length = length;
+    result->state = status == BCD_OK ? RESULT_DONE : RESULT_FAILED;
+    if (status != BCD_OK && pool->status == BCD_OK) {
+        pool->status = status;
+        pool->failedTask = index;
+    }
+    while (pool->nextToEmit < pool->taskCount && pool->results[pool->nextToEmit].state == RESULT_DONE) {
+        result = &pool->results[pool->nextToEmit++];
+        if (result->length > 0) fwrite(result->text, 1, result->length, pool->out);
+        free(result->text);
+        result->text = NULL;
+    }
+    pthread_mutex_unlock(&pool->outputLock);
+}
+
+static void run_worker(struct scan_pool *pool, int worker)
+{
+    size_t index = 0;
+    while (take_task(pool, worker, &index)) {
+        char *text = NULL;
+        size_t length = 0;
+        FILE *buffer = open_memstream(&text, &length);
+        int status = buffer ? pool->task(index, worker, buffer, pool->context) : BCD_ERR_CAPACITY;
+        if (buffer && fclose(buffer) != 0 && status == BCD_OK) status = BCD_ERR_CAPACITY;
+        finish_task(pool, index, status, text, length);
+    }
+}
+
+static void *scan_thread_main(void *arg)
+{
+    struct scan_worker *worker = (struct scan_worker *)arg;
+    run_worker(worker->pool, worker->index);
+    BcdStatsSnapshot(&worker->stats);
+    return NULL;
+}
+
+int BcdScanRun(size_t taskCount, int workerCount, BCD_SCAN_TASK task, void *context, FILE *out,
+               size_t *outFailedTask, BCD_STATS *workerStats)
+{
+    if (!task || !out) return BCD_ERR_INVALID_ARG;
+    if (workerStats && workerCount > 0) memset(workerStats, 0, (size_t)workerCount * sizeof(BCD_STATS));
+    if (taskCount == 0) return BCD_OK;
+    if (workerCount < 1) workerCount = 1;
+    if ((size_t)workerCount > taskCount) workerCount = (int)taskCount;
+
+    struct scan_pool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.taskCount = taskCount;
+    pool.task = task;
+    pool.context = context;
+    pool.out = out;
+    pool.workerCount = workerCount;
+    pool.ranges = (struct scan_range *)calloc((size_t)workerCount, sizeof(struct scan_range));
+    pool.results = (struct scan_result *)calloc(taskCount, sizeof(struct scan_result));
+    struct scan_worker *workers = (struct scan_worker *)calloc((size_t)workerCount, sizeof(struct scan_worker));
+    if (!pool.ranges || !pool.results || !workers) {
+        free(pool.ranges);
+        free(pool.results);
+        free(workers);
+        return BCD_ERR_CAPACITY;
+    }
+    pthread_mutex_init(&pool.outputLock, NULL);
+    for (int w = 0; w < workerCount; ++w) {
+        pthread_mutex_init(&pool.ranges[w].lock, NULL);
+        pool.ranges[w].next = taskCount * (size_t)w / (size_t)workerCount;
+        pool.ranges[w].end = taskCount * (size_t)(w + 1) / (size_t)workerCount;
+        workers[w].pool = &pool;
+        workers[w].index = w;
+    }
+
+    /* Worker 0 is the calling thread; the ranges of workers whose thread
+     * could not be started are stolen by the others. */
+    int started = 1;
+    while (started < workerCount && pthread_create(&workers[started].thread, NULL, scan_thread_main, &workers[started]) == 0) {
+        ++started;
+    }
+    BCD_STATS start;
+    BcdStatsSnapshot(&start);
+    run_worker(&pool, 0);
+    if (workerStats) BcdStatsSince(&workerStats[0], &start);
+    for (int w = 1; w < started; ++w) {
+        pthread_join(workers[w].thread, NULL);
+        BcdStatsMerge(&workers[w].stats);
+        if (workerStats) workerStats[w] = workers[w].stats;
+    }
+
+    for (size_t i = 0; i < taskCount; ++i) free(pool.results[i].text);
+    for (int w = 0; w < workerCount; ++w) pthread_mutex_destroy(&pool.ranges[w].lock);
+    pthread_mutex_destroy(&pool.outputLock);
+    if (pool.status != BCD_OK && outFailedTask) *outFailedTask = pool.failedTask;
+    free(workers);
+    free(pool.results);
+    free(pool.ranges);
+    return pool.status;
+}
+
+int BcdScanDefaultWorkers(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) return count > 1024 ? 1024 : (int)count;
+#endif
+    return 1;
+}
+#else
+int BcdScanRun(size_t taskCount, int workerCount, BCD_SCAN_TASK task, void *context, FILE *out,
+               size_t *outFailedTask, BCD_STATS *workerStats)
+{
+    if (!task || !out) return BCD_ERR_INVALID_ARG;
+    if (workerStats && workerCount > 0) memset(workerStats, 0, (size_t)workerCount * sizeof(BCD_STATS));
+    BCD_STATS start;
+    BcdStatsSnapshot(&start);
+    int status = BCD_OK;
+    for (size_t i = 0; i < taskCount && status == BCD_OK; ++i) {
+        status = task(i, 0, out, context);
+        if (status != BCD_OK && outFailedTask) *outFailedTask = i;
+    }
+    if (workerStats && workerCount > 0) BcdStatsSince(&workerStats[0], &start);
+    return status;
+}
+
+int BcdScanDefaultWorkers(void)
+{
+    return 1;
+}
+#endif
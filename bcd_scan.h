@@ -0,0 +1,40 @@
+#ifndef BCD_SCAN_H
+#define BCD_SCAN_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "bcd.h"
+#include "bcd_stats.h"
+
+/* Work-stealing pool running one task per input (POSIX threads; elsewhere
+ * tasks run in order on the calling thread and write straight to out).
+ *
+ * Each worker starts with an equal, contiguous range of task indices and
+ * takes tasks from the front of its own range; a worker that runs dry steals
+ * the back half of the largest range left. Every task writes to a private
+ * buffer, and buffers are copied to out in task order as soon as all earlier
+ * tasks are done, so the output matches a serial run.
+ *
+ * The first task to fail cancels the run: no further tasks are started, and
+ * out receives only the output of the tasks before the first one that did not
+ * complete, i.e. a prefix of the serial run's output. */
+
+/* Runs task index on the given worker (0..workerCount-1; worker 0 is the
+ * calling thread), writing its output to out. Tasks on one worker never run
+ * concurrently, so per-worker state can be indexed by worker. Anything other
+ * than BCD_OK cancels the run. */
+typedef int (*BCD_SCAN_TASK)(size_t index, int worker, FILE *out, void *context);
+
+/* Counters of the other workers are merged into the calling thread's
+ * statistics. workerStats, when given, has room for workerCount entries and
+ * receives each worker's own counters and phase times (zero for workers that
+ * did not run). Returns the first failure, with its task in *outFailedTask
+ * when given, or BCD_OK. */
+int BcdScanRun(size_t taskCount, int workerCount, BCD_SCAN_TASK task, void *context, FILE *out,
+               size_t *outFailedTask, BCD_STATS *workerStats);
+
+/* Online processors, at least 1. */
+int BcdScanDefaultWorkers(void);
+
+#endif /* BCD_SCAN_H */
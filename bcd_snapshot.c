@@ -0,0 +1,561 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "bcd_snapshot.h"
+
+#include "bcd_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const unsigned char SNAPSHOT_MAGIC[8] = { 'B', 'C', 'D', 'S', 'N', 'A', 'P', '\0' };
+
+/* Header fields. */
+#define HDR_VERSION 0x08
+#define HDR_HEADER_SIZE 0x0c
+#define HDR_OBJECT_COUNT 0x10
+#define HDR_ELEMENT_COUNT 0x14
+#define HDR_OBJECT_TABLE 0x18
+#define HDR_ELEMENT_TABLE 0x20
+#define HDR_PAYLOAD 0x28
+#define HDR_PAYLOAD_SIZE 0x30
+#define HDR_SOURCE_SIZE 0x38
+#define HDR_SOURCE_HASH 0x40
+#define HDR_SOURCE_PATH 0x48        /* payload offset of the path */
+#define HDR_SOURCE_PATH_LENGTH 0x50 /* without its NUL; 0 when there is none */
+#define HEADER_SIZE 0x58
+
+/* Object record fields. */
+#define OBJ_ID 0x00
+#define OBJ_TYPE 0x10
+#define OBJ_FIRST_ELEMENT 0x14
+#define OBJ_ELEMENT_COUNT 0x18
+#define OBJECT_RECORD_SIZE 0x20
+
+/* Element record fields; VALUE holds the integer or boolean, or the payload
+ * offset of a string or binary whose size is in SIZE. */
+#define EL_TYPE 0x00
+#define EL_KIND 0x04
+#define EL_VALUE 0x08
+#define EL_SIZE 0x10
+#define ELEMENT_RECORD_SIZE 0x18
+
+struct BCD_SNAPSHOT {
+    const unsigned char *data;
+    size_t size;
+    void *mapping;              /* mmap view backing data */
+    unsigned char *owned;       /* heap copy backing data when not mapped */
+    uint32_t objectCount;
+    uint32_t elementCount;
+    const unsigned char *objects;
+    const unsigned char *elements;
+    const unsigned char *payload;
+    uint64_t payloadSize;
+    char *sourcePath;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+};
+
+static uint16_t get_uint16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_uint32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_uint64(const unsigned char *p)
+{
+    return (uint64_t)get_uint32(p) | ((uint64_t)get_uint32(p + 4) << 32);
+}
+
+static void put_uint16(unsigned char *p, uint16_t v)
+{
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+}
+
+static void put_uint32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+    p[2] = (unsigned char)((v >> 16) & 0xff);
+    p[3] = (unsigned char)((v >> 24) & 0xff);
+}
+
+static void put_uint64(unsigned char *p, uint64_t v)
+{
+    put_uint32(p, (uint32_t)v);
+    put_uint32(p + 4, (uint32_t)(v >> 32));
+}
+
+/* A whole file, mapped read-only where possible and read into memory otherwise. */
+struct file_view {
+    const unsigned char *data;
+    size_t size;
+    void *mapping;
+    unsigned char *owned;
+};
+
+static int read_stream(FILE *f, struct file_view *view)
+{
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    unsigned char *buffer = (unsigned char *)malloc(capacity);
+    if (!buffer) return BCD_ERR_CAPACITY;
+    size_t n;
+    while ((n = fread(buffer + size, 1, capacity - size, f)) > 0) {
+        size += n;
+        if (size < capacity) continue;
+        unsigned char *grown = (unsigned char *)realloc(buffer, capacity * 2);
+        if (!grown) {
+            free(buffer);
+            return BCD_ERR_CAPACITY;
+        }
+        buffer = grown;
+        capacity *= 2;
+    }
+    if (ferror(f)) {
+        free(buffer);
+        return BCD_ERR_IO;
+    }
+    view->data = buffer;
+    view->size = size;
+    view->owned = buffer;
+    return BCD_OK;
+}
+
+static int open_view(const char *path, struct file_view *view)
+{
+    memset(view, 0, sizeof(*view));
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return BCD_ERR_IO;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (uintmax_t)st.st_size <= (uintmax_t)SIZE_MAX) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            view->data = (const unsigned char *)map;
+            view->size = (size_t)st.st_size;
+            view->mapping = map;
+            return BCD_OK;
+        }
+    }
+    FILE *f = fdopen(fd, "rb");
+    if (!f) {
+        close(fd);
+        return BCD_ERR_IO;
+    }
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f) return BCD_ERR_IO;
+#endif
+    int status = read_stream(f, view);
+    fclose(f);
+    return status;
+}
+
+static void close_view(struct file_view *view)
+{
+#ifndef _WIN32
+    if (view->mapping) munmap(view->mapping, view->size);
+#endif
+    free(view->owned);
+    memset(view, 0, sizeof(*view));
+}
+
+int BcdSnapshotHashFile(const char *path, uint64_t *outHash, uint64_t *outSize)
+{
+    if (!path || !outHash || !outSize) return BCD_ERR_INVALID_ARG;
+    struct file_view view;
+    int status = open_view(path, &view);
+    if (status != BCD_OK) return status;
+    *outHash = BcdHashBytes(view.data, view.size, BCD_HASH_SEED);
+    *outSize = (uint64_t)view.size;
+    close_view(&view);
+    return BCD_OK;
+}
+
+/* GUIDs compare field by field, which matches the order of their text form. */
+static int compare_ids(const BCD_OBJECT_ID *a, const BCD_OBJECT_ID *b)
+{
+    if (a->data1 != b->data1) return a->data1 < b->data1 ? -1 : 1;
+    if (a->data2 != b->data2) return a->data2 < b->data2 ? -1 : 1;
+    if (a->data3 != b->data3) return a->data3 < b->data3 ? -1 : 1;
+    return memcmp(a->data4, b->data4, sizeof(a->data4));
+}
+
+static int compare_objects(const void *a, const void *b)
+{
+    return compare_ids(&(*(BCD_OBJECT *const *)a)->id, &(*(BCD_OBJECT *const *)b)->id);
+}
+
+static void put_id(unsigned char *p, const BCD_OBJECT_ID *id)
+{
+    put_uint32(p, id->data1);
+    put_uint16(p + 4, id->data2);
+    put_uint16(p + 6, id->data3);
+    memcpy(p + 8, id->data4, sizeof(id->data4));
+}
+
+static void get_id(const unsigned char *p, BCD_OBJECT_ID *id)
+{
+    id->data1 = get_uint32(p);
+    id->data2 = get_uint16(p + 4);
+    id->data3 = get_uint16(p + 6);
+    memcpy(id->data4, p + 8, sizeof(id->data4));
+}
+
+static size_t payload_size(const BCD_ELEMENT *element)
+{
+    if (element->kind == BCD_ELEMENT_STRING) {
+        return element->data.stringValue ? strlen(element->data.stringValue) + 1 : 1;
+    }
+    return element->kind == BCD_ELEMENT_BINARY ? element->data.binaryValue.size : 0;
+}
+
+struct snapshot_layout {
+    size_t objectCount;
+    size_t elementCount;
+    size_t payloadSize;
+    size_t pathLength;
+    size_t size;
+};
+
+static int measure_snapshot(BCD_STORE *store, const BCD_SNAPSHOT_SOURCE *source, struct snapshot_layout *layout)
+{
+    int status = BcdStoreMaterialize(store);
+    if (status != BCD_OK) return status;
+    memset(layout, 0, sizeof(*layout));
+    layout->objectCount = BcdStoreGetObjectCount(store);
+    for (size_t i = 0; i < layout->objectCount; ++i) {
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(store, i);
+        size_t count = BcdObjectGetElementCount(obj);
+        layout->elementCount += count;
+        for (size_t e = 0; e < count; ++e) layout->payloadSize += payload_size(BcdObjectGetElementAt(obj, e));
+    }
+    if (source && source->path) {
+        layout->pathLength = strlen(source->path);
+        layout->payloadSize += layout->pathLength + 1;
+    }
+    if (layout->objectCount > UINT32_MAX || layout->elementCount > UINT32_MAX) return BCD_ERR_CAPACITY;
+    size_t tables = HEADER_SIZE + layout->objectCount * OBJECT_RECORD_SIZE + layout->elementCount * ELEMENT_RECORD_SIZE;
+    if (layout->payloadSize > SIZE_MAX - tables) return BCD_ERR_CAPACITY;
+    layout->size = tables + layout->payloadSize;
+    return BCD_OK;
+}
+
+int BcdSnapshotMeasure(BCD_STORE *store, const BCD_SNAPSHOT_SOURCE *source, size_t *outSize)
+{
+    if (!store || !outSize) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_SERIALIZE);
+    struct snapshot_layout layout;
+    int status = measure_snapshot(store, source, &layout);
+    if (status == BCD_OK) *outSize = layout.size;
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+static void emit_snapshot(BCD_OBJECT **order, const struct snapshot_layout *layout,
+                          const BCD_SNAPSHOT_SOURCE *source, unsigned char *out)
+{
+    size_t objectTable = HEADER_SIZE;
+    size_t elementTable = objectTable + layout->objectCount * OBJECT_RECORD_SIZE;
+    size_t payload = elementTable + layout->elementCount * ELEMENT_RECORD_SIZE;
+    unsigned char *objectRecord = out + objectTable;
+    unsigned char *elementRecord = out + elementTable;
+    size_t payloadUsed = 0;
+    uint32_t elementIndex = 0;
+    for (size_t i = 0; i < layout->objectCount; ++i) {
+        BCD_OBJECT *obj = order[i];
+        size_t count = BcdObjectGetElementCount(obj);
+        put_id(objectRecord + OBJ_ID, &obj->id);
+        put_uint32(objectRecord + OBJ_TYPE, obj->objectType);
+        put_uint32(objectRecord + OBJ_FIRST_ELEMENT, elementIndex);
+        put_uint32(objectRecord + OBJ_ELEMENT_COUNT, (uint32_t)count);
+        objectRecord += OBJECT_RECORD_SIZE;
+        for (size_t e = 0; e < count; ++e) {
+            const BCD_ELEMENT *el = BcdObjectGetElementAt(obj, e);
+            size_t size = payload_size(el);
+            put_uint32(elementRecord + EL_TYPE, el->type);
+            put_uint32(elementRecord + EL_KIND, (uint32_t)el->kind);
+            if (el->kind == BCD_ELEMENT_INTEGER) {
+                put_uint64(elementRecord + EL_VALUE, el->data.integerValue);
+            } else if (el->kind == BCD_ELEMENT_BOOLEAN) {
+                put_uint64(elementRecord + EL_VALUE, el->data.boolValue ? 1 : 0);
+            } else if (el->kind == BCD_ELEMENT_STRING || el->kind == BCD_ELEMENT_BINARY) {
+                const void *data = el->kind == BCD_ELEMENT_STRING ? (const void *)el->data.stringValue
+                                                                  : (const void *)el->data.binaryValue.data;
+                if (data && size > 0) memcpy(out + payload + payloadUsed, data, size);
+                put_uint64(elementRecord + EL_VALUE, (uint64_t)payloadUsed);
+                put_uint64(elementRecord + EL_SIZE, (uint64_t)size);
+                payloadUsed += size;
+            }
+            elementRecord += ELEMENT_RECORD_SIZE;
+            ++elementIndex;
+        }
+    }
+
+    memcpy(out, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put_uint32(out + HDR_VERSION, BCD_SNAPSHOT_VERSION);
+    put_uint32(out + HDR_HEADER_SIZE, HEADER_SIZE);
+    put_uint32(out + HDR_OBJECT_COUNT, (uint32_t)layout->objectCount);
+    put_uint32(out + HDR_ELEMENT_COUNT, (uint32_t)layout->elementCount);
+    put_uint64(out + HDR_OBJECT_TABLE, (uint64_t)objectTable);
+    put_uint64(out + HDR_ELEMENT_TABLE, (uint64_t)elementTable);
+    put_uint64(out + HDR_PAYLOAD, (uint64_t)payload);
+    put_uint64(out + HDR_PAYLOAD_SIZE, (uint64_t)layout->payloadSize);
+    if (source) {
+        put_uint64(out + HDR_SOURCE_SIZE, source->size);
+        put_uint64(out + HDR_SOURCE_HASH, source->hash);
+    }
+    if (layout->pathLength > 0) {
+        memcpy(out + payload + payloadUsed, source->path, layout->pathLength + 1);
+        put_uint64(out + HDR_SOURCE_PATH, (uint64_t)payloadUsed);
+        put_uint64(out + HDR_SOURCE_PATH_LENGTH, (uint64_t)layout->pathLength);
+    }
+}
+
+int BcdSnapshotWrite(BCD_STORE *store, const BCD_SNAPSHOT_SOURCE *source, unsigned char *out, size_t size)
+{
+    if (!store || !out) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_SERIALIZE);
+    struct snapshot_layout layout;
+    BCD_OBJECT **order = NULL;
+    int status = measure_snapshot(store, source, &layout);
+    if (status == BCD_OK && size != layout.size) status = BCD_ERR_INVALID_ARG;
+    if (status == BCD_OK && layout.objectCount > 0) {
+        order = (BCD_OBJECT **)malloc(layout.objectCount * sizeof(BCD_OBJECT *));
+        if (!order) status = BCD_ERR_CAPACITY;
+    }
+    if (status == BCD_OK) {
+        for (size_t i = 0; i < layout.objectCount; ++i) order[i] = BcdStoreGetObjectAt(store, i);
+        if (order) qsort(order, layout.objectCount, sizeof(BCD_OBJECT *), compare_objects);
+        memset(out, 0, size);
+        emit_snapshot(order, &layout, source, out);
+    }
+    free(order);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+int BcdSnapshotProbe(const char *path)
+{
+    if (!path || strcmp(path, "-") == 0) return 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    unsigned char magic[sizeof(SNAPSHOT_MAGIC)];
+    int match = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+    return match;
+}
+
+/* True when count records of recordSize bytes starting at offset fit in size. */
+static int table_fits(uint64_t offset, uint64_t count, uint64_t recordSize, uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / recordSize;
+}
+
+static int parse_header(BCD_SNAPSHOT *snapshot)
+{
+    const unsigned char *data = snapshot->data;
+    uint64_t size = (uint64_t)snapshot->size;
+    if (size < HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return BCD_ERR_PARSE;
+    if (get_uint32(data + HDR_VERSION) != BCD_SNAPSHOT_VERSION) return BCD_ERR_PARSE;
+    uint64_t objectTable = get_uint64(data + HDR_OBJECT_TABLE);
+    uint64_t elementTable = get_uint64(data + HDR_ELEMENT_TABLE);
+    uint64_t payload = get_uint64(data + HDR_PAYLOAD);
+    snapshot->objectCount = get_uint32(data + HDR_OBJECT_COUNT);
+    snapshot->elementCount = get_uint32(data + HDR_ELEMENT_COUNT);
+    snapshot->payloadSize = get_uint64(data + HDR_PAYLOAD_SIZE);
+    if (get_uint32(data + HDR_HEADER_SIZE) < HEADER_SIZE ||
+        !table_fits(objectTable, snapshot->objectCount, OBJECT_RECORD_SIZE, size) ||
+        !table_fits(elementTable, snapshot->elementCount, ELEMENT_RECORD_SIZE, size) ||
+        !table_fits(payload, snapshot->payloadSize, 1, size)) {
+        return BCD_ERR_PARSE;
+    }
+    snapshot->objects = data + objectTable;
+    snapshot->elements = data + elementTable;
+    snapshot->payload = data + payload;
+    snapshot->sourceSize = get_uint64(data + HDR_SOURCE_SIZE);
+    snapshot->sourceHash = get_uint64(data + HDR_SOURCE_HASH);
+
+    uint64_t pathOffset = get_uint64(data + HDR_SOURCE_PATH);
+    uint64_t pathLength = get_uint64(data + HDR_SOURCE_PATH_LENGTH);
+    if (pathLength == 0) return BCD_OK;
+    if (!table_fits(pathOffset, pathLength + 1, 1, snapshot->payloadSize) ||
+        snapshot->payload[pathOffset + pathLength] != '\0') {
+        return BCD_ERR_PARSE;
+    }
+    snapshot->sourcePath = (char *)malloc((size_t)pathLength + 1);
+    if (!snapshot->sourcePath) return BCD_ERR_CAPACITY;
+    memcpy(snapshot->sourcePath, snapshot->payload + pathOffset, (size_t)pathLength + 1);
+    return BCD_OK;
+}
+
+int BcdSnapshotOpen(const char *path, BCD_SNAPSHOT **outSnapshot)
+{
+    if (!path || !outSnapshot) return BCD_ERR_INVALID_ARG;
+    *outSnapshot = NULL;
+    BCD_SNAPSHOT *snapshot = (BCD_SNAPSHOT *)calloc(1, sizeof(BCD_SNAPSHOT));
+    if (!snapshot) return BCD_ERR_CAPACITY;
+    struct file_view view;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_READ);
+    int status = open_view(path, &view);
+    BCD_STATS_PHASE_END(outer);
+    if (status != BCD_OK) {
+        free(snapshot);
+        return status;
+    }
+    BCD_STATS_ADD(BCD_STAT_BYTES_READ, view.size);
+    snapshot->data = view.data;
+    snapshot->size = view.size;
+    snapshot->mapping = view.mapping;
+    snapshot->owned = view.owned;
+    BCD_STATS_PHASE_BEGIN(inner, BCD_PHASE_OPEN);
+    status = parse_header(snapshot);
+    BCD_STATS_PHASE_END(inner);
+    if (status != BCD_OK) {
+        BcdSnapshotClose(snapshot);
+        return status;
+    }
+    *outSnapshot = snapshot;
+    return BCD_OK;
+}
+
+void BcdSnapshotClose(BCD_SNAPSHOT *snapshot)
+{
+    if (!snapshot) return;
+    struct file_view view = { snapshot->data, snapshot->size, snapshot->mapping, snapshot->owned };
+    close_view(&view);
+    free(snapshot->sourcePath);
+    free(snapshot);
+}
+
+int BcdSnapshotIsStale(const BCD_SNAPSHOT *snapshot)
+{
+    if (!snapshot || !snapshot->sourcePath) return 0;
+    uint64_t hash = 0;
+    uint64_t size = 0;
+    if (BcdSnapshotHashFile(snapshot->sourcePath, &hash, &size) != BCD_OK) return 0;
+    return size != snapshot->sourceSize || hash != snapshot->sourceHash;
+}
+
+const char *BcdSnapshotGetSourcePath(const BCD_SNAPSHOT *snapshot)
+{
+    return snapshot ? snapshot->sourcePath : NULL;
+}
+
+/* The object table is sorted, so a pending object finds its record by GUID. */
+static const unsigned char *find_object_record(const BCD_SNAPSHOT *snapshot, const BCD_OBJECT_ID *id)
+{
+    size_t lo = 0;
+    size_t hi = snapshot->objectCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const unsigned char *record = snapshot->objects + mid * OBJECT_RECORD_SIZE;
+        BCD_OBJECT_ID recordId;
+        get_id(record + OBJ_ID, &recordId);
+        int cmp = compare_ids(id, &recordId);
+        if (cmp == 0) return record;
+        if (cmp < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+/* Payloads out of bounds, and strings missing their NUL, become unknown
+ * elements as undecodable hive values do. */
+static int load_element(BCD_OBJECT *obj, const BCD_SNAPSHOT *snapshot, const unsigned char *record)
+{
+    uint32_t type = get_uint32(record + EL_TYPE);
+    uint32_t kind = get_uint32(record + EL_KIND);
+    uint64_t value = get_uint64(record + EL_VALUE);
+    uint64_t size = get_uint64(record + EL_SIZE);
+    BCD_ELEMENT *element = NULL;
+    if (kind == BCD_ELEMENT_STRING || kind == BCD_ELEMENT_BINARY) {
+        int fits = table_fits(value, size, 1, snapshot->payloadSize) &&
+                   (kind == BCD_ELEMENT_BINARY || (size > 0 && snapshot->payload[value + size - 1] == '\0'));
+        void *payload = NULL;
+        element = BcdObjectReserveElement(obj, type, fits ? (BCD_ELEMENT_KIND)kind : BCD_ELEMENT_UNKNOWN,
+                                          fits ? (size_t)size : 0, &payload);
+        if (element && fits && size > 0) memcpy(payload, snapshot->payload + value, (size_t)size);
+    } else if (kind == BCD_ELEMENT_INTEGER) {
+        element = BcdObjectReserveElement(obj, type, BCD_ELEMENT_INTEGER, 0, NULL);
+        if (element) element->data.integerValue = value;
+    } else if (kind == BCD_ELEMENT_BOOLEAN) {
+        element = BcdObjectReserveElement(obj, type, BCD_ELEMENT_BOOLEAN, 0, NULL);
+        if (element) element->data.boolValue = value != 0;
+    } else {
+        element = BcdObjectReserveElement(obj, type, BCD_ELEMENT_UNKNOWN, 0, NULL);
+    }
+    if (!element) return BCD_ERR_CAPACITY;
+    BCD_STATS_INC(BCD_STAT_ELEMENTS_LOADED);
+    if (element->kind == BCD_ELEMENT_UNKNOWN) BCD_STATS_INC(BCD_STAT_ELEMENTS_UNKNOWN);
+    return BCD_OK;
+}
+
+static int materialize_object(BCD_OBJECT *obj, void *context)
+{
+    const BCD_SNAPSHOT *snapshot = (const BCD_SNAPSHOT *)context;
+    const unsigned char *record = find_object_record(snapshot, &obj->id);
+    if (!record) return BCD_ERR_NOT_FOUND;
+    uint32_t first = get_uint32(record + OBJ_FIRST_ELEMENT);
+    uint32_t count = get_uint32(record + OBJ_ELEMENT_COUNT);
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_LOAD);
+    int status = BCD_OK;
+    for (uint32_t i = 0; i < count && status == BCD_OK; ++i) {
+        status = load_element(obj, snapshot, snapshot->elements + (size_t)(first + i) * ELEMENT_RECORD_SIZE);
+    }
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+/* Element ranges are checked here so materialize_object can trust them, and
+ * the table order is checked so the binary search above is sound. */
+int BcdStoreLoadFromSnapshot(BCD_STORE *store, BCD_SNAPSHOT *snapshot)
+{
+    if (!store || !snapshot) return BCD_ERR_INVALID_ARG;
+    BcdStoreReset(store);
+    store->materialize = materialize_object;
+    store->materializeContext = snapshot;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_LOAD);
+    int status = BCD_OK;
+    BCD_OBJECT_ID previous;
+    for (uint32_t i = 0; i < snapshot->objectCount && status == BCD_OK; ++i) {
+        const unsigned char *record = snapshot->objects + (size_t)i * OBJECT_RECORD_SIZE;
+        BCD_OBJECT header;
+        memset(&header, 0, sizeof(header));
+        get_id(record + OBJ_ID, &header.id);
+        header.objectType = get_uint32(record + OBJ_TYPE);
+        uint32_t first = get_uint32(record + OBJ_FIRST_ELEMENT);
+        uint32_t count = get_uint32(record + OBJ_ELEMENT_COUNT);
+        if (first > snapshot->elementCount || count > snapshot->elementCount - first ||
+            (i > 0 && compare_ids(&previous, &header.id) >= 0)) {
+            status = BCD_ERR_PARSE;
+            break;
+        }
+        previous = header.id;
+        status = BcdStoreAddObject(store, &header);
+        if (status != BCD_OK) break;
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(store, BcdStoreGetObjectCount(store) - 1);
+        obj->pending = 1;
+        obj->dirty = 0;
+        BCD_STATS_INC(BCD_STAT_OBJECTS_LOADED);
+    }
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
@@ -0,0 +1,65 @@
+#ifndef BCD_SNAPSHOT_H
+#define BCD_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bcd.h"
+
+/* Compact binary image of a decoded store, reloaded without touching the hive.
+ *
+ * All fields are little-endian and every reference is an offset from the start
+ * of the file, so a snapshot can be mapped and read in place. The layout is:
+ *
+ *   header         magic "BCDSNAP\0", version, counts, table offsets, and the
+ *                  size, content hash and path of the hive it was taken from
+ *   object table   32-byte records sorted by GUID: id (in on-disk GUID byte
+ *                  order), object type, first element and element count
+ *   element table  24-byte records grouped by object: element type, kind and
+ *                  either the integer value or a payload offset and size
+ *   payload blob   string (NUL-terminated) and binary payloads, then the
+ *                  source path
+ *
+ * GUIDs sort by their numeric fields, which is the order of their text form
+ * and so the order the writer keeps subkeys in. */
+
+#define BCD_SNAPSHOT_VERSION 1U
+
+typedef struct BCD_SNAPSHOT BCD_SNAPSHOT;
+
+/* The hive a snapshot is taken from; path may be NULL when it has none (e.g.
+ * stdin), in which case the snapshot is never considered stale. */
+typedef struct BCD_SNAPSHOT_SOURCE {
+    const char *path;
+    uint64_t size;
+    uint64_t hash;
+} BCD_SNAPSHOT_SOURCE;
+
+/* Content hash recorded for the source hive; size is its length in bytes. */
+int BcdSnapshotHashFile(const char *path, uint64_t *outHash, uint64_t *outSize);
+
+/* Two-pass writer, as for hives: measure, then fill exactly size bytes. Every
+ * object is materialized first, so lazily loaded stores may be passed. */
+int BcdSnapshotMeasure(BCD_STORE *store, const BCD_SNAPSHOT_SOURCE *source, size_t *outSize);
+int BcdSnapshotWrite(BCD_STORE *store, const BCD_SNAPSHOT_SOURCE *source, unsigned char *out, size_t size);
+
+/* 1 when the file at path starts with the snapshot magic, 0 otherwise. */
+int BcdSnapshotProbe(const char *path);
+/* Map a snapshot and check its header and table bounds. Returns BCD_ERR_IO
+ * when it cannot be read and BCD_ERR_PARSE when it is not a usable snapshot
+ * (including other versions). */
+int BcdSnapshotOpen(const char *path, BCD_SNAPSHOT **outSnapshot);
+void BcdSnapshotClose(BCD_SNAPSHOT *snapshot);
+/* 1 when the recorded source hive still exists but its size or content hash
+ * no longer match, 0 when it is unchanged or gone. */
+int BcdSnapshotIsStale(const BCD_SNAPSHOT *snapshot);
+/* Source path recorded at write time, or NULL. */
+const char *BcdSnapshotGetSourcePath(const BCD_SNAPSHOT *snapshot);
+
+/* Fill store with the snapshot's objects, in table order. Only ids and types
+ * are read up front; each object's elements are copied out of the element
+ * table on first access, so the snapshot must stay open while the store is in
+ * use. */
+int BcdStoreLoadFromSnapshot(BCD_STORE *store, BCD_SNAPSHOT *snapshot);
+
+#endif /* BCD_SNAPSHOT_H */
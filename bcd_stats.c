@@ -0,0 +1,176 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "bcd_stats.h"
+
+#include <string.h>
+
+#if BCD_ENABLE_STATS
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+BCD_STATS_THREAD_LOCAL BCD_STATS g_bcdStats;
+
+static const char *const g_counterNames[BCD_STAT_COUNTER_COUNT] = {
+    "cells_visited",
+    "cell_bytes",
+    "cells_rejected",
+    "bytes_read",
+    "bytes_written",
+    "log_entries_replayed",
+    "log_bytes_replayed",
+    "keys_allocated",
+    "keys_freed",
+    "values_allocated",
+    "values_freed",
+    "handle_blocks",
+    "objects_loaded",
+    "objects_skipped",
+    "elements_loaded",
+    "elements_skipped",
+    "elements_unknown"
+};
+
+static const char *const g_phaseNames[BCD_PHASE_COUNT] = {
+    "other",
+    "read",
+    "open",
+    "load",
+    "command",
+    "serialize",
+    "write"
+};
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Charge the time since the last switch to the current phase. */
+static void charge_phase(void)
+{
+    uint64_t now = now_ns();
+    if (g_bcdStats.phaseStart) g_bcdStats.phaseNanoseconds[g_bcdStats.phase] += now - g_bcdStats.phaseStart;
+    g_bcdStats.phaseStart = now;
+}
+
+int BcdStatsEnter(int phase)
+{
+    int previous = g_bcdStats.phase;
+    charge_phase();
+    g_bcdStats.phase = phase;
+    return previous;
+}
+
+void BcdStatsLeave(int previous)
+{
+    charge_phase();
+    g_bcdStats.phase = previous;
+}
+
+void BcdStatsReset(void)
+{
+    memset(&g_bcdStats, 0, sizeof(g_bcdStats));
+    g_bcdStats.phaseStart = now_ns();
+}
+
+void BcdStatsSnapshot(BCD_STATS *out)
+{
+    if (!out) return;
+    charge_phase();
+    *out = g_bcdStats;
+}
+
+void BcdStatsSince(BCD_STATS *out, const BCD_STATS *start)
+{
+    if (!out || !start) return;
+    BcdStatsSnapshot(out);
+    for (int i = 0; i < BCD_STAT_COUNTER_COUNT; ++i) out->counters[i] -= start->counters[i];
+    for (int i = 0; i < BCD_PHASE_COUNT; ++i) out->phaseNanoseconds[i] -= start->phaseNanoseconds[i];
+}
+
+void BcdStatsMerge(const BCD_STATS *other)
+{
+    if (!other) return;
+    for (int i = 0; i < BCD_STAT_COUNTER_COUNT; ++i) g_bcdStats.counters[i] += other->counters[i];
+}
+
+/* One JSON object; worker is omitted when negative. */
+static void print_stats(FILE *out, const BCD_STATS *stats, int worker)
+{
+    fprintf(out, "{");
+    if (worker >= 0) fprintf(out, "\"worker\": %d, ", worker);
+    fprintf(out, "\"enabled\": true");
+    for (int i = 0; i < BCD_STAT_COUNTER_COUNT; ++i) {
+        fprintf(out, ", \"%s\": %llu", g_counterNames[i], (unsigned long long)stats->counters[i]);
+    }
+    uint64_t total = 0;
+    fprintf(out, ", \"phase_ns\": {");
+    for (int i = 0; i < BCD_PHASE_COUNT; ++i) {
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", g_phaseNames[i],
+                (unsigned long long)stats->phaseNanoseconds[i]);
+        total += stats->phaseNanoseconds[i];
+    }
+    fprintf(out, "}, \"total_ns\": %llu}\n", (unsigned long long)total);
+}
+
+void BcdStatsPrint(FILE *out)
+{
+    charge_phase();
+    print_stats(out, &g_bcdStats, -1);
+}
+
+void BcdStatsPrintWorker(FILE *out, int worker, const BCD_STATS *stats)
+{
+    if (stats) print_stats(out, stats, worker);
+}
+
+#else
+
+void BcdStatsReset(void)
+{
+}
+
+void BcdStatsSnapshot(BCD_STATS *out)
+{
+    if (out) memset(out, 0, sizeof(*out));
+}
+
+void BcdStatsSince(BCD_STATS *out, const BCD_STATS *start)
+{
+    (void)start;
+    BcdStatsSnapshot(out);
+}
+
+void BcdStatsMerge(const BCD_STATS *other)
+{
+    (void)other;
+}
+
+void BcdStatsPrint(FILE *out)
+{
+    fprintf(out, "{\"enabled\": false}\n");
+}
+
+void BcdStatsPrintWorker(FILE *out, int worker, const BCD_STATS *stats)
+{
+    (void)stats;
+    fprintf(out, "{\"worker\": %d, \"enabled\": false}\n", worker);
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef BCD_STATS_H
+#define BCD_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Hot-path counters and per-phase wall time, printed by /stats.
+ *
+ * Counters live in a per-thread block so the hive reader can bump them
+ * without locking; threads that are joined into a result (the parallel loader)
+ * fold their block into the joining thread with BcdStatsMerge. Phase timers
+ * are exclusive: entering a phase charges the time so far to the enclosing
+ * one, so the phases of a run add up to its wall time instead of overlapping.
+ *
+ * Build with -DBCD_ENABLE_STATS=0 to compile every hook to nothing. */
+
+#ifndef BCD_ENABLE_STATS
+#define BCD_ENABLE_STATS 1
+#endif
+
+typedef enum {
+    BCD_STAT_CELLS_VISITED,     /* cells returned by the bounds-checked reader */
+    BCD_STAT_CELL_BYTES,        /* their total size */
+    BCD_STAT_CELLS_REJECTED,    /* offsets failing bounds or alignment checks */
+    BCD_STAT_BYTES_READ,        /* hive bytes mapped or read from disk */
+    BCD_STAT_BYTES_WRITTEN,     /* hive bytes written back to disk */
+    BCD_STAT_LOG_ENTRIES_REPLAYED,  /* transaction log entries applied on open */
+    BCD_STAT_LOG_BYTES_REPLAYED,
+    BCD_STAT_KEYS_ALLOCATED,    /* key handles taken from the hive's pool */
+    BCD_STAT_KEYS_FREED,
+    BCD_STAT_VALUES_ALLOCATED,  /* value handles taken from the hive's pool */
+    BCD_STAT_VALUES_FREED,
+    BCD_STAT_HANDLE_BLOCKS,     /* heap blocks carved into handles */
+    BCD_STAT_OBJECTS_LOADED,
+    BCD_STAT_OBJECTS_SKIPPED,   /* subkeys that are unreadable or not object ids */
+    BCD_STAT_ELEMENTS_LOADED,
+    BCD_STAT_ELEMENTS_SKIPPED,  /* values that are unreadable or not element ids */
+    BCD_STAT_ELEMENTS_UNKNOWN,  /* elements whose data could not be decoded */
+    BCD_STAT_COUNTER_COUNT
+} BCD_STAT_COUNTER;
+
+typedef enum {
+    BCD_PHASE_NONE,
+    BCD_PHASE_READ,
+    BCD_PHASE_OPEN,
+    BCD_PHASE_LOAD,
+    BCD_PHASE_COMMAND,
+    BCD_PHASE_SERIALIZE,
+    BCD_PHASE_WRITE,
+    BCD_PHASE_COUNT
+} BCD_STAT_PHASE;
+
+typedef struct BCD_STATS {
+    uint64_t counters[BCD_STAT_COUNTER_COUNT];
+    uint64_t phaseNanoseconds[BCD_PHASE_COUNT];
+    int phase;
+    uint64_t phaseStart;
+} BCD_STATS;
+
+#if BCD_ENABLE_STATS
+
+#if defined(_MSC_VER)
+#define BCD_STATS_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define BCD_STATS_THREAD_LOCAL __thread
+#else
+#define BCD_STATS_THREAD_LOCAL  /* counters from concurrent loads may race */
+#endif
+
+extern BCD_STATS_THREAD_LOCAL BCD_STATS g_bcdStats;
+
+/* Enter phase and return the enclosing one, which BcdStatsLeave restores. */
+int BcdStatsEnter(int phase);
+void BcdStatsLeave(int previous);
+
+#define BCD_STATS_ADD(counter, n) ((void)(g_bcdStats.counters[counter] += (uint64_t)(n)))
+#define BCD_STATS_INC(counter) BCD_STATS_ADD(counter, 1)
+#define BCD_STATS_PHASE_BEGIN(saved, phase) int saved = BcdStatsEnter(phase)
+#define BCD_STATS_PHASE_END(saved) BcdStatsLeave(saved)
+
+#else
+
+#define BCD_STATS_ADD(counter, n) ((void)0)
+#define BCD_STATS_INC(counter) ((void)0)
+#define BCD_STATS_PHASE_BEGIN(saved, phase)
+#define BCD_STATS_PHASE_END(saved) ((void)0)
+
+#endif
+
+/* Zero the calling thread's counters and timers. */
+void BcdStatsReset(void);
+/* Copy the calling thread's counters and phase times into out, e.g. before a
+ * worker exits. Phase time still running is charged to its phase first. */
+void BcdStatsSnapshot(BCD_STATS *out);
+/* Fill out with what the calling thread accumulated since start, an earlier
+ * snapshot of the same thread. */
+void BcdStatsSince(BCD_STATS *out, const BCD_STATS *start);
+/* Add another thread's counters (not its timers) to the calling thread's. */
+void BcdStatsMerge(const BCD_STATS *other);
+/* Print the calling thread's statistics as a single JSON object. Phase time
+ * still running is charged to its phase first. */
+void BcdStatsPrint(FILE *out);
+/* Print one worker's statistics (a snapshot) as a JSON object tagged with
+ * its index, in the same shape as BcdStatsPrint. */
+void BcdStatsPrintWorker(FILE *out, int worker, const BCD_STATS *stats);
+
+#endif /* BCD_STATS_H */
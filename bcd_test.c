@@ -0,0 +1,2334 @@
+/* Regression tests for the hive reader and writer and the commands built on
+ * them (POSIX only). Build and run with `make check`; each case prints
+ * "ok <name>" or the first failed check, and the exit status is non-zero when
+ * any case failed. Naming cases on the command line runs only those.
+ *
+ * bcdedit.c is compiled in (without its main), as in bcd_bench.c, so edits
+ * are committed through the same code the command line runs. */
+#define BCDEDIT_NO_MAIN
+#include "bcdedit.c"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* The generated catalog, walked entry by entry against the lookups. */
+#include "bcd_element_table.h"
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                            \
+        }                                                                        \
+    } while (0)
+
+typedef int (*TEST_FN)(void);
+
+typedef struct TEST {
+    const char *name;
+    TEST_FN run;
+} TEST;
+
+/* More objects than one lh list can count. */
+#define LARGE_OBJECT_COUNT 70000U
+
+static int make_id(size_t index, BCD_OBJECT_ID *id)
+{
+    memset(id, 0, sizeof(*id));
+    id->data1 = (uint32_t)(index * 2654435761U);
+    id->data2 = (uint16_t)index;
+    id->data3 = (uint16_t)(index >> 16);
+    id->data4[7] = 0x5a;
+    return BCD_OK;
+}
+
+static int add_object(BCD_STORE *store, size_t index)
+{
+    BCD_OBJECT obj;
+    memset(&obj, 0, sizeof(obj));
+    make_id(index, &obj.id);
+    obj.objectType = BCD_OBJECT_OSLOADER;
+    char text[32];
+    snprintf(text, sizeof(text), "object %zu", index);
+    BCD_ELEMENT el;
+    memset(&el, 0, sizeof(el));
+    el.type = BCD_ELEMENT_DESCRIPTION;
+    el.kind = BCD_ELEMENT_STRING;
+    el.data.stringValue = text;
+    int status = BcdObjectAddElement(&obj, &el);
+    if (status == BCD_OK) status = BcdStoreAddObject(store, &obj);
+    BcdObjectRelease(&obj);
+    return status;
+}
+
+/* Every object of 0..count-1 except skip is present with its description. */
+static int check_objects(BCD_STORE *store, size_t count, size_t skip)
+{
+    CHECK(BcdStoreGetObjectCount(store) == count - (skip < count ? 1 : 0));
+    for (size_t i = 0; i < count; ++i) {
+        BCD_OBJECT_ID id;
+        make_id(i, &id);
+        BCD_OBJECT *obj = BcdStoreFindObjectById(store, &id);
+        if (i == skip) {
+            CHECK(obj == NULL);
+            continue;
+        }
+        CHECK(obj != NULL);
+        BCD_ELEMENT *el = BcdObjectFindElement(obj, BCD_ELEMENT_DESCRIPTION);
+        char text[32];
+        snprintf(text, sizeof(text), "object %zu", i);
+        CHECK(el && el->kind == BCD_ELEMENT_STRING && strcmp(el->data.stringValue, text) == 0);
+    }
+    return 0;
+}
+
+static int write_temp(const unsigned char *image, size_t size, char *path)
+{
+    strcpy(path, "/tmp/bcd_test_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return BCD_ERR_IO;
+    FILE *f = fdopen(fd, "wb");
+    int ok = f && fwrite(image, 1, size, f) == size;
+    if (f) ok = fclose(f) == 0 && ok;
+    else close(fd);
+    return ok ? BCD_OK : BCD_ERR_IO;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void set_le32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+/* Refresh the checksum of a base block at 0x1fc after editing it. */
+static void seal_base_block(unsigned char *base)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < 0x1fc; i += 4) sum ^= get_le32(base + i);
+    if (sum == 0) sum = 1;
+    if (sum == 0xffffffffU) sum = 0xfffffffeU;
+    set_le32(base + 0x1fc, sum);
+}
+
+static size_t file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+/* Remove a store together with the transaction log its edits leave. */
+static void remove_store(const char *path)
+{
+    char log[48];
+    snprintf(log, sizeof(log), "%s.LOG1", path);
+    unlink(log);
+    unlink(path);
+}
+
+/* A hive image of objects 0..count-1. */
+static int serialize_objects(size_t count, unsigned char **image, size_t *size)
+{
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    int status = BCD_OK;
+    for (size_t i = 0; i < count && status == BCD_OK; ++i) status = add_object(&store, i);
+    if (status == BCD_OK) status = RegfSerializeBcdStore(&store, image, size);
+    BcdStoreRelease(&store);
+    return status;
+}
+
+/* A hive of objects 0..count-1 in a new temporary file. */
+static int write_store(size_t count, char *path)
+{
+    unsigned char *image = NULL;
+    size_t size = 0;
+    int status = serialize_objects(count, &image, &size);
+    if (status == BCD_OK) status = write_temp(image, size, path);
+    free(image);
+    return status;
+}
+
+#define GROWTH_ROUNDS 300
+
+/* Open path for update, apply one edit and commit it, as one CLI run does.
+ * Creates object index, or deletes it when remove is set. */
+static int commit_one_edit(const char *path, size_t index, int remove)
+{
+    BCD_STORE store;
+    REGF_HIVE *hive = NULL;
+    int status = load_bcd_store(stderr, path, &store, 0, STORE_EDIT, &hive);
+    if (status == BCD_OK && remove) {
+        BCD_OBJECT_ID id;
+        make_id(index, &id);
+        status = BcdStoreDeleteObject(&store, &id);
+    } else if (status == BCD_OK) {
+        status = add_object(&store, index);
+    }
+    if (status == BCD_OK) status = commit_bcd_store(path, &store, hive);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    return status;
+}
+
+/* Objects created and then deleted one commit at a time, as by repeated
+ * /create and /delete, keep the hive within a small margin of a fresh
+ * serialization of the same store instead of growing with every rewritten
+ * subkey list. */
+static int test_edit_growth_bounded(void)
+{
+    char path[32];
+    CHECK(write_store(0, path) == BCD_OK);
+    for (size_t i = 0; i < GROWTH_ROUNDS; ++i) CHECK(commit_one_edit(path, i, 0) == BCD_OK);
+    for (size_t i = 0; i < GROWTH_ROUNDS; i += 3) CHECK(commit_one_edit(path, i, 1) == BCD_OK);
+
+    BCD_STORE store;
+    CHECK(load_bcd_store(stderr, path, &store, 0, STORE_READ, NULL) == BCD_OK);
+    CHECK(BcdStoreGetObjectCount(&store) == GROWTH_ROUNDS - GROWTH_ROUNDS / 3);
+    size_t measured = 0;
+    CHECK(RegfMeasureBcdStore(&store, &measured) == BCD_OK);
+    BcdStoreRelease(&store);
+    CHECK(file_size(path) <= measured + measured / 4 + 4 * 4096);
+    remove_store(path);
+    return 0;
+}
+
+/* An edit interrupted after the primary's sequence number was bumped, before
+ * any page reached it, is recovered from the .LOG1 the commit wrote first. */
+static int test_edit_log_recovers_torn_write(void)
+{
+    char path[32];
+    CHECK(write_store(50, path) == BCD_OK);
+    unsigned char *before = NULL;
+    size_t beforeSize = 0;
+    CHECK(read_whole_file(path, &before, &beforeSize) == BCD_OK);
+
+    BCD_STORE store;
+    REGF_HIVE *hive = NULL;
+    CHECK(load_bcd_store(stderr, path, &store, 0, STORE_EDIT, &hive) == BCD_OK);
+    BCD_OBJECT_ID id;
+    make_id(3, &id);
+    CHECK(BcdStoreDeleteObject(&store, &id) == BCD_OK);
+    for (size_t i = 50; i < 60; ++i) CHECK(add_object(&store, i) == BCD_OK);
+    CHECK(commit_bcd_store(path, &store, hive) == BCD_OK);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+
+    set_le32(before + 0x04, get_le32(before + 0x08) + 1);
+    seal_base_block(before);
+    FILE *f = fopen(path, "wb");
+    CHECK(f != NULL);
+    CHECK(fwrite(before, 1, beforeSize, f) == beforeSize);
+    CHECK(fclose(f) == 0);
+    free(before);
+
+    hive = RegfOpenFile(path);
+    CHECK(hive != NULL);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    CHECK(check_objects(&store, 60, 3) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    remove_store(path);
+    return 0;
+}
+
+static uint32_t rotate_left(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+static void log_hash_block(uint32_t *lo, uint32_t *hi, uint32_t word)
+{
+    *lo += word;
+    *hi ^= *lo;
+    *lo = rotate_left(*lo, 20) + *hi;
+    *hi = rotate_left(*hi, 9) ^ *lo;
+    *lo = rotate_left(*lo, 27) + *hi;
+    *hi = rotate_left(*hi, 19);
+}
+
+/* Marvin32 with the seed Windows uses for log entries. */
+static uint64_t log_hash(const unsigned char *p, size_t len)
+{
+    uint32_t lo = 0x7A4E55C5U;
+    uint32_t hi = 0x82EF4D88U;
+    for (; len >= 4; p += 4, len -= 4) log_hash_block(&lo, &hi, get_le32(p));
+    uint32_t tail = 0x80;
+    for (size_t i = len; i-- > 0;) tail = (tail << 8) | p[i];
+    log_hash_block(&lo, &hi, tail);
+    log_hash_block(&lo, &hi, 0);
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Write an HvLE entry at entry carrying bins pages [first, first + count) of
+ * image and return its size. */
+static size_t put_log_entry(unsigned char *entry, const unsigned char *image, uint32_t sequence, size_t first,
+                            size_t count)
+{
+    size_t bytes = count * 4096;
+    size_t size = (0x28 + 8 + bytes + 0x1ff) & ~(size_t)0x1ff;
+    memset(entry, 0, size);
+    memcpy(entry, "HvLE", 4);
+    set_le32(entry + 0x04, (uint32_t)size);
+    set_le32(entry + 0x0c, sequence);
+    set_le32(entry + 0x10, get_le32(image + 0x28));
+    set_le32(entry + 0x14, 1);
+    set_le32(entry + 0x28, (uint32_t)(first * 4096));
+    set_le32(entry + 0x2c, (uint32_t)bytes);
+    memcpy(entry + 0x30, image + 0x1000 + first * 4096, bytes);
+    uint64_t hash = log_hash(entry + 0x28, size - 0x28);
+    set_le32(entry + 0x18, (uint32_t)hash);
+    set_le32(entry + 0x1c, (uint32_t)(hash >> 32));
+    hash = log_hash(entry, 0x20);
+    set_le32(entry + 0x20, (uint32_t)hash);
+    set_le32(entry + 0x24, (uint32_t)(hash >> 32));
+    return size;
+}
+
+/* A log's base block: image's, sealed with the given sequence number and the
+ * new-format log file type. */
+static void put_log_base(unsigned char *log, const unsigned char *image, uint32_t sequence)
+{
+    memcpy(log, image, 0x200);
+    set_le32(log + 0x04, sequence);
+    set_le32(log + 0x08, sequence);
+    set_le32(log + 0x1c, 6);
+    seal_base_block(log);
+}
+
+static int write_log(const char *path, const char *suffix, const unsigned char *log, size_t size)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%s%s", path, suffix);
+    FILE *f = fopen(name, "wb");
+    if (!f) return BCD_ERR_IO;
+    int ok = fwrite(log, 1, size, f) == size;
+    return fclose(f) == 0 && ok ? BCD_OK : BCD_ERR_IO;
+}
+
+/* RegfReplayLogs over a copy of primary; the copy is returned in *out. */
+static int replay_copy(const char *path, const unsigned char *primary, size_t size, unsigned char **out,
+                       size_t *outSize)
+{
+    *out = (unsigned char *)malloc(size);
+    if (!*out) return BCD_ERR_CAPACITY;
+    memcpy(*out, primary, size);
+    *outSize = size;
+    return RegfReplayLogs(path, out, outSize);
+}
+
+#define REPLAY_SMALL_COUNT 4
+#define REPLAY_LARGE_COUNT 400
+
+/* Hand-built logs replaying a small hive into a larger one. Entries are
+ * chained across .LOG2 and .LOG1 in sequence order and grow the image; a
+ * bad hash or a sequence gap ends the run at the last good entry, and a
+ * legacy (DIRT) log is ignored. */
+static int test_log_replay(void)
+{
+    unsigned char *small = NULL;
+    unsigned char *large = NULL;
+    size_t smallSize = 0;
+    size_t largeSize = 0;
+    CHECK(serialize_objects(REPLAY_SMALL_COUNT, &small, &smallSize) == BCD_OK);
+    CHECK(serialize_objects(REPLAY_LARGE_COUNT, &large, &largeSize) == BCD_OK);
+    CHECK(get_le32(small + 0x24) == get_le32(large + 0x24));
+    size_t largeBins = get_le32(large + 0x28);
+    size_t pages = largeBins / 4096;
+    size_t half = pages / 2;
+    CHECK(largeSize > smallSize && half > 0);
+
+    /* The primary as an interrupted write leaves it: sequence numbers apart. */
+    uint32_t sequence = get_le32(small + 0x08);
+    set_le32(small + 0x04, sequence + 1);
+    seal_base_block(small);
+    char path[32];
+    CHECK(write_temp(small, smallSize, path) == BCD_OK);
+    char log2[48];
+    snprintf(log2, sizeof(log2), "%s.LOG2", path);
+
+    unsigned char *log = (unsigned char *)malloc(0x200 + 2 * (largeBins + 0x400));
+    unsigned char *other = (unsigned char *)malloc(0x200 + largeBins + 0x400);
+    CHECK(log != NULL && other != NULL);
+    unsigned char *image = NULL;
+    size_t size = 0;
+
+    put_log_base(other, large, sequence);
+    size_t otherSize = 0x200 + put_log_entry(other + 0x200, large, sequence, 0, half);
+    put_log_base(log, large, sequence + 1);
+    size_t logSize = 0x200 + put_log_entry(log + 0x200, large, sequence + 1, half, pages - half);
+    CHECK(write_log(path, ".LOG2", other, otherSize) == BCD_OK);
+    CHECK(write_log(path, ".LOG1", log, logSize) == BCD_OK);
+    CHECK(replay_copy(path, small, smallSize, &image, &size) == 1);
+    CHECK(size == largeSize && memcmp(image + 0x1000, large + 0x1000, largeBins) == 0);
+    CHECK(get_le32(image + 0x04) == sequence + 1 && get_le32(image + 0x08) == sequence + 1);
+    CHECK(get_le32(image + 0x28) == largeBins);
+    free(image);
+    REGF_HIVE *hive = RegfOpenFile(path);
+    CHECK(hive != NULL);
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    CHECK(check_objects(&store, REPLAY_LARGE_COUNT, REPLAY_LARGE_COUNT) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    unlink(log2);
+
+    /* Both entries in .LOG1; a flipped data byte fails the hash. */
+    put_log_base(log, large, sequence);
+    size_t first = put_log_entry(log + 0x200, large, sequence, 0, half);
+    size_t second = put_log_entry(log + 0x200 + first, large, sequence + 1, half, pages - half);
+    logSize = 0x200 + first + second;
+    log[0x200 + first + 0x30] ^= 1;
+    CHECK(write_log(path, ".LOG1", log, logSize) == BCD_OK);
+    CHECK(replay_copy(path, small, smallSize, &image, &size) == 1);
+    CHECK(get_le32(image + 0x04) == sequence && get_le32(image + 0x08) == sequence);
+    CHECK(memcmp(image + 0x1000, large + 0x1000, half * 4096) == 0);
+    CHECK(memcmp(image + 0x1000 + half * 4096, large + 0x1000 + half * 4096, (pages - half) * 4096) != 0);
+    free(image);
+    log[0x200 + first + 0x30] ^= 1;
+    log[0x200 + 0x30] ^= 1;
+    CHECK(write_log(path, ".LOG1", log, logSize) == BCD_OK);
+    CHECK(replay_copy(path, small, smallSize, &image, &size) == 0);
+    CHECK(size == smallSize && memcmp(image, small, smallSize) == 0);
+    free(image);
+    log[0x200 + 0x30] ^= 1;
+
+    /* A gap in the sequence numbers ends the run. */
+    second = put_log_entry(log + 0x200 + first, large, sequence + 2, half, pages - half);
+    CHECK(write_log(path, ".LOG1", log, logSize) == BCD_OK);
+    CHECK(replay_copy(path, small, smallSize, &image, &size) == 1);
+    CHECK(get_le32(image + 0x04) == sequence);
+    CHECK(memcmp(image + 0x1000 + half * 4096, large + 0x1000 + half * 4096, (pages - half) * 4096) != 0);
+    free(image);
+    put_log_entry(log + 0x200, large, sequence + 2, 0, half);
+    CHECK(write_log(path, ".LOG1", log, 0x200 + first) == BCD_OK);
+    CHECK(replay_copy(path, small, smallSize, &image, &size) == 0);
+    free(image);
+
+    /* A legacy log: file type 1 and a dirty vector instead of entries. */
+    memcpy(log, large, 0x200);
+    set_le32(log + 0x04, sequence + 1);
+    set_le32(log + 0x08, sequence + 1);
+    set_le32(log + 0x1c, 1);
+    seal_base_block(log);
+    memset(log + 0x200, 0, 0x200);
+    memcpy(log + 0x200, "DIRT", 4);
+    memset(log + 0x204, 0xff, (pages + 7) / 8);
+    memcpy(log + 0x400, large + 0x1000, largeBins);
+    CHECK(write_log(path, ".LOG1", log, 0x400 + largeBins) == BCD_OK);
+    CHECK(replay_copy(path, small, smallSize, &image, &size) == 0);
+    CHECK(size == smallSize && memcmp(image, small, smallSize) == 0);
+    free(image);
+
+    free(log);
+    free(other);
+    free(small);
+    free(large);
+    remove_store(path);
+    return 0;
+}
+
+/* Every key of image points at one sk cell, linked to itself and counting
+ * all of them, and has no class name. */
+static int check_security(const unsigned char *image, size_t size, size_t objectCount)
+{
+    const unsigned char *bins = image + 0x1000;
+    uint32_t rootOffset = get_le32(image + 0x24);
+    uint32_t security = get_le32(bins + rootOffset + 0x30);
+    CHECK(security + 0x18 <= size - 0x1000);
+    const unsigned char *sk = bins + security;
+    CHECK(sk[4] == 's' && sk[5] == 'k');
+    CHECK(get_le32(sk + 0x08) == security && get_le32(sk + 0x0c) == security);
+    CHECK(get_le32(sk + 0x10) == objectCount + 1);
+    CHECK(get_le32(bins + rootOffset + 0x34) == 0xffffffffU);
+
+    REGF_HIVE *hive = RegfOpen(image, size);
+    CHECK(hive != NULL);
+    REGF_KEY *root = RegfGetRootKey(hive);
+    CHECK(RegfGetSubKeyCount(root) == (int)objectCount);
+    for (int i = 0; i < RegfGetSubKeyCount(root); ++i) {
+        REGF_KEY *key = RegfGetSubKeyAt(root, i);
+        CHECK(key != NULL);
+        const unsigned char *nk = bins + RegfGetKeyOffset(key);
+        RegfReleaseKey(key);
+        CHECK(get_le32(nk + 0x30) == security);
+        CHECK(get_le32(nk + 0x34) == 0xffffffffU);
+    }
+    RegfClose(hive);
+    return 0;
+}
+
+/* Written hives carry a shared security cell whose reference count in-place
+ * creates and deletes keep in step with the keys. */
+static int test_security_cell(void)
+{
+    char path[32];
+    CHECK(write_store(20, path) == BCD_OK);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(read_whole_file(path, &image, &size) == BCD_OK);
+    CHECK(check_security(image, size, 20) == 0);
+    free(image);
+
+    CHECK(commit_one_edit(path, 20, 0) == BCD_OK);
+    CHECK(commit_one_edit(path, 21, 0) == BCD_OK);
+    CHECK(commit_one_edit(path, 4, 1) == BCD_OK);
+    CHECK(read_whole_file(path, &image, &size) == BCD_OK);
+    CHECK(check_security(image, size, 21) == 0);
+    free(image);
+    remove_store(path);
+    return 0;
+}
+
+static int make_temp_dir(char *dir)
+{
+    strcpy(dir, "/tmp/bcd_test_XXXXXX");
+    return mkdtemp(dir) ? BCD_OK : BCD_ERR_IO;
+}
+
+/* Entries of dir other than . and .., or -1. */
+static int count_entries(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) ++count;
+    }
+    closedir(d);
+    return count;
+}
+
+/* Empty and remove a directory made by make_temp_dir (one level deep). */
+static void remove_temp_dir(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *entry;
+    char path[512];
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static int file_equals(const char *path, const void *data, size_t size)
+{
+    unsigned char *content = NULL;
+    size_t contentSize = 0;
+    if (read_whole_file(path, &content, &contentSize) != BCD_OK) return 0;
+    int same = contentSize == size && (size == 0 || memcmp(content, data, size) == 0);
+    free(content);
+    return same;
+}
+
+static int fill_failing(void *context, unsigned char *out, size_t size)
+{
+    (void)context;
+    if (out && size > 0) memset(out, 0xee, size);
+    return BCD_ERR_IO;
+}
+
+/* A commit whose primary write fails leaves the hive's sequence numbers as
+ * they were, so the next commit writes the following sequence number and
+ * the file ends up clean. The failing primary is /dev/full behind a link. */
+static int test_failed_write_keeps_sequence(void)
+{
+    char path[32];
+    char dir[32];
+    char full[64];
+    CHECK(write_store(10, path) == BCD_OK);
+    CHECK(make_temp_dir(dir) == BCD_OK);
+    snprintf(full, sizeof(full), "%s/full", dir);
+    CHECK(symlink("/dev/full", full) == 0);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(read_whole_file(path, &image, &size) == BCD_OK);
+    uint32_t sequence = get_le32(image + 0x04);
+    free(image);
+
+    BCD_STORE store;
+    REGF_HIVE *hive = NULL;
+    CHECK(load_bcd_store(stderr, path, &store, 0, STORE_EDIT, &hive) == BCD_OK);
+    CHECK(add_object(&store, 10) == BCD_OK);
+    CHECK(RegfUpdateBcdStore(hive, &store) == BCD_OK);
+    CHECK(RegfWriteChanges(hive, full) == BCD_ERR_IO);
+    CHECK(RegfWriteChanges(hive, path) == BCD_OK);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+
+    CHECK(read_whole_file(path, &image, &size) == BCD_OK);
+    CHECK(get_le32(image + 0x04) == sequence + 1 && get_le32(image + 0x08) == sequence + 1);
+    free(image);
+    hive = RegfOpenFile(path);
+    CHECK(hive != NULL);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    CHECK(check_objects(&store, 11, 11) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    remove_store(path);
+    remove_temp_dir(dir);
+    return 0;
+}
+
+/* Full writes go through a sibling temporary file: the target gets the new
+ * content and keeps its permissions, a symlinked target has the file it
+ * points to replaced, and a failing fill leaves the original byte-identical
+ * with no temporary file behind. */
+static int test_replace_file_atomic(void)
+{
+    static const char oldText[] = "old store contents";
+    static const char newText[] = "new store contents, a little longer";
+    char dir[32];
+    char path[64];
+    char link[64];
+    CHECK(make_temp_dir(dir) == BCD_OK);
+    snprintf(path, sizeof(path), "%s/BCD", dir);
+    snprintf(link, sizeof(link), "%s/BCD.link", dir);
+    FILE *f = fopen(path, "wb");
+    CHECK(f != NULL);
+    CHECK(fwrite(oldText, 1, sizeof(oldText), f) == sizeof(oldText));
+    CHECK(fclose(f) == 0);
+    CHECK(chmod(path, 0640) == 0);
+
+    CHECK(replace_file(path, sizeof(oldText), fill_failing, NULL) == BCD_ERR_IO);
+    CHECK(file_equals(path, oldText, sizeof(oldText)));
+    CHECK(count_entries(dir) == 1);
+
+    CHECK(replace_file(path, sizeof(newText), fill_from_buffer, (void *)newText) == BCD_OK);
+    CHECK(file_equals(path, newText, sizeof(newText)));
+    struct stat st;
+    CHECK(stat(path, &st) == 0 && (st.st_mode & 07777) == 0640);
+    CHECK(count_entries(dir) == 1);
+
+    CHECK(symlink("BCD", link) == 0);
+    CHECK(replace_file(link, sizeof(oldText), fill_failing, NULL) == BCD_ERR_IO);
+    CHECK(file_equals(path, newText, sizeof(newText)));
+    CHECK(replace_file(link, sizeof(oldText), fill_from_buffer, (void *)oldText) == BCD_OK);
+    CHECK(lstat(link, &st) == 0 && S_ISLNK(st.st_mode));
+    CHECK(file_equals(path, oldText, sizeof(oldText)));
+    CHECK(count_entries(dir) == 2);
+    remove_temp_dir(dir);
+    return 0;
+}
+
+static int connect_to(const char *socketPath)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Fork a daemon serving the command line's handler on socketPath and wait
+ * until it accepts connections. Returns the child's pid, or -1. */
+static pid_t start_daemon(const char *socketPath)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) _exit(BcdDaemonRun(socketPath, handle_daemon_request, NULL) == BCD_OK ? 0 : 1);
+    if (pid < 0) return -1;
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    for (int i = 0; i < 500; ++i) {
+        int fd = connect_to(socketPath);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        nanosleep(&pause, NULL);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/* Stop the daemon the way an operator would; it must exit cleanly. */
+static int stop_daemon(pid_t pid)
+{
+    int wstatus = 0;
+    if (kill(pid, SIGTERM) != 0 || waitpid(pid, &wstatus, 0) != pid) return BCD_ERR_IO;
+    return WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0 ? BCD_OK : BCD_ERR_IO;
+}
+
+/* Send a NULL-terminated argument list through the client API. The command's
+ * status goes to *result; its output and diagnostics are returned as strings
+ * the caller frees. */
+static int daemon_call(const char *socketPath, char **args, int *result, char **outText, char **errText)
+{
+    int argc = 0;
+    while (args[argc]) ++argc;
+    size_t outLength = 0;
+    size_t errLength = 0;
+    *outText = NULL;
+    *errText = NULL;
+    FILE *out = open_memstream(outText, &outLength);
+    FILE *err = open_memstream(errText, &errLength);
+    int status = out && err ? BcdDaemonRequest(socketPath, argc, args, out, err, result) : BCD_ERR_CAPACITY;
+    if (out) fclose(out);
+    if (err) fclose(err);
+    return status;
+}
+
+/* Write raw bytes as a request and return how many response bytes came back
+ * before the daemon closed the connection, or -1. */
+static long send_raw(const char *socketPath, const unsigned char *data, size_t size)
+{
+    int fd = connect_to(socketPath);
+    if (fd < 0) return -1;
+    long received = 0;
+    if (write(fd, data, size) != (ssize_t)size || shutdown(fd, SHUT_WR) != 0) received = -1;
+    unsigned char buffer[256];
+    ssize_t n;
+    while (received >= 0 && (n = read(fd, buffer, sizeof(buffer))) > 0) received += n;
+    close(fd);
+    return received;
+}
+
+#define DAEMON_OBJECT_COUNT 8
+
+/* The daemon answers enum, lookup and set requests over its socket, serves
+ * repeated reads from its cache, drops the cached store when the file is
+ * rewritten in place or replaced, refuses malformed frames without dying,
+ * and keeps its socket owner-only. */
+static int test_daemon_requests(void)
+{
+    char dir[32];
+    char socketPath[64];
+    char path[32];
+    char replacement[32];
+    char name[BCD_ID_STRING_LENGTH + 1];
+    char other[BCD_ID_STRING_LENGTH + 1];
+    BCD_OBJECT_ID id;
+    CHECK(make_temp_dir(dir) == BCD_OK);
+    snprintf(socketPath, sizeof(socketPath), "%s/daemon.sock", dir);
+    CHECK(write_store(DAEMON_OBJECT_COUNT, path) == BCD_OK);
+    make_id(3, &id);
+    BcdFormatObjectId(&id, name, sizeof(name));
+    make_id(5, &id);
+    BcdFormatObjectId(&id, other, sizeof(other));
+
+    pid_t pid = start_daemon(socketPath);
+    CHECK(pid > 0);
+    struct stat st;
+    CHECK(stat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode) && (st.st_mode & 0777) == 0600);
+
+    int result = -1;
+    char *out = NULL;
+    char *err = NULL;
+    char *enumArgs[] = {"/store", path, "/enum", "/stats", NULL};
+    CHECK(daemon_call(socketPath, enumArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK && strstr(out, name) && strstr(out, other) && strstr(out, "object 7"));
+    CHECK(strstr(err, "\"bytes_read\": 0,") == NULL);
+    free(out);
+    free(err);
+    CHECK(daemon_call(socketPath, enumArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK && strstr(out, name));
+    CHECK(strstr(err, "\"bytes_read\": 0,") != NULL);
+    free(out);
+    free(err);
+
+    char *lookupArgs[] = {"/store", path, "/enum", name, NULL};
+    CHECK(daemon_call(socketPath, lookupArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK && strstr(out, "object 3") && !strstr(out, other));
+    free(out);
+    free(err);
+    char *setArgs[] = {"/store", path, "/set", name, "description", "renamed", NULL};
+    CHECK(daemon_call(socketPath, setArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK);
+    free(out);
+    free(err);
+    CHECK(daemon_call(socketPath, lookupArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK && strstr(out, "renamed") && !strstr(out, "object 3"));
+    free(out);
+    free(err);
+
+    /* Rewritten in place by another process: inotify drops the entry. */
+    CHECK(commit_one_edit(path, DAEMON_OBJECT_COUNT, 0) == BCD_OK);
+    CHECK(daemon_call(socketPath, enumArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK && strstr(out, "object 8"));
+    CHECK(strstr(err, "\"bytes_read\": 0,") == NULL);
+    free(out);
+    free(err);
+    /* Replaced by a new file: the inode no longer matches. */
+    CHECK(write_store(2, replacement) == BCD_OK);
+    CHECK(rename(replacement, path) == 0);
+    CHECK(daemon_call(socketPath, enumArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_OK && strstr(out, "object 1") && !strstr(out, name));
+    CHECK(strstr(err, "\"bytes_read\": 0,") == NULL);
+    free(out);
+    free(err);
+
+    static const unsigned char oversized[4] = {0x01, 0x00, 0x00, 0x04};
+    static const unsigned char truncated[14] = {100, 0, 0, 0, '/', 's', 't', 'o', 'r', 'e', 0, '/', 't', 'm'};
+    CHECK(send_raw(socketPath, oversized, sizeof(oversized)) == 0);
+    CHECK(send_raw(socketPath, truncated, sizeof(truncated)) == 0);
+    CHECK(daemon_call(socketPath, lookupArgs, &result, &out, &err) == BCD_OK);
+    CHECK(result == BCD_ERR_NOT_FOUND && strstr(err, "Object not found"));
+    free(out);
+    free(err);
+
+    CHECK(stop_daemon(pid) == BCD_OK);
+    CHECK(access(socketPath, F_OK) != 0);
+    remove_temp_dir(dir);
+    remove_store(path);
+    return 0;
+}
+
+/* A well-formed id parses to its fields (the boot manager's id, as any
+ * store has it) and formats back to the same text. */
+static int test_parse_known_id(void)
+{
+    static const char text[] = "{9dea862c-5cdd-4e70-acc1-f32b344d4795}";
+    static const uint8_t data4[8] = {0xac, 0xc1, 0xf3, 0x2b, 0x34, 0x4d, 0x47, 0x95};
+    BCD_OBJECT_ID id;
+    CHECK(BcdParseObjectId(text, &id) == BCD_OK);
+    CHECK(id.data1 == 0x9dea862cU && id.data2 == 0x5cdd && id.data3 == 0x4e70);
+    CHECK(memcmp(id.data4, data4, sizeof(data4)) == 0);
+    char formatted[BCD_ID_STRING_LENGTH + 1];
+    CHECK(BcdFormatObjectId(&id, formatted, sizeof(formatted)) == BCD_OK);
+    CHECK(strcmp(formatted, text) == 0);
+    BCD_OBJECT_ID upper;
+    CHECK(BcdParseObjectId("{9DEA862C-5CDD-4E70-ACC1-F32B344D4795}", &upper) == BCD_OK);
+    CHECK(memcmp(&upper, &id, sizeof(id)) == 0);
+    return 0;
+}
+
+/* The per-nibble parser and snprintf formatter the GUID code replaced; every
+ * build variant must agree with them. */
+static int reference_parse_id(const char *text, size_t len, BCD_OBJECT_ID *id)
+{
+    static const char digits[] = "0123456789abcdef";
+    uint8_t b[16];
+    if (len != BCD_ID_STRING_LENGTH) return BCD_ERR_PARSE;
+    if (text[0] != '{' || text[9] != '-' || text[14] != '-' || text[19] != '-' || text[24] != '-' ||
+        text[37] != '}') {
+        return BCD_ERR_PARSE;
+    }
+    size_t n = 0;
+    for (size_t i = 1; i < 37; ++i) {
+        if (i == 9 || i == 14 || i == 19 || i == 24) continue;
+        int c = text[i] >= 'A' && text[i] <= 'F' ? text[i] - 'A' + 'a' : text[i];
+        const char *digit = c ? strchr(digits, c) : NULL;
+        if (!digit) return BCD_ERR_PARSE;
+        unsigned value = (unsigned)(digit - digits);
+        if (n % 2 == 0) b[n / 2] = (uint8_t)(value << 4);
+        else b[n / 2] |= (uint8_t)value;
+        ++n;
+    }
+    id->data1 = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    id->data2 = (uint16_t)((b[4] << 8) | b[5]);
+    id->data3 = (uint16_t)((b[6] << 8) | b[7]);
+    memcpy(id->data4, b + 8, 8);
+    return BCD_OK;
+}
+
+static void reference_format_id(const BCD_OBJECT_ID *id, char *text, size_t size)
+{
+    snprintf(text, size, "{%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x}", (unsigned)id->data1,
+             (unsigned)id->data2, (unsigned)id->data3, id->data4[0], id->data4[1], id->data4[2], id->data4[3],
+             id->data4[4], id->data4[5], id->data4[6], id->data4[7]);
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Both parsers must agree on the status and, when they accept, the id. */
+static int parsers_agree(const char *text, size_t len)
+{
+    BCD_OBJECT_ID expected;
+    BCD_OBJECT_ID actual;
+    memset(&expected, 0, sizeof(expected));
+    memset(&actual, 0, sizeof(actual));
+    int want = reference_parse_id(text, len, &expected);
+    int got = BcdParseObjectIdN(text, len, &actual);
+    return want == got && (got != BCD_OK || memcmp(&expected, &actual, sizeof(actual)) == 0);
+}
+
+#define GUID_VARIANT_ROUNDS 2000
+
+/* BcdParseObjectIdN and BcdFormatObjectId match the reference code on random
+ * ids, on mixed-case input and on every single-character corruption, including
+ * bytes next to the hex ranges and with the high bit set. `make check` runs
+ * this case in the default build (SSE2 on x86-64), an SSSE3 build and a
+ * -DBCD_GUID_SIMD=0 build. */
+static int test_guid_variants(void)
+{
+    static const char probes[] = {'0', '9', 'a', 'f', 'A', 'F', '/', ':', '@', 'G', '`', 'g', '-', '{', '}', ' ', '\0',
+                                  (char)0x80, (char)0xb0, (char)0xc1, (char)0xe6, (char)0xff};
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    char text[BCD_ID_STRING_LENGTH + 2];
+    char expected[BCD_ID_STRING_LENGTH + 1];
+    for (int round = 0; round < GUID_VARIANT_ROUNDS; ++round) {
+        BCD_OBJECT_ID id;
+        uint64_t a = next_random(&state);
+        uint64_t b = next_random(&state);
+        id.data1 = (uint32_t)a;
+        id.data2 = (uint16_t)(a >> 32);
+        id.data3 = (uint16_t)(a >> 48);
+        for (int i = 0; i < 8; ++i) id.data4[i] = (uint8_t)(b >> (8 * i));
+        CHECK(BcdFormatObjectId(&id, text, sizeof(text)) == BCD_OK);
+        reference_format_id(&id, expected, sizeof(expected));
+        CHECK(strcmp(text, expected) == 0);
+        CHECK(parsers_agree(text, BCD_ID_STRING_LENGTH));
+        for (size_t i = 0; i < BCD_ID_STRING_LENGTH; ++i) {
+            if ((next_random(&state) & 1) && text[i] >= 'a' && text[i] <= 'f') text[i] = (char)(text[i] - 'a' + 'A');
+        }
+        CHECK(parsers_agree(text, BCD_ID_STRING_LENGTH));
+        for (size_t i = 0; i < BCD_ID_STRING_LENGTH; ++i) {
+            char saved = text[i];
+            for (size_t p = 0; p < sizeof(probes); ++p) {
+                text[i] = probes[p];
+                CHECK(parsers_agree(text, BCD_ID_STRING_LENGTH));
+            }
+            text[i] = saved;
+        }
+        CHECK(parsers_agree(text, BCD_ID_STRING_LENGTH - 1));
+        text[BCD_ID_STRING_LENGTH] = '}';
+        CHECK(parsers_agree(text, BCD_ID_STRING_LENGTH + 1));
+    }
+    return 0;
+}
+
+#define CLI_MAX_ARGS 16
+
+/* Run a command line (args without the program name, NULL-terminated) the
+ * way main does, returning its output and diagnostics as strings the caller
+ * frees. */
+static int run_cli(char **args, char **outText, char **errText)
+{
+    static char programName[] = "bcdedit";
+    char *argv[CLI_MAX_ARGS + 1];
+    int argc = 0;
+    argv[argc++] = programName;
+    while (*args && argc < CLI_MAX_ARGS) argv[argc++] = *args++;
+    argv[argc] = NULL;
+    size_t outLength = 0;
+    size_t errLength = 0;
+    *outText = NULL;
+    *errText = NULL;
+    OPTIONS opts;
+    if (parse_options(argc, argv, &opts) != 0) return BCD_ERR_INVALID_ARG;
+    FILE *out = open_memstream(outText, &outLength);
+    FILE *err = open_memstream(errText, &errLength);
+    int status = BCD_ERR_CAPACITY;
+    if (out && err) {
+        opts.out = out;
+        opts.err = err;
+        status = run_store_command(&opts);
+    }
+    if (out) fclose(out);
+    if (err) fclose(err);
+    return status;
+}
+
+/* A batch whose last line fails, or holds a command that does not edit,
+ * leaves the store byte-identical and writes no log; one that succeeds applies every line in a single save, so the
+ * sequence number moves by one. */
+static int test_batch_all_or_nothing(void)
+{
+    char path[32];
+    char script[32];
+    char a[BCD_ID_STRING_LENGTH + 1];
+    char b[BCD_ID_STRING_LENGTH + 1];
+    char missing[BCD_ID_STRING_LENGTH + 1];
+    char text[512];
+    BCD_OBJECT_ID id;
+    CHECK(write_store(6, path) == BCD_OK);
+    make_id(1, &id);
+    BcdFormatObjectId(&id, a, sizeof(a));
+    make_id(2, &id);
+    BcdFormatObjectId(&id, b, sizeof(b));
+    make_id(99, &id);
+    BcdFormatObjectId(&id, missing, sizeof(missing));
+    unsigned char *before = NULL;
+    size_t beforeSize = 0;
+    CHECK(read_whole_file(path, &before, &beforeSize) == BCD_OK);
+    char log[48];
+    snprintf(log, sizeof(log), "%s.LOG1", path);
+
+    int length = snprintf(text, sizeof(text),
+                          "/set %s description \"first edit\"\n"
+                          "# comments and blank lines are skipped\n"
+                          "\n"
+                          "/delete %s\n"
+                          "/delete %s\n",
+                          a, b, missing);
+    CHECK(write_temp((const unsigned char *)text, (size_t)length, script) == BCD_OK);
+    char *batchArgs[] = {"/store", path, "/batch", script, NULL};
+    char *out = NULL;
+    char *err = NULL;
+    CHECK(run_cli(batchArgs, &out, &err) == BCD_ERR_NOT_FOUND);
+    CHECK(strstr(err, "Batch line 5 failed") && strstr(err, "the store was not modified"));
+    free(out);
+    free(err);
+    CHECK(file_equals(path, before, beforeSize));
+    CHECK(access(log, F_OK) != 0);
+
+    unlink(script);
+    length = snprintf(text, sizeof(text), "/set %s description \"first edit\"\n/enum\n", a);
+    CHECK(write_temp((const unsigned char *)text, (size_t)length, script) == BCD_OK);
+    CHECK(run_cli(batchArgs, &out, &err) == BCD_ERR_INVALID_ARG);
+    CHECK(strstr(err, "Batch line 2: not an editing command"));
+    free(out);
+    free(err);
+    CHECK(file_equals(path, before, beforeSize));
+
+    unlink(script);
+    length = snprintf(text, sizeof(text), "/set %s description \"first edit\"\n\n/delete %s\n", a, b);
+    CHECK(write_temp((const unsigned char *)text, (size_t)length, script) == BCD_OK);
+    CHECK(run_cli(batchArgs, &out, &err) == BCD_OK);
+    free(out);
+    free(err);
+    unsigned char *after = NULL;
+    size_t afterSize = 0;
+    CHECK(read_whole_file(path, &after, &afterSize) == BCD_OK);
+    CHECK(get_le32(after + 0x04) == get_le32(before + 0x04) + 1);
+    CHECK(get_le32(after + 0x08) == get_le32(after + 0x04));
+    free(after);
+    char *lookupArgs[] = {"/store", path, "/enum", a, NULL};
+    CHECK(run_cli(lookupArgs, &out, &err) == BCD_OK);
+    CHECK(strstr(out, "first edit") != NULL);
+    free(out);
+    free(err);
+    lookupArgs[3] = b;
+    CHECK(run_cli(lookupArgs, &out, &err) == BCD_ERR_NOT_FOUND);
+    free(out);
+    free(err);
+    free(before);
+    unlink(script);
+    remove_store(path);
+    return 0;
+}
+
+/* Copy the first size bytes of image to a new temporary file, with count
+ * bytes at offset replaced. */
+static int write_snapshot_variant(const unsigned char *image, size_t size, size_t offset, const void *bytes,
+                                  size_t count, char *path)
+{
+    unsigned char *copy = (unsigned char *)malloc(size);
+    if (!copy) return BCD_ERR_CAPACITY;
+    memcpy(copy, image, size);
+    if (count) memcpy(copy + offset, bytes, count);
+    int status = write_temp(copy, size, path);
+    free(copy);
+    return status;
+}
+
+/* A snapshot lists the same store as its hive; one with a bad header or an
+ * unsorted object table is refused, and so is one whose source has changed
+ * since, until the source is gone. */
+static int test_snapshot_round_trip(void)
+{
+    char path[32];
+    char snap[48];
+    char variant[32];
+    CHECK(write_store(12, path) == BCD_OK);
+    snprintf(snap, sizeof(snap), "%s.snap", path);
+    char *takeArgs[] = {"/store", path, "/snapshot", snap, NULL};
+    char *hiveArgs[] = {"/store", path, "/enum", "/v", NULL};
+    char *snapArgs[] = {"/store", snap, "/enum", "/v", NULL};
+    char *out = NULL;
+    char *err = NULL;
+    char *expected = NULL;
+    CHECK(run_cli(takeArgs, &out, &err) == BCD_OK);
+    free(out);
+    free(err);
+    CHECK(BcdSnapshotProbe(snap) == 1 && BcdSnapshotProbe(path) == 0);
+    CHECK(run_cli(hiveArgs, &expected, &err) == BCD_OK);
+    CHECK(strstr(expected, "object 11") != NULL);
+    free(err);
+    CHECK(run_cli(snapArgs, &out, &err) == BCD_OK);
+    CHECK(strcmp(out, expected) == 0);
+    free(out);
+    free(err);
+    free(expected);
+
+    BCD_SNAPSHOT *snapshot = NULL;
+    CHECK(BcdSnapshotOpen(snap, &snapshot) == BCD_OK);
+    CHECK(!BcdSnapshotIsStale(snapshot));
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromSnapshot(&store, snapshot) == BCD_OK);
+    CHECK(check_objects(&store, 12, 12) == 0);
+    BcdStoreRelease(&store);
+    BcdSnapshotClose(snapshot);
+
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(read_whole_file(snap, &image, &size) == BCD_OK);
+    /* Header: version at 0x08, object table offset at 0x18. */
+    static const unsigned char version[4] = {2, 0, 0, 0};
+    static const unsigned char farTable[8] = {0, 0, 0, 0, 0, 0, 1, 0};
+    CHECK(write_snapshot_variant(image, size, 0x08, version, sizeof(version), variant) == BCD_OK);
+    CHECK(BcdSnapshotOpen(variant, &snapshot) == BCD_ERR_PARSE);
+    unlink(variant);
+    CHECK(write_snapshot_variant(image, size, 0x18, farTable, sizeof(farTable), variant) == BCD_OK);
+    CHECK(BcdSnapshotOpen(variant, &snapshot) == BCD_ERR_PARSE);
+    unlink(variant);
+    CHECK(write_snapshot_variant(image, 0x40, 0, NULL, 0, variant) == BCD_OK);
+    CHECK(BcdSnapshotOpen(variant, &snapshot) == BCD_ERR_PARSE);
+    unlink(variant);
+
+    /* Swap the first two 32-byte object records. */
+    size_t objects = (size_t)get_le32(image + 0x18);
+    unsigned char records[64];
+    memcpy(records, image + objects + 32, 32);
+    memcpy(records + 32, image + objects, 32);
+    CHECK(write_snapshot_variant(image, size, objects, records, sizeof(records), variant) == BCD_OK);
+    CHECK(BcdSnapshotOpen(variant, &snapshot) == BCD_OK);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromSnapshot(&store, snapshot) == BCD_ERR_PARSE);
+    BcdStoreRelease(&store);
+    BcdSnapshotClose(snapshot);
+    snapArgs[1] = variant;
+    CHECK(run_cli(snapArgs, &out, &err) == BCD_ERR_PARSE);
+    CHECK(strstr(err, "Invalid snapshot") != NULL);
+    free(out);
+    free(err);
+    snapArgs[1] = snap;
+    unlink(variant);
+    free(image);
+
+    CHECK(commit_one_edit(path, 12, 0) == BCD_OK);
+    CHECK(run_cli(snapArgs, &out, &err) == BCD_ERR_PARSE);
+    CHECK(strstr(err, "Snapshot is out of date") != NULL);
+    free(out);
+    free(err);
+    remove_store(path);
+    CHECK(run_cli(snapArgs, &out, &err) == BCD_OK);
+    CHECK(strstr(out, "object 11") != NULL);
+    free(out);
+    free(err);
+    unlink(snap);
+    return 0;
+}
+
+struct diff_tally {
+    size_t counts[BCD_DIFF_ELEMENT_CHANGED + 1];
+    BCD_OBJECT_ID ids[BCD_DIFF_ELEMENT_CHANGED + 1]; /* object of the last entry of each kind */
+};
+
+static int tally_diff_entry(const BCD_DIFF_ENTRY *entry, void *context)
+{
+    struct diff_tally *tally = (struct diff_tally *)context;
+    const BCD_OBJECT_DIGEST *object = entry->newObject ? entry->newObject : entry->oldObject;
+    tally->counts[entry->kind]++;
+    tally->ids[entry->kind] = object->id;
+    return BCD_OK;
+}
+
+static int digest_file(const char *path, BCD_STORE_DIGEST *digest)
+{
+    BCD_STORE store;
+    int status = load_bcd_store(stderr, path, &store, 0, STORE_READ, NULL);
+    if (status == BCD_OK) status = BcdDigestStore(&store, digest);
+    BcdStoreRelease(&store);
+    return status;
+}
+
+static int run_edit(char *path, char **edit)
+{
+    char *args[CLI_MAX_ARGS] = {"/store", path};
+    for (int i = 0; edit[i] && i + 3 < CLI_MAX_ARGS; ++i) args[i + 2] = edit[i];
+    char *out = NULL;
+    char *err = NULL;
+    int status = run_cli(args, &out, &err);
+    free(out);
+    free(err);
+    return status;
+}
+
+/* Two stores written separately from the same objects digest alike and show
+ * no differences. After editing one, each object and element difference is
+ * classified as changed, added or removed, and /diff prints the totals. */
+static int test_diff_classification(void)
+{
+    char a[32];
+    char b[32];
+    char ids[5][BCD_ID_STRING_LENGTH + 1];
+    static const size_t indexes[5] = {1, 2, 3, 4, 10};
+    BCD_OBJECT_ID id;
+    for (size_t i = 0; i < 5; ++i) {
+        make_id(indexes[i], &id);
+        BcdFormatObjectId(&id, ids[i], sizeof(ids[i]));
+    }
+    CHECK(write_store(6, a) == BCD_OK);
+    CHECK(write_store(6, b) == BCD_OK);
+
+    BCD_STORE_DIGEST before;
+    BCD_STORE_DIGEST after;
+    CHECK(digest_file(a, &before) == BCD_OK);
+    CHECK(digest_file(b, &after) == BCD_OK);
+    CHECK(before.objectCount == 6 && after.objectCount == 6);
+    for (size_t i = 0; i < before.objectCount; ++i) {
+        const BCD_OBJECT_DIGEST *match = BcdDigestFindObject(&after, &before.objects[i].id);
+        CHECK(match != NULL && match->hash == before.objects[i].hash);
+    }
+    struct diff_tally tally;
+    memset(&tally, 0, sizeof(tally));
+    CHECK(BcdDiffDigests(&before, &after, tally_diff_entry, &tally) == BCD_OK);
+    for (int kind = 0; kind <= BCD_DIFF_ELEMENT_CHANGED; ++kind) CHECK(tally.counts[kind] == 0);
+    BcdDigestRelease(&after);
+
+    char *setDescription[] = {"/set", ids[0], "description", "changed", NULL};
+    char *deleteObject[] = {"/delete", ids[1], NULL};
+    char *setLocale[] = {"/set", ids[2], "locale", "en-US", NULL};
+    char *deleteDescription[] = {"/deletevalue", ids[3], "description", NULL};
+    char *createObject[] = {"/create", ids[4], "/d", "added", "/application", "osloader", NULL};
+    CHECK(run_edit(b, setDescription) == BCD_OK);
+    CHECK(run_edit(b, deleteObject) == BCD_OK);
+    CHECK(run_edit(b, setLocale) == BCD_OK);
+    CHECK(run_edit(b, deleteDescription) == BCD_OK);
+    CHECK(run_edit(b, createObject) == BCD_OK);
+
+    CHECK(digest_file(b, &after) == BCD_OK);
+    memset(&tally, 0, sizeof(tally));
+    CHECK(BcdDiffDigests(&before, &after, tally_diff_entry, &tally) == BCD_OK);
+    CHECK(tally.counts[BCD_DIFF_OBJECT_CHANGED] == 3);
+    CHECK(tally.counts[BCD_DIFF_OBJECT_REMOVED] == 1 && tally.counts[BCD_DIFF_OBJECT_ADDED] == 1);
+    CHECK(tally.counts[BCD_DIFF_ELEMENT_CHANGED] == 1 && tally.counts[BCD_DIFF_ELEMENT_ADDED] == 1 &&
+          tally.counts[BCD_DIFF_ELEMENT_REMOVED] == 1);
+    CHECK(BcdParseObjectId(ids[0], &id) == BCD_OK && BcdIdsEqual(&tally.ids[BCD_DIFF_ELEMENT_CHANGED], &id));
+    CHECK(BcdParseObjectId(ids[1], &id) == BCD_OK && BcdIdsEqual(&tally.ids[BCD_DIFF_OBJECT_REMOVED], &id));
+    CHECK(BcdParseObjectId(ids[2], &id) == BCD_OK && BcdIdsEqual(&tally.ids[BCD_DIFF_ELEMENT_ADDED], &id));
+    CHECK(BcdParseObjectId(ids[3], &id) == BCD_OK && BcdIdsEqual(&tally.ids[BCD_DIFF_ELEMENT_REMOVED], &id));
+    CHECK(BcdParseObjectId(ids[4], &id) == BCD_OK && BcdIdsEqual(&tally.ids[BCD_DIFF_OBJECT_ADDED], &id));
+    BcdDigestRelease(&after);
+    BcdDigestRelease(&before);
+
+    char *diffArgs[] = {"/diff", a, b, a, NULL};
+    char *out = NULL;
+    char *err = NULL;
+    CHECK(run_cli(diffArgs, &out, &err) == BCD_OK);
+    CHECK(strstr(out, "3 changed, 1 added, 1 removed\n") != NULL);
+    CHECK(strstr(out, "0 changed, 0 added, 0 removed\n") != NULL);
+    free(out);
+    free(err);
+    remove_store(a);
+    remove_store(b);
+    return 0;
+}
+
+#define SCAN_STORE_COUNT 9
+
+/* The value of counter in one line of /stats JSON, or -1. */
+static long long stats_counter(const char *line, const char *counter)
+{
+    char key[48];
+    snprintf(key, sizeof(key), "\"%s\": ", counter);
+    const char *end = strchr(line, '\n');
+    const char *found = strstr(line, key);
+    if (!found || (end && found > end)) return -1;
+    return strtoll(found + strlen(key), NULL, 10);
+}
+
+/* /scan over a directory of stores on four workers reports every store
+ * exactly once, in name order, and skips the transaction logs edits leave
+ * beside them and files that are not stores. With /stats, each worker's
+ * counters are printed on their own, and they add up to the totals. */
+static int test_scan_directory(void)
+{
+    char dir[32];
+    char path[32];
+    char name[64];
+    CHECK(make_temp_dir(dir) == BCD_OK);
+    for (size_t i = 0; i < SCAN_STORE_COUNT; ++i) {
+        CHECK(write_store(i + 1, path) == BCD_OK);
+        snprintf(name, sizeof(name), "%s/store%02zu", dir, i);
+        CHECK(rename(path, name) == 0);
+        if (i % 3 == 0) CHECK(commit_one_edit(name, i + 1, 0) == BCD_OK);
+    }
+    snprintf(name, sizeof(name), "%s/notes.txt", dir);
+    CHECK(write_temp((const unsigned char *)"not a store\n", 12, path) == BCD_OK);
+    CHECK(rename(path, name) == 0);
+    snprintf(name, sizeof(name), "%s/store00.LOG1", dir);
+    CHECK(access(name, F_OK) == 0);
+
+    char *scanArgs[] = {"/scan", dir, "/threads", "4", NULL};
+    char *out = NULL;
+    char *err = NULL;
+    CHECK(run_cli(scanArgs, &out, &err) == BCD_OK);
+    CHECK(err[0] == '\0');
+    size_t headers = 0;
+    for (const char *p = out; (p = strstr(p, "==> ")) != NULL; ++p) ++headers;
+    CHECK(headers == SCAN_STORE_COUNT);
+    const char *previous = out;
+    for (size_t i = 0; i < SCAN_STORE_COUNT; ++i) {
+        snprintf(name, sizeof(name), "==> %s/store%02zu <==\n", dir, i);
+        const char *found = strstr(out, name);
+        CHECK(found != NULL && found >= previous && strstr(found + 1, name) == NULL);
+        previous = found;
+    }
+    free(out);
+    free(err);
+
+    char *jsonArgs[] = {"/scan", dir, "/threads", "4", "/json", NULL};
+    CHECK(run_cli(jsonArgs, &out, &err) == BCD_OK);
+    size_t lines = 0;
+    for (const char *p = out; (p = strchr(p, '\n')) != NULL; ++p) ++lines;
+    CHECK(lines == SCAN_STORE_COUNT);
+    for (size_t i = 0; i < SCAN_STORE_COUNT; ++i) {
+        snprintf(name, sizeof(name), "{\"store\":\"%s/store%02zu\"", dir, i);
+        const char *found = strstr(out, name);
+        CHECK(found != NULL && strstr(found + 1, name) == NULL);
+    }
+    free(out);
+    free(err);
+
+    char *statsArgs[] = {"/stats", "/scan", dir, "/threads", "4", NULL};
+    BcdStatsReset();
+    CHECK(run_cli(statsArgs, &out, &err) == BCD_OK);
+    BCD_STATS totals;
+    BcdStatsSnapshot(&totals);
+    long long objects = 0;
+    for (size_t i = 0; i < SCAN_STORE_COUNT; ++i) objects += (long long)(i + 1) + (i % 3 == 0);
+    CHECK(totals.counters[BCD_STAT_OBJECTS_LOADED] == (uint64_t)objects);
+    long long workerObjects = 0;
+    long long workerBytes = 0;
+    const char *line = err;
+    for (int w = 0; w < 4; ++w) {
+        char tag[32];
+        snprintf(tag, sizeof(tag), "{\"worker\": %d, ", w);
+        CHECK(strncmp(line, tag, strlen(tag)) == 0);
+        CHECK(stats_counter(line, "objects_loaded") >= 0 && stats_counter(line, "bytes_read") >= 0);
+        workerObjects += stats_counter(line, "objects_loaded");
+        workerBytes += stats_counter(line, "bytes_read");
+        line = strchr(line, '\n') + 1;
+    }
+    CHECK(*line == '\0');
+    CHECK(workerObjects == objects);
+    CHECK(workerBytes == (long long)totals.counters[BCD_STAT_BYTES_READ]);
+    free(out);
+    free(err);
+    remove_temp_dir(dir);
+    return 0;
+}
+
+/* Render object alone in format, optionally tagged with store. */
+static char *render_object(BCD_OBJECT *object, BCD_OUTPUT_FORMAT format, const char *store)
+{
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    if (!out) return NULL;
+    BCD_FORMATTER *formatter = (BCD_FORMATTER *)malloc(sizeof(BCD_FORMATTER));
+    int status = BCD_ERR_CAPACITY;
+    if (formatter) {
+        BcdFormatterBegin(formatter, out, format, 0, store);
+        BcdFormatterWriteObject(formatter, object);
+        status = BcdFormatterEnd(formatter);
+        free(formatter);
+    }
+    fclose(out);
+    if (status != BCD_OK) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+static int add_string_element(BCD_OBJECT *object, uint32_t type, const char *value)
+{
+    BCD_ELEMENT el;
+    memset(&el, 0, sizeof(el));
+    el.type = type;
+    el.kind = BCD_ELEMENT_STRING;
+    el.data.stringValue = (char *)value;
+    return BcdObjectAddElement(object, &el);
+}
+
+#define GOLDEN_ID "{01234567-89ab-cdef-0123-456789abcdef}"
+#define GOLDEN_STORE "st\"ore,1\\"
+
+/* JSON and CSV output of strings with quotes, backslashes, commas, control
+ * characters and UTF-8, byte for byte. JSON escapes quotes, backslashes and
+ * every control character and passes other bytes through; CSV quotes a
+ * field holding a quote, comma or line break and doubles its quotes. */
+static int test_format_escaping(void)
+{
+    static const char description[] = "say \"hi\", C:\\Windows\n\r\t\x01\x1f caf\xc3\xa9 \xe2\x82\xac";
+    static const char locale[] = "tab\there\\";
+    static const char json[] =
+        "[\n"
+        "{\"identifier\":\"" GOLDEN_ID "\",\"type\":\"0x10200003\",\"elements\":["
+        "{\"type\":\"0x12000004\",\"name\":\"description\",\"kind\":\"string\","
+        "\"value\":\"say \\\"hi\\\", C:\\\\Windows\\n\\r\\t\\u0001\\u001f caf\xc3\xa9 \xe2\x82\xac\"},"
+        "{\"type\":\"0x12000005\",\"name\":\"locale\",\"kind\":\"string\",\"value\":\"tab\\there\\\\\"}]}"
+        "\n]\n";
+    static const char taggedJson[] =
+        "{\"store\":\"st\\\"ore,1\\\\\",\"objects\":["
+        "{\"identifier\":\"" GOLDEN_ID "\",\"type\":\"0x10200003\",\"elements\":["
+        "{\"type\":\"0x12000004\",\"name\":\"description\",\"kind\":\"string\","
+        "\"value\":\"say \\\"hi\\\", C:\\\\Windows\\n\\r\\t\\u0001\\u001f caf\xc3\xa9 \xe2\x82\xac\"},"
+        "{\"type\":\"0x12000005\",\"name\":\"locale\",\"kind\":\"string\",\"value\":\"tab\\there\\\\\"}]}"
+        "]}\n";
+    static const char csv[] =
+        "identifier,type,element,name,kind,value\n"
+        GOLDEN_ID ",0x10200003,0x12000004,description,string,"
+        "\"say \"\"hi\"\", C:\\Windows\n\r\t\x01\x1f caf\xc3\xa9 \xe2\x82\xac\"\n"
+        GOLDEN_ID ",0x10200003,0x12000005,locale,string,tab\there\\\n";
+    static const char taggedCsv[] =
+        "\"st\"\"ore,1\\\"," GOLDEN_ID ",0x10200003,0x12000004,description,string,"
+        "\"say \"\"hi\"\", C:\\Windows\n\r\t\x01\x1f caf\xc3\xa9 \xe2\x82\xac\"\n"
+        "\"st\"\"ore,1\\\"," GOLDEN_ID ",0x10200003,0x12000005,locale,string,tab\there\\\n";
+
+    BCD_OBJECT object;
+    memset(&object, 0, sizeof(object));
+    CHECK(BcdParseObjectId(GOLDEN_ID, &object.id) == BCD_OK);
+    object.objectType = BCD_OBJECT_OSLOADER;
+    CHECK(add_string_element(&object, BCD_ELEMENT_DESCRIPTION, description) == BCD_OK);
+    CHECK(add_string_element(&object, 0x12000005U, locale) == BCD_OK);
+
+    struct {
+        BCD_OUTPUT_FORMAT format;
+        const char *store;
+        const char *expected;
+    } cases[] = {
+        {BCD_FORMAT_JSON, NULL, json},
+        {BCD_FORMAT_JSON, GOLDEN_STORE, taggedJson},
+        {BCD_FORMAT_CSV, NULL, csv},
+        {BCD_FORMAT_CSV, GOLDEN_STORE, taggedCsv},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        char *text = render_object(&object, cases[i].format, cases[i].store);
+        CHECK(text != NULL);
+        int same = strcmp(text, cases[i].expected) == 0;
+        if (!same) fprintf(stderr, "case %zu rendered:\n%s", i, text);
+        free(text);
+        CHECK(same);
+    }
+    BcdObjectRelease(&object);
+    return 0;
+}
+
+/* Element ids written by the original serializer, before the catalog. */
+#define LEGACY_DISPLAY_ORDER 0x24000002U
+#define LEGACY_RECOVERY_SEQUENCE 0x24000001U
+#define LEGACY_BOOTDEBUG 0x26000010U
+#define LEGACY_EMS 0x26000022U
+
+/* A store as the original serializer left it: object 0 carries elements
+ * under the old ids and the base block has no format version. */
+static int write_legacy_store(char *path)
+{
+    static const uint8_t order[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    int status = BCD_OK;
+    for (size_t i = 0; i < 3 && status == BCD_OK; ++i) status = add_object(&store, i);
+    BCD_OBJECT_ID id;
+    make_id(0, &id);
+    BCD_OBJECT *obj = BcdStoreFindObjectById(&store, &id);
+    BCD_ELEMENT el;
+    memset(&el, 0, sizeof(el));
+    el.type = LEGACY_DISPLAY_ORDER;
+    el.kind = BCD_ELEMENT_BINARY;
+    el.data.binaryValue.data = order;
+    el.data.binaryValue.size = sizeof(order);
+    if (status == BCD_OK) status = BcdObjectSetElement(obj, &el);
+    el.type = LEGACY_RECOVERY_SEQUENCE;
+    if (status == BCD_OK) status = BcdObjectSetElement(obj, &el);
+    memset(&el.data, 0, sizeof(el.data));
+    el.type = LEGACY_BOOTDEBUG;
+    el.kind = BCD_ELEMENT_INTEGER;
+    el.data.integerValue = 1;
+    if (status == BCD_OK) status = BcdObjectSetElement(obj, &el);
+    el.type = LEGACY_EMS;
+    el.data.integerValue = 0;
+    if (status == BCD_OK) status = BcdObjectSetElement(obj, &el);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    if (status == BCD_OK) status = RegfSerializeBcdStore(&store, &image, &size);
+    BcdStoreRelease(&store);
+    if (status != BCD_OK) return status;
+    set_le32(image + 0x14, 0);
+    set_le32(image + 0x18, 0);
+    seal_base_block(image);
+    status = write_temp(image, size, path);
+    free(image);
+    return status;
+}
+
+/* Object 0 of write_legacy_store reads back under the current ids. */
+static int check_migrated_ids(BCD_STORE *store)
+{
+    BCD_OBJECT_ID id;
+    make_id(0, &id);
+    BCD_OBJECT *obj = BcdStoreFindObjectById(store, &id);
+    CHECK(obj != NULL);
+    CHECK(BcdObjectGetElementCount(obj) == 5);
+    BCD_ELEMENT *el = BcdObjectFindElement(obj, BCD_ELEMENT_DISPLAY_ORDER);
+    CHECK(el && el->kind == BCD_ELEMENT_BINARY && el->data.binaryValue.size == 16 && el->data.binaryValue.data[15] == 16);
+    CHECK(BcdObjectFindElement(obj, BCD_ELEMENT_RECOVERY_SEQUENCE) != NULL);
+    el = BcdObjectFindElement(obj, BCD_ELEMENT_BOOLEAN_BOOTDEBUG);
+    CHECK(el && el->kind == BCD_ELEMENT_INTEGER && el->data.integerValue == 1);
+    CHECK(BcdObjectFindElement(obj, BCD_ELEMENT_BOOLEAN_EMS) != NULL);
+    /* The old ids collide with current elements and must not show up as them. */
+    CHECK(BcdObjectFindElement(obj, BCD_ELEMENT_BOOT_SEQUENCE) == NULL);
+    CHECK(BcdObjectFindElement(obj, LEGACY_BOOTDEBUG) == NULL);
+    return 0;
+}
+
+/* Stores written before the element catalog renumbered inherit, the boot
+ * sequences and the debug/EMS switches are read under the current ids, and
+ * the first edit rewrites them whole so the file no longer needs the remap. */
+static int test_legacy_element_ids(void)
+{
+    char path[32];
+    CHECK(write_legacy_store(path) == BCD_OK);
+    BCD_STORE store;
+    REGF_HIVE *hive = NULL;
+    CHECK(load_bcd_store(stderr, path, &store, 0, STORE_READ, &hive) == BCD_OK);
+    CHECK(check_objects(&store, 3, 3) == 0);
+    CHECK(check_migrated_ids(&store) == 0);
+    BcdStoreRelease(&store);
+    CHECK(load_bcd_store(stderr, path, &store, 0, STORE_BROWSE, &hive) == BCD_OK);
+    CHECK(RegfIsLegacyBcdHive(hive));
+    CHECK(check_migrated_ids(&store) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+
+    CHECK(commit_one_edit(path, 3, 0) == BCD_OK);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(read_whole_file(path, &image, &size) == BCD_OK);
+    CHECK(get_le32(image + 0x14) == 1);
+    free(image);
+    hive = RegfOpenFile(path);
+    CHECK(hive != NULL && !RegfIsLegacyBcdHive(hive));
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    CHECK(check_objects(&store, 4, 4) == 0);
+    CHECK(check_migrated_ids(&store) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    remove_store(path);
+    return 0;
+}
+
+/* Every catalog entry is found by its id and by each of its names, aliases
+ * resolving to the canonical entry, and ids or names outside it are not. */
+static int test_element_catalog(void)
+{
+    for (size_t i = 0; i < ELEMENT_COUNT; ++i) {
+        const BCD_ELEMENT_META *expected = &g_elementTable[i];
+        const BCD_ELEMENT_META *meta = BcdLookupElementById(expected->id);
+        CHECK(meta && meta->id == expected->id && strcmp(meta->name, expected->name) == 0 &&
+              meta->kind == expected->kind);
+        CHECK(BcdLookupElementByName(expected->name) == meta);
+    }
+    for (size_t i = 0; i < sizeof(g_elementNames) / sizeof(g_elementNames[0]); ++i) {
+        const BCD_ELEMENT_META *meta = BcdLookupElementByName(g_elementNames[i].name);
+        CHECK(meta && meta->id == g_elementTable[g_elementNames[i].element].id);
+    }
+    for (size_t i = 0; i < ELEMENT_COUNT; ++i) {
+        uint32_t id = g_elementTable[i].id ^ 0x00800000U;
+        int listed = 0;
+        for (size_t j = 0; j < ELEMENT_COUNT && !listed; ++j) listed = g_elementTable[j].id == id;
+        if (!listed) CHECK(BcdLookupElementById(id) == NULL);
+    }
+    CHECK(BcdLookupElementById(0) == NULL);
+    CHECK(BcdLookupElementByName("") == NULL);
+    CHECK(BcdLookupElementByName("nosuchelement") == NULL);
+    CHECK(BcdLookupElementByName("Description") == NULL);
+    CHECK(BcdLookupElementByName(NULL) == NULL);
+    return 0;
+}
+
+#define PARALLEL_OBJECT_COUNT 256U
+
+/* Two loaded objects hold the same id, type and elements, in the same order. */
+static int objects_equal(BCD_OBJECT *a, BCD_OBJECT *b)
+{
+    CHECK(memcmp(&a->id, &b->id, sizeof(a->id)) == 0 && a->objectType == b->objectType);
+    CHECK(BcdObjectGetElementCount(a) == BcdObjectGetElementCount(b));
+    for (size_t e = 0; e < BcdObjectGetElementCount(a); ++e) {
+        BCD_ELEMENT *x = BcdObjectGetElementAt(a, e);
+        BCD_ELEMENT *y = BcdObjectGetElementAt(b, e);
+        CHECK(x->type == y->type && x->kind == y->kind);
+        if (x->kind == BCD_ELEMENT_STRING) {
+            CHECK(strcmp(x->data.stringValue, y->data.stringValue) == 0);
+        } else if (x->kind == BCD_ELEMENT_BINARY) {
+            CHECK(x->data.binaryValue.size == y->data.binaryValue.size);
+            CHECK(memcmp(x->data.binaryValue.data, y->data.binaryValue.data, x->data.binaryValue.size) == 0);
+        } else {
+            CHECK(x->data.integerValue == y->data.integerValue);
+        }
+    }
+    return 0;
+}
+
+/* Loading with worker threads gives the store a serial load gives: the same
+ * objects in the same order with the same elements, serializing to the same
+ * bytes. The object count leaves room for several workers of
+ * MIN_OBJECTS_PER_WORKER objects each. */
+static int test_parallel_load_matches_serial(void)
+{
+    BCD_STORE source;
+    BcdStoreInit(&source);
+    uint8_t bytes[64];
+    for (size_t i = 0; i < sizeof(bytes); ++i) bytes[i] = (uint8_t)(i * 37);
+    for (size_t i = 0; i < PARALLEL_OBJECT_COUNT; ++i) {
+        CHECK(add_object(&source, i) == BCD_OK);
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(&source, i);
+        BCD_ELEMENT el;
+        memset(&el, 0, sizeof(el));
+        el.type = BCD_ELEMENT_TIMEOUT;
+        el.kind = BCD_ELEMENT_INTEGER;
+        el.data.integerValue = i * 7;
+        CHECK(BcdObjectSetElement(obj, &el) == BCD_OK);
+        memset(&el.data, 0, sizeof(el.data));
+        el.type = BCD_ELEMENT_DISPLAY_ORDER;
+        el.kind = BCD_ELEMENT_BINARY;
+        el.data.binaryValue.data = bytes + i % 16;
+        el.data.binaryValue.size = 16 + i % 48;
+        CHECK(BcdObjectSetElement(obj, &el) == BCD_OK);
+    }
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(RegfSerializeBcdStore(&source, &image, &size) == BCD_OK);
+    BcdStoreRelease(&source);
+    char path[32];
+    CHECK(write_temp(image, size, path) == BCD_OK);
+    free(image);
+
+    BCD_STORE serial;
+    CHECK(load_bcd_store(stderr, path, &serial, 1, STORE_READ, NULL) == BCD_OK);
+    CHECK(check_objects(&serial, PARALLEL_OBJECT_COUNT, PARALLEL_OBJECT_COUNT) == 0);
+    unsigned char *serialImage = NULL;
+    size_t serialSize = 0;
+    CHECK(RegfSerializeBcdStore(&serial, &serialImage, &serialSize) == BCD_OK);
+    static const int threadCounts[] = {2, 4, 7, 64};
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+        BCD_STORE parallel;
+        CHECK(load_bcd_store(stderr, path, &parallel, threadCounts[t], STORE_READ, NULL) == BCD_OK);
+        CHECK(BcdStoreGetObjectCount(&parallel) == PARALLEL_OBJECT_COUNT);
+        for (size_t i = 0; i < PARALLEL_OBJECT_COUNT; ++i) {
+            CHECK(objects_equal(BcdStoreGetObjectAt(&serial, i), BcdStoreGetObjectAt(&parallel, i)) == 0);
+        }
+        unsigned char *parallelImage = NULL;
+        size_t parallelSize = 0;
+        CHECK(RegfSerializeBcdStore(&parallel, &parallelImage, &parallelSize) == BCD_OK);
+        CHECK(parallelSize == serialSize && memcmp(parallelImage, serialImage, serialSize) == 0);
+        free(parallelImage);
+        BcdStoreRelease(&parallel);
+    }
+    free(serialImage);
+    BcdStoreRelease(&serial);
+    unlink(path);
+    return 0;
+}
+
+#define LIST_OBJECT_COUNT 12
+
+/* Append a cell holding data to the bin being filled at image + *next;
+ * returns its hive offset. */
+static int32_t put_cell(unsigned char *image, size_t *next, const unsigned char *data, size_t length)
+{
+    size_t size = (length + 4 + 7) & ~(size_t)7;
+    set_le32(image + *next, (uint32_t)-(int32_t)size);
+    memcpy(image + *next + 4, data, length);
+    int32_t offset = (int32_t)(*next - 0x1000);
+    *next += size;
+    return offset;
+}
+
+/* An li/lf/lh list over children[first, first + count), or an ri root over
+ * count sublists when sig is "ri". lf entries carry the first four characters
+ * of the child's name, lh entries the registry name hash. */
+static int32_t put_subkey_list(unsigned char *image, size_t *next, const char *sig, const int32_t *children,
+                               int first, int count)
+{
+    unsigned char cell[8 + LIST_OBJECT_COUNT * 8];
+    size_t stride = sig[1] == 'i' ? 4 : 8;
+    memcpy(cell, sig, 2);
+    cell[2] = (unsigned char)count;
+    cell[3] = 0;
+    for (int i = 0; i < count; ++i) {
+        unsigned char *entry = cell + 4 + i * stride;
+        set_le32(entry, (uint32_t)children[first + i]);
+        if (stride == 4) continue;
+        const unsigned char *nk = image + 0x1000 + children[first + i];
+        size_t nameLength = (size_t)nk[0x4c] | ((size_t)nk[0x4d] << 8);
+        uint32_t hint = 0;
+        for (size_t c = 0; c < nameLength; ++c) {
+            int ch = nk[0x50 + c];
+            if (ch >= 'a' && ch <= 'z') ch -= 'a' - 'A';
+            if (sig[1] == 'h') hint = hint * 37 + (uint32_t)ch;
+            else if (c < 4) hint |= (uint32_t)nk[0x50 + c] << (8 * c);
+        }
+        set_le32(entry + 4, hint);
+    }
+    return put_cell(image, next, cell, 4 + (size_t)count * stride);
+}
+
+/* Copy of a LIST_OBJECT_COUNT-object hive with a 4 KB bin appended for new
+ * cells, which are put from *next on; children receives the offsets of the
+ * root's subkeys. */
+static unsigned char *append_bin(const unsigned char *source, size_t sourceSize, size_t *next, int32_t *children)
+{
+    unsigned char *image = (unsigned char *)calloc(1, sourceSize + 0x1000);
+    if (!image) return NULL;
+    memcpy(image, source, sourceSize);
+    uint32_t binOffset = (uint32_t)(sourceSize - 0x1000);
+    memcpy(image + sourceSize, "hbin", 4);
+    set_le32(image + sourceSize + 4, binOffset);
+    set_le32(image + sourceSize + 8, 0x1000);
+    set_le32(image + 0x28, binOffset + 0x1000);
+    const unsigned char *root = image + 0x1000 + get_le32(image + 0x24);
+    const unsigned char *lh = image + 0x1000 + get_le32(root + 0x20);
+    for (int i = 0; i < LIST_OBJECT_COUNT; ++i) children[i] = (int32_t)get_le32(lh + 8 + i * 8);
+    *next = sourceSize + 0x20;
+    return image;
+}
+
+/* Point key (a hive offset) at a new list of count subkeys. */
+static void set_subkey_list(unsigned char *image, int32_t key, int32_t list, int count)
+{
+    set_le32(image + 0x1000 + key + 0x18, (uint32_t)count);
+    set_le32(image + 0x1000 + key + 0x20, (uint32_t)list);
+}
+
+/* Leave the rest of the appended bin as one free cell and reseal. */
+static void close_bin(unsigned char *image, size_t size, size_t next)
+{
+    set_le32(image + next, (uint32_t)(size - next));
+    seal_base_block(image);
+}
+
+/* Copy of a LIST_OBJECT_COUNT-object hive whose root subkey list is rebuilt,
+ * in a bin appended for it, in the layout named by layout. */
+static int build_list_layout(const unsigned char *source, size_t sourceSize, const char *layout,
+                             unsigned char **outImage, size_t *outSize)
+{
+    size_t size = sourceSize + 0x1000;
+    size_t next = 0;
+    int32_t children[LIST_OBJECT_COUNT];
+    unsigned char *image = append_bin(source, sourceSize, &next, children);
+    if (!image) return BCD_ERR_CAPACITY;
+    int32_t list;
+    if (strcmp(layout, "ri") == 0) {
+        int32_t sublists[3];
+        sublists[0] = put_subkey_list(image, &next, "lh", children, 0, 4);
+        sublists[1] = put_subkey_list(image, &next, "lh", children, 4, 5);
+        sublists[2] = put_subkey_list(image, &next, "lh", children, 9, 3);
+        list = put_subkey_list(image, &next, "ri", sublists, 0, 3);
+    } else if (strcmp(layout, "mixed") == 0) {
+        int32_t sublists[2];
+        sublists[0] = put_subkey_list(image, &next, "li", children, 0, 6);
+        sublists[1] = put_subkey_list(image, &next, "lf", children, 6, 6);
+        list = put_subkey_list(image, &next, "ri", sublists, 0, 2);
+    } else {
+        list = put_subkey_list(image, &next, layout, children, 0, LIST_OBJECT_COUNT);
+    }
+    set_subkey_list(image, (int32_t)get_le32(image + 0x24), list, LIST_OBJECT_COUNT);
+    close_bin(image, size, next);
+    *outImage = image;
+    *outSize = size;
+    return BCD_OK;
+}
+
+/* The root of a hive built by build_list_layout yields every child in list
+ * order through indexing and the cursor, and finds each by name. */
+static int check_list_layout(const unsigned char *image, size_t size)
+{
+    REGF_HIVE *hive = RegfOpen(image, size);
+    CHECK(hive != NULL);
+    REGF_KEY *root = RegfGetRootKey(hive);
+    CHECK(RegfGetSubKeyCount(root) == LIST_OBJECT_COUNT);
+    REGF_SUBKEY_CURSOR cursor;
+    CHECK(RegfSubKeyCursorBegin(root, &cursor) == BCD_OK);
+    int index = 0;
+    REGF_KEY *child = NULL;
+    while (RegfSubKeyCursorNext(&cursor, &child)) {
+        CHECK(child != NULL && index < LIST_OBJECT_COUNT);
+        REGF_KEY *byIndex = RegfGetSubKeyAt(root, index);
+        CHECK(byIndex && RegfGetKeyOffset(byIndex) == RegfGetKeyOffset(child));
+        RegfReleaseKey(byIndex);
+        REGF_NAME name = RegfGetKeyName(child);
+        char text[64];
+        CHECK(RegfNameCopy(name, text, sizeof(text)) < sizeof(text));
+        REGF_KEY *found = RegfFindSubKey(root, text);
+        CHECK(found && RegfGetKeyOffset(found) == RegfGetKeyOffset(child));
+        RegfReleaseKey(found);
+        /* Lookups ignore case. */
+        for (char *c = text; *c; ++c) {
+            if (*c >= 'A' && *c <= 'Z') *c = (char)(*c - 'A' + 'a');
+            else if (*c >= 'a' && *c <= 'z') *c = (char)(*c - 'a' + 'A');
+        }
+        found = RegfFindSubKey(root, text);
+        CHECK(found && RegfGetKeyOffset(found) == RegfGetKeyOffset(child));
+        RegfReleaseKey(found);
+        RegfReleaseKey(child);
+        ++index;
+    }
+    CHECK(index == LIST_OBJECT_COUNT);
+    CHECK(RegfFindSubKey(root, "{00000000-0000-0000-0000-000000000000}") == NULL);
+    CHECK(RegfFindSubKey(root, "{ffffffff-ffff-ffff-ffff-ffffffffffff}") == NULL);
+    CHECK(RegfFindSubKey(root, "") == NULL);
+    CHECK(RegfFindSubKey(root, "Type") == NULL);
+    RegfClose(hive);
+    return 0;
+}
+
+/* Every subkey list kind other hives use reads the same as the lh lists this
+ * tool writes: li, lf and lh lists, an ri root over several lh lists, and an
+ * ri root mixing li and lf lists, which must be searched by name rather than
+ * by lf hints the li entries do not have. */
+static int test_subkey_list_kinds(void)
+{
+    unsigned char *source = NULL;
+    size_t sourceSize = 0;
+    CHECK(serialize_objects(LIST_OBJECT_COUNT, &source, &sourceSize) == BCD_OK);
+    static const char *const layouts[] = {"li", "lf", "lh", "ri", "mixed"};
+    for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); ++i) {
+        unsigned char *image = NULL;
+        size_t size = 0;
+        CHECK(build_list_layout(source, sourceSize, layouts[i], &image, &size) == BCD_OK);
+        int rc = check_list_layout(image, size);
+        free(image);
+        if (rc != 0) fprintf(stderr, "subkey list layout %s\n", layouts[i]);
+        CHECK(rc == 0);
+    }
+    free(source);
+    return 0;
+}
+
+/* Over two big-data segments of 16344 bytes, so the value is written as a db
+ * record with three segments. */
+#define BIG_VALUE_SIZE 40000U
+#define BIG_VALUE_SEGMENT 16344U
+
+/* The first allocated cell in image whose signature is sig, or NULL. */
+static unsigned char *find_cell(unsigned char *image, size_t size, const char *sig)
+{
+    for (size_t bin = 0x1000; bin + 0x20 <= size && memcmp(image + bin, "hbin", 4) == 0;) {
+        size_t binSize = get_le32(image + bin + 8);
+        for (size_t pos = bin + 0x20; pos + 8 <= bin + binSize;) {
+            int32_t cellSize = (int32_t)get_le32(image + pos);
+            if (cellSize == 0) break;
+            if (cellSize < 0 && memcmp(image + pos + 4, sig, 2) == 0) return image + pos;
+            pos += (size_t)(cellSize < 0 ? -cellSize : cellSize);
+        }
+        bin += binSize;
+    }
+    return NULL;
+}
+
+/* Stream object 0's big value through a data cursor into out; returns the
+ * cursor's first failure, or the number of chunks it produced. */
+static int read_big_value(const unsigned char *image, size_t size, unsigned char *out)
+{
+    REGF_HIVE *hive = RegfOpen(image, size);
+    if (!hive) return BCD_ERR_PARSE;
+    REGF_KEY *key = RegfGetSubKeyAt(RegfGetRootKey(hive), 0);
+    char name[16];
+    snprintf(name, sizeof(name), "%08x", BCD_ELEMENT_DISPLAY_ORDER);
+    REGF_VALUE *value = key ? RegfFindValue(key, name) : NULL;
+    REGF_DATA_CURSOR cursor;
+    int status = value ? RegfValueDataBegin(value, &cursor) : BCD_ERR_PARSE;
+    int chunks = 0;
+    size_t copied = 0;
+    const void *chunk = NULL;
+    size_t chunkSize = 0;
+    while (status == BCD_OK && (status = RegfValueDataNext(&cursor, &chunk, &chunkSize)) == 1) {
+        if (chunkSize > BIG_VALUE_SIZE - copied || (chunkSize != BIG_VALUE_SEGMENT && copied + chunkSize != BIG_VALUE_SIZE)) {
+            status = BCD_ERR_PARSE;
+            break;
+        }
+        memcpy(out + copied, chunk, chunkSize);
+        copied += chunkSize;
+        ++chunks;
+        status = BCD_OK;
+    }
+    if (status == 0 && copied != BIG_VALUE_SIZE) status = BCD_ERR_PARSE;
+    RegfReleaseValue(value);
+    RegfReleaseKey(key);
+    RegfClose(hive);
+    return status == 0 ? chunks : status;
+}
+
+/* A binary element larger than one cell round trips through a db record in
+ * segments, both through the loader and a data cursor. A db record whose
+ * segment list is short, or holds a segment outside the hive or too small
+ * for its share, reads as BCD_ERR_PARSE,
+ * and the loader keeps the element as unknown instead of failing. */
+static int test_big_data_values(void)
+{
+    unsigned char *payload = (unsigned char *)malloc(BIG_VALUE_SIZE);
+    unsigned char *copy = (unsigned char *)malloc(BIG_VALUE_SIZE);
+    CHECK(payload && copy);
+    for (size_t i = 0; i < BIG_VALUE_SIZE; ++i) payload[i] = (unsigned char)(i * 7 + (i >> 9));
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    CHECK(add_object(&store, 0) == BCD_OK);
+    BCD_ELEMENT el;
+    memset(&el, 0, sizeof(el));
+    el.type = BCD_ELEMENT_DISPLAY_ORDER;
+    el.kind = BCD_ELEMENT_BINARY;
+    el.data.binaryValue.data = payload;
+    el.data.binaryValue.size = BIG_VALUE_SIZE;
+    CHECK(BcdObjectSetElement(BcdStoreGetObjectAt(&store, 0), &el) == BCD_OK);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(RegfSerializeBcdStore(&store, &image, &size) == BCD_OK);
+    BcdStoreRelease(&store);
+
+    CHECK(read_big_value(image, size, copy) == 3);
+    CHECK(memcmp(copy, payload, BIG_VALUE_SIZE) == 0);
+    REGF_HIVE *hive = RegfOpen(image, size);
+    CHECK(hive != NULL);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    BCD_ELEMENT *loaded = BcdObjectFindElement(BcdStoreGetObjectAt(&store, 0), BCD_ELEMENT_DISPLAY_ORDER);
+    CHECK(loaded && loaded->kind == BCD_ELEMENT_BINARY && loaded->data.binaryValue.size == BIG_VALUE_SIZE);
+    CHECK(memcmp(loaded->data.binaryValue.data, payload, BIG_VALUE_SIZE) == 0);
+    BcdStoreRelease(&store);
+    RegfClose(hive);
+
+    unsigned char *db = find_cell(image, size, "db");
+    CHECK(db != NULL && db[6] == 3 && db[7] == 0);
+    unsigned char *segments = image + 0x1000 + get_le32(db + 8);
+    /* Too few segments for the value size. */
+    db[6] = 2;
+    CHECK(read_big_value(image, size, copy) == BCD_ERR_PARSE);
+    /* More segments than the list cell holds. */
+    db[6] = 200;
+    CHECK(read_big_value(image, size, copy) == BCD_ERR_PARSE);
+    db[6] = 3;
+    /* A segment outside the hive. */
+    set_le32(segments + 8, 0x7ffffff8U);
+    CHECK(read_big_value(image, size, copy) == BCD_ERR_PARSE);
+    hive = RegfOpen(image, size);
+    CHECK(hive != NULL);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    loaded = BcdObjectFindElement(BcdStoreGetObjectAt(&store, 0), BCD_ELEMENT_DISPLAY_ORDER);
+    CHECK(loaded && loaded->kind == BCD_ELEMENT_UNKNOWN);
+    BcdStoreRelease(&store);
+    RegfClose(hive);
+    /* A middle segment too short for a full share: the last one, again. */
+    set_le32(segments + 8, get_le32(segments + 12));
+    CHECK(read_big_value(image, size, copy) == BCD_ERR_PARSE);
+    free(image);
+    free(copy);
+    free(payload);
+    return 0;
+}
+
+/* RegfMeasureBcdStore sizes the hive RegfWriteBcdStore then lays out exactly:
+ * the same bytes as RegfSerializeBcdStore, whatever the buffer held before,
+ * and the same bytes on every run. A buffer of any other size is refused
+ * untouched. */
+static int test_measured_serialization(void)
+{
+    static const size_t counts[] = {0, 1, 20, 300};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        BCD_STORE store;
+        BcdStoreInit(&store);
+        for (size_t i = 0; i < counts[c]; ++i) {
+            CHECK(add_object(&store, i) == BCD_OK);
+            BCD_ELEMENT el;
+            memset(&el, 0, sizeof(el));
+            el.type = BCD_ELEMENT_TIMEOUT;
+            el.kind = BCD_ELEMENT_INTEGER;
+            el.data.integerValue = i;
+            CHECK(BcdObjectSetElement(BcdStoreGetObjectAt(&store, i), &el) == BCD_OK);
+        }
+        size_t measured = 0;
+        CHECK(RegfMeasureBcdStore(&store, &measured) == BCD_OK);
+        unsigned char *first = NULL;
+        unsigned char *second = NULL;
+        size_t firstSize = 0;
+        size_t secondSize = 0;
+        CHECK(RegfSerializeBcdStore(&store, &first, &firstSize) == BCD_OK);
+        CHECK(RegfSerializeBcdStore(&store, &second, &secondSize) == BCD_OK);
+        CHECK(firstSize == measured && secondSize == measured);
+        CHECK(memcmp(first, second, measured) == 0);
+
+        unsigned char *out = (unsigned char *)malloc(measured + 0x1000);
+        CHECK(out != NULL);
+        memset(out, 0xa5, measured + 0x1000);
+        CHECK(RegfWriteBcdStore(&store, out, measured) == BCD_OK);
+        CHECK(memcmp(out, first, measured) == 0);
+        memset(out, 0xa5, measured + 0x1000);
+        CHECK(RegfWriteBcdStore(&store, out, measured - 8) == BCD_ERR_INVALID_ARG);
+        CHECK(RegfWriteBcdStore(&store, out, measured + 0x1000) == BCD_ERR_INVALID_ARG);
+        CHECK(out[0] == 0xa5 && out[measured - 1] == 0xa5);
+        free(out);
+        free(second);
+        free(first);
+        BcdStoreRelease(&store);
+    }
+    return 0;
+}
+
+/* A lazily loaded store reads only object headers up front; touching one
+ * object's elements decodes that object and no other. */
+static int test_lazy_materialize(void)
+{
+    char path[32];
+    CHECK(write_store(20, path) == BCD_OK);
+    REGF_HIVE *hive = RegfOpenFile(path);
+    CHECK(hive != NULL);
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    BcdStatsReset();
+    CHECK(BcdStoreLoadFromHiveLazy(&store, hive) == BCD_OK);
+    BCD_STATS stats;
+    BcdStatsSnapshot(&stats);
+    CHECK(stats.counters[BCD_STAT_OBJECTS_LOADED] == 20);
+    CHECK(stats.counters[BCD_STAT_ELEMENTS_LOADED] == 0);
+    CHECK(BcdStoreGetObjectCount(&store) == 20);
+    for (size_t i = 0; i < 20; ++i) {
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(&store, i);
+        CHECK(obj->pending && obj->objectType == BCD_OBJECT_OSLOADER);
+    }
+
+    BCD_OBJECT_ID id;
+    make_id(5, &id);
+    BCD_OBJECT *touched = BcdStoreFindObjectById(&store, &id);
+    CHECK(touched != NULL && touched->pending);
+    BCD_ELEMENT *el = BcdObjectFindElement(touched, BCD_ELEMENT_DESCRIPTION);
+    CHECK(el && strcmp(el->data.stringValue, "object 5") == 0);
+    BcdStatsSnapshot(&stats);
+    CHECK(stats.counters[BCD_STAT_ELEMENTS_LOADED] == 1);
+    for (size_t i = 0; i < 20; ++i) {
+        BCD_OBJECT *obj = BcdStoreGetObjectAt(&store, i);
+        CHECK(obj->pending == (obj != touched));
+    }
+
+    CHECK(BcdStoreMaterialize(&store) == BCD_OK);
+    BcdStatsSnapshot(&stats);
+    CHECK(stats.counters[BCD_STAT_ELEMENTS_LOADED] == 20);
+    CHECK(check_objects(&store, 20, 20) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    unlink(path);
+    return 0;
+}
+
+/* A full load counts every object, element and byte it read, and closing
+ * the hive returns every key and value handle the load took. */
+static int test_load_stats(void)
+{
+    char path[32];
+    CHECK(write_store(30, path) == BCD_OK);
+    BcdStatsReset();
+    REGF_HIVE *hive = RegfOpenFile(path);
+    CHECK(hive != NULL);
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    RegfCloseFile(hive);
+    BcdStoreRelease(&store);
+    BCD_STATS stats;
+    BcdStatsSnapshot(&stats);
+    CHECK(stats.counters[BCD_STAT_OBJECTS_LOADED] == 30);
+    CHECK(stats.counters[BCD_STAT_OBJECTS_SKIPPED] == 0);
+    CHECK(stats.counters[BCD_STAT_ELEMENTS_LOADED] == 30);
+    CHECK(stats.counters[BCD_STAT_ELEMENTS_SKIPPED] == 0);
+    CHECK(stats.counters[BCD_STAT_BYTES_READ] == file_size(path));
+    CHECK(stats.counters[BCD_STAT_KEYS_ALLOCATED] >= 30);
+    CHECK(stats.counters[BCD_STAT_KEYS_FREED] == stats.counters[BCD_STAT_KEYS_ALLOCATED]);
+    CHECK(stats.counters[BCD_STAT_VALUES_ALLOCATED] >= 60);
+    CHECK(stats.counters[BCD_STAT_VALUES_FREED] == stats.counters[BCD_STAT_VALUES_ALLOCATED]);
+    CHECK(stats.counters[BCD_STAT_CELLS_VISITED] > 0 && stats.counters[BCD_STAT_CELLS_REJECTED] == 0);
+    unlink(path);
+    return 0;
+}
+
+/* Open path with cache, load it fully and close it; returns the handle
+ * blocks the round allocated, or -1. */
+static long cached_load_blocks(const char *path, REGF_HANDLE_CACHE *cache)
+{
+    BcdStatsReset();
+    REGF_HIVE *hive = RegfOpenFileCached(path, cache);
+    if (!hive) return -1;
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    int status = BcdStoreLoadFromHive(&store, hive);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    BCD_STATS stats;
+    BcdStatsSnapshot(&stats);
+    return status == BCD_OK ? (long)stats.counters[BCD_STAT_HANDLE_BLOCKS] : -1;
+}
+
+/* Hives opened in turn with one handle cache reuse the first hive's handle
+ * blocks instead of allocating their own. */
+static int test_handle_cache_reuse(void)
+{
+    char path[32];
+    CHECK(write_store(40, path) == BCD_OK);
+    REGF_HANDLE_CACHE *cache = RegfHandleCacheCreate();
+    CHECK(cache != NULL);
+    long first = cached_load_blocks(path, cache);
+    CHECK(first > 0);
+    CHECK(cached_load_blocks(path, cache) == 0);
+    CHECK(cached_load_blocks(path, cache) == 0);
+    CHECK(cached_load_blocks(path, NULL) == first);
+    RegfHandleCacheDestroy(cache);
+    unlink(path);
+    return 0;
+}
+
+#define WALK_KEY_COUNT 6
+
+/* Records a walk over a hive built by build_walk_tree: keys as '0'-'5' by
+ * their object index ('R' for the root), values as a count. */
+struct walk_log {
+    int32_t keys[WALK_KEY_COUNT];
+    char order[16];
+    size_t visits;
+    int deepest;
+    int skipAt;         /* key index answered with SKIP, or -1 */
+    int stopAt;         /* key index answered with STOP, or -1 */
+    int skipValues;     /* answer every value with SKIP */
+    int values;
+};
+
+static int log_key(REGF_KEY *key, int depth, void *context)
+{
+    struct walk_log *log = (struct walk_log *)context;
+    int index = -1;
+    for (int i = 0; i < WALK_KEY_COUNT; ++i) {
+        if (log->keys[i] == RegfGetKeyOffset(key)) index = i;
+    }
+    if (log->visits < sizeof(log->order) - 1) log->order[log->visits] = index < 0 ? 'R' : (char)('0' + index);
+    log->visits++;
+    if (depth > log->deepest) log->deepest = depth;
+    if (index >= 0 && index == log->stopAt) return REGF_VISIT_STOP;
+    if (index >= 0 && index == log->skipAt) return REGF_VISIT_SKIP;
+    return REGF_VISIT_CONTINUE;
+}
+
+static int log_value(REGF_KEY *key, REGF_VALUE *value, int depth, void *context)
+{
+    (void)key;
+    (void)value;
+    (void)depth;
+    struct walk_log *log = (struct walk_log *)context;
+    log->values++;
+    return log->skipValues ? REGF_VISIT_SKIP : REGF_VISIT_CONTINUE;
+}
+
+/* Nest the first six objects of a LIST_OBJECT_COUNT-object hive as
+ *   root -> 0 -> 2 -> 5,  0 -> 3,  root -> 1 -> 4
+ * and, with cycle set, hang key 0 under key 5 as well. */
+static int build_walk_tree(const unsigned char *source, size_t sourceSize, int cycle, int32_t *keys,
+                           unsigned char **outImage, size_t *outSize)
+{
+    size_t size = sourceSize + 0x1000;
+    size_t next = 0;
+    int32_t children[LIST_OBJECT_COUNT];
+    unsigned char *image = append_bin(source, sourceSize, &next, children);
+    if (!image) return BCD_ERR_CAPACITY;
+    memcpy(keys, children, WALK_KEY_COUNT * sizeof(int32_t));
+    int32_t rootList[2] = {children[0], children[1]};
+    int32_t list0[2] = {children[2], children[3]};
+    set_subkey_list(image, (int32_t)get_le32(image + 0x24), put_subkey_list(image, &next, "lh", rootList, 0, 2), 2);
+    set_subkey_list(image, children[0], put_subkey_list(image, &next, "lh", list0, 0, 2), 2);
+    set_subkey_list(image, children[1], put_subkey_list(image, &next, "lh", children, 4, 1), 1);
+    set_subkey_list(image, children[2], put_subkey_list(image, &next, "lh", children, 5, 1), 1);
+    if (cycle) set_subkey_list(image, children[5], put_subkey_list(image, &next, "lh", children, 0, 1), 1);
+    close_bin(image, size, next);
+    *outImage = image;
+    *outSize = size;
+    return BCD_OK;
+}
+
+/* Walk image from its root, answering as log's settings say; returns the
+ * walk's status. */
+static int run_walk(const unsigned char *image, size_t size, REGF_WALK_ORDER order, int maxDepth,
+                    struct walk_log *log)
+{
+    REGF_HIVE *hive = RegfOpen(image, size);
+    if (!hive) return BCD_ERR_PARSE;
+    memset(log->order, 0, sizeof(log->order));
+    log->visits = 0;
+    log->deepest = 0;
+    log->values = 0;
+    REGF_WALK_VISITOR visitor = { log_key, log_value, log };
+    int status = RegfWalk(RegfGetRootKey(hive), order, maxDepth, &visitor);
+    RegfClose(hive);
+    return status;
+}
+
+/* Depth-first walks finish a subtree before its siblings and breadth-first
+ * walks a level before the next; SKIP passes over a key's values and subtree
+ * (or the rest of its values), STOP ends the walk, maxDepth limits it, and a
+ * cycle of keys ends at REGF_WALK_MAX_DEPTH. */
+static int test_walk_orders(void)
+{
+    unsigned char *source = NULL;
+    size_t sourceSize = 0;
+    CHECK(serialize_objects(LIST_OBJECT_COUNT, &source, &sourceSize) == BCD_OK);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    struct walk_log log;
+    memset(&log, 0, sizeof(log));
+    CHECK(build_walk_tree(source, sourceSize, 0, log.keys, &image, &size) == BCD_OK);
+    log.skipAt = log.stopAt = -1;
+
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R025314") == 0 && log.deepest == 3 && log.values == 12);
+    CHECK(run_walk(image, size, REGF_WALK_BREADTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R012345") == 0 && log.deepest == 3 && log.values == 12);
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 2, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R02314") == 0);
+    CHECK(run_walk(image, size, REGF_WALK_BREADTH_FIRST, 2, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R01234") == 0);
+
+    log.skipValues = 1;
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R025314") == 0 && log.values == 6);
+    log.skipValues = 0;
+    log.skipAt = 0;
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R014") == 0 && log.values == 4);
+    CHECK(run_walk(image, size, REGF_WALK_BREADTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R014") == 0 && log.values == 4);
+    log.skipAt = -1;
+    log.stopAt = 3;
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R0253") == 0);
+    CHECK(run_walk(image, size, REGF_WALK_BREADTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R0123") == 0);
+    free(image);
+
+    log.stopAt = -1;
+    CHECK(build_walk_tree(source, sourceSize, 1, log.keys, &image, &size) == BCD_OK);
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(log.deepest == REGF_WALK_MAX_DEPTH && log.visits < 2 * REGF_WALK_MAX_DEPTH);
+    CHECK(run_walk(image, size, REGF_WALK_BREADTH_FIRST, 0, &log) == BCD_OK);
+    CHECK(log.deepest == REGF_WALK_MAX_DEPTH && log.visits < 2 * REGF_WALK_MAX_DEPTH);
+    CHECK(run_walk(image, size, REGF_WALK_DEPTH_FIRST, 7, &log) == BCD_OK);
+    CHECK(strcmp(log.order, "R02502503314") == 0 && log.deepest == 7);
+    free(image);
+    free(source);
+    return 0;
+}
+
+/* Stores past 65535 objects are written with an ri root over several lh
+ * lists, read back whole, and updated in place without truncation. */
+static int test_large_store_round_trip(void)
+{
+    BCD_STORE store;
+    BcdStoreInit(&store);
+    for (size_t i = 0; i < LARGE_OBJECT_COUNT; ++i) CHECK(add_object(&store, i) == BCD_OK);
+    unsigned char *image = NULL;
+    size_t size = 0;
+    CHECK(RegfSerializeBcdStore(&store, &image, &size) == BCD_OK);
+    BcdStoreRelease(&store);
+
+    REGF_HIVE *hive = RegfOpen(image, size);
+    CHECK(hive != NULL);
+    REGF_KEY *root = RegfGetRootKey(hive);
+    CHECK(RegfGetSubKeyCount(root) == (int)LARGE_OBJECT_COUNT);
+    char name[BCD_ID_STRING_LENGTH + 1];
+    BCD_OBJECT_ID id;
+    make_id(LARGE_OBJECT_COUNT - 1, &id);
+    BcdFormatObjectId(&id, name, sizeof(name));
+    REGF_KEY *key = RegfFindSubKey(root, name);
+    CHECK(key != NULL);
+    RegfReleaseKey(key);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    CHECK(check_objects(&store, LARGE_OBJECT_COUNT, LARGE_OBJECT_COUNT) == 0);
+    BcdStoreRelease(&store);
+    RegfClose(hive);
+
+    char path[32];
+    CHECK(write_temp(image, size, path) == BCD_OK);
+    free(image);
+    hive = RegfOpenFileForUpdate(path);
+    CHECK(hive != NULL);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHiveLazy(&store, hive) == BCD_OK);
+    make_id(7, &id);
+    CHECK(BcdStoreDeleteObject(&store, &id) == BCD_OK);
+    CHECK(add_object(&store, LARGE_OBJECT_COUNT) == BCD_OK);
+    CHECK(RegfUpdateBcdStore(hive, &store) == BCD_OK);
+    CHECK(RegfWriteChanges(hive, path) == BCD_OK);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+
+    hive = RegfOpenFile(path);
+    CHECK(hive != NULL);
+    BcdStoreInit(&store);
+    CHECK(BcdStoreLoadFromHive(&store, hive) == BCD_OK);
+    CHECK(check_objects(&store, LARGE_OBJECT_COUNT + 1, 7) == 0);
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    remove_store(path);
+    return 0;
+}
+
+static const TEST g_tests[] = {
+    {"large_store_round_trip", test_large_store_round_trip},
+    {"subkey_list_kinds", test_subkey_list_kinds},
+    {"big_data_values", test_big_data_values},
+    {"measured_serialization", test_measured_serialization},
+    {"lazy_materialize", test_lazy_materialize},
+    {"load_stats", test_load_stats},
+    {"handle_cache_reuse", test_handle_cache_reuse},
+    {"walk_orders", test_walk_orders},
+    {"edit_growth_bounded", test_edit_growth_bounded},
+    {"edit_log_recovers_torn_write", test_edit_log_recovers_torn_write},
+    {"failed_write_keeps_sequence", test_failed_write_keeps_sequence},
+    {"log_replay", test_log_replay},
+    {"security_cell", test_security_cell},
+    {"parallel_load_matches_serial", test_parallel_load_matches_serial},
+    {"replace_file_atomic", test_replace_file_atomic},
+    {"daemon_requests", test_daemon_requests},
+    {"batch_all_or_nothing", test_batch_all_or_nothing},
+    {"snapshot_round_trip", test_snapshot_round_trip},
+    {"diff_classification", test_diff_classification},
+    {"scan_directory", test_scan_directory},
+    {"format_escaping", test_format_escaping},
+    {"parse_known_id", test_parse_known_id},
+    {"guid_variants", test_guid_variants},
+    {"legacy_element_ids", test_legacy_element_ids},
+    {"element_catalog", test_element_catalog},
+};
+
+/* With arguments, only the named cases run. */
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(g_tests) / sizeof(g_tests[0]); ++i) {
+        int selected = argc < 2;
+        for (int a = 1; a < argc && !selected; ++a) selected = strcmp(argv[a], g_tests[i].name) == 0;
+        if (!selected) continue;
+        int rc = g_tests[i].run();
+        printf("%s %s\n", rc == 0 ? "ok" : "FAIL", g_tests[i].name);
+        if (rc != 0) ++failed;
+    }
+    return failed ? 1 : 0;
+}
@@ -1,3 +1,7 @@
+#ifndef _WIN32
+#define _XOPEN_SOURCE 700   /* realpath, mkstemp */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,10 +9,23 @@
 #include "bcd.h"
 #include "regf.h"
 #include "bcd_parser.h"
+#include "bcd_daemon.h"
+#include "bcd_diff.h"
+#include "bcd_scan.h"
+#include "bcd_format.h"
+#include "bcd_snapshot.h"
+#include "bcd_stats.h"
 
 #ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #define DEFAULT_SYSTEM_STORE NULL
 #else
+#include <io.h>
 #include <windows.h>
 #endif
 
@@ -16,6 +33,8 @@ typedef enum {
     CMD_HELP,
     CMD_ENUM,
     CMD_EXPORT,
+    CMD_SNAPSHOT,
+    CMD_DIFF,
     CMD_IMPORT,
     CMD_CREATESTORE,
     CMD_CREATE,
@@ -28,21 +47,31 @@ typedef enum {
     CMD_DISPLAYORDER,
     CMD_BOOTSEQUENCE,
     CMD_TOOLSDISPLAYORDER,
+    CMD_BATCH,
+    CMD_DAEMON,
     CMD_UNKNOWN
 } COMMAND_TYPE;
 
 typedef struct OPTIONS {
     const char *storePath;
+    const char *scanPath;   /* /scan: directory or list of stores */
     COMMAND_TYPE command;
     const char *pathArg;
     char idText[64];
     char targetIdText[64];
+    const char *enumFilter;
     const char *elementName;
     const char **extraValues;
     int extraCount;
     int verbose;
+    BCD_OUTPUT_FORMAT format;   /* /json, /csv */
+    int threads;
+    int stats;              /* /stats: print counters and phase times to err */
     const char *application;
     const char *description;
+    const char *serverPath;
+    FILE *out;              /* command output */
+    FILE *err;              /* diagnostics */
 } OPTIONS;
 
 static void print_usage_summary(void)
@@ -50,10 +79,11 @@ static void print_usage_summary(void)
     printf("bcdedit-style tool (clean-room)\n");
     printf("Common commands:\n");
     printf("  bcdedit /? [command]             Show help\n");
-    printf("  bcdedit /enum [type] [/v]        Enumerate entries\n");
+    printf("  bcdedit /enum [type] [/v|/json|/csv]  Enumerate entries\n");
     printf("  bcdedit /createstore <file>      Create empty store\n");
     printf("  bcdedit /import <file>           Replace system/offline store with file contents\n");
     printf("  bcdedit /export <file>           Export store to hive file\n");
+    printf("  bcdedit /snapshot <file>         Save a decoded snapshot usable with /store\n");
     printf("  bcdedit /create {id|/d desc /application type}   Create new entry\n");
     printf("  bcdedit /copy <id> /d desc       Duplicate entry\n");
     printf("  bcdedit /delete <id>             Remove entry\n");
@@ -61,17 +91,54 @@ static void print_usage_summary(void)
     printf("  bcdedit /deletevalue <id> <element>     Remove element\n");
     printf("  bcdedit /default <id>            Set default entry\n");
     printf("  bcdedit /timeout <seconds>       Set boot timeout\n");
+    printf("  bcdedit /batch <file|->          Apply a script of edits, saving once\n");
+    printf("  bcdedit /diff <store> <store>... Compare stores object by object\n");
+    printf("Options:\n");
+    printf("  /store <file>                    Operate on an offline store (hive or snapshot)\n");
+    printf("  /scan <dir|listfile>             Run /enum over many stores on a thread pool\n");
+    printf("  /threads <n>                     Decode objects (or /scan stores) on n threads\n");
+    printf("  /server <socket>                 Forward the command to a running /daemon\n");
+    printf("  /stats                           Print load/write statistics as JSON to stderr\n");
+    printf("Daemon:\n");
+    printf("  bcdedit /daemon <socket>         Serve cached stores over a Unix socket\n");
 }
 
 static void print_usage_command(const char *cmd)
 {
     if (!cmd) return;
     if (strcmp(cmd, "enum") == 0) {
-        printf("/enum [all|active|bootmgr|osloader] [/v]\n");
+        printf("/enum [all|active|bootmgr|osloader|{id}] [/v|/json|/csv]\n");
+        printf("/json prints a JSON array with one object per line, and /csv one row per\n");
+        printf("element; both carry element ids, names, kinds and full binary values.\n");
     } else if (strcmp(cmd, "create") == 0) {
         printf("/create {<id>|/d <description> /application <type>}\n");
     } else if (strcmp(cmd, "set") == 0) {
         printf("/set <id> <element> <value> ...\n");
+    } else if (strcmp(cmd, "snapshot") == 0) {
+        printf("/snapshot <file>\n");
+        printf("Writes the decoded store to file. Passing the file to /store loads it\n");
+        printf("without decoding the hive; /enum and /export are supported, and the\n");
+        printf("snapshot is refused once the hive it was taken from has changed.\n");
+    } else if (strcmp(cmd, "diff") == 0) {
+        printf("/diff <storeA> <storeB> [<storeC> ...]\n");
+        printf("Compares the first store (hive or snapshot) with each of the others and\n");
+        printf("lists removed (-), added (+) and changed (~) objects, with the elements\n");
+        printf("that differ under each changed object. The first store is only loaded\n");
+        printf("and hashed once. Every argument after /diff is a store, so options such\n");
+        printf("as /stats must come before it.\n");
+    } else if (strcmp(cmd, "scan") == 0) {
+        printf("/scan <dir|listfile|-> [/threads <n>] [/enum [type] [/v]]\n");
+        printf("Enumerates every store in a directory, or listed one path per line in a\n");
+        printf("file (blank lines and lines starting with # are skipped), on n worker\n");
+        printf("threads (one per processor by default). Each store's output starts with\n");
+        printf("a \"==> path <==\" line, and stores appear in directory or list order.\n");
+        printf("Directory entries that are not hives or snapshots are skipped. The first\n");
+        printf("store that fails stops the scan.\n");
+    } else if (strcmp(cmd, "batch") == 0) {
+        printf("/batch <file|->\n");
+        printf("One editing command per line, as on the command line; blank lines and\n");
+        printf("lines starting with # are ignored. Double quotes group words into one\n");
+        printf("argument. The store is saved once, and only if every line succeeds.\n");
     } else {
         print_usage_summary();
     }
@@ -83,6 +150,8 @@ static int parse_options(int argc, char **argv, OPTIONS *opts)
     opts->command = CMD_UNKNOWN;
     opts->extraValues = NULL;
     opts->extraCount = 0;
+    opts->out = stdout;
+    opts->err = stderr;
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "/?") == 0 || strcmp(argv[i], "/help") == 0) {
@@ -92,12 +161,27 @@ static int parse_options(int argc, char **argv, OPTIONS *opts)
         } else if (strcmp(argv[i], "/store") == 0) {
             if (i + 1 >= argc) return -1;
             opts->storePath = argv[++i];
+        } else if (strcmp(argv[i], "/scan") == 0) {
+            if (i + 1 >= argc) return -1;
+            opts->scanPath = argv[++i];
         } else if (strcmp(argv[i], "/enum") == 0) {
             opts->command = CMD_ENUM;
+            if (i + 1 < argc && argv[i + 1][0] != '/') opts->enumFilter = argv[++i];
         } else if (strcmp(argv[i], "/export") == 0) {
             opts->command = CMD_EXPORT;
             if (i + 1 >= argc) return -1;
             opts->pathArg = argv[++i];
+        } else if (strcmp(argv[i], "/snapshot") == 0) {
+            opts->command = CMD_SNAPSHOT;
+            if (i + 1 >= argc) return -1;
+            opts->pathArg = argv[++i];
+        } else if (strcmp(argv[i], "/diff") == 0) {
+            opts->command = CMD_DIFF;
+            if (i + 2 >= argc) return -1;
+            opts->pathArg = argv[++i];
+            opts->extraValues = (const char **)&argv[i + 1];
+            opts->extraCount = argc - i - 1;
+            break;
         } else if (strcmp(argv[i], "/import") == 0) {
             opts->command = CMD_IMPORT;
             if (i + 1 >= argc) return -1;
@@ -159,6 +243,17 @@ static int parse_options(int argc, char **argv, OPTIONS *opts)
             opts->extraValues = (const char **)&argv[i + 1];
             opts->extraCount = argc - i - 1;
             break;
+        } else if (strcmp(argv[i], "/batch") == 0) {
+            opts->command = CMD_BATCH;
+            if (i + 1 >= argc) return -1;
+            opts->pathArg = argv[++i];
+        } else if (strcmp(argv[i], "/daemon") == 0) {
+            opts->command = CMD_DAEMON;
+            if (i + 1 >= argc) return -1;
+            opts->pathArg = argv[++i];
+        } else if (strcmp(argv[i], "/server") == 0) {
+            if (i + 1 >= argc) return -1;
+            opts->serverPath = argv[++i];
         } else if (strcmp(argv[i], "/d") == 0) {
             if (i + 1 >= argc) return -1;
             opts->description = argv[++i];
@@ -167,10 +262,20 @@ static int parse_options(int argc, char **argv, OPTIONS *opts)
             opts->application = argv[++i];
         } else if (strcmp(argv[i], "/v") == 0) {
             opts->verbose = 1;
+        } else if (strcmp(argv[i], "/json") == 0) {
+            opts->format = BCD_FORMAT_JSON;
+        } else if (strcmp(argv[i], "/csv") == 0) {
+            opts->format = BCD_FORMAT_CSV;
+        } else if (strcmp(argv[i], "/threads") == 0) {
+            if (i + 1 >= argc) return -1;
+            opts->threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "/stats") == 0) {
+            opts->stats = 1;
         }
     }
 
     if (opts->command == CMD_UNKNOWN) opts->command = CMD_ENUM;
+    if (opts->format != BCD_FORMAT_TEXT && opts->command != CMD_ENUM) return -1;
     return 0;
 }
 
@@ -187,7 +292,7 @@ static const char *resolve_system_store(void)
 #endif
 }
 
-static int read_file(const char *path, unsigned char **buffer, size_t *size)
+static int read_whole_file(const char *path, unsigned char **buffer, size_t *size)
 {
     FILE *f = fopen(path, "rb");
     if (!f) return BCD_ERR_IO;
@@ -204,106 +309,329 @@ static int read_file(const char *path, unsigned char **buffer, size_t *size)
     return BCD_OK;
 }
 
-static int write_file(const char *path, const unsigned char *buffer, size_t size)
+static int read_file(const char *path, unsigned char **buffer, size_t *size)
 {
-    FILE *f = fopen(path, "wb");
-    if (!f) return BCD_ERR_IO;
-    if (fwrite(buffer, 1, size, f) != size) { fclose(f); return BCD_ERR_IO; }
-    fclose(f);
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_READ);
+    int status = read_whole_file(path, buffer, size);
+    if (status == BCD_OK) BCD_STATS_ADD(BCD_STAT_BYTES_READ, *size);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+/* Produces exactly size bytes of file content into out. */
+typedef int (*FILL_CONTENT)(void *context, unsigned char *out, size_t size);
+
+#ifndef _WIN32
+static int write_all_fd(int fd, const unsigned char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return BCD_ERR_IO;
+        data += n;
+        size -= (size_t)n;
+    }
     return BCD_OK;
 }
 
-static int load_bcd_store(const char *path, BCD_STORE *store)
+/* Fill the temporary file. When its blocks could be reserved up front the
+ * content is produced straight into a shared mapping of it; otherwise (no
+ * fallocate support) through a buffer, so a full disk surfaces as a write
+ * error rather than a fault on the mapping. */
+static int fill_fd(int fd, size_t size, FILL_CONTENT fill, void *context)
 {
-    unsigned char *buffer = NULL;
-    size_t size = 0;
-    if (read_file(path, &buffer, &size) != BCD_OK) {
-        fprintf(stderr, "Failed to open store: %s\n", path);
+    if (size == 0) return fill(context, NULL, 0);
+    int rc = posix_fallocate(fd, 0, (off_t)size);
+    if (rc == ENOSPC || rc == EFBIG) return BCD_ERR_IO;
+    if (rc == 0) {
+        void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            int status = fill(context, (unsigned char *)map, size);
+            if (status == BCD_OK && msync(map, size, MS_SYNC) != 0) status = BCD_ERR_IO;
+            munmap(map, size);
+            return status;
+        }
+    }
+    unsigned char *buffer = (unsigned char *)malloc(size);
+    if (!buffer) return BCD_ERR_CAPACITY;
+    int status = fill(context, buffer, size);
+    if (status == BCD_OK) status = write_all_fd(fd, buffer, size);
+    free(buffer);
+    return status;
+}
+
+/* Replace path atomically: the content goes to a temporary file beside it,
+ * which is flushed and renamed over path, and the directory is flushed so the
+ * rename itself survives a crash. Readers see either the old or the new file,
+ * never a partial one; on failure path is left untouched. A symlinked path
+ * has its target replaced, not the link. */
+static int replace_file_atomically(const char *linkPath, size_t size, FILL_CONTENT fill, void *context)
+{
+    char *resolved = realpath(linkPath, NULL);
+    const char *path = resolved ? resolved : linkPath;
+    size_t pathLen = strlen(path);
+    char *tempPath = (char *)malloc(pathLen + 8);
+    if (!tempPath) {
+        free(resolved);
+        return BCD_ERR_CAPACITY;
+    }
+    memcpy(tempPath, path, pathLen);
+    memcpy(tempPath + pathLen, ".XXXXXX", 8);
+    int fd = mkstemp(tempPath);
+    if (fd < 0) {
+        free(tempPath);
+        free(resolved);
         return BCD_ERR_IO;
     }
-    REGF_HIVE *hive = RegfOpen(buffer, size);
-    if (!hive) {
-        fprintf(stderr, "Invalid hive file: %s\n", path);
+    struct stat st;
+    mode_t mode = stat(path, &st) == 0 ? (st.st_mode & 07777) : 0644;
+    int status = fchmod(fd, mode) == 0 ? BCD_OK : BCD_ERR_IO;
+    if (status == BCD_OK) status = fill_fd(fd, size, fill, context);
+    if (status == BCD_OK && fsync(fd) != 0) status = BCD_ERR_IO;
+    if (close(fd) != 0 && status == BCD_OK) status = BCD_ERR_IO;
+    if (status == BCD_OK && rename(tempPath, path) != 0) status = BCD_ERR_IO;
+    if (status != BCD_OK) unlink(tempPath);
+    else status = RegfSyncParentDirectory(path);
+    free(tempPath);
+    free(resolved);
+    return status;
+}
+#else
+/* Replace path atomically: the content goes to a temporary file beside it,
+ * which is flushed and moved over path with write-through. */
+static int replace_file_atomically(const char *path, size_t size, FILL_CONTENT fill, void *context)
+{
+    size_t pathLen = strlen(path);
+    char *tempPath = (char *)malloc(pathLen + 5);
+    unsigned char *buffer = (unsigned char *)malloc(size ? size : 1);
+    if (!tempPath || !buffer) {
+        free(tempPath);
         free(buffer);
-        return BCD_ERR_PARSE;
+        return BCD_ERR_CAPACITY;
     }
-    if (BcdStoreInit(store) != BCD_OK) {
-        RegfClose(hive);
-        free(buffer);
-        return BCD_ERR_INVALID_ARG;
+    memcpy(tempPath, path, pathLen);
+    memcpy(tempPath + pathLen, ".tmp", 5);
+    int status = fill(context, buffer, size);
+    FILE *f = status == BCD_OK ? fopen(tempPath, "wb") : NULL;
+    if (status == BCD_OK && !f) status = BCD_ERR_IO;
+    if (f) {
+        if (fwrite(buffer, 1, size, f) != size || fflush(f) != 0 || _commit(_fileno(f)) != 0) status = BCD_ERR_IO;
+        if (fclose(f) != 0) status = BCD_ERR_IO;
+        if (status == BCD_OK && !MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            status = BCD_ERR_IO;
+        }
+        if (status != BCD_OK) remove(tempPath);
     }
-    int status = BcdStoreLoadFromHive(store, hive);
-    RegfClose(hive);
     free(buffer);
+    free(tempPath);
     return status;
 }
+#endif
 
-static int save_bcd_store(const char *path, const BCD_STORE *store)
+/* Serialization done by fill is charged to its own phase, not to the write. */
+static int replace_file(const char *path, size_t size, FILL_CONTENT fill, void *context)
+{
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_WRITE);
+    int status = replace_file_atomically(path, size, fill, context);
+    if (status == BCD_OK) BCD_STATS_ADD(BCD_STAT_BYTES_WRITTEN, size);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+static int fill_from_buffer(void *context, unsigned char *out, size_t size)
+{
+    if (size > 0) memcpy(out, context, size);
+    return BCD_OK;
+}
+
+static int fill_from_store(void *context, unsigned char *out, size_t size)
+{
+    return RegfWriteBcdStore((const BCD_STORE *)context, out, size);
+}
+
+typedef enum {
+    STORE_READ,     /* decode every object up front, hive closed after loading */
+    STORE_BROWSE,   /* lazy load, hive kept open read-only */
+    STORE_EDIT      /* lazy load, hive opened for in-place updates when possible */
+} STORE_ACCESS;
+
+/* Unreadable stores fail with BCD_ERR_IO, files that are not hives with
+ * BCD_ERR_PARSE. */
+static void report_open_failure(FILE *err, const char *path, int status)
+{
+    if (status == BCD_ERR_PARSE) fprintf(err, "Invalid hive file: %s\n", path);
+    else fprintf(err, "Failed to open store: %s\n", path);
+}
+
+static REGF_HIVE *open_store_hive(FILE *err, const char *path, REGF_HANDLE_CACHE *cache, int *outStatus)
+{
+    REGF_HIVE *hive = RegfOpenFileStatus(path, cache, outStatus);
+    if (!hive) report_open_failure(err, path, *outStatus);
+    return hive;
+}
+
+/* The store is always initialized, even on failure, so callers can release it.
+ * Lazily loaded stores hand the hive back through outHive; the caller must
+ * keep it open until the store is released. */
+static int load_bcd_store(FILE *err, const char *path, BCD_STORE *store, int threads, STORE_ACCESS access, REGF_HIVE **outHive)
+{
+    if (BcdStoreInit(store) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    REGF_HIVE *hive = access == STORE_EDIT ? RegfOpenFileForUpdate(path) : NULL;
+    int status = BCD_OK;
+    if (!hive) hive = open_store_hive(err, path, NULL, &status);
+    if (!hive) return status;
+    if (access != STORE_READ) {
+        *outHive = hive;
+        return BcdStoreLoadFromHiveLazy(store, hive);
+    }
+    status = threads > 1 ? BcdStoreLoadFromHiveParallel(store, hive, threads) : BcdStoreLoadFromHive(store, hive);
+    RegfCloseFile(hive);
+    return status;
+}
+
+/* The hive is sized first and then serialized straight into the replacement
+ * file. */
+static int save_bcd_store(const char *path, BCD_STORE *store)
 {
-    unsigned char *buffer = NULL;
     size_t size = 0;
-    int status = BcdStoreSerializeToHive(store, &buffer, &size);
+    int status = BcdStoreMaterialize(store);
+    if (status == BCD_OK) status = RegfMeasureBcdStore(store, &size);
     if (status != BCD_OK) return status;
-    status = write_file(path, buffer, size);
-    free(buffer);
+    return replace_file(path, size, fill_from_store, store);
+}
+
+/* Apply edits to the image they were loaded from, touching only the cells
+ * that changed, and write back just the pages holding them through the
+ * hive's transaction log. Hives that cannot be updated in place are
+ * re-serialized in full. */
+static int commit_bcd_store(const char *path, BCD_STORE *store, REGF_HIVE *hive)
+{
+    int status = RegfUpdateBcdStore(hive, store);
+    if (status == BCD_ERR_INVALID_ARG) return save_bcd_store(path, store);
+    if (status == BCD_OK) status = RegfWriteChanges(hive, path);
     return status;
 }
 
-static void print_element(const BCD_ELEMENT *el, int verbose)
+/* Enumerations render through a formatter into its own buffer; stores
+ * printed by /scan are tagged with their path. */
+static void begin_output(const OPTIONS *opts, BCD_FORMATTER *formatter)
 {
-    if (!el) return;
-    const BCD_ELEMENT_META *meta = BcdLookupElementById(el->type);
-    if (verbose && meta) printf("  %s (0x%08x): ", meta->name, el->type);
-    else if (meta) printf("  %s: ", meta->name);
-    else printf("  0x%08x: ", el->type);
+    BcdFormatterBegin(formatter, opts->out, opts->format, opts->verbose, opts->scanPath ? opts->storePath : NULL);
+}
 
-    switch (el->kind) {
-    case BCD_ELEMENT_INTEGER:
-        printf("%llu\n", (unsigned long long)el->data.integerValue);
-        break;
-    case BCD_ELEMENT_STRING:
-        printf("%s\n", el->data.stringValue);
-        break;
-    case BCD_ELEMENT_BOOLEAN:
-        printf(el->data.boolValue ? "ON\n" : "OFF\n");
-        break;
-    case BCD_ELEMENT_BINARY:
-        printf("%zu bytes\n", el->data.binaryValue.size);
-        break;
-    default:
-        printf("unknown\n");
-        break;
+static int end_output(const OPTIONS *opts, BCD_FORMATTER *formatter)
+{
+    int status = BcdFormatterEnd(formatter);
+    if (status != BCD_OK) fprintf(opts->err, "Failed to write output\n");
+    return status;
+}
+
+static int parse_object_id(const char *text, BCD_OBJECT_ID *out, FILE *err)
+{
+    int status = BcdParseObjectId(text, out);
+    if (status != BCD_OK) fprintf(err, "Invalid object identifier: %s\n", text);
+    return status;
+}
+
+/* The boot manager followed by the entries of its display order. */
+static int enum_active(const OPTIONS *opts, BCD_STORE *store, BCD_FORMATTER *formatter)
+{
+    BCD_OBJECT_ID bootmgrId;
+    if (parse_object_id(BCD_BOOTMGR_ID_STRING, &bootmgrId, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    BCD_OBJECT *bm = BcdStoreFindObjectById(store, &bootmgrId);
+    if (!bm) return BCD_OK;
+    BcdFormatterWriteObject(formatter, bm);
+    BCD_ELEMENT *order = BcdObjectFindElement(bm, BCD_ELEMENT_DISPLAY_ORDER);
+    if (!order || order->kind != BCD_ELEMENT_BINARY) return BCD_OK;
+    size_t entries = order->data.binaryValue.size / sizeof(BCD_OBJECT_ID);
+    for (size_t i = 0; i < entries; ++i) {
+        BCD_OBJECT_ID id;
+        memcpy(&id, order->data.binaryValue.data + i * sizeof(BCD_OBJECT_ID), sizeof(id));
+        BCD_OBJECT *obj = BcdStoreFindObjectById(store, &id);
+        BcdFormatterWriteObject(formatter, obj);
     }
+    return BCD_OK;
 }
 
-static void print_object(const BCD_OBJECT *obj, int verbose)
+/* Filters naming a type select objects of that type; 0 selects them all. */
+static int enum_filter_type(const OPTIONS *opts, const char *filter, uint32_t *type)
 {
-    char idText[64];
-    if (BcdFormatObjectId(&obj->id, idText, sizeof(idText)) != BCD_OK) strcpy(idText, "{invalid}");
-    printf("identifier %s\n", idText);
-    if (verbose) printf("type 0x%08x\n", obj->objectType);
-    for (size_t i = 0; i < obj->elementCount; ++i) {
-        print_element(&obj->elements[i], verbose);
+    *type = 0;
+    if (strcmp(filter, "bootmgr") == 0) *type = BCD_OBJECT_BOOTMGR;
+    else if (strcmp(filter, "osloader") == 0) *type = BCD_OBJECT_OSLOADER;
+    else if (strcmp(filter, "all") != 0) {
+        fprintf(opts->err, "Unknown enumeration type: %s\n", filter);
+        return BCD_ERR_INVALID_ARG;
     }
-    printf("\n");
+    return BCD_OK;
+}
+
+/* Only single-object and active enumerations need lookups across the store. */
+static int is_streamed_enum(const OPTIONS *opts)
+{
+    const char *filter = opts->enumFilter ? opts->enumFilter : "all";
+    return opts->command == CMD_ENUM && filter[0] != '{' && strcmp(filter, "active") != 0;
 }
 
+static int print_streamed_object(BCD_OBJECT *obj, void *context)
+{
+    BcdFormatterWriteObject((BCD_FORMATTER *)context, obj);
+    return BCD_OK;
+}
+
+/* Type enumerations print each object as it is decoded from the hive, so
+ * memory use stays flat however large the store is. */
+static int stream_enum(const OPTIONS *opts, const char *storePath)
+{
+    uint32_t type = 0;
+    if (enum_filter_type(opts, opts->enumFilter ? opts->enumFilter : "all", &type) != BCD_OK) {
+        return BCD_ERR_INVALID_ARG;
+    }
+    int status;
+    REGF_HIVE *hive = open_store_hive(opts->err, storePath, NULL, &status);
+    if (!hive) return status;
+    BCD_FORMATTER formatter;
+    begin_output(opts, &formatter);
+    status = BcdStreamObjectsFromHive(hive, type, print_streamed_object, &formatter);
+    int written = end_output(opts, &formatter);
+    RegfCloseFile(hive);
+    return status != BCD_OK ? status : written;
+}
+
+/* Objects are matched on id and type alone, so with a lazily loaded store
+ * only the entries that are printed have their elements decoded. */
 static int cmd_enum(const OPTIONS *opts, BCD_STORE *store)
 {
-    (void)opts;
+    const char *filter = opts->enumFilter ? opts->enumFilter : "all";
+    BCD_FORMATTER formatter;
+    if (filter[0] == '{') {
+        BCD_OBJECT_ID id;
+        if (parse_object_id(filter, &id, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
+        BCD_OBJECT *obj = BcdStoreFindObjectById(store, &id);
+        if (!obj) {
+            fprintf(opts->err, "Object not found: %s\n", filter);
+            return BCD_ERR_NOT_FOUND;
+        }
+        begin_output(opts, &formatter);
+        BcdFormatterWriteObject(&formatter, obj);
+        return end_output(opts, &formatter);
+    }
+    if (strcmp(filter, "active") == 0) {
+        begin_output(opts, &formatter);
+        int status = enum_active(opts, store, &formatter);
+        int written = end_output(opts, &formatter);
+        return status != BCD_OK ? status : written;
+    }
+
+    uint32_t type = 0;
+    if (enum_filter_type(opts, filter, &type) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    begin_output(opts, &formatter);
     size_t count = BcdStoreGetObjectCount(store);
     for (size_t i = 0; i < count; ++i) {
         BCD_OBJECT *obj = BcdStoreGetObjectAt(store, i);
-        if (obj) print_object(obj, opts->verbose);
+        if (obj && (!type || obj->objectType == type)) BcdFormatterWriteObject(&formatter, obj);
     }
-    return 0;
-}
-
-static int parse_object_id(const char *text, BCD_OBJECT_ID *out)
-{
-    int status = BcdParseObjectId(text, out);
-    if (status != BCD_OK) fprintf(stderr, "Invalid object identifier: %s\n", text);
-    return status;
+    return end_output(opts, &formatter);
 }
 
 static int cmd_createstore(const OPTIONS *opts)
@@ -311,14 +639,15 @@ static int cmd_createstore(const OPTIONS *opts)
     BCD_STORE store;
     BcdStoreInit(&store);
     int status = save_bcd_store(opts->pathArg, &store);
-    if (status != BCD_OK) fprintf(stderr, "Failed to create store file\n");
+    BcdStoreRelease(&store);
+    if (status != BCD_OK) fprintf(opts->err, "Failed to create store file\n");
     return status;
 }
 
 static int cmd_export(const OPTIONS *opts, BCD_STORE *store)
 {
     int status = save_bcd_store(opts->pathArg, store);
-    if (status != BCD_OK) fprintf(stderr, "Export failed\n");
+    if (status != BCD_OK) fprintf(opts->err, "Export failed\n");
     return status;
 }
 
@@ -327,7 +656,7 @@ static int cmd_import(const OPTIONS *opts)
     if (!opts->storePath) {
         const char *sys = resolve_system_store();
         if (!sys) {
-            fprintf(stderr, "System store import not supported on this platform\n");
+            fprintf(opts->err, "System store import not supported on this platform\n");
             return BCD_ERR_INVALID_ARG;
         }
         opts = opts; /* silence warning */
@@ -335,42 +664,78 @@ static int cmd_import(const OPTIONS *opts)
     unsigned char *buffer = NULL;
     size_t size = 0;
     if (read_file(opts->pathArg, &buffer, &size) != BCD_OK) {
-        fprintf(stderr, "Failed to read import file\n");
+        fprintf(opts->err, "Failed to read import file\n");
         return BCD_ERR_IO;
     }
     const char *target = opts->storePath ? opts->storePath : resolve_system_store();
-    int status = write_file(target, buffer, size);
+    int status = replace_file(target, size, fill_from_buffer, buffer);
     free(buffer);
-    if (status != BCD_OK) fprintf(stderr, "Failed to write target store\n");
+    if (status != BCD_OK) fprintf(opts->err, "Failed to write target store\n");
     return status;
 }
 
-static int element_from_values(const BCD_ELEMENT_META *meta, const OPTIONS *opts, BCD_ELEMENT *el)
+/* Parse a list of object identifiers into a freshly allocated binary payload. */
+static int parse_id_list(const char **values, int count, BCD_OBJECT_ID **outIds, size_t *outSize, FILE *err)
 {
-    if (!meta || !opts || !el) return BCD_ERR_INVALID_ARG;
+    BCD_OBJECT_ID *ids = (BCD_OBJECT_ID *)malloc((size_t)count * sizeof(BCD_OBJECT_ID));
+    if (!ids) return BCD_ERR_CAPACITY;
+    size_t n = 0;
+    for (int i = 0; i < count; ++i) {
+        if (parse_object_id(values[i], &ids[n], err) == BCD_OK) ++n;
+    }
+    *outIds = ids;
+    *outSize = n * sizeof(BCD_OBJECT_ID);
+    return BCD_OK;
+}
+
+/* Parse a list of integers into a freshly allocated payload of little-endian
+ * 64-bit values, the layout of integer-list elements. */
+static int parse_integer_list(const char **values, int count, uint8_t **outData, size_t *outSize)
+{
+    uint8_t *data = (uint8_t *)malloc((size_t)count * 8);
+    if (!data) return BCD_ERR_CAPACITY;
+    for (int i = 0; i < count; ++i) {
+        uint64_t value = (uint64_t)strtoull(values[i], NULL, 0);
+        for (int b = 0; b < 8; ++b) data[(size_t)i * 8 + (size_t)b] = (uint8_t)(value >> (8 * b));
+    }
+    *outData = data;
+    *outSize = (size_t)count * 8;
+    return BCD_OK;
+}
+
+/* On success with a binary element, *scratch owns the payload and must be freed by the caller. */
+static int element_from_values(const BCD_ELEMENT_META *meta, const OPTIONS *opts, BCD_ELEMENT *el, void **scratch)
+{
+    if (!meta || !opts || !el || !scratch) return BCD_ERR_INVALID_ARG;
     memset(el, 0, sizeof(*el));
+    *scratch = NULL;
     el->type = meta->id;
     el->kind = meta->kind;
     if (meta->kind == BCD_ELEMENT_STRING) {
         if (opts->extraCount < 1) return BCD_ERR_INVALID_ARG;
-        strncpy(el->data.stringValue, opts->extraValues[0], sizeof(el->data.stringValue) - 1);
+        el->data.stringValue = opts->extraValues[0];
     } else if (meta->kind == BCD_ELEMENT_INTEGER) {
         if (opts->extraCount < 1) return BCD_ERR_INVALID_ARG;
         el->data.integerValue = (uint64_t)strtoull(opts->extraValues[0], NULL, 0);
     } else if (meta->kind == BCD_ELEMENT_BOOLEAN) {
         if (opts->extraCount < 1) return BCD_ERR_INVALID_ARG;
         el->data.boolValue = (strcmp(opts->extraValues[0], "ON") == 0 || strcmp(opts->extraValues[0], "on") == 0);
+    } else if (meta->kind == BCD_ELEMENT_BINARY && BCD_ELEMENT_FORMAT(meta->id) == BCD_ELEMENT_FORMAT_INTEGER_LIST) {
+        if (opts->extraCount < 1) return BCD_ERR_INVALID_ARG;
+        uint8_t *data = NULL;
+        size_t size = 0;
+        if (parse_integer_list(opts->extraValues, opts->extraCount, &data, &size) != BCD_OK) return BCD_ERR_CAPACITY;
+        el->data.binaryValue.data = data;
+        el->data.binaryValue.size = size;
+        *scratch = data;
     } else if (meta->kind == BCD_ELEMENT_BINARY) {
         if (opts->extraCount < 1) return BCD_ERR_INVALID_ARG;
-        size_t offset = 0;
-        for (int i = 0; i < opts->extraCount && offset + sizeof(BCD_OBJECT_ID) <= BCD_MAX_BINARY_SIZE; ++i) {
-            BCD_OBJECT_ID id;
-            if (parse_object_id(opts->extraValues[i], &id) == BCD_OK) {
-                memcpy(el->data.binaryValue.data + offset, &id, sizeof(id));
-                offset += sizeof(id);
-            }
-        }
-        el->data.binaryValue.size = offset;
+        BCD_OBJECT_ID *ids = NULL;
+        size_t size = 0;
+        if (parse_id_list(opts->extraValues, opts->extraCount, &ids, &size, opts->err) != BCD_OK) return BCD_ERR_CAPACITY;
+        el->data.binaryValue.data = (const uint8_t *)ids;
+        el->data.binaryValue.size = size;
+        *scratch = ids;
     }
     return BCD_OK;
 }
@@ -379,20 +744,22 @@ static int cmd_set(const OPTIONS *opts, BCD_STORE *store)
 {
     const BCD_ELEMENT_META *meta = BcdLookupElementByName(opts->elementName);
     if (!meta) {
-        fprintf(stderr, "Unknown element name: %s\n", opts->elementName);
+        fprintf(opts->err, "Unknown element name: %s\n", opts->elementName);
         return BCD_ERR_INVALID_ARG;
     }
     BCD_OBJECT_ID id;
-    if (parse_object_id(opts->idText, &id) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    if (parse_object_id(opts->idText, &id, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     BCD_OBJECT *obj = BcdStoreFindObjectById(store, &id);
     if (!obj) {
-        fprintf(stderr, "Object not found\n");
+        fprintf(opts->err, "Object not found\n");
         return BCD_ERR_NOT_FOUND;
     }
     BCD_ELEMENT el;
-    if (element_from_values(meta, opts, &el) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    void *scratch = NULL;
+    if (element_from_values(meta, opts, &el, &scratch) != BCD_OK) return BCD_ERR_INVALID_ARG;
     int status = BcdObjectSetElement(obj, &el);
-    if (status != BCD_OK) fprintf(stderr, "Failed to set element\n");
+    free(scratch);
+    if (status != BCD_OK) fprintf(opts->err, "Failed to set element\n");
     return status;
 }
 
@@ -401,7 +768,7 @@ static int cmd_deletevalue(const OPTIONS *opts, BCD_STORE *store)
     const BCD_ELEMENT_META *meta = BcdLookupElementByName(opts->elementName);
     if (!meta) return BCD_ERR_INVALID_ARG;
     BCD_OBJECT_ID id;
-    if (parse_object_id(opts->idText, &id) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    if (parse_object_id(opts->idText, &id, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     BCD_OBJECT *obj = BcdStoreFindObjectById(store, &id);
     if (!obj) return BCD_ERR_NOT_FOUND;
     return BcdObjectRemoveElement(obj, meta->id);
@@ -410,7 +777,7 @@ static int cmd_deletevalue(const OPTIONS *opts, BCD_STORE *store)
 static int cmd_delete(const OPTIONS *opts, BCD_STORE *store)
 {
     BCD_OBJECT_ID id;
-    if (parse_object_id(opts->idText, &id) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    if (parse_object_id(opts->idText, &id, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     return BcdStoreDeleteObject(store, &id);
 }
 
@@ -428,24 +795,24 @@ static int cmd_create(const OPTIONS *opts, BCD_STORE *store)
     BCD_OBJECT obj;
     memset(&obj, 0, sizeof(obj));
     if (opts->idText[0]) {
-        if (parse_object_id(opts->idText, &obj.id) != BCD_OK) return BCD_ERR_INVALID_ARG;
+        if (parse_object_id(opts->idText, &obj.id, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     } else {
         BcdGenerateObjectId(&obj.id);
     }
     obj.objectType = application_type(opts->application);
-    if (opts->description) {
+    int status = BcdStoreAddObject(store, &obj);
+    if (status == BCD_OK && opts->description) {
         BCD_ELEMENT el;
         memset(&el, 0, sizeof(el));
         el.type = BCD_ELEMENT_DESCRIPTION;
         el.kind = BCD_ELEMENT_STRING;
-        strncpy(el.data.stringValue, opts->description, sizeof(el.data.stringValue) - 1);
-        BcdObjectAddElement(&obj, &el);
+        el.data.stringValue = opts->description;
+        status = BcdObjectAddElement(BcdStoreFindObjectById(store, &obj.id), &el);
     }
-    int status = BcdStoreAddObject(store, &obj);
     if (status == BCD_OK) {
         char idText[64];
         BcdFormatObjectId(&obj.id, idText, sizeof(idText));
-        printf("%s\n", idText);
+        fprintf(opts->out, "%s\n", idText);
     }
     return status;
 }
@@ -453,38 +820,33 @@ static int cmd_create(const OPTIONS *opts, BCD_STORE *store)
 static int cmd_copy(const OPTIONS *opts, BCD_STORE *store)
 {
     BCD_OBJECT_ID sourceId;
-    if (parse_object_id(opts->idText, &sourceId) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    if (parse_object_id(opts->idText, &sourceId, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     BCD_OBJECT *src = BcdStoreFindObjectById(store, &sourceId);
     if (!src) return BCD_ERR_NOT_FOUND;
     BCD_OBJECT copy = *src;
     BcdGenerateObjectId(&copy.id);
-    if (opts->description) {
-        BCD_ELEMENT *desc = BcdObjectFindElement(&copy, BCD_ELEMENT_DESCRIPTION);
-        if (!desc) {
-            BCD_ELEMENT el;
-            memset(&el, 0, sizeof(el));
-            el.type = BCD_ELEMENT_DESCRIPTION;
-            el.kind = BCD_ELEMENT_STRING;
-            strncpy(el.data.stringValue, opts->description, sizeof(el.data.stringValue) - 1);
-            BcdObjectAddElement(&copy, &el);
-        } else {
-            strncpy(desc->data.stringValue, opts->description, sizeof(desc->data.stringValue) - 1);
-        }
-    }
     int status = BcdStoreAddObject(store, &copy);
+    if (status == BCD_OK && opts->description) {
+        BCD_ELEMENT el;
+        memset(&el, 0, sizeof(el));
+        el.type = BCD_ELEMENT_DESCRIPTION;
+        el.kind = BCD_ELEMENT_STRING;
+        el.data.stringValue = opts->description;
+        status = BcdObjectSetElement(BcdStoreFindObjectById(store, &copy.id), &el);
+    }
     if (status == BCD_OK) {
         char idText[64];
         BcdFormatObjectId(&copy.id, idText, sizeof(idText));
-        printf("%s\n", idText);
+        fprintf(opts->out, "%s\n", idText);
     }
     return status;
 }
 
 static int cmd_default(const OPTIONS *opts, BCD_STORE *store)
 {
-    const char *bootmgrIdText = "{9dea862c-5cdd-4e70-acc1-f32b344d4795}";
+    const char *bootmgrIdText = BCD_BOOTMGR_ID_STRING;
     BCD_OBJECT_ID bootmgrId;
-    if (parse_object_id(bootmgrIdText, &bootmgrId) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    if (parse_object_id(bootmgrIdText, &bootmgrId, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     BCD_OBJECT *bm = BcdStoreFindObjectById(store, &bootmgrId);
     if (!bm) {
         BCD_OBJECT obj;
@@ -496,18 +858,21 @@ static int cmd_default(const OPTIONS *opts, BCD_STORE *store)
     }
     BCD_ELEMENT el;
     memset(&el, 0, sizeof(el));
+    BCD_OBJECT_ID target;
+    memset(&target, 0, sizeof(target));
+    parse_object_id(opts->targetIdText, &target, opts->err);
     el.type = BCD_ELEMENT_BOOTMANAGER_DEFAULT;
     el.kind = BCD_ELEMENT_BINARY;
-    el.data.binaryValue.size = sizeof(BCD_OBJECT_ID);
-    parse_object_id(opts->targetIdText, (BCD_OBJECT_ID *)el.data.binaryValue.data);
+    el.data.binaryValue.data = (const uint8_t *)&target;
+    el.data.binaryValue.size = sizeof(target);
     return BcdObjectSetElement(bm, &el);
 }
 
 static int cmd_timeout(const OPTIONS *opts, BCD_STORE *store)
 {
-    const char *bootmgrIdText = "{9dea862c-5cdd-4e70-acc1-f32b344d4795}";
+    const char *bootmgrIdText = BCD_BOOTMGR_ID_STRING;
     BCD_OBJECT_ID bootmgrId;
-    if (parse_object_id(bootmgrIdText, &bootmgrId) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    if (parse_object_id(bootmgrIdText, &bootmgrId, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
     BCD_OBJECT *bm = BcdStoreFindObjectById(store, &bootmgrId);
     if (!bm) return BCD_ERR_NOT_FOUND;
     BCD_ELEMENT el;
@@ -521,110 +886,766 @@ static int cmd_timeout(const OPTIONS *opts, BCD_STORE *store)
 static int set_order_list(BCD_STORE *store, const OPTIONS *opts, uint32_t elementId)
 {
     if (opts->extraCount <= 0) return BCD_ERR_INVALID_ARG;
+    const char *bootmgrIdText = BCD_BOOTMGR_ID_STRING;
+    BCD_OBJECT_ID bootmgrId;
+    if (parse_object_id(bootmgrIdText, &bootmgrId, opts->err) != BCD_OK) return BCD_ERR_INVALID_ARG;
+    BCD_OBJECT *bm = BcdStoreFindObjectById(store, &bootmgrId);
+    if (!bm) return BCD_ERR_NOT_FOUND;
+
+    BCD_OBJECT_ID *ids = NULL;
+    size_t size = 0;
+    if (parse_id_list(opts->extraValues, opts->extraCount, &ids, &size, opts->err) != BCD_OK) return BCD_ERR_CAPACITY;
     BCD_ELEMENT el;
     memset(&el, 0, sizeof(el));
     el.type = elementId;
     el.kind = BCD_ELEMENT_BINARY;
-    size_t offset = 0;
-    for (int i = 0; i < opts->extraCount && offset + sizeof(BCD_OBJECT_ID) <= BCD_MAX_BINARY_SIZE; ++i) {
-        BCD_OBJECT_ID id;
-        if (parse_object_id(opts->extraValues[i], &id) == BCD_OK) {
-            memcpy(el.data.binaryValue.data + offset, &id, sizeof(id));
-            offset += sizeof(id);
-        }
-    }
-    el.data.binaryValue.size = offset;
-
-    const char *bootmgrIdText = "{9dea862c-5cdd-4e70-acc1-f32b344d4795}";
-    BCD_OBJECT_ID bootmgrId;
-    if (parse_object_id(bootmgrIdText, &bootmgrId) != BCD_OK) return BCD_ERR_INVALID_ARG;
-    BCD_OBJECT *bm = BcdStoreFindObjectById(store, &bootmgrId);
-    if (!bm) return BCD_ERR_NOT_FOUND;
-    return BcdObjectSetElement(bm, &el);
+    el.data.binaryValue.data = (const uint8_t *)ids;
+    el.data.binaryValue.size = size;
+    int status = BcdObjectSetElement(bm, &el);
+    free(ids);
+    return status;
 }
 
-int main(int argc, char **argv)
+static int run_command(const OPTIONS *opts, BCD_STORE *store)
 {
-    OPTIONS opts;
-    if (argc == 1) {
-        memset(&opts, 0, sizeof(opts));
-        opts.command = CMD_ENUM;
-    } else if (parse_options(argc, argv, &opts) != 0) {
-        print_usage_summary();
-        return 1;
-    }
-
-    if (opts.command == CMD_HELP) {
-        print_usage_summary();
-        return 0;
-    }
-
-    const char *storePath = opts.storePath ? opts.storePath : resolve_system_store();
-    if (!storePath && (opts.command != CMD_CREATESTORE && opts.command != CMD_IMPORT)) {
-        fprintf(stderr, "System store access is not available. Use /store <path>.\n");
-        return 1;
-    }
-
-    if (opts.command == CMD_CREATESTORE) {
-        return cmd_createstore(&opts) == BCD_OK ? 0 : 1;
-    }
-
-    if (opts.command == CMD_IMPORT) {
-        return cmd_import(&opts) == BCD_OK ? 0 : 1;
-    }
-
-    BCD_STORE store;
-    if (load_bcd_store(storePath, &store) != BCD_OK) return 1;
-
     int result = 0;
-    switch (opts.command) {
+    switch (opts->command) {
     case CMD_ENUM:
-        result = cmd_enum(&opts, &store);
+        result = cmd_enum(opts, store);
         break;
     case CMD_EXPORT:
-        result = cmd_export(&opts, &store);
+        result = cmd_export(opts, store);
         break;
     case CMD_CREATE:
-        result = cmd_create(&opts, &store);
+        result = cmd_create(opts, store);
         break;
     case CMD_COPY:
-        result = cmd_copy(&opts, &store);
+        result = cmd_copy(opts, store);
         break;
     case CMD_DELETE:
-        result = cmd_delete(&opts, &store);
+        result = cmd_delete(opts, store);
         break;
     case CMD_SET:
-        result = cmd_set(&opts, &store);
+        result = cmd_set(opts, store);
         break;
     case CMD_DELETEVALUE:
-        result = cmd_deletevalue(&opts, &store);
+        result = cmd_deletevalue(opts, store);
         break;
     case CMD_DEFAULT:
-        result = cmd_default(&opts, &store);
+        result = cmd_default(opts, store);
         break;
     case CMD_TIMEOUT:
-        result = cmd_timeout(&opts, &store);
+        result = cmd_timeout(opts, store);
         break;
     case CMD_DISPLAYORDER:
-        result = set_order_list(&store, &opts, BCD_ELEMENT_DISPLAY_ORDER);
+        result = set_order_list(store, opts, BCD_ELEMENT_DISPLAY_ORDER);
         break;
     case CMD_BOOTSEQUENCE:
-        result = set_order_list(&store, &opts, BCD_ELEMENT_BOOT_SEQUENCE);
+        result = set_order_list(store, opts, BCD_ELEMENT_BOOT_SEQUENCE);
         break;
     case CMD_TOOLSDISPLAYORDER:
-        result = set_order_list(&store, &opts, BCD_ELEMENT_TOOLS_DISPLAY_ORDER);
+        result = set_order_list(store, opts, BCD_ELEMENT_TOOLS_DISPLAY_ORDER);
         break;
     default:
         result = 0;
         break;
     }
+    return result;
+}
+
+/* Read one line of any length into *line, growing it as needed, and strip the
+ * line terminator. Returns 1 for a line, 0 at end of input, -1 on error. */
+static int read_line(FILE *f, char **line, size_t *capacity)
+{
+    size_t len = 0;
+    for (;;) {
+        if (*capacity - len < 2) {
+            size_t newCap = *capacity ? *capacity * 2 : 256;
+            char *p = (char *)realloc(*line, newCap);
+            if (!p) return -1;
+            *line = p;
+            *capacity = newCap;
+        }
+        if (!fgets(*line + len, (int)(*capacity - len), f)) break;
+        len += strlen(*line + len);
+        if ((*line)[len - 1] == '\n') break;
+    }
+    if (ferror(f)) return -1;
+    if (len == 0) return 0;
+    while (len > 0 && ((*line)[len - 1] == '\n' || (*line)[len - 1] == '\r')) (*line)[--len] = '\0';
+    return 1;
+}
+
+/* Split a script line in place into an argv for parse_options; (*argv)[0] is
+ * a stand-in program name. Words are separated by blanks, double quotes group
+ * words and \" inside quotes is a literal quote. Returns the argument count
+ * including argv[0], BCD_ERR_PARSE for an unterminated quote or
+ * BCD_ERR_CAPACITY. */
+static int split_line(char *line, char ***argv, size_t *capacity)
+{
+    static char programName[] = "bcdedit";
+    int argc = 0;
+    char *in = line;
+    for (;;) {
+        if ((size_t)argc + 2 > *capacity) {
+            size_t newCap = *capacity ? *capacity * 2 : 16;
+            char **p = (char **)realloc(*argv, newCap * sizeof(char *));
+            if (!p) return BCD_ERR_CAPACITY;
+            *argv = p;
+            *capacity = newCap;
+        }
+        if (argc == 0) {
+            (*argv)[argc++] = programName;
+            continue;
+        }
+        while (*in == ' ' || *in == '\t') ++in;
+        if (!*in) break;
+        char *out = in;
+        int quoted = 0;
+        (*argv)[argc++] = out;
+        while (*in && (quoted || (*in != ' ' && *in != '\t'))) {
+            if (*in == '"') {
+                quoted = !quoted;
+                ++in;
+            } else if (quoted && in[0] == '\\' && in[1] == '"') {
+                *out++ = '"';
+                in += 2;
+            } else {
+                *out++ = *in++;
+            }
+        }
+        if (quoted) return BCD_ERR_PARSE;
+        if (*in) ++in;
+        *out = '\0';
+    }
+    (*argv)[argc] = NULL;
+    return argc;
+}
+
+static int is_edit_command(COMMAND_TYPE command)
+{
+    switch (command) {
+    case CMD_CREATE:
+    case CMD_COPY:
+    case CMD_DELETE:
+    case CMD_SET:
+    case CMD_DELETEVALUE:
+    case CMD_DEFAULT:
+    case CMD_TIMEOUT:
+    case CMD_DISPLAYORDER:
+    case CMD_BOOTSEQUENCE:
+    case CMD_TOOLSDISPLAYORDER:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Apply every command of a /batch script to the one loaded store. The store is
+ * only committed by the caller once the whole script has succeeded, so a
+ * failing line rolls the batch back by leaving the file untouched. */
+static int cmd_batch(const OPTIONS *opts, BCD_STORE *store)
+{
+    int fromStdin = strcmp(opts->pathArg, "-") == 0;
+    if (fromStdin && opts->storePath && strcmp(opts->storePath, "-") == 0) {
+        fprintf(opts->err, "The batch script and the store cannot both be read from stdin\n");
+        return BCD_ERR_INVALID_ARG;
+    }
+    FILE *f = fromStdin ? stdin : fopen(opts->pathArg, "r");
+    if (!f) {
+        fprintf(opts->err, "Failed to open batch file: %s\n", opts->pathArg);
+        return BCD_ERR_IO;
+    }
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    char **args = NULL;
+    size_t argCapacity = 0;
+    unsigned long lineNumber = 0;
+    int status = BCD_OK;
+    int rc;
+    while (status == BCD_OK && (rc = read_line(f, &line, &lineCapacity)) > 0) {
+        ++lineNumber;
+        const char *first = line + strspn(line, " \t");
+        if (*first == '\0' || *first == '#') continue;
+        int argc = split_line(line, &args, &argCapacity);
+        OPTIONS lineOpts;
+        if (argc < 0) {
+            status = argc;
+            fprintf(opts->err, "Batch line %lu: %s\n", lineNumber,
+                    argc == BCD_ERR_PARSE ? "unterminated quote" : "out of memory");
+        } else if (parse_options(argc, args, &lineOpts) != 0 || lineOpts.storePath ||
+                   !is_edit_command(lineOpts.command)) {
+            status = BCD_ERR_INVALID_ARG;
+            fprintf(opts->err, "Batch line %lu: not an editing command\n", lineNumber);
+        } else {
+            lineOpts.out = opts->out;
+            lineOpts.err = opts->err;
+            status = run_command(&lineOpts, store);
+            if (status != BCD_OK) fprintf(opts->err, "Batch line %lu failed\n", lineNumber);
+        }
+    }
+    if (status == BCD_OK && rc < 0) {
+        status = BCD_ERR_IO;
+        fprintf(opts->err, "Failed to read batch file: %s\n", opts->pathArg);
+    }
+    if (status != BCD_OK) fprintf(opts->err, "Batch aborted; the store was not modified\n");
+    free(args);
+    free(line);
+    if (!fromStdin) fclose(f);
+    return status;
+}
+
+/* Requests served by /daemon. Enumerations run against the daemon's cached
+ * copy of the store; edits load the hive for update exactly as the command
+ * line does, commit, and drop the cached copy. */
+static int serve_request(BCD_DAEMON *daemon, const OPTIONS *opts)
+{
+    if (opts->command == CMD_ENUM) {
+        BCD_STORE *store = NULL;
+        int status = BcdDaemonGetStore(daemon, opts->storePath, &store);
+        if (status != BCD_OK) {
+            report_open_failure(opts->err, opts->storePath, status);
+            return status;
+        }
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        status = cmd_enum(opts, store);
+        BCD_STATS_PHASE_END(outer);
+        return status;
+    }
+    if (!is_edit_command(opts->command)) {
+        fprintf(opts->err, "Command not supported by the daemon\n");
+        return BCD_ERR_INVALID_ARG;
+    }
+    BCD_STORE store;
+    REGF_HIVE *hive = NULL;
+    int status = load_bcd_store(opts->err, opts->storePath, &store, 0, STORE_EDIT, &hive);
+    if (status == BCD_OK) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        status = run_command(opts, &store);
+        BCD_STATS_PHASE_END(outer);
+    }
+    if (status == BCD_OK && (status = commit_bcd_store(opts->storePath, &store, hive)) != BCD_OK) {
+        fprintf(opts->err, "Failed to write store\n");
+    }
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    BcdDaemonInvalidate(daemon, opts->storePath);
+    return status;
+}
+
+/* /stats in a request reports that request alone, to the client's stderr. */
+static int handle_daemon_request(BCD_DAEMON *daemon, int argc, char **argv, FILE *out, FILE *err, void *context)
+{
+    (void)context;
+    OPTIONS opts;
+    if (parse_options(argc, argv, &opts) != 0 || !opts.storePath) {
+        fprintf(err, "Requests must name a store with /store <path>\n");
+        return BCD_ERR_INVALID_ARG;
+    }
+    opts.out = out;
+    opts.err = err;
+    BcdStatsReset();
+    int status = serve_request(daemon, &opts);
+    if (opts.stats) BcdStatsPrint(err);
+    return status;
+}
+
+static int run_daemon(const OPTIONS *opts)
+{
+    int status = BcdDaemonRun(opts->pathArg, handle_daemon_request, NULL);
+    if (status == BCD_ERR_INVALID_ARG) fprintf(stderr, "Daemon mode is not supported on this platform\n");
+    else if (status != BCD_OK) fprintf(stderr, "Failed to listen on %s\n", opts->pathArg);
+    return status;
+}
+
+/* Send the command line, minus /server, to a running daemon. The /store path
+ * is made absolute since the daemon resolves it from its own directory. */
+static int forward_to_daemon(int argc, char **argv, const OPTIONS *opts)
+{
+    char **args = (char **)malloc((size_t)argc * sizeof(char *));
+    if (!args) return BCD_ERR_CAPACITY;
+    char *resolved = NULL;
+    int count = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "/server") == 0 && i + 1 < argc) {
+            ++i;
+            continue;
+        }
+        args[count++] = argv[i];
+#ifndef _WIN32
+        if (strcmp(argv[i], "/store") == 0 && i + 1 < argc && !resolved) {
+            resolved = realpath(argv[i + 1], NULL);
+            args[count++] = resolved ? resolved : argv[i + 1];
+            ++i;
+        }
+#endif
+    }
+    int result = BCD_OK;
+    int status = BcdDaemonRequest(opts->serverPath, count, args, stdout, stderr, &result);
+    if (status == BCD_ERR_INVALID_ARG) fprintf(stderr, "Daemon mode is not supported on this platform\n");
+    else if (status != BCD_OK) fprintf(stderr, "Failed to reach the daemon at %s\n", opts->serverPath);
+    free(resolved);
+    free(args);
+    return status != BCD_OK ? status : result;
+}
+
+struct snapshot_fill {
+    BCD_STORE *store;
+    const BCD_SNAPSHOT_SOURCE *source;
+};
+
+static int fill_from_snapshot(void *context, unsigned char *out, size_t size)
+{
+    struct snapshot_fill *fill = (struct snapshot_fill *)context;
+    return BcdSnapshotWrite(fill->store, fill->source, out, size);
+}
+
+/* The hive is hashed as it is on disk, before loading: a write racing with
+ * the load leaves a snapshot that is reported stale rather than one that
+ * silently misses the write. */
+static int take_snapshot(const OPTIONS *opts, const char *storePath)
+{
+    BCD_SNAPSHOT_SOURCE source;
+    memset(&source, 0, sizeof(source));
+    char *resolved = NULL;
+    if (strcmp(storePath, "-") != 0) {
+        if (BcdSnapshotHashFile(storePath, &source.hash, &source.size) != BCD_OK) {
+            report_open_failure(opts->err, storePath, BCD_ERR_IO);
+            return BCD_ERR_IO;
+        }
+#ifndef _WIN32
+        resolved = realpath(storePath, NULL);
+#endif
+        source.path = resolved ? resolved : storePath;
+    }
+    BCD_STORE store;
+    int status = load_bcd_store(opts->err, storePath, &store, opts->threads, STORE_READ, NULL);
+    if (status == BCD_OK) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        size_t size = 0;
+        struct snapshot_fill fill = { &store, &source };
+        status = BcdSnapshotMeasure(&store, &source, &size);
+        if (status == BCD_OK) status = replace_file(opts->pathArg, size, fill_from_snapshot, &fill);
+        if (status != BCD_OK) fprintf(opts->err, "Snapshot failed\n");
+        BCD_STATS_PHASE_END(outer);
+    }
+    BcdStoreRelease(&store);
+    free(resolved);
+    return status;
+}
+
+/* Snapshots are refused once the hive they were taken from has changed. On
+ * success the snapshot backs the (initialized) store and must be closed after
+ * the store is released or reset. */
+static int load_snapshot_store(const OPTIONS *opts, const char *path, BCD_STORE *store, BCD_SNAPSHOT **outSnapshot)
+{
+    BCD_SNAPSHOT *snapshot = NULL;
+    int status = BcdSnapshotOpen(path, &snapshot);
+    if (status != BCD_OK) {
+        fprintf(opts->err, "Failed to open snapshot or unsupported snapshot version: %s\n", path);
+        return status;
+    }
+    if (BcdSnapshotIsStale(snapshot)) {
+        fprintf(opts->err, "Snapshot is out of date: %s has changed since it was taken\n",
+                BcdSnapshotGetSourcePath(snapshot));
+        BcdSnapshotClose(snapshot);
+        return BCD_ERR_PARSE;
+    }
+    status = BcdStoreLoadFromSnapshot(store, snapshot);
+    if (status != BCD_OK) {
+        fprintf(opts->err, "Invalid snapshot: %s\n", path);
+        BcdStoreReset(store);
+        BcdSnapshotClose(snapshot);
+        return status;
+    }
+    *outSnapshot = snapshot;
+    return BCD_OK;
+}
+
+/* Snapshots are read-only views of the hive they were taken from. */
+static int run_snapshot_command(const OPTIONS *opts, const char *storePath)
+{
+    if (opts->command != CMD_ENUM && opts->command != CMD_EXPORT) {
+        fprintf(opts->err, "Snapshots only support /enum and /export; edit the source hive instead\n");
+        return BCD_ERR_INVALID_ARG;
+    }
+    BCD_STORE store;
+    BCD_SNAPSHOT *snapshot = NULL;
+    BcdStoreInit(&store);
+    int status = load_snapshot_store(opts, storePath, &store, &snapshot);
+    if (status == BCD_OK) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        status = run_command(opts, &store);
+        BCD_STATS_PHASE_END(outer);
+    }
+    BcdStoreRelease(&store);
+    BcdSnapshotClose(snapshot);
+    return status;
+}
+
+/* Load a hive or snapshot and keep only its digest. */
+static int digest_store_file(const OPTIONS *opts, const char *path, BCD_STORE_DIGEST *digest)
+{
+    BCD_STORE store;
+    BCD_SNAPSHOT *snapshot = NULL;
+    BcdStoreInit(&store);
+    int status = BcdSnapshotProbe(path) ? load_snapshot_store(opts, path, &store, &snapshot)
+                                        : load_bcd_store(opts->err, path, &store, opts->threads, STORE_READ, NULL);
+    if (status == BCD_OK) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        status = BcdDigestStore(&store, digest);
+        BCD_STATS_PHASE_END(outer);
+    }
+    BcdStoreRelease(&store);
+    BcdSnapshotClose(snapshot);
+    return status;
+}
+
+struct diff_report {
+    FILE *out;
+    size_t removed;
+    size_t added;
+    size_t changed;
+};
+
+static int print_diff_entry(const BCD_DIFF_ENTRY *entry, void *context)
+{
+    struct diff_report *report = (struct diff_report *)context;
+    const BCD_OBJECT_DIGEST *object = entry->newObject ? entry->newObject : entry->oldObject;
+    const BCD_ELEMENT_DIGEST *element = entry->newElement ? entry->newElement : entry->oldElement;
+    char idText[BCD_ID_STRING_LENGTH + 1];
+    const BCD_ELEMENT_META *meta = NULL;
+    switch (entry->kind) {
+    case BCD_DIFF_OBJECT_REMOVED:
+    case BCD_DIFF_OBJECT_ADDED:
+        BcdFormatObjectId(&object->id, idText, sizeof(idText));
+        fprintf(report->out, "%c %s type 0x%08x\n", entry->kind == BCD_DIFF_OBJECT_ADDED ? '+' : '-', idText,
+                object->objectType);
+        if (entry->kind == BCD_DIFF_OBJECT_ADDED) ++report->added;
+        else ++report->removed;
+        break;
+    case BCD_DIFF_OBJECT_CHANGED:
+        BcdFormatObjectId(&object->id, idText, sizeof(idText));
+        if (entry->oldObject->objectType != entry->newObject->objectType) {
+            fprintf(report->out, "~ %s type 0x%08x -> 0x%08x\n", idText, entry->oldObject->objectType,
+                    entry->newObject->objectType);
+        } else {
+            fprintf(report->out, "~ %s\n", idText);
+        }
+        ++report->changed;
+        break;
+    default:
+        meta = BcdLookupElementById(element->type);
+        fprintf(report->out, "    %c %s (0x%08x)\n",
+                entry->kind == BCD_DIFF_ELEMENT_ADDED ? '+' : entry->kind == BCD_DIFF_ELEMENT_REMOVED ? '-' : '~',
+                meta ? meta->name : "element", element->type);
+        break;
+    }
+    return BCD_OK;
+}
+
+/* The first store is digested once and compared against each of the others
+ * in turn, so auditing many copies against one reference costs one load and
+ * one hashing pass per copy. */
+static int cmd_diff(const OPTIONS *opts)
+{
+    BCD_STORE_DIGEST base;
+    int status = digest_store_file(opts, opts->pathArg, &base);
+    if (status != BCD_OK) return status;
+    for (int i = 0; i < opts->extraCount && status == BCD_OK; ++i) {
+        BCD_STORE_DIGEST other;
+        status = digest_store_file(opts, opts->extraValues[i], &other);
+        if (status != BCD_OK) break;
+        struct diff_report report = { opts->out, 0, 0, 0 };
+        fprintf(opts->out, "--- %s\n+++ %s\n", opts->pathArg, opts->extraValues[i]);
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        status = BcdDiffDigests(&base, &other, print_diff_entry, &report);
+        BCD_STATS_PHASE_END(outer);
+        fprintf(opts->out, "%zu changed, %zu added, %zu removed\n", report.changed, report.added, report.removed);
+        BcdDigestRelease(&other);
+    }
+    BcdDigestRelease(&base);
+    return status;
+}
+
+struct path_list {
+    char **paths;
+    size_t count;
+    size_t capacity;
+    int fromDirectory;
+};
+
+static int path_list_add(struct path_list *list, const char *dir, const char *name)
+{
+    if (list->count == list->capacity) {
+        size_t newCap = list->capacity ? list->capacity * 2 : 64;
+        char **paths = (char **)realloc(list->paths, newCap * sizeof(char *));
+        if (!paths) return BCD_ERR_CAPACITY;
+        list->paths = paths;
+        list->capacity = newCap;
+    }
+    size_t dirLen = dir ? strlen(dir) : 0;
+    size_t nameLen = strlen(name);
+    char *path = (char *)malloc(dirLen + nameLen + 2);
+    if (!path) return BCD_ERR_CAPACITY;
+    if (dir) {
+        memcpy(path, dir, dirLen);
+        if (dirLen == 0 || dir[dirLen - 1] != '/') path[dirLen++] = '/';
+    }
+    memcpy(path + dirLen, name, nameLen + 1);
+    list->paths[list->count++] = path;
+    return BCD_OK;
+}
+
+static void path_list_release(struct path_list *list)
+{
+    for (size_t i = 0; i < list->count; ++i) free(list->paths[i]);
+    free(list->paths);
+    memset(list, 0, sizeof(*list));
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Directory entries are taken in name order, so the output is reproducible. */
+static int list_directory(const char *dir, struct path_list *list)
+{
+#ifndef _WIN32
+    DIR *d = opendir(dir);
+    if (!d) return BCD_ERR_IO;
+    list->fromDirectory = 1;
+    int status = BCD_OK;
+    struct dirent *entry;
+    while (status == BCD_OK && (entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        status = path_list_add(list, dir, entry->d_name);
+    }
+    closedir(d);
+    if (status == BCD_OK && list->count > 1) qsort(list->paths, list->count, sizeof(char *), compare_paths);
+    return status;
+#else
+    (void)dir;
+    (void)list;
+    return BCD_ERR_INVALID_ARG;
+#endif
+}
+
+static int list_file(const char *path, struct path_list *list)
+{
+    int fromStdin = strcmp(path, "-") == 0;
+    FILE *f = fromStdin ? stdin : fopen(path, "r");
+    if (!f) return BCD_ERR_IO;
+    char *line = NULL;
+    size_t capacity = 0;
+    int status = BCD_OK;
+    int rc;
+    while (status == BCD_OK && (rc = read_line(f, &line, &capacity)) > 0) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t')) line[--len] = '\0';
+        const char *first = line + strspn(line, " \t");
+        if (*first == '\0' || *first == '#') continue;
+        status = path_list_add(list, NULL, first);
+    }
+    if (status == BCD_OK && rc < 0) status = BCD_ERR_IO;
+    free(line);
+    if (!fromStdin) fclose(f);
+    return status;
+}
+
+static int is_directory(const char *path)
+{
+#ifndef _WIN32
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#else
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#endif
+}
+
+/* Each worker keeps one store and one handle cache for all of its stores. */
+struct scan_worker_state {
+    BCD_STORE store;
+    REGF_HANDLE_CACHE *handles;
+};
+
+struct scan_job {
+    const OPTIONS *opts;
+    const struct path_list *list;
+    struct scan_worker_state *workers;
+};
+
+/* A primary hive file: transaction logs share the "regf" base block but have
+ * a non-zero file type at 0x1c. */
+static int is_hive_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    unsigned char base[0x20];
+    int match = fread(base, 1, sizeof(base), f) == sizeof(base) && memcmp(base, "regf", 4) == 0 &&
+                (base[0x1c] | base[0x1d] | base[0x1e] | base[0x1f]) == 0;
+    fclose(f);
+    return match;
+}
+
+/* Enumerate one store into out. Directory entries that are neither hives nor
+ * snapshots, such as the .LOG1 files edits leave, produce no output; listed
+ * paths must be stores. */
+static int scan_store(size_t index, int worker, FILE *out, void *context)
+{
+    struct scan_job *job = (struct scan_job *)context;
+    struct scan_worker_state *state = &job->workers[worker];
+    const char *path = job->list->paths[index];
+    int isSnapshot = BcdSnapshotProbe(path);
+    if (job->list->fromDirectory && !isSnapshot && !is_hive_file(path)) return BCD_OK;
+
+    BCD_SNAPSHOT *snapshot = NULL;
+    REGF_HIVE *hive = NULL;
+    int status;
+    if (isSnapshot) {
+        status = load_snapshot_store(job->opts, path, &state->store, &snapshot);
+    } else if ((hive = open_store_hive(job->opts->err, path, state->handles, &status)) != NULL) {
+        status = BcdStoreLoadFromHiveLazy(&state->store, hive);
+    }
+    if (status == BCD_OK) {
+        OPTIONS storeOpts = *job->opts;
+        storeOpts.storePath = path;
+        storeOpts.out = out;
+        status = cmd_enum(&storeOpts, &state->store);
+    }
+    BcdStoreReset(&state->store);
+    RegfCloseFile(hive);
+    BcdSnapshotClose(snapshot);
+    return status;
+}
+
+/* /scan replaces one process per store: stores are enumerated on a
+ * work-stealing pool and their output is written in input order. */
+static int cmd_scan(const OPTIONS *opts)
+{
+    if (opts->command != CMD_ENUM && opts->command != CMD_UNKNOWN) {
+        fprintf(opts->err, "/scan only supports /enum\n");
+        return BCD_ERR_INVALID_ARG;
+    }
+    struct path_list list;
+    memset(&list, 0, sizeof(list));
+    int status = is_directory(opts->scanPath) ? list_directory(opts->scanPath, &list) : list_file(opts->scanPath, &list);
+    if (status != BCD_OK) {
+        fprintf(opts->err, "Failed to read store list: %s\n", opts->scanPath);
+        path_list_release(&list);
+        return status;
+    }
+
+    int workerCount = opts->threads > 0 ? opts->threads : BcdScanDefaultWorkers();
+    if ((size_t)workerCount > list.count) workerCount = list.count ? (int)list.count : 1;
+    struct scan_worker_state *workers = (struct scan_worker_state *)calloc((size_t)workerCount, sizeof(*workers));
+    BCD_STATS *workerStats = opts->stats ? (BCD_STATS *)calloc((size_t)workerCount, sizeof(BCD_STATS)) : NULL;
+    if (!workers || (opts->stats && !workerStats)) {
+        free(workerStats);
+        free(workers);
+        path_list_release(&list);
+        return BCD_ERR_CAPACITY;
+    }
+    for (int w = 0; w < workerCount; ++w) {
+        BcdStoreInit(&workers[w].store);
+        workers[w].handles = RegfHandleCacheCreate();
+    }
+
+    struct scan_job job = { opts, &list, workers };
+    size_t failed = 0;
+    if (opts->format == BCD_FORMAT_CSV) fputs(BCD_CSV_TAGGED_HEADER, opts->out);
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+    status = BcdScanRun(list.count, workerCount, scan_store, &job, opts->out, &failed, workerStats);
+    BCD_STATS_PHASE_END(outer);
+    if (status != BCD_OK) fprintf(opts->err, "Scan stopped at %s\n", list.paths[failed]);
+    /* /stats: each worker's share, ahead of the totals the caller prints. */
+    for (int w = 0; workerStats && w < workerCount; ++w) BcdStatsPrintWorker(opts->err, w, &workerStats[w]);
+    free(workerStats);
+
+    for (int w = 0; w < workerCount; ++w) {
+        BcdStoreRelease(&workers[w].store);
+        RegfHandleCacheDestroy(workers[w].handles);
+    }
+    free(workers);
+    path_list_release(&list);
+    return status;
+}
+
+/* Runs a command against a store file; the caller reports /stats. */
+static int run_store_command(const OPTIONS *opts)
+{
+    if (opts->command == CMD_DIFF) return cmd_diff(opts);
+    if (opts->scanPath) return cmd_scan(opts);
+
+    const char *storePath = opts->storePath ? opts->storePath : resolve_system_store();
+    if (!storePath && (opts->command != CMD_CREATESTORE && opts->command != CMD_IMPORT)) {
+        fprintf(opts->err, "System store access is not available. Use /store <path>.\n");
+        return BCD_ERR_INVALID_ARG;
+    }
 
-    if (result == BCD_OK && opts.command != CMD_ENUM && opts.command != CMD_EXPORT) {
-        if (save_bcd_store(storePath, &store) != BCD_OK) {
-            fprintf(stderr, "Failed to write store\n");
-            result = 1;
+    if (opts->command == CMD_CREATESTORE || opts->command == CMD_IMPORT) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        int status = opts->command == CMD_CREATESTORE ? cmd_createstore(opts) : cmd_import(opts);
+        BCD_STATS_PHASE_END(outer);
+        return status;
+    }
+
+    if (BcdSnapshotProbe(storePath)) return run_snapshot_command(opts, storePath);
+    if (opts->command == CMD_SNAPSHOT) return take_snapshot(opts, storePath);
+
+    if (is_streamed_enum(opts)) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        int status = stream_enum(opts, storePath);
+        BCD_STATS_PHASE_END(outer);
+        return status;
+    }
+
+    BCD_STORE store;
+    REGF_HIVE *hive = NULL;
+    STORE_ACCESS access = opts->command == CMD_ENUM ? STORE_BROWSE : opts->command == CMD_EXPORT ? STORE_READ : STORE_EDIT;
+    int result = load_bcd_store(opts->err, storePath, &store, opts->threads, access, &hive);
+    if (result == BCD_OK) {
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_COMMAND);
+        result = opts->command == CMD_BATCH ? cmd_batch(opts, &store) : run_command(opts, &store);
+        BCD_STATS_PHASE_END(outer);
+        if (result == BCD_OK && opts->command != CMD_ENUM && opts->command != CMD_EXPORT) {
+            result = commit_bcd_store(storePath, &store, hive);
+            if (result != BCD_OK) fprintf(opts->err, "Failed to write store\n");
         }
     }
 
+    BcdStoreRelease(&store);
+    RegfCloseFile(hive);
+    return result;
+}
+
+#ifndef BCDEDIT_NO_MAIN
+int main(int argc, char **argv)
+{
+    OPTIONS opts;
+    if (argc == 1) {
+        memset(&opts, 0, sizeof(opts));
+        opts.command = CMD_ENUM;
+        opts.out = stdout;
+        opts.err = stderr;
+    } else if (parse_options(argc, argv, &opts) != 0) {
+        print_usage_summary();
+        return 1;
+    }
+
+    if (opts.command == CMD_HELP) {
+        print_usage_summary();
+        return 0;
+    }
+
+    if (opts.command == CMD_DAEMON) return run_daemon(&opts) == BCD_OK ? 0 : 1;
+    if (opts.serverPath) return forward_to_daemon(argc, argv, &opts) == BCD_OK ? 0 : 1;
+
+    BcdStatsReset();
+    int result = run_store_command(&opts);
+    if (opts.stats) BcdStatsPrint(stderr);
     return result == BCD_OK ? 0 : 1;
 }
+#endif /* BCDEDIT_NO_MAIN */
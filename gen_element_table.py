@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+"""Generate bcd_element_table.h: the BCD element catalog and its perfect hashes.
+
+Run `make element-table` (or `python3 gen_element_table.py > bcd_element_table.h`)
+after editing CATALOG. The output is checked in, so building needs no Python.
+
+Each element is listed once under its canonical name with any aliases. An
+element's kind follows from the format nibble of its id (bits 24-27).
+Device-format elements take strings, as `device` always has in this tool.
+Object, object-list and integer-list elements are binary.
+
+Both lookups use hash-and-displace perfect hashing. A key (an element id, or
+the 32-bit FNV-1a hash of a name) picks a bucket with seed 0. The bucket's
+stored seed then picks the key's slot, and slots hold table index + 1. The
+hash must stay in step with element_hash() in bcd.c.
+"""
+
+import sys
+
+# (canonical name, id, aliases)
+CATALOG = [
+    # Library settings (0x1xxxxxxx), valid for every application.
+    ("device", 0x11000001, []),
+    ("path", 0x12000002, []),
+    ("description", 0x12000004, []),
+    ("locale", 0x12000005, []),
+    ("inherit", 0x14000006, []),
+    ("truncatememory", 0x15000007, []),
+    ("recoverysequence", 0x14000008, []),
+    ("recoveryenabled", 0x16000009, []),
+    ("badmemorylist", 0x1700000A, []),
+    ("badmemoryaccess", 0x1600000B, []),
+    ("firstmegabytepolicy", 0x1500000C, []),
+    ("relocatephysical", 0x1500000D, []),
+    ("avoidlowmemory", 0x1500000E, []),
+    ("traditionalkseg", 0x1600000F, []),
+    ("bootdebug", 0x16000010, []),
+    ("debugtype", 0x15000011, []),
+    ("debugaddress", 0x15000012, []),
+    ("debugport", 0x15000013, []),
+    ("baudrate", 0x15000014, []),
+    ("channel", 0x15000015, []),
+    ("targetname", 0x12000016, []),
+    ("noumex", 0x16000017, []),
+    ("debugstart", 0x15000018, []),
+    ("busparams", 0x12000019, []),
+    ("hostip", 0x1500001A, []),
+    ("port", 0x1500001B, []),
+    ("dhcp", 0x1600001C, []),
+    ("key", 0x1200001D, []),
+    ("vm", 0x1600001E, []),
+    ("bootems", 0x16000020, []),
+    ("emsport", 0x15000022, []),
+    ("emsbaudrate", 0x15000023, []),
+    ("loadoptions", 0x12000030, []),
+    ("advancedoptions", 0x16000040, []),
+    ("optionsedit", 0x16000041, []),
+    ("keyringaddress", 0x15000042, []),
+    ("bsdlogdevice", 0x11000043, ["bootstatusdatalogdevice"]),
+    ("bsdlogpath", 0x12000044, ["bootstatusdatalogfile"]),
+    ("bsdpreservelog", 0x16000045, ["bootstatusdatalogappend"]),
+    ("graphicsmodedisabled", 0x16000046, []),
+    ("configaccesspolicy", 0x15000047, []),
+    ("nointegritychecks", 0x16000048, []),
+    ("testsigning", 0x16000049, []),
+    ("fontpath", 0x1200004A, []),
+    ("integrityservices", 0x1500004B, []),
+    ("volumebandid", 0x1500004C, []),
+    ("extendedinput", 0x16000050, []),
+    ("initialconsoleinput", 0x15000051, []),
+    ("graphicsresolution", 0x15000052, []),
+    ("restartonfailure", 0x16000053, []),
+    ("highestmode", 0x16000054, []),
+    ("isolatedcontext", 0x16000060, []),
+    ("displaymessage", 0x15000065, []),
+    ("displaymessageoverride", 0x15000066, []),
+    ("nobootuxlogo", 0x16000067, []),
+    ("nobootuxtext", 0x16000068, []),
+    ("nobootuxprogress", 0x16000069, []),
+    ("nobootuxfade", 0x1600006A, []),
+    ("bootuxdisabled", 0x1600006C, []),
+    ("bootshutdowndisabled", 0x16000074, []),
+    ("allowedinmemorysettings", 0x17000077, []),
+    ("forcefipscrypto", 0x16000079, []),
+
+    # Boot manager (0x2xxxxxxx on {bootmgr}).
+    ("displayorder", 0x24000001, []),
+    ("bootsequence", 0x24000002, []),
+    ("default", 0x23000003, []),
+    ("timeout", 0x25000004, []),
+    ("resume", 0x26000005, ["attemptresume"]),
+    ("resumeobject", 0x23000006, []),
+    ("toolsdisplayorder", 0x24000010, []),
+    ("displaybootmenu", 0x26000020, []),
+    ("noerrordisplay", 0x26000021, []),
+    ("bcddevice", 0x21000022, []),
+    ("bcdfilepath", 0x22000023, []),
+    ("processcustomactionsfirst", 0x26000028, []),
+    ("customactions", 0x27000030, []),
+    ("persistbootsequence", 0x26000031, []),
+
+    # OS loader (0x2xxxxxxx on Windows boot loader entries). The resume
+    # application stores its hibernation file location in the same two ids.
+    ("osdevice", 0x21000001, ["filedevice"]),
+    ("systemroot", 0x22000002, ["filepath"]),
+    ("detecthal", 0x26000010, []),
+    ("kernel", 0x22000011, []),
+    ("hal", 0x22000012, []),
+    ("dbgtransport", 0x22000013, []),
+    ("nx", 0x25000020, []),
+    ("pae", 0x25000021, []),
+    ("winpe", 0x26000022, []),
+    ("nocrashautoreboot", 0x26000024, []),
+    ("lastknowngood", 0x26000025, []),
+    ("oslnointegritychecks", 0x26000026, []),
+    ("osltestsigning", 0x26000027, []),
+    ("nolowmem", 0x26000030, []),
+    ("removememory", 0x25000031, []),
+    ("increaseuserva", 0x25000032, []),
+    ("perfmem", 0x25000033, []),
+    ("vga", 0x26000040, []),
+    ("quietboot", 0x26000041, []),
+    ("novesa", 0x26000042, []),
+    ("novga", 0x26000043, []),
+    ("clustermodeaddressing", 0x25000050, []),
+    ("usephysicaldestination", 0x26000051, []),
+    ("restrictapiccluster", 0x25000052, []),
+    ("uselegacyapicmode", 0x26000054, []),
+    ("x2apicpolicy", 0x25000055, []),
+    ("onecpu", 0x26000060, []),
+    ("numproc", 0x25000061, []),
+    ("maxproc", 0x26000062, []),
+    ("configflags", 0x25000063, []),
+    ("maxgroup", 0x26000064, []),
+    ("groupaware", 0x26000065, []),
+    ("groupsize", 0x25000066, []),
+    ("usefirmwarepcisettings", 0x26000070, []),
+    ("msi", 0x25000071, []),
+    ("pciexpress", 0x25000072, []),
+    ("safeboot", 0x25000080, []),
+    ("safebootalternateshell", 0x26000081, []),
+    ("bootlog", 0x26000090, []),
+    ("sos", 0x26000091, []),
+    ("debug", 0x260000A0, []),
+    ("halbreakpoint", 0x260000A1, []),
+    ("useplatformclock", 0x260000A2, []),
+    ("forcelegacyplatform", 0x260000A3, []),
+    ("useplatformtick", 0x260000A4, []),
+    ("disabledynamictick", 0x260000A5, []),
+    ("tscsyncpolicy", 0x250000A6, []),
+    ("ems", 0x260000B0, []),
+    ("forcefailure", 0x250000C0, []),
+    ("driverloadfailurepolicy", 0x250000C1, []),
+    ("bootmenupolicy", 0x250000C2, []),
+    ("onetimeadvancedoptions", 0x260000C3, []),
+    ("bootstatuspolicy", 0x250000E0, []),
+    ("disableelamdrivers", 0x260000E1, []),
+    ("hypervisorlaunchtype", 0x250000F0, []),
+    ("hypervisordebug", 0x260000F2, []),
+    ("hypervisordebugtype", 0x250000F3, []),
+    ("hypervisordebugport", 0x250000F4, []),
+    ("hypervisorbaudrate", 0x250000F5, []),
+    ("hypervisorchannel", 0x250000F6, []),
+    ("bootux", 0x250000F7, []),
+    ("hypervisordisableslat", 0x260000F8, []),
+    ("hypervisorbusparams", 0x220000F9, []),
+    ("hypervisornumproc", 0x250000FA, []),
+    ("hypervisorrootprocpernode", 0x250000FB, []),
+    ("hypervisoruselargevtlb", 0x260000FC, []),
+    ("hypervisorhostip", 0x250000FD, []),
+    ("hypervisorhostport", 0x250000FE, []),
+    ("hypervisordebugpages", 0x250000FF, []),
+    ("tpmbootentropy", 0x25000100, []),
+    ("hypervisorusekey", 0x22000110, []),
+    ("hypervisordhcp", 0x26000114, []),
+    ("hypervisoriommupolicy", 0x25000115, []),
+    ("hypervisorusevapic", 0x26000116, []),
+    ("hypervisorloadoptions", 0x22000117, []),
+    ("hypervisormsrfilterpolicy", 0x25000118, []),
+    ("hypervisormmionxpolicy", 0x25000119, []),
+    ("hypervisorschedulertype", 0x2500011A, []),
+    ("xsavepolicy", 0x25000120, []),
+    ("xsavedisable", 0x2500012B, []),
+    ("vsmlaunchtype", 0x25000142, []),
+
+    # Resume and memory diagnostic applications.
+    ("customsettings", 0x26000003, []),
+    ("debugoptionenabled", 0x26000006, []),
+    ("passcount", 0x25000001, []),
+    ("testmix", 0x25000002, []),
+
+    # Device objects (0x3xxxxxxx): ramdisk options.
+    ("ramdiskimageoffset", 0x35000001, []),
+    ("ramdisktftpclientport", 0x35000002, []),
+    ("ramdisksdidevice", 0x31000003, []),
+    ("ramdisksdipath", 0x32000004, []),
+    ("ramdiskimagelength", 0x35000005, []),
+    ("exportascd", 0x36000006, []),
+    ("ramdisktftpblocksize", 0x35000007, []),
+    ("ramdisktftpwindowsize", 0x35000008, []),
+    ("ramdiskmcenabled", 0x36000009, []),
+    ("ramdiskmctftpfallback", 0x3600000A, []),
+    ("ramdisktftpvarwindow", 0x3600000B, []),
+]
+
+KINDS = {
+    1: "BCD_ELEMENT_STRING",    # device
+    2: "BCD_ELEMENT_STRING",
+    3: "BCD_ELEMENT_BINARY",    # object
+    4: "BCD_ELEMENT_BINARY",    # object list
+    5: "BCD_ELEMENT_INTEGER",
+    6: "BCD_ELEMENT_BOOLEAN",
+    7: "BCD_ELEMENT_BINARY",    # integer list
+}
+
+MASK32 = 0xFFFFFFFF
+
+
+def element_hash(key, seed):
+    h = (key ^ (seed * 0x9E3779B9)) & MASK32
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK32
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK32
+    h ^= h >> 16
+    return h
+
+
+def name_key(name):
+    h = 0x811C9DC5
+    for c in name.encode("ascii"):
+        h = ((h ^ c) * 0x01000193) & MASK32
+    return h
+
+
+def power_of_two_at_least(n):
+    size = 1
+    while size < n:
+        size *= 2
+    return size
+
+
+def perfect_hash(keys):
+    """Seeds per bucket and slot -> key index + 1 (0 for an empty slot)."""
+    if len(set(keys)) != len(keys):
+        sys.exit("gen_element_table.py: duplicate hash keys")
+    bucket_count = power_of_two_at_least(max(1, len(keys) // 4))
+    slot_count = power_of_two_at_least(len(keys) * 3 // 2)
+    buckets = [[] for _ in range(bucket_count)]
+    for index, key in enumerate(keys):
+        buckets[element_hash(key, 0) & (bucket_count - 1)].append(index)
+    seeds = [0] * bucket_count
+    slots = [0] * slot_count
+    for bucket in sorted(range(bucket_count), key=lambda b: -len(buckets[b])):
+        members = buckets[bucket]
+        if not members:
+            continue
+        for seed in range(1, 0x10000):
+            taken = [element_hash(keys[i], seed) & (slot_count - 1) for i in members]
+            if len(set(taken)) == len(taken) and all(slots[t] == 0 for t in taken):
+                break
+        else:
+            sys.exit("gen_element_table.py: no seed found")
+        seeds[bucket] = seed
+        for i, t in zip(members, taken):
+            slots[t] = i + 1
+    return seeds, slots
+
+
+def c_array(ctype, name, values, per_line=12):
+    lines = ["static const %s %s[%d] = {" % (ctype, name, len(values))]
+    for start in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(str(v) for v in values[start:start + per_line]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    ids = [element_id for _, element_id, _ in CATALOG]
+    if len(set(ids)) != len(ids):
+        sys.exit("gen_element_table.py: duplicate element ids")
+    names = []
+    for index, (name, _, aliases) in enumerate(CATALOG):
+        names.extend((n, index) for n in [name] + aliases)
+    if len({n for n, _ in names}) != len(names):
+        sys.exit("gen_element_table.py: duplicate element names")
+
+    id_seeds, id_slots = perfect_hash(ids)
+    name_seeds, name_slots = perfect_hash([name_key(n) for n, _ in names])
+
+    out = []
+    out.append("/* Generated by gen_element_table.py; edit the catalog there and run")
+    out.append(" * `make element-table`. Included by bcd.c and bcd_test.c. */")
+    out.append("")
+    out.append("#define ELEMENT_COUNT %d" % len(CATALOG))
+    out.append("#define ELEMENT_ID_BUCKETS %d" % len(id_seeds))
+    out.append("#define ELEMENT_ID_SLOTS %d" % len(id_slots))
+    out.append("#define ELEMENT_NAME_BUCKETS %d" % len(name_seeds))
+    out.append("#define ELEMENT_NAME_SLOTS %d" % len(name_slots))
+    out.append("")
+    out.append("static const BCD_ELEMENT_META g_elementTable[ELEMENT_COUNT] = {")
+    for name, element_id, _ in CATALOG:
+        out.append('    {"%s", 0x%08xU, %s},' % (name, element_id, KINDS[(element_id >> 24) & 0xF]))
+    out.append("};")
+    out.append("")
+    out.append("/* Canonical names and aliases, with the index of their element. */")
+    out.append("struct element_name {")
+    out.append("    const char *name;")
+    out.append("    uint16_t element;")
+    out.append("};")
+    out.append("")
+    out.append("static const struct element_name g_elementNames[%d] = {" % len(names))
+    for name, index in names:
+        out.append('    {"%s", %d},' % (name, index))
+    out.append("};")
+    out.append("")
+    out.append(c_array("uint16_t", "g_elementIdSeeds", id_seeds))
+    out.append("")
+    out.append(c_array("uint16_t", "g_elementIdSlots", id_slots))
+    out.append("")
+    out.append(c_array("uint16_t", "g_elementNameSeeds", name_seeds))
+    out.append("")
+    out.append(c_array("uint16_t", "g_elementNameSlots", name_slots))
+    sys.stdout.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,16 +1,129 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "regf.h"
+#include "bcd_stats.h"
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct hive_bin {
+    uint32_t offset;        /* relative to the first bin, like cell offsets */
+    uint32_t size;
+};
+
+/* Handles are carved from malloc'd blocks and recycled through a free list
+ * threaded through their first bytes; blocks are only freed with the hive,
+ * or handed back to the handle cache it was opened with. */
+struct handle_block {
+    struct handle_block *next;
+};
+
+struct handle_pool {
+    size_t handleSize;
+    void *freeList;
+    struct handle_block *blocks;
+};
+
+struct REGF_HANDLE_CACHE {
+    struct handle_pool keyPool;
+    struct handle_pool valuePool;
+};
+
 struct REGF_HIVE {
     const unsigned char *buffer;
     size_t size;
     REGF_KEY *root;
+    void *mapping;          /* mmap view backing buffer (RegfOpenFile) */
+    unsigned char *owned;   /* heap copy backing buffer (buffered fallback) */
+    /* hbin index; empty for binless hives, which keep whole-file bounds. */
+    struct hive_bin *bins;
+    size_t binCount;
+    size_t binCapacity;
+    uint32_t *pageBins;     /* bin index of every 4 KB page of the bins area */
+    size_t pageCapacity;
+    size_t binsSize;        /* bytes covered by bins, from the first one */
+    /* In-place update state (RegfOpenFileForUpdate only). */
+    size_t capacity;        /* bytes allocated behind owned */
+    int32_t *freeCells;
+    size_t freeCount;
+    size_t freeCapacity;
+    unsigned char *dirtyPages;  /* one flag per 4 KB page of the image */
+    int recovered;              /* transaction logs were replayed into owned */
+    struct handle_pool keyPool;
+    struct handle_pool valuePool;
+    REGF_HANDLE_CACHE *handleCache; /* lent the pools, takes them back on close */
+#ifndef _WIN32
+    pthread_mutex_t poolLock;   /* the parallel loader shares one hive */
+#endif
 };
 
-#define HVIEW(hive, off) ((off) < 0 ? NULL : (((size_t)(off) + 0x1000 <= (hive)->size) ? (hive)->buffer + (off) + 0x1000 : NULL))
+#define HIVE_PAGE_SIZE 0x1000U
+#define HANDLE_BLOCK_COUNT 64
+#define HBIN_HEADER_SIZE 0x20U
+#define MIN_CELL_SIZE 8U
+
+/* Offsets into the base block. */
+#define BASE_SEQUENCE1 0x04
+#define BASE_SEQUENCE2 0x08
+#define BASE_MAJOR_VERSION 0x14
+#define BASE_FILE_TYPE 0x1c
+#define BASE_MINOR_VERSION 0x18
+#define BASE_FILE_FORMAT 0x20
+#define BASE_ROOT_CELL 0x24
+#define BASE_BINS_SIZE 0x28
+#define BASE_CLUSTERING 0x2c
+#define BASE_CHECKSUM 0x1fc
+
+/* Offsets into an nk cell, counted from the start of the cell (size field included). */
+#define NK_FLAGS 0x06
+#define NK_PARENT 0x14
+#define NK_SUBKEY_COUNT 0x18
+#define NK_SUBKEY_LIST 0x20
+#define NK_VALUE_COUNT 0x28
+#define NK_VALUE_LIST 0x2c
+#define NK_SECURITY 0x30
+#define NK_NAME_LENGTH 0x4c
+#define NK_NAME 0x50
+
+/* Offset of an sk cell's reference count, counted from the start of the cell. */
+#define SK_REFERENCES 0x10
+
+/* Offsets into a vk cell, counted from the start of the cell. */
+#define VK_NAME_LENGTH 0x06
+#define VK_DATA_SIZE 0x08
+#define VK_DATA_OFFSET 0x0c
+#define VK_TYPE 0x10
+#define VK_FLAGS 0x14
+#define VK_NAME 0x18
+
+#define VALUE_COMP_NAME 0x0001
+#define VALUE_DATA_INLINE 0x80000000U
+
+/* Values larger than this are stored as a db record over segment cells. */
+#define BIG_DATA_SEGMENT_SIZE 16344U
+
+#define KEY_HIVE_ENTRY 0x0004
+#define KEY_COMP_NAME 0x0020
+
+enum {
+    SUBKEY_LIST_LI,
+    SUBKEY_LIST_LF,
+    SUBKEY_LIST_LH
+};
 
 #define REG_TYPE_NONE 0
 #define REG_TYPE_SZ 1
@@ -20,14 +133,19 @@ struct REGF_HIVE {
 #define REG_TYPE_MULTI_SZ 7
 #define REG_TYPE_QWORD 11
 
+static uint32_t read_uint32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
 static int32_t read_int32(const unsigned char *p)
 {
-    return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24));
+    return (int32_t)read_uint32(p);
 }
 
-static uint32_t read_uint32(const unsigned char *p)
+static uint64_t read_uint64(const unsigned char *p)
 {
-    return (uint32_t)read_int32(p);
+    return (uint64_t)read_uint32(p) | ((uint64_t)read_uint32(p + 4) << 32);
 }
 
 static uint16_t read_uint16(const unsigned char *p)
@@ -35,81 +153,308 @@ static uint16_t read_uint16(const unsigned char *p)
     return (uint16_t)(p[0] | (p[1] << 8));
 }
 
-static const unsigned char *get_cell(REGF_HIVE *hive, int32_t offset, size_t *cellSize)
+static void put_uint16(unsigned char *p, uint16_t v)
+{
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+}
+
+static void put_uint32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+    p[2] = (unsigned char)((v >> 16) & 0xff);
+    p[3] = (unsigned char)((v >> 24) & 0xff);
+}
+
+/* XOR of the base block's first 127 dwords; 0 and -1 are reserved. */
+static uint32_t base_block_checksum(const unsigned char *base)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < BASE_CHECKSUM; i += 4) sum ^= read_uint32(base + i);
+    if (sum == 0) return 1;
+    if (sum == 0xffffffffU) return 0xfffffffeU;
+    return sum;
+}
+
+static int push_bin(REGF_HIVE *hive, uint32_t offset, uint32_t size)
+{
+    if (hive->binCount == hive->binCapacity) {
+        size_t newCap = hive->binCapacity ? hive->binCapacity * 2 : 16;
+        struct hive_bin *bins = (struct hive_bin *)realloc(hive->bins, newCap * sizeof(struct hive_bin));
+        if (!bins) return 0;
+        hive->bins = bins;
+        hive->binCapacity = newCap;
+    }
+    size_t pages = ((size_t)offset + size) / HIVE_PAGE_SIZE;
+    if (pages > hive->pageCapacity) {
+        size_t newCap = hive->pageCapacity ? hive->pageCapacity * 2 : 64;
+        while (newCap < pages) newCap *= 2;
+        uint32_t *map = (uint32_t *)realloc(hive->pageBins, newCap * sizeof(uint32_t));
+        if (!map) return 0;
+        hive->pageBins = map;
+        hive->pageCapacity = newCap;
+    }
+    for (size_t page = offset / HIVE_PAGE_SIZE; page < pages; ++page) hive->pageBins[page] = (uint32_t)hive->binCount;
+    hive->bins[hive->binCount].offset = offset;
+    hive->bins[hive->binCount].size = size;
+    hive->binCount++;
+    hive->binsSize = (size_t)offset + size;
+    return 1;
+}
+
+static const struct hive_bin *find_bin(const REGF_HIVE *hive, int32_t offset)
+{
+    if (offset < 0 || (size_t)offset >= hive->binsSize) return NULL;
+    return &hive->bins[hive->pageBins[(size_t)offset / HIVE_PAGE_SIZE]];
+}
+
+/* Index the hbin chain. Each bin must sit at the offset it records and span
+ * whole pages inside the file. A hive with no bin at 0x1000 and a zero bins
+ * size (as written by older versions of this tool) is accepted binless. */
+static int index_bins(REGF_HIVE *hive)
+{
+    size_t available = (hive->size - 0x1000) / HIVE_PAGE_SIZE * HIVE_PAGE_SIZE;
+    size_t end = read_uint32(hive->buffer + BASE_BINS_SIZE);
+    if (hive->size < 0x1000 + HBIN_HEADER_SIZE || memcmp(hive->buffer + 0x1000, "hbin", 4) != 0) return end == 0;
+    if (end == 0 || end > available) end = available;
+    for (size_t pos = 0; pos < end;) {
+        const unsigned char *bin = hive->buffer + 0x1000 + pos;
+        if (end - pos < HIVE_PAGE_SIZE || memcmp(bin, "hbin", 4) != 0) return 0;
+        size_t binSize = read_uint32(bin + 8);
+        if (read_uint32(bin + 4) != pos || binSize < HIVE_PAGE_SIZE || binSize % HIVE_PAGE_SIZE ||
+            binSize > end - pos) {
+            return 0;
+        }
+        if (!push_bin(hive, (uint32_t)pos, (uint32_t)binSize)) return 0;
+        pos += binSize;
+    }
+    return 1;
+}
+
+/* Bounds-checked view of a cell. In binned hives a cell must be 8-byte
+ * aligned, start past its bin's header and end inside the same bin. */
+static const unsigned char *locate_cell(REGF_HIVE *hive, int32_t offset, size_t *cellSize)
 {
-    const unsigned char *ptr = HVIEW(hive, offset);
-    if (!ptr) return NULL;
+    if (offset < 0) return NULL;
+    size_t end = hive->size - 0x1000;
+    if (hive->binCount > 0) {
+        const struct hive_bin *bin = find_bin(hive, offset);
+        if (!bin || (offset & 7) || (uint32_t)offset - bin->offset < HBIN_HEADER_SIZE) return NULL;
+        end = (size_t)bin->offset + bin->size;
+    } else if ((size_t)offset + 4 > end) {
+        return NULL;
+    }
+    const unsigned char *ptr = hive->buffer + 0x1000 + offset;
     int32_t sizeSigned = read_int32(ptr);
-    size_t size = (sizeSigned < 0) ? (size_t)(-sizeSigned) : (size_t)sizeSigned;
-    if (size < 4 || (offset + 0x1000 + size) > hive->size) return NULL;
-    if (cellSize) *cellSize = size;
+    size_t size = (sizeSigned < 0) ? (size_t)(-(int64_t)sizeSigned) : (size_t)sizeSigned;
+    if (size < 4 || size > end - (size_t)offset) return NULL;
+    *cellSize = size;
     return ptr;
 }
 
+static const unsigned char *get_cell(REGF_HIVE *hive, int32_t offset, size_t *cellSize)
+{
+    size_t size = 0;
+    const unsigned char *cell = locate_cell(hive, offset, &size);
+    if (!cell) {
+        /* Negative offsets are the "no cell" sentinel, not malformed data. */
+        if (offset >= 0) BCD_STATS_INC(BCD_STAT_CELLS_REJECTED);
+        return NULL;
+    }
+    BCD_STATS_INC(BCD_STAT_CELLS_VISITED);
+    BCD_STATS_ADD(BCD_STAT_CELL_BYTES, size);
+    if (cellSize) *cellSize = size;
+    return cell;
+}
+
+static void lock_pools(REGF_HIVE *hive)
+{
+#ifndef _WIN32
+    pthread_mutex_lock(&hive->poolLock);
+#else
+    (void)hive;
+#endif
+}
+
+static void unlock_pools(REGF_HIVE *hive)
+{
+#ifndef _WIN32
+    pthread_mutex_unlock(&hive->poolLock);
+#else
+    (void)hive;
+#endif
+}
+
+static void *pool_acquire(REGF_HIVE *hive, struct handle_pool *pool)
+{
+    lock_pools(hive);
+    if (!pool->freeList) {
+        /* Handles hold nothing more strictly aligned than a pointer, so they
+         * can follow the block header directly. */
+        unsigned char *block = (unsigned char *)malloc(sizeof(struct handle_block) +
+                                                       HANDLE_BLOCK_COUNT * pool->handleSize);
+        if (block) {
+            BCD_STATS_INC(BCD_STAT_HANDLE_BLOCKS);
+            ((struct handle_block *)block)->next = pool->blocks;
+            pool->blocks = (struct handle_block *)block;
+            for (size_t i = HANDLE_BLOCK_COUNT; i-- > 0;) {
+                void *handle = block + sizeof(struct handle_block) + i * pool->handleSize;
+                *(void **)handle = pool->freeList;
+                pool->freeList = handle;
+            }
+        }
+    }
+    void *handle = pool->freeList;
+    if (handle) pool->freeList = *(void **)handle;
+    unlock_pools(hive);
+    if (handle) memset(handle, 0, pool->handleSize);
+    return handle;
+}
+
+static void pool_release(REGF_HIVE *hive, struct handle_pool *pool, void *handle)
+{
+    lock_pools(hive);
+    *(void **)handle = pool->freeList;
+    pool->freeList = handle;
+    unlock_pools(hive);
+}
+
+static void pool_free(struct handle_pool *pool)
+{
+    while (pool->blocks) {
+        struct handle_block *next = pool->blocks->next;
+        free(pool->blocks);
+        pool->blocks = next;
+    }
+    pool->freeList = NULL;
+}
+
 static REGF_KEY *alloc_key(REGF_HIVE *hive)
 {
-    REGF_KEY *key = (REGF_KEY *)calloc(1, sizeof(REGF_KEY));
+    REGF_KEY *key = (REGF_KEY *)pool_acquire(hive, &hive->keyPool);
     if (!key) return NULL;
+    BCD_STATS_INC(BCD_STAT_KEYS_ALLOCATED);
     key->hive = hive;
     return key;
 }
 
 static REGF_VALUE *alloc_value(REGF_HIVE *hive)
 {
-    REGF_VALUE *val = (REGF_VALUE *)calloc(1, sizeof(REGF_VALUE));
+    REGF_VALUE *val = (REGF_VALUE *)pool_acquire(hive, &hive->valuePool);
     if (!val) return NULL;
+    BCD_STATS_INC(BCD_STAT_VALUES_ALLOCATED);
     val->hive = hive;
     return val;
 }
 
+static int list_kind(const unsigned char *listCell, int *kind)
+{
+    if (listCell[4] == 'l' && listCell[5] == 'i') *kind = SUBKEY_LIST_LI;
+    else if (listCell[4] == 'l' && listCell[5] == 'f') *kind = SUBKEY_LIST_LF;
+    else if (listCell[4] == 'l' && listCell[5] == 'h') *kind = SUBKEY_LIST_LH;
+    else return 0;
+    return 1;
+}
+
+/* Count children reachable from an li/lf/lh list or an ri index root of them.
+ * kind (-1 on entry) becomes the lists' kind; an ri root mixing sublist kinds
+ * degrades to li so hints are never misinterpreted. */
+static int count_subkey_list(REGF_HIVE *hive, const unsigned char *listCell, size_t listSize, int depth, int *kind)
+{
+    if (listSize < 8) return -1;
+    int count = read_uint16(listCell + 0x06);
+    int listKind = 0;
+    if (list_kind(listCell, &listKind)) {
+        *kind = (*kind < 0 || *kind == listKind) ? listKind : SUBKEY_LIST_LI;
+        size_t stride = listKind == SUBKEY_LIST_LI ? 4 : 8;
+        return (size_t)8 + (size_t)count * stride <= listSize ? count : -1;
+    }
+    if (depth > 0 || listCell[4] != 'r' || listCell[5] != 'i') return -1;
+    if ((size_t)8 + (size_t)count * 4 > listSize) return -1;
+    int total = 0;
+    for (int i = 0; i < count; ++i) {
+        size_t subSize = 0;
+        const unsigned char *sub = get_cell(hive, read_int32(listCell + 0x08 + i * 4), &subSize);
+        int n = sub ? count_subkey_list(hive, sub, subSize, depth + 1, kind) : -1;
+        if (n < 0 || n > INT_MAX - total) return -1;
+        total += n;
+    }
+    return total;
+}
+
+/* The (validated) li/lf/lh list holding child *index, which becomes the
+ * child's index within that list. */
+static const unsigned char *subkey_sublist(const REGF_KEY *key, int *index)
+{
+    const unsigned char *list = key->subkeyList;
+    if (list[4] != 'r') return list;
+    int count = read_uint16(list + 0x06);
+    for (int i = 0; i < count; ++i) {
+        const unsigned char *sub = get_cell(key->hive, read_int32(list + 0x08 + i * 4), NULL);
+        int n = read_uint16(sub + 0x06);
+        if (*index < n) return sub;
+        *index -= n;
+    }
+    return NULL;
+}
+
+static size_t list_stride(const unsigned char *list)
+{
+    return list[5] == 'i' ? 4 : 8;
+}
+
+/* Offset of child index; hint receives its lf/lh hint (0 for li lists). */
+static int32_t subkey_entry(const REGF_KEY *key, int index, uint32_t *hint)
+{
+    const unsigned char *list = subkey_sublist(key, &index);
+    const unsigned char *entry = list + 0x08 + (size_t)index * list_stride(list);
+    if (hint) *hint = key->subkeyListKind == SUBKEY_LIST_LI ? 0 : read_uint32(entry + 4);
+    return read_int32(entry);
+}
+
+static int32_t value_entry(const REGF_KEY *key, int index)
+{
+    return read_int32(key->valueList + (size_t)index * 4);
+}
+
 static REGF_KEY *parse_key(REGF_HIVE *hive, const unsigned char *cell, size_t cellSize)
 {
-    if (!cell || cellSize < 0x50) return NULL;
+    if (!cell || cellSize < NK_NAME) return NULL;
     if (cell[4] != 'n' || cell[5] != 'k') return NULL;
     REGF_KEY *key = alloc_key(hive);
     if (!key) return NULL;
+    key->offset = (int32_t)(cell - hive->buffer - 0x1000);
     key->cell = cell;
     key->cellSize = cellSize;
-    key->subkeyCount = read_uint16(cell + 0x14);
-    key->valueCount = read_uint32(cell + 0x24);
-    key->nameLen = read_uint16(cell + 0x48);
+    uint32_t subkeyCount = read_uint32(cell + NK_SUBKEY_COUNT);
+    key->valueCount = read_uint32(cell + NK_VALUE_COUNT);
+    key->nameLen = read_uint16(cell + NK_NAME_LENGTH);
     {
-        size_t needed = 0x4c + (size_t)key->nameLen;
+        size_t needed = NK_NAME + (size_t)key->nameLen;
         if (needed > cellSize) {
             RegfReleaseKey(key);
             return NULL;
         }
     }
-    key->name = (const char *)(cell + 0x4c);
+    key->name = (const char *)(cell + NK_NAME);
 
-    if (key->subkeyCount > 0) {
+    if (subkeyCount > 0) {
         size_t listSize = 0;
-        const unsigned char *listCell = get_cell(hive, read_int32(cell + 0x1c), &listSize);
-        if (listCell && listSize >= 0x08 && listCell[4] == 'l' && listCell[5] == 'f') {
-            int count = read_uint16(listCell + 0x06);
-            if (count > 0 && (size_t)(0x08 + count * 4) <= listSize) {
-                key->subkeyOffsets = (int *)calloc((size_t)count, sizeof(int));
-                if (key->subkeyOffsets) {
-                    for (int i = 0; i < count; ++i) {
-                        key->subkeyOffsets[i] = read_int32(listCell + 0x08 + i * 4);
-                    }
-                    key->subkeyCount = count;
-                }
-            }
+        const unsigned char *listCell = get_cell(hive, read_int32(cell + NK_SUBKEY_LIST), &listSize);
+        int kind = -1;
+        int count = listCell ? count_subkey_list(hive, listCell, listSize, 0, &kind) : -1;
+        key->subkeyCount = count > 0 ? count : 0;
+        if (count > 0) {
+            key->subkeyList = listCell;
+            key->subkeyListKind = kind;
         }
     }
 
     if (key->valueCount > 0) {
         size_t listSize = 0;
-        const unsigned char *listCell = get_cell(hive, read_int32(cell + 0x28), &listSize);
-        if (listCell && listSize >= 4 && listSize >= 4 + (size_t)key->valueCount * 4) {
-            key->valueOffsets = (int *)calloc((size_t)key->valueCount, sizeof(int));
-            if (key->valueOffsets) {
-                for (int i = 0; i < key->valueCount; ++i) {
-                    key->valueOffsets[i] = read_int32(listCell + 4 + i * 4);
-                }
-            }
-        }
+        const unsigned char *listCell = get_cell(hive, read_int32(cell + NK_VALUE_LIST), &listSize);
+        if (listCell && listSize >= 4 && listSize >= 4 + (size_t)key->valueCount * 4) key->valueList = listCell + 4;
     }
 
     return key;
@@ -117,28 +462,28 @@ static REGF_KEY *parse_key(REGF_HIVE *hive, const unsigned char *cell, size_t ce
 
 static REGF_VALUE *parse_value(REGF_HIVE *hive, const unsigned char *cell, size_t cellSize)
 {
-    if (!cell || cellSize < 0x18) return NULL;
+    if (!cell || cellSize < VK_NAME) return NULL;
     if (cell[4] != 'v' || cell[5] != 'k') return NULL;
     REGF_VALUE *val = alloc_value(hive);
     if (!val) return NULL;
     val->cell = cell;
     val->cellSize = cellSize;
-    val->nameLen = read_uint16(cell + 0x02);
-    val->type = read_uint32(cell + 0x0c);
-    val->dataSize = read_uint32(cell + 0x04);
-    val->dataOffset = read_uint32(cell + 0x08);
+    val->nameLen = read_uint16(cell + VK_NAME_LENGTH);
+    val->type = read_uint32(cell + VK_TYPE);
+    val->dataSize = read_uint32(cell + VK_DATA_SIZE);
+    val->dataOffset = read_uint32(cell + VK_DATA_OFFSET);
     {
-        size_t needed = 0x18 + (size_t)val->nameLen;
+        size_t needed = VK_NAME + (size_t)val->nameLen;
         if (needed > cellSize) {
             RegfReleaseValue(val);
             return NULL;
         }
     }
-    val->name = (const char *)(cell + 0x18);
+    val->name = (const char *)(cell + VK_NAME);
     return val;
 }
 
-REGF_HIVE *RegfOpen(const unsigned char *buffer, size_t size)
+static REGF_HIVE *open_hive(const unsigned char *buffer, size_t size, REGF_HANDLE_CACHE *cache)
 {
     if (!buffer || size < 4096) return NULL;
     if (memcmp(buffer, "regf", 4) != 0) return NULL;
@@ -146,9 +491,25 @@ REGF_HIVE *RegfOpen(const unsigned char *buffer, size_t size)
     if (!hive) return NULL;
     hive->buffer = buffer;
     hive->size = size;
+    if (cache) {
+        hive->keyPool = cache->keyPool;
+        hive->valuePool = cache->valuePool;
+        cache->keyPool.freeList = cache->valuePool.freeList = NULL;
+        cache->keyPool.blocks = cache->valuePool.blocks = NULL;
+        hive->handleCache = cache;
+    }
+    hive->keyPool.handleSize = sizeof(REGF_KEY);
+    hive->valuePool.handleSize = sizeof(REGF_VALUE);
+#ifndef _WIN32
+    pthread_mutex_init(&hive->poolLock, NULL);
+#endif
+    if (!index_bins(hive)) {
+        RegfClose(hive);
+        return NULL;
+    }
 
     size_t rootCellSize = 0;
-    int32_t rootOffset = read_int32(buffer + 0x24);
+    int32_t rootOffset = read_int32(buffer + BASE_ROOT_CELL);
     const unsigned char *rootCell = get_cell(hive, rootOffset, &rootCellSize);
     hive->root = parse_key(hive, rootCell, rootCellSize);
     if (!hive->root) {
@@ -158,423 +519,2309 @@ REGF_HIVE *RegfOpen(const unsigned char *buffer, size_t size)
     return hive;
 }
 
+static REGF_HIVE *open_image(const unsigned char *buffer, size_t size, REGF_HANDLE_CACHE *cache)
+{
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_OPEN);
+    REGF_HIVE *hive = open_hive(buffer, size, cache);
+    BCD_STATS_PHASE_END(outer);
+    return hive;
+}
+
+REGF_HIVE *RegfOpen(const unsigned char *buffer, size_t size)
+{
+    return open_image(buffer, size, NULL);
+}
+
+/* A cache that was lent to another hive in the meantime already holds that
+ * hive's blocks; this hive's are then freed as usual. */
 void RegfClose(REGF_HIVE *hive)
 {
     if (!hive) return;
     if (hive->root) RegfReleaseKey(hive->root);
+    REGF_HANDLE_CACHE *cache = hive->handleCache;
+    if (cache && !cache->keyPool.blocks && !cache->valuePool.blocks) {
+        cache->keyPool = hive->keyPool;
+        cache->valuePool = hive->valuePool;
+    } else {
+        pool_free(&hive->keyPool);
+        pool_free(&hive->valuePool);
+    }
+#ifndef _WIN32
+    pthread_mutex_destroy(&hive->poolLock);
+#endif
+    free(hive->bins);
+    free(hive->pageBins);
+    free(hive->freeCells);
+    free(hive->dirtyPages);
     free(hive);
 }
 
-REGF_KEY *RegfGetRootKey(REGF_HIVE *hive)
-{
-    return hive ? hive->root : NULL;
-}
-
-REGF_KEY *RegfFindSubKey(REGF_KEY *parent, const char *name)
+static int read_all(FILE *f, unsigned char **outBuffer, size_t *outSize)
 {
-    if (!parent || !name) return NULL;
-    int count = RegfGetSubKeyCount(parent);
-    for (int i = 0; i < count; ++i) {
-        REGF_KEY *child = RegfGetSubKeyAt(parent, i);
-        if (child && child->nameLen == strlen(name) && strncmp(child->name, name, child->nameLen) == 0) {
-            return child;
+    size_t size = 0;
+    size_t capacity = 0;
+    unsigned char *buf = NULL;
+    for (;;) {
+        if (size == capacity) {
+            size_t newCap = capacity ? capacity * 2 : 64 * 1024;
+            unsigned char *p = (unsigned char *)realloc(buf, newCap);
+            if (!p) { free(buf); return 0; }
+            buf = p;
+            capacity = newCap;
         }
-        RegfReleaseKey(child);
+        size_t n = fread(buf + size, 1, capacity - size, f);
+        size += n;
+        if (n == 0) break;
     }
-    return NULL;
+    if (ferror(f)) { free(buf); return 0; }
+    *outBuffer = buf;
+    *outSize = size;
+    return 1;
 }
 
-int RegfGetSubKeyCount(REGF_KEY *key)
+static int read_stream(FILE *f, unsigned char **outBuffer, size_t *outSize)
 {
-    return key ? key->subkeyCount : 0;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_READ);
+    int ok = read_all(f, outBuffer, outSize);
+    if (ok) BCD_STATS_ADD(BCD_STAT_BYTES_READ, *outSize);
+    BCD_STATS_PHASE_END(outer);
+    return ok;
 }
 
-REGF_KEY *RegfGetSubKeyAt(REGF_KEY *key, int index)
+/* -------------------- Transaction logs -------------------- */
+
+/* New-format logs (Windows 8.1 and later) hold a base block sector followed
+ * by HvLE entries. Each entry carries whole dirty pages of the bins area, is
+ * hashed with Marvin32 and bears a sequence number the base block takes once
+ * the entry is applied. Legacy (DIRT) logs are not replayed. */
+#define LOG_ENTRIES_START 0x200
+#define LOG_ENTRY_SIZE 0x04
+#define LOG_ENTRY_SEQUENCE 0x0c
+#define LOG_ENTRY_BINS_SIZE 0x10
+#define LOG_ENTRY_PAGE_COUNT 0x14
+#define LOG_ENTRY_HASH1 0x18
+#define LOG_ENTRY_HASH2 0x20
+#define LOG_ENTRY_PAGES 0x28
+#define LOG_HASH_SEED 0x82EF4D887A4E55C5ULL
+
+struct hive_log {
+    unsigned char *data;
+    size_t size;
+};
+
+/* Log entries to apply, in order, and the image they produce. */
+struct log_replay {
+    struct hive_log logs[2];
+    int logCount;
+    const unsigned char **entries;
+    size_t entryCount;
+    size_t entryCapacity;
+    const unsigned char *baseBlock; /* log base block replacing a torn primary one */
+    uint32_t sequence;              /* of the last entry */
+    uint32_t binsSize;              /* of the last entry */
+    size_t size;                    /* image size after replay */
+};
+
+static uint32_t rotl32(uint32_t v, int n)
 {
-    if (!key || !key->subkeyOffsets || index < 0 || index >= key->subkeyCount) return NULL;
-    size_t cellSize = 0;
-    const unsigned char *cell = get_cell(key->hive, key->subkeyOffsets[index], &cellSize);
-    return parse_key(key->hive, cell, cellSize);
+    return (v << n) | (v >> (32 - n));
 }
 
-int RegfGetValueCount(REGF_KEY *key)
+static void marvin_mix(uint32_t *lo, uint32_t *hi)
 {
-    return key ? key->valueCount : 0;
+    *hi ^= *lo;
+    *lo = rotl32(*lo, 20);
+    *lo += *hi;
+    *hi = rotl32(*hi, 9);
+    *hi ^= *lo;
+    *lo = rotl32(*lo, 27);
+    *lo += *hi;
+    *hi = rotl32(*hi, 19);
 }
 
-REGF_VALUE *RegfGetValueAt(REGF_KEY *key, int index)
+static uint64_t marvin32(const unsigned char *p, size_t len)
 {
-    if (!key || !key->valueOffsets || index < 0 || index >= key->valueCount) return NULL;
-    size_t cellSize = 0;
-    const unsigned char *cell = get_cell(key->hive, key->valueOffsets[index], &cellSize);
-    return parse_value(key->hive, cell, cellSize);
+    uint32_t lo = (uint32_t)LOG_HASH_SEED;
+    uint32_t hi = (uint32_t)(LOG_HASH_SEED >> 32);
+    for (; len >= 4; p += 4, len -= 4) {
+        lo += read_uint32(p);
+        marvin_mix(&lo, &hi);
+    }
+    uint32_t tail = 0x80;
+    for (size_t i = len; i-- > 0;) tail = (tail << 8) | p[i];
+    lo += tail;
+    marvin_mix(&lo, &hi);
+    marvin_mix(&lo, &hi);
+    return ((uint64_t)hi << 32) | lo;
 }
 
-const char *RegfGetKeyName(REGF_KEY *key)
+static int base_block_valid(const unsigned char *base, size_t size)
 {
-    if (!key) return NULL;
-    static char nameBuf[256];
-    size_t len = key->nameLen < sizeof(nameBuf) - 1 ? key->nameLen : sizeof(nameBuf) - 1;
-    memcpy(nameBuf, key->name, len);
-    nameBuf[len] = '\0';
-    return nameBuf;
+    return size >= LOG_ENTRIES_START && memcmp(base, "regf", 4) == 0 &&
+           read_uint32(base + BASE_CHECKSUM) == base_block_checksum(base);
 }
 
-const char *RegfGetValueName(REGF_VALUE *value)
+/* A hive whose write-back was interrupted (or never happened) has differing
+ * sequence numbers or a torn base block. */
+static int hive_is_dirty(const unsigned char *base, size_t size)
 {
-    if (!value) return NULL;
-    static char nameBuf[256];
-    size_t len = value->nameLen < sizeof(nameBuf) - 1 ? value->nameLen : sizeof(nameBuf) - 1;
-    memcpy(nameBuf, value->name, len);
-    nameBuf[len] = '\0';
-    return nameBuf;
+    return !base_block_valid(base, size) || read_uint32(base + BASE_SEQUENCE1) != read_uint32(base + BASE_SEQUENCE2);
 }
 
-uint32_t RegfGetValueType(REGF_VALUE *value)
+/* Size of the intact log entry at pos, or 0 where the entries end. */
+static size_t log_entry_size(const struct hive_log *log, size_t pos)
 {
-    return value ? value->type : 0;
+    if (log->size - pos < LOG_ENTRY_PAGES) return 0;
+    const unsigned char *entry = log->data + pos;
+    size_t size = read_uint32(entry + LOG_ENTRY_SIZE);
+    size_t pageCount = read_uint32(entry + LOG_ENTRY_PAGE_COUNT);
+    size_t binsSize = read_uint32(entry + LOG_ENTRY_BINS_SIZE);
+    if (memcmp(entry, "HvLE", 4) != 0 || size < LOG_ENTRY_PAGES || size % 0x200 || size > log->size - pos) return 0;
+    if (binsSize % HIVE_PAGE_SIZE || pageCount > (size - LOG_ENTRY_PAGES) / 8) return 0;
+    size_t data = LOG_ENTRY_PAGES + pageCount * 8;
+    for (size_t i = 0; i < pageCount; ++i) {
+        size_t offset = read_uint32(entry + LOG_ENTRY_PAGES + i * 8);
+        size_t pageSize = read_uint32(entry + LOG_ENTRY_PAGES + i * 8 + 4);
+        if (offset % HIVE_PAGE_SIZE || pageSize == 0 || pageSize % HIVE_PAGE_SIZE || offset > binsSize ||
+            pageSize > binsSize - offset || pageSize > size - data) {
+            return 0;
+        }
+        data += pageSize;
+    }
+    if (marvin32(entry, LOG_ENTRY_HASH2) != read_uint64(entry + LOG_ENTRY_HASH2)) return 0;
+    if (marvin32(entry + LOG_ENTRY_PAGES, size - LOG_ENTRY_PAGES) != read_uint64(entry + LOG_ENTRY_HASH1)) return 0;
+    return size;
 }
 
-const void *RegfGetValueData(REGF_VALUE *value, size_t *size)
+static int read_log(const char *path, const char *suffix, struct hive_log *log)
 {
-    if (!value || value->dataSize == 0) return NULL;
-    if (value->dataSize <= 4) {
-        if (size) *size = value->dataSize;
-        return value->cell + 0x08;
+    size_t pathLen = strlen(path);
+    size_t suffixLen = strlen(suffix);
+    char *name = (char *)malloc(pathLen + suffixLen + 1);
+    if (!name) return 0;
+    memcpy(name, path, pathLen);
+    memcpy(name + pathLen, suffix, suffixLen + 1);
+    FILE *f = fopen(name, "rb");
+    free(name);
+    if (!f) return 0;
+    int ok = read_stream(f, &log->data, &log->size);
+    fclose(f);
+    if (ok && !base_block_valid(log->data, log->size)) {
+        free(log->data);
+        ok = 0;
     }
-    size_t offset = (size_t)value->dataOffset + 0x1000;
-    if (offset + value->dataSize > value->hive->size) return NULL;
-    if (size) *size = value->dataSize;
-    return value->hive->buffer + offset;
+    return ok;
 }
 
-uint32_t RegfGetValueDataAsUint32(REGF_VALUE *value, int *ok)
+static int push_log_entry(struct log_replay *replay, const unsigned char *entry)
 {
-    if (ok) *ok = 0;
-    size_t size = 0;
-    const void *data = RegfGetValueData(value, &size);
-    if (!data || size < 4) return 0;
-    if (ok) *ok = 1;
-    const unsigned char *p = (const unsigned char *)data;
-    return (uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24));
+    if (replay->entryCount == replay->entryCapacity) {
+        size_t newCap = replay->entryCapacity ? replay->entryCapacity * 2 : 16;
+        const unsigned char **entries =
+            (const unsigned char **)realloc((void *)replay->entries, newCap * sizeof(*entries));
+        if (!entries) return 0;
+        replay->entries = entries;
+        replay->entryCapacity = newCap;
+    }
+    replay->entries[replay->entryCount++] = entry;
+    return 1;
 }
 
-void RegfReleaseKey(REGF_KEY *key)
+/* Chain the logs' entries into one run of consecutive sequence numbers, older
+ * log first. With an intact primary base block the run resumes at its
+ * secondary sequence number (the last write known to be complete), which
+ * never skips an entry the primary may lack; entries that would leave a gap
+ * end the run. */
+static void plan_replay(struct log_replay *replay, const unsigned char *primary, size_t size)
 {
-    if (!key) return;
-    if (key->subkeyOffsets) free(key->subkeyOffsets);
-    if (key->valueOffsets) free(key->valueOffsets);
-    free(key);
+    int primaryValid = base_block_valid(primary, size);
+    uint32_t resume = read_uint32(primary + BASE_SEQUENCE2);
+    if (replay->logCount == 2 &&
+        read_uint32(replay->logs[0].data + BASE_SEQUENCE1) > read_uint32(replay->logs[1].data + BASE_SEQUENCE1)) {
+        struct hive_log older = replay->logs[1];
+        replay->logs[1] = replay->logs[0];
+        replay->logs[0] = older;
+    }
+    replay->size = size;
+    for (int l = 0; l < replay->logCount; ++l) {
+        const struct hive_log *log = &replay->logs[l];
+        size_t entrySize = 0;
+        for (size_t pos = LOG_ENTRIES_START; (entrySize = log_entry_size(log, pos)) > 0; pos += entrySize) {
+            const unsigned char *entry = log->data + pos;
+            uint32_t sequence = read_uint32(entry + LOG_ENTRY_SEQUENCE);
+            if (replay->entryCount > 0) {
+                if (sequence <= replay->sequence) continue;
+                if (sequence != replay->sequence + 1) break;
+            } else if (primaryValid) {
+                if (sequence < resume) continue;
+                if (sequence > resume + 1) break;
+            }
+            if (!push_log_entry(replay, entry)) return;
+            replay->sequence = sequence;
+            replay->binsSize = read_uint32(entry + LOG_ENTRY_BINS_SIZE);
+            replay->baseBlock = primaryValid ? NULL : log->data;
+            if (0x1000 + (size_t)replay->binsSize > replay->size) replay->size = 0x1000 + (size_t)replay->binsSize;
+        }
+    }
 }
 
-void RegfReleaseValue(REGF_VALUE *value)
+static void release_replay(struct log_replay *replay)
 {
-    if (!value) return;
-    free(value);
+    for (int l = 0; l < replay->logCount; ++l) free(replay->logs[l].data);
+    free((void *)replay->entries);
 }
 
-/* -------------------- Serialization -------------------- */
-
-struct writer {
-    unsigned char *data;
-    size_t size;
-    size_t capacity;
-};
-
-static int writer_reserve(struct writer *w, size_t need)
+/* Read path's .LOG1/.LOG2 when the image is dirty and plan their replay.
+ * Returns 1 when there are entries to apply (release the plan afterwards). */
+static int prepare_replay(const char *path, const unsigned char *image, size_t size, struct log_replay *replay)
 {
-    if (need <= w->capacity) return 1;
-    size_t newCap = w->capacity ? w->capacity * 2 : 1024;
-    while (newCap < need) newCap *= 2;
-    unsigned char *p = (unsigned char *)realloc(w->data, newCap);
-    if (!p) return 0;
-    w->data = p;
-    w->capacity = newCap;
+    static const char *const suffixes[] = { ".LOG1", ".LOG2" };
+    memset(replay, 0, sizeof(*replay));
+    if (!path || size < 0x1000 || !hive_is_dirty(image, size)) return 0;
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        if (read_log(path, suffixes[i], &replay->logs[replay->logCount])) replay->logCount++;
+    }
+    plan_replay(replay, image, size);
+    if (replay->entryCount == 0) {
+        release_replay(replay);
+        return 0;
+    }
     return 1;
 }
 
-static int writer_append(struct writer *w, const void *src, size_t len)
+/* Copy each entry's pages into image, which holds replay->size bytes (zeroed
+ * past the primary), and install an up-to-date, clean base block. */
+static void apply_replay(const struct log_replay *replay, unsigned char *image)
 {
-    if (!writer_reserve(w, w->size + len)) return 0;
-    memcpy(w->data + w->size, src, len);
-    w->size += len;
-    return 1;
+    if (replay->baseBlock) memcpy(image, replay->baseBlock, LOG_ENTRIES_START);
+    for (size_t e = 0; e < replay->entryCount; ++e) {
+        const unsigned char *entry = replay->entries[e];
+        size_t pageCount = read_uint32(entry + LOG_ENTRY_PAGE_COUNT);
+        const unsigned char *data = entry + LOG_ENTRY_PAGES + pageCount * 8;
+        for (size_t i = 0; i < pageCount; ++i) {
+            size_t offset = read_uint32(entry + LOG_ENTRY_PAGES + i * 8);
+            size_t pageSize = read_uint32(entry + LOG_ENTRY_PAGES + i * 8 + 4);
+            memcpy(image + 0x1000 + offset, data, pageSize);
+            data += pageSize;
+            BCD_STATS_ADD(BCD_STAT_LOG_BYTES_REPLAYED, pageSize);
+        }
+        BCD_STATS_INC(BCD_STAT_LOG_ENTRIES_REPLAYED);
+    }
+    put_uint32(image + BASE_SEQUENCE1, replay->sequence);
+    put_uint32(image + BASE_SEQUENCE2, replay->sequence);
+    put_uint32(image + BASE_FILE_TYPE, 0);
+    put_uint32(image + BASE_BINS_SIZE, replay->binsSize);
+    put_uint32(image + BASE_CHECKSUM, base_block_checksum(image));
 }
 
-static size_t align4(size_t v)
+int RegfReplayLogs(const char *path, unsigned char **image, size_t *size)
 {
-    return (v + 3U) & ~3U;
+    if (!path || !image || !*image || !size) return BCD_ERR_INVALID_ARG;
+    struct log_replay replay;
+    if (!prepare_replay(path, *image, *size, &replay)) return 0;
+    unsigned char *grown = replay.size > *size ? (unsigned char *)realloc(*image, replay.size) : *image;
+    if (grown) {
+        memset(grown + *size, 0, replay.size - *size);
+        *image = grown;
+        *size = replay.size;
+        apply_replay(&replay, grown);
+    }
+    release_replay(&replay);
+    return grown ? 1 : BCD_ERR_CAPACITY;
 }
 
-static int32_t append_cell(struct writer *w, const unsigned char *payload, size_t payloadSize)
+/* path names the file the stream was opened from (NULL for stdin), whose
+ * transaction logs are replayed into the buffer if the hive is dirty. */
+/* Failures set *status to BCD_ERR_IO when the input could not be read and to
+ * BCD_ERR_PARSE when it is not a valid hive. */
+static REGF_HIVE *open_buffered(FILE *f, const char *path, REGF_HANDLE_CACHE *cache, int *status)
 {
-    size_t cellSize = align4(payloadSize + 4);
-    int32_t offset = (int32_t)w->size;
-    int32_t signedSize = -(int32_t)cellSize;
-    if (!writer_append(w, &signedSize, 4)) return -1;
-    if (!writer_append(w, payload, payloadSize)) return -1;
-    unsigned char pad[3] = {0};
-    size_t padLen = cellSize - payloadSize - 4;
-    if (padLen > 0 && !writer_append(w, pad, padLen)) return -1;
-    return offset;
+    unsigned char *buffer = NULL;
+    size_t size = 0;
+    if (!read_stream(f, &buffer, &size)) {
+        *status = BCD_ERR_IO;
+        return NULL;
+    }
+    int recovered = path && RegfReplayLogs(path, &buffer, &size) == 1;
+    REGF_HIVE *hive = open_image(buffer, size, cache);
+    if (!hive) {
+        free(buffer);
+        *status = BCD_ERR_PARSE;
+        return NULL;
+    }
+    hive->owned = buffer;
+    hive->recovered = recovered;
+    return hive;
 }
 
-static int append_value_cell(struct writer *w, const char *name, uint32_t regType, const unsigned char *data, uint32_t dataSize, int32_t *outOffset)
+#ifndef _WIN32
+/* Replay path's logs over a private mapping of the primary. Pages are written
+ * through the mapping, so the kernel copies only the dirty ones; logs that
+ * grow the hive get a heap copy instead, returned with its size. */
+static unsigned char *replay_mapped(const char *path, void *map, size_t size, size_t *copySize)
 {
-    unsigned char header[0x18];
-    memset(header, 0, sizeof(header));
-    header[0] = 'v';
-    header[1] = 'k';
-    uint16_t nameLen = (uint16_t)strlen(name);
-    header[0x02] = (unsigned char)(nameLen & 0xff);
-    header[0x03] = (unsigned char)((nameLen >> 8) & 0xff);
-    header[0x04] = (unsigned char)(dataSize & 0xff);
-    header[0x05] = (unsigned char)((dataSize >> 8) & 0xff);
-    header[0x06] = (unsigned char)((dataSize >> 16) & 0xff);
-    header[0x07] = (unsigned char)((dataSize >> 24) & 0xff);
-    int32_t dataOffset = 0;
-    if (dataSize > 4) {
-        dataOffset = (int32_t)align4(w->size) + (int32_t)0x1000;
-    }
-    header[0x08] = (unsigned char)(dataOffset & 0xff);
-    header[0x09] = (unsigned char)((dataOffset >> 8) & 0xff);
-    header[0x0a] = (unsigned char)((dataOffset >> 16) & 0xff);
-    header[0x0b] = (unsigned char)((dataOffset >> 24) & 0xff);
-    header[0x0c] = (unsigned char)(regType & 0xff);
-    header[0x0d] = (unsigned char)((regType >> 8) & 0xff);
-    header[0x0e] = (unsigned char)((regType >> 16) & 0xff);
-    header[0x0f] = (unsigned char)((regType >> 24) & 0xff);
-    unsigned char *payload = (unsigned char *)malloc(0x18 + nameLen);
-    if (!payload) return 0;
-    memcpy(payload, header, 0x18);
-    memcpy(payload + 0x18, name, nameLen);
-
-    int32_t offset = append_cell(w, payload, 0x18 + nameLen);
-    free(payload);
-    if (offset < 0) return 0;
+    struct log_replay replay;
+    if (!prepare_replay(path, (const unsigned char *)map, size, &replay)) return NULL;
+    unsigned char *copy = NULL;
+    if (replay.size <= size && mprotect(map, size, PROT_READ | PROT_WRITE) == 0) {
+        apply_replay(&replay, (unsigned char *)map);
+        mprotect(map, size, PROT_READ);
+    } else if ((copy = (unsigned char *)malloc(replay.size)) != NULL) {
+        memcpy(copy, map, size);
+        memset(copy + size, 0, replay.size - size);
+        apply_replay(&replay, copy);
+        *copySize = replay.size;
+    }
+    release_replay(&replay);
+    return copy;
+}
+#endif
 
-    if (dataSize <= 4) {
-        unsigned char tmp[4] = {0};
-        memcpy(tmp, data, dataSize);
-        memcpy(w->data + (size_t)offset + 4 + 0x08, tmp, 4);
-    } else {
-        size_t aligned = align4(w->size);
-        if (!writer_reserve(w, aligned + dataSize)) return 0;
-        memset(w->data + w->size, 0, aligned - w->size);
-        w->size = aligned;
-        memcpy(w->data + w->size, data, dataSize);
-        w->size += dataSize;
+static REGF_HIVE *open_file(const char *path, REGF_HANDLE_CACHE *cache, int *status)
+{
+    *status = BCD_ERR_IO;
+    if (!path) return NULL;
+    if (strcmp(path, "-") == 0) return open_buffered(stdin, NULL, cache, status);
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= 4096 &&
+        (uintmax_t)st.st_size <= (uintmax_t)SIZE_MAX) {
+        size_t size = (size_t)st.st_size;
+        BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_READ);
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        BCD_STATS_PHASE_END(outer);
+        if (map != MAP_FAILED) {
+            BCD_STATS_ADD(BCD_STAT_BYTES_READ, size);
+            close(fd);
+            size_t copySize = 0;
+            unsigned char *copy = replay_mapped(path, map, size, &copySize);
+            if (copy) munmap(map, size);
+            REGF_HIVE *hive = copy ? open_image(copy, copySize, cache) : open_image((const unsigned char *)map, size, cache);
+            if (!hive) {
+                if (copy) free(copy);
+                else munmap(map, size);
+                *status = BCD_ERR_PARSE;
+                return NULL;
+            }
+            if (copy) hive->owned = copy;
+            else hive->mapping = map;
+            return hive;
+        }
+    }
+    FILE *f = fdopen(fd, "rb");
+    if (!f) {
+        close(fd);
+        return NULL;
     }
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+#endif
+    REGF_HIVE *hive = open_buffered(f, path, cache, status);
+    fclose(f);
+    return hive;
+}
 
-    if (outOffset) *outOffset = offset;
-    return 1;
+REGF_HIVE *RegfOpenFile(const char *path)
+{
+    int status;
+    return open_file(path, NULL, &status);
 }
 
-static int append_subkey_list(struct writer *w, const int32_t *offsets, size_t count, int32_t *outOffset)
+REGF_HIVE *RegfOpenFileCached(const char *path, REGF_HANDLE_CACHE *cache)
 {
-    size_t payloadSize = 0x08 + count * 4;
-    unsigned char *payload = (unsigned char *)calloc(1, payloadSize);
-    if (!payload) return 0;
-    payload[0x00] = 'l';
-    payload[0x01] = 'f';
-    payload[0x04] = 'l';
-    payload[0x05] = 'f';
-    payload[0x06] = (unsigned char)(count & 0xff);
-    payload[0x07] = (unsigned char)((count >> 8) & 0xff);
-    for (size_t i = 0; i < count; ++i) {
-        int32_t off = offsets[i];
-        payload[0x08 + i * 4] = (unsigned char)(off & 0xff);
-        payload[0x09 + i * 4] = (unsigned char)((off >> 8) & 0xff);
-        payload[0x0a + i * 4] = (unsigned char)((off >> 16) & 0xff);
-        payload[0x0b + i * 4] = (unsigned char)((off >> 24) & 0xff);
-    }
-    int32_t offset = append_cell(w, payload, payloadSize);
-    free(payload);
-    if (offset < 0) return 0;
-    if (outOffset) *outOffset = offset;
-    return 1;
+    int status;
+    return open_file(path, cache, &status);
 }
 
-static int append_value_list(struct writer *w, const int32_t *offsets, size_t count, int32_t *outOffset)
+REGF_HIVE *RegfOpenFileStatus(const char *path, REGF_HANDLE_CACHE *cache, int *outStatus)
 {
-    size_t payloadSize = 4 + count * 4;
-    unsigned char *payload = (unsigned char *)calloc(1, payloadSize);
-    if (!payload) return 0;
-    for (size_t i = 0; i < count; ++i) {
-        int32_t off = offsets[i];
-        payload[4 + i * 4] = (unsigned char)(off & 0xff);
-        payload[5 + i * 4] = (unsigned char)((off >> 8) & 0xff);
-        payload[6 + i * 4] = (unsigned char)((off >> 16) & 0xff);
-        payload[7 + i * 4] = (unsigned char)((off >> 24) & 0xff);
-    }
-    int32_t offset = append_cell(w, payload, payloadSize);
-    free(payload);
-    if (offset < 0) return 0;
-    if (outOffset) *outOffset = offset;
-    return 1;
+    int status;
+    REGF_HIVE *hive = open_file(path, cache, &status);
+    if (outStatus) *outStatus = hive ? BCD_OK : status;
+    return hive;
 }
 
-static int32_t append_key(struct writer *w, const char *name, uint16_t subkeyCount, int32_t subkeyList, uint32_t valueCount, int32_t valueList)
+REGF_HANDLE_CACHE *RegfHandleCacheCreate(void)
 {
-    uint16_t nameLen = (uint16_t)strlen(name);
-    size_t payloadSize = 0x4c + nameLen;
-    unsigned char *payload = (unsigned char *)calloc(1, payloadSize);
-    if (!payload) return -1;
-    payload[0x00] = 'n';
-    payload[0x01] = 'k';
-    payload[0x04] = (unsigned char)(subkeyCount & 0xff);
-    payload[0x05] = (unsigned char)((subkeyCount >> 8) & 0xff);
-    payload[0x14] = (unsigned char)(subkeyCount & 0xff);
-    payload[0x15] = (unsigned char)((subkeyCount >> 8) & 0xff);
-    payload[0x1c] = (unsigned char)(subkeyList & 0xff);
-    payload[0x1d] = (unsigned char)((subkeyList >> 8) & 0xff);
-    payload[0x1e] = (unsigned char)((subkeyList >> 16) & 0xff);
-    payload[0x1f] = (unsigned char)((subkeyList >> 24) & 0xff);
-    payload[0x24] = (unsigned char)(valueCount & 0xff);
-    payload[0x25] = (unsigned char)((valueCount >> 8) & 0xff);
-    payload[0x26] = (unsigned char)((valueCount >> 16) & 0xff);
-    payload[0x27] = (unsigned char)((valueCount >> 24) & 0xff);
-    payload[0x28] = (unsigned char)(valueList & 0xff);
-    payload[0x29] = (unsigned char)((valueList >> 8) & 0xff);
-    payload[0x2a] = (unsigned char)((valueList >> 16) & 0xff);
-    payload[0x2b] = (unsigned char)((valueList >> 24) & 0xff);
-    payload[0x48] = (unsigned char)(nameLen & 0xff);
-    payload[0x49] = (unsigned char)((nameLen >> 8) & 0xff);
-    memcpy(payload + 0x4c, name, nameLen);
+    REGF_HANDLE_CACHE *cache = (REGF_HANDLE_CACHE *)calloc(1, sizeof(REGF_HANDLE_CACHE));
+    if (!cache) return NULL;
+    cache->keyPool.handleSize = sizeof(REGF_KEY);
+    cache->valuePool.handleSize = sizeof(REGF_VALUE);
+    return cache;
+}
 
-    int32_t offset = append_cell(w, payload, payloadSize);
-    free(payload);
-    return offset;
+void RegfHandleCacheDestroy(REGF_HANDLE_CACHE *cache)
+{
+    if (!cache) return;
+    pool_free(&cache->keyPool);
+    pool_free(&cache->valuePool);
+    free(cache);
 }
 
-static uint32_t element_to_regtype(BCD_ELEMENT_KIND kind)
+void RegfCloseFile(REGF_HIVE *hive)
 {
-    switch (kind) {
-    case BCD_ELEMENT_STRING:
-        return REG_TYPE_SZ;
-    case BCD_ELEMENT_INTEGER:
-        return REG_TYPE_QWORD;
-    case BCD_ELEMENT_BOOLEAN:
-        return REG_TYPE_DWORD;
-    case BCD_ELEMENT_BINARY:
-    default:
-        return REG_TYPE_BINARY;
-    }
+    if (!hive) return;
+#ifndef _WIN32
+    if (hive->mapping) munmap(hive->mapping, hive->size);
+#endif
+    free(hive->owned);
+    RegfClose(hive);
 }
 
-int RegfSerializeBcdStore(const BCD_STORE *store, unsigned char **outBuffer, size_t *outSize)
+REGF_KEY *RegfGetRootKey(REGF_HIVE *hive)
 {
-    if (!store || !outBuffer || !outSize) return BCD_ERR_INVALID_ARG;
-    struct writer w = {0};
+    return hive ? hive->root : NULL;
+}
 
-    int32_t *objectOffsets = (int32_t *)calloc(store->objectCount, sizeof(int32_t));
-    if (!objectOffsets) return BCD_ERR_IO;
+int RegfIsLegacyBcdHive(const REGF_HIVE *hive)
+{
+    return hive && read_uint32(hive->buffer + BASE_MAJOR_VERSION) == 0;
+}
+
+static int upper_ascii(int c)
+{
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+static REGF_NAME make_name(const char *text, size_t len)
+{
+    REGF_NAME name;
+    name.data = text;
+    name.length = len;
+    name.wide = 0;
+    return name;
+}
+
+static size_t name_chars(REGF_NAME name)
+{
+    return name.wide ? name.length / 2 : name.length;
+}
+
+static int name_char(REGF_NAME name, size_t i)
+{
+    if (name.wide) return read_uint16((const unsigned char *)name.data + i * 2);
+    return (unsigned char)name.data[i];
+}
+
+static uint32_t hash_name(REGF_NAME name)
+{
+    uint32_t hash = 0;
+    size_t n = name_chars(name);
+    for (size_t i = 0; i < n; ++i) hash = hash * 37U + (uint32_t)upper_ascii(name_char(name, i));
+    return hash;
+}
+
+uint32_t RegfHashName(const char *name, size_t len)
+{
+    return name ? hash_name(make_name(name, len)) : 0;
+}
+
+int RegfNameCompare(REGF_NAME a, REGF_NAME b)
+{
+    size_t aLen = name_chars(a);
+    size_t bLen = name_chars(b);
+    size_t n = aLen < bLen ? aLen : bLen;
+    for (size_t i = 0; i < n; ++i) {
+        int ca = upper_ascii(name_char(a, i));
+        int cb = upper_ascii(name_char(b, i));
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return aLen == bLen ? 0 : (aLen < bLen ? -1 : 1);
+}
+
+int RegfNameEquals(REGF_NAME name, const char *text)
+{
+    if (!text) return 0;
+    return RegfNameCompare(name, make_name(text, strlen(text))) == 0;
+}
+
+int RegfNameParseHex32(REGF_NAME name, uint32_t *out)
+{
+    size_t n = name_chars(name);
+    if (!out || n == 0 || n > 8) return BCD_ERR_PARSE;
+    uint32_t value = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int c = name_char(name, i);
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = 10 + (c - 'a');
+        else if (c >= 'A' && c <= 'F') digit = 10 + (c - 'A');
+        else return BCD_ERR_PARSE;
+        value = (value << 4) | (uint32_t)digit;
+    }
+    *out = value;
+    return BCD_OK;
+}
+
+size_t RegfNameCopy(REGF_NAME name, char *buffer, size_t bufferSize)
+{
+    size_t n = name_chars(name);
+    if (!buffer || bufferSize == 0) return n;
+    size_t copy = n < bufferSize - 1 ? n : bufferSize - 1;
+    for (size_t i = 0; i < copy; ++i) {
+        int c = name_char(name, i);
+        buffer[i] = c < 0x80 ? (char)c : '?';
+    }
+    buffer[copy] = '\0';
+    return n;
+}
+
+static REGF_NAME nk_name(const unsigned char *cell, size_t nameLen)
+{
+    REGF_NAME name = make_name((const char *)(cell + NK_NAME), nameLen);
+    name.wide = !(read_uint16(cell + NK_FLAGS) & KEY_COMP_NAME);
+    return name;
+}
+
+/* Read a child's name straight from its nk cell without building a REGF_KEY. */
+static int child_name(REGF_HIVE *hive, int32_t offset, REGF_NAME *name)
+{
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(hive, offset, &cellSize);
+    if (!cell || cellSize < NK_NAME || cell[4] != 'n' || cell[5] != 'k') return 0;
+    size_t nameLen = read_uint16(cell + NK_NAME_LENGTH);
+    if (NK_NAME + nameLen > cellSize) return 0;
+    *name = nk_name(cell, nameLen);
+    return 1;
+}
+
+/* Order the target against an lf hint (first four name bytes, zero padded).
+ * Returns 0 when the hint cannot decide and the child must be read. */
+static int compare_lf_hint(REGF_NAME name, uint32_t hint)
+{
+    size_t len = name_chars(name);
+    for (size_t i = 0; i < 4; ++i) {
+        int h = (int)((hint >> (8 * i)) & 0xff);
+        if (h == 0) return len > i ? 1 : 0;
+        if (i >= len) return -1;
+        int ca = upper_ascii(name_char(name, i));
+        int cb = upper_ascii(h);
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return 0;
+}
+
+REGF_KEY *RegfFindSubKey(REGF_KEY *parent, const char *name)
+{
+    if (!parent || !name || !parent->subkeyList) return NULL;
+    REGF_NAME target = make_name(name, strlen(name));
+    REGF_NAME childName;
+
+    int lo = 0;
+    int hi = parent->subkeyCount - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        uint32_t hint = 0;
+        int32_t child = subkey_entry(parent, mid, &hint);
+        /* lh hints are hashes: they cannot order names, so lh and li probes
+         * read the child name. */
+        int cmp = 0;
+        if (parent->subkeyListKind == SUBKEY_LIST_LF) cmp = compare_lf_hint(target, hint);
+        if (cmp == 0) {
+            if (!child_name(parent->hive, child, &childName)) return NULL;
+            cmp = RegfNameCompare(target, childName);
+            if (cmp == 0) return RegfGetSubKeyAt(parent, mid);
+        }
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+int RegfGetSubKeyCount(REGF_KEY *key)
+{
+    return key ? key->subkeyCount : 0;
+}
+
+REGF_KEY *RegfGetSubKeyAt(REGF_KEY *key, int index)
+{
+    if (!key || !key->subkeyList || index < 0 || index >= key->subkeyCount) return NULL;
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(key->hive, subkey_entry(key, index, NULL), &cellSize);
+    return parse_key(key->hive, cell, cellSize);
+}
+
+int RegfGetValueCount(REGF_KEY *key)
+{
+    return key ? key->valueCount : 0;
+}
+
+REGF_VALUE *RegfGetValueAt(REGF_KEY *key, int index)
+{
+    if (!key || !key->valueList || index < 0 || index >= key->valueCount) return NULL;
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(key->hive, value_entry(key, index), &cellSize);
+    return parse_value(key->hive, cell, cellSize);
+}
+
+REGF_VALUE *RegfFindValue(REGF_KEY *key, const char *name)
+{
+    if (!key || !name || !key->valueList) return NULL;
+    REGF_NAME target = make_name(name, strlen(name));
+    for (int i = 0; i < key->valueCount; ++i) {
+        size_t cellSize = 0;
+        const unsigned char *cell = get_cell(key->hive, value_entry(key, i), &cellSize);
+        if (!cell || cellSize < VK_NAME || cell[4] != 'v' || cell[5] != 'k') continue;
+        size_t nameLen = read_uint16(cell + VK_NAME_LENGTH);
+        if (VK_NAME + nameLen > cellSize) continue;
+        REGF_NAME candidate = make_name((const char *)(cell + VK_NAME), nameLen);
+        candidate.wide = !(read_uint16(cell + VK_FLAGS) & VALUE_COMP_NAME);
+        if (RegfNameCompare(target, candidate) == 0) return parse_value(key->hive, cell, cellSize);
+    }
+    return NULL;
+}
+
+int32_t RegfGetKeyOffset(REGF_KEY *key)
+{
+    return key ? key->offset : -1;
+}
+
+REGF_KEY *RegfGetKeyAtOffset(REGF_HIVE *hive, int32_t offset)
+{
+    if (!hive) return NULL;
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(hive, offset, &cellSize);
+    return parse_key(hive, cell, cellSize);
+}
+
+int RegfSubKeyCursorBegin(REGF_KEY *parent, REGF_SUBKEY_CURSOR *cursor)
+{
+    if (!parent || !cursor) return BCD_ERR_INVALID_ARG;
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->parent = parent;
+    if (parent->subkeyList) {
+        int first = 0;
+        cursor->list = subkey_sublist(parent, &first);
+    }
+    return BCD_OK;
+}
+
+int RegfSubKeyCursorNext(REGF_SUBKEY_CURSOR *cursor, REGF_KEY **child)
+{
+    if (!cursor || !child) return BCD_ERR_INVALID_ARG;
+    const unsigned char *root = cursor->parent->subkeyList;
+    while (cursor->list && cursor->entry >= read_uint16(cursor->list + 0x06)) {
+        /* Lists were validated when the parent was parsed. */
+        cursor->list = NULL;
+        cursor->entry = 0;
+        if (root[4] == 'r' && ++cursor->sublist < read_uint16(root + 0x06)) {
+            cursor->list = get_cell(cursor->parent->hive, read_int32(root + 0x08 + cursor->sublist * 4), NULL);
+        }
+    }
+    if (!cursor->list) return 0;
+    const unsigned char *entry = cursor->list + 0x08 + (size_t)cursor->entry++ * list_stride(cursor->list);
+    *child = RegfGetKeyAtOffset(cursor->parent->hive, read_int32(entry));
+    return 1;
+}
+
+/* Report a key and then its values; returns the verdict on the key's subtree. */
+static int visit_key(REGF_KEY *key, int depth, const REGF_WALK_VISITOR *visitor)
+{
+    int verdict = visitor->key ? visitor->key(key, depth, visitor->context) : REGF_VISIT_CONTINUE;
+    if (verdict != REGF_VISIT_CONTINUE || !visitor->value) return verdict;
+    for (int i = 0; i < key->valueCount && verdict == REGF_VISIT_CONTINUE; ++i) {
+        REGF_VALUE *value = RegfGetValueAt(key, i);
+        if (!value) continue;
+        verdict = visitor->value(key, value, depth, visitor->context);
+        RegfReleaseValue(value);
+    }
+    return verdict == REGF_VISIT_STOP ? REGF_VISIT_STOP : REGF_VISIT_CONTINUE;
+}
+
+struct walk_frame {
+    REGF_KEY *key;
+    REGF_SUBKEY_CURSOR cursor;
+};
+
+static int walk_depth_first(REGF_KEY *start, int maxDepth, const REGF_WALK_VISITOR *visitor)
+{
+    struct walk_frame *stack = (struct walk_frame *)malloc(16 * sizeof(struct walk_frame));
+    if (!stack) return BCD_ERR_CAPACITY;
+    size_t capacity = 16;
+    size_t depth = 1;
+    stack[0].key = start;
+    RegfSubKeyCursorBegin(start, &stack[0].cursor);
+    int status = BCD_OK;
+    while (depth > 0) {
+        REGF_KEY *child = NULL;
+        if (!RegfSubKeyCursorNext(&stack[depth - 1].cursor, &child)) {
+            if (--depth > 0) RegfReleaseKey(stack[depth].key);
+            continue;
+        }
+        if (!child) continue;
+        int verdict = visit_key(child, (int)depth, visitor);
+        if (verdict == REGF_VISIT_STOP) {
+            RegfReleaseKey(child);
+            break;
+        }
+        if (verdict == REGF_VISIT_SKIP || (int)depth >= maxDepth || child->subkeyCount == 0) {
+            RegfReleaseKey(child);
+            continue;
+        }
+        if (depth == capacity) {
+            struct walk_frame *grown = (struct walk_frame *)realloc(stack, capacity * 2 * sizeof(struct walk_frame));
+            if (!grown) {
+                RegfReleaseKey(child);
+                status = BCD_ERR_CAPACITY;
+                break;
+            }
+            stack = grown;
+            capacity *= 2;
+        }
+        stack[depth].key = child;
+        RegfSubKeyCursorBegin(child, &stack[depth].cursor);
+        ++depth;
+    }
+    while (depth > 1) RegfReleaseKey(stack[--depth].key);
+    free(stack);
+    return status;
+}
+
+struct walk_entry {
+    int32_t offset;
+    int depth;
+};
+
+/* FIFO of keys whose children are still to be visited. */
+struct walk_queue {
+    struct walk_entry *entries;
+    size_t head;
+    size_t count;
+    size_t capacity;
+};
+
+static int walk_queue_push(struct walk_queue *queue, int32_t offset, int depth)
+{
+    if (queue->count == queue->capacity) {
+        size_t newCap = queue->capacity ? queue->capacity * 2 : 64;
+        struct walk_entry *entries = (struct walk_entry *)malloc(newCap * sizeof(struct walk_entry));
+        if (!entries) return 0;
+        for (size_t i = 0; i < queue->count; ++i) entries[i] = queue->entries[(queue->head + i) % queue->capacity];
+        free(queue->entries);
+        queue->entries = entries;
+        queue->head = 0;
+        queue->capacity = newCap;
+    }
+    struct walk_entry *entry = &queue->entries[(queue->head + queue->count++) % queue->capacity];
+    entry->offset = offset;
+    entry->depth = depth;
+    return 1;
+}
+
+static int walk_breadth_first(REGF_KEY *start, int maxDepth, const REGF_WALK_VISITOR *visitor)
+{
+    struct walk_queue queue;
+    memset(&queue, 0, sizeof(queue));
+    if (!walk_queue_push(&queue, start->offset, 0)) return BCD_ERR_CAPACITY;
+    int status = BCD_OK;
+    int stopped = 0;
+    while (queue.count > 0 && !stopped && status == BCD_OK) {
+        struct walk_entry next = queue.entries[queue.head];
+        queue.head = (queue.head + 1) % queue.capacity;
+        queue.count--;
+        /* The start key is used as given; queued keys are re-read from their cells. */
+        REGF_KEY *parent = next.depth == 0 ? start : RegfGetKeyAtOffset(start->hive, next.offset);
+        if (!parent) continue;
+        REGF_SUBKEY_CURSOR cursor;
+        RegfSubKeyCursorBegin(parent, &cursor);
+        REGF_KEY *child = NULL;
+        while (!stopped && status == BCD_OK && RegfSubKeyCursorNext(&cursor, &child)) {
+            if (!child) continue;
+            int verdict = visit_key(child, next.depth + 1, visitor);
+            if (verdict == REGF_VISIT_STOP) stopped = 1;
+            else if (verdict == REGF_VISIT_CONTINUE && next.depth + 1 < maxDepth && child->subkeyCount > 0 &&
+                     !walk_queue_push(&queue, child->offset, next.depth + 1)) {
+                status = BCD_ERR_CAPACITY;
+            }
+            RegfReleaseKey(child);
+        }
+        if (parent != start) RegfReleaseKey(parent);
+    }
+    free(queue.entries);
+    return status;
+}
+
+int RegfWalk(REGF_KEY *start, REGF_WALK_ORDER order, int maxDepth, const REGF_WALK_VISITOR *visitor)
+{
+    if (!start || !visitor) return BCD_ERR_INVALID_ARG;
+    if (maxDepth < 1 || maxDepth > REGF_WALK_MAX_DEPTH) maxDepth = REGF_WALK_MAX_DEPTH;
+    if (visit_key(start, 0, visitor) != REGF_VISIT_CONTINUE) return BCD_OK;
+    if (order == REGF_WALK_BREADTH_FIRST) return walk_breadth_first(start, maxDepth, visitor);
+    return walk_depth_first(start, maxDepth, visitor);
+}
+
+REGF_NAME RegfGetKeyName(REGF_KEY *key)
+{
+    if (!key) return make_name("", 0);
+    return nk_name(key->cell, key->nameLen);
+}
+
+REGF_NAME RegfGetValueName(REGF_VALUE *value)
+{
+    if (!value) return make_name("", 0);
+    REGF_NAME name = make_name(value->name, value->nameLen);
+    name.wide = !(read_uint16(value->cell + VK_FLAGS) & VALUE_COMP_NAME);
+    return name;
+}
+
+uint32_t RegfGetValueType(REGF_VALUE *value)
+{
+    return value ? value->type : 0;
+}
+
+size_t RegfGetValueDataSize(REGF_VALUE *value)
+{
+    if (!value) return 0;
+    if (value->dataSize & VALUE_DATA_INLINE) {
+        size_t size = value->dataSize & ~VALUE_DATA_INLINE;
+        return size <= 4 ? size : 0;
+    }
+    return value->dataSize;
+}
+
+/* Resolve a db record to its segment list; returns the segment count or -1. */
+static int big_data_segments(REGF_VALUE *value, const unsigned char **segmentList)
+{
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(value->hive, (int32_t)value->dataOffset, &cellSize);
+    if (!cell || cellSize < 12 || cell[4] != 'd' || cell[5] != 'b') return -1;
+    int count = read_uint16(cell + 0x06);
+    size_t listSize = 0;
+    const unsigned char *list = get_cell(value->hive, read_int32(cell + 0x08), &listSize);
+    if (!list || count == 0 || 4 + (size_t)count * 4 > listSize) return -1;
+    if ((size_t)count * BIG_DATA_SEGMENT_SIZE < value->dataSize) return -1;
+    *segmentList = list + 4;
+    return count;
+}
+
+static int is_big_data(REGF_VALUE *value)
+{
+    if (value->dataSize & VALUE_DATA_INLINE || value->dataSize <= BIG_DATA_SEGMENT_SIZE) return 0;
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(value->hive, (int32_t)value->dataOffset, &cellSize);
+    return cell && cellSize >= 6 && cell[4] == 'd' && cell[5] == 'b';
+}
+
+const void *RegfGetValueData(REGF_VALUE *value, size_t *size)
+{
+    if (!value) return NULL;
+    size_t dataSize = RegfGetValueDataSize(value);
+    if (dataSize == 0) return NULL;
+    if (value->dataSize & VALUE_DATA_INLINE) {
+        if (size) *size = dataSize;
+        return value->cell + VK_DATA_OFFSET;
+    }
+    if (is_big_data(value)) return NULL;
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(value->hive, (int32_t)value->dataOffset, &cellSize);
+    if (!cell || cellSize - 4 < dataSize) return NULL;
+    if (size) *size = dataSize;
+    return cell + 4;
+}
+
+int RegfValueDataBegin(REGF_VALUE *value, REGF_DATA_CURSOR *cursor)
+{
+    if (!value || !cursor) return BCD_ERR_INVALID_ARG;
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->value = value;
+    cursor->remaining = RegfGetValueDataSize(value);
+    if (cursor->remaining == 0) return BCD_OK;
+    if (cursor->remaining > value->hive->size) return BCD_ERR_PARSE;
+    if (is_big_data(value)) {
+        cursor->segmentCount = big_data_segments(value, &cursor->segmentList);
+        if (cursor->segmentCount < 0) return BCD_ERR_PARSE;
+    } else if (!RegfGetValueData(value, NULL)) {
+        return BCD_ERR_PARSE;
+    }
+    return BCD_OK;
+}
+
+int RegfValueDataNext(REGF_DATA_CURSOR *cursor, const void **chunk, size_t *chunkSize)
+{
+    if (!cursor || !chunk || !chunkSize) return BCD_ERR_INVALID_ARG;
+    if (cursor->remaining == 0) return 0;
+    if (!cursor->segmentList) {
+        const void *data = RegfGetValueData(cursor->value, chunkSize);
+        if (!data) return BCD_ERR_PARSE;
+        *chunk = data;
+        cursor->remaining = 0;
+        return 1;
+    }
+    if (cursor->segmentIndex >= cursor->segmentCount) return BCD_ERR_PARSE;
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(cursor->value->hive,
+                                         read_int32(cursor->segmentList + (size_t)cursor->segmentIndex * 4), &cellSize);
+    size_t want = cursor->remaining < BIG_DATA_SEGMENT_SIZE ? cursor->remaining : BIG_DATA_SEGMENT_SIZE;
+    if (!cell || cellSize - 4 < want) return BCD_ERR_PARSE;
+    cursor->segmentIndex++;
+    cursor->remaining -= want;
+    *chunk = cell + 4;
+    *chunkSize = want;
+    return 1;
+}
+
+uint32_t RegfGetValueDataAsUint32(REGF_VALUE *value, int *ok)
+{
+    if (ok) *ok = 0;
+    size_t size = 0;
+    const void *data = RegfGetValueData(value, &size);
+    if (!data || size < 4) return 0;
+    if (ok) *ok = 1;
+    const unsigned char *p = (const unsigned char *)data;
+    return (uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24));
+}
+
+void RegfReleaseKey(REGF_KEY *key)
+{
+    if (!key) return;
+    pool_release(key->hive, &key->hive->keyPool, key);
+    BCD_STATS_INC(BCD_STAT_KEYS_FREED);
+}
+
+void RegfReleaseValue(REGF_VALUE *value)
+{
+    if (!value) return;
+    pool_release(value->hive, &value->hive->valuePool, value);
+    BCD_STATS_INC(BCD_STAT_VALUES_FREED);
+}
+
+/* -------------------- Serialization -------------------- */
+
+/* The serializer runs the same emit code twice: a sizing pass without an
+ * output buffer places every cell and yields the exact hive size, then the
+ * emit pass writes each cell straight into its final place in the output,
+ * which must be zero-filled. Cells are 8-byte aligned and packed into hbins
+ * of whole 4 KB pages; a cell that does not fit in the rest of a bin starts a
+ * new one and the remainder is left as a free cell. The root key comes first,
+ * then the sk cell all keys share, then per object its nk cell, value list
+ * and each vk followed by its data, and last the root's lh list. */
+
+static size_t align8(size_t v)
+{
+    return (v + 7U) & ~(size_t)7U;
+}
+
+/* Size of an hbin holding a cell of cellSize bytes after its header. */
+static size_t bin_size_for(size_t cellSize)
+{
+    return (cellSize + HBIN_HEADER_SIZE + HIVE_PAGE_SIZE - 1) / HIVE_PAGE_SIZE * HIVE_PAGE_SIZE;
+}
+
+/* Fixed fields of a base block for a freshly written primary hive (version
+ * 1.5, direct-memory-load format). Timestamps stay zero so output is
+ * reproducible. */
+static void fill_base_block(unsigned char *base, int32_t rootKey, size_t binsSize)
+{
+    memcpy(base, "regf", 4);
+    put_uint32(base + BASE_SEQUENCE1, 1);
+    put_uint32(base + BASE_SEQUENCE2, 1);
+    put_uint32(base + BASE_MAJOR_VERSION, 1);
+    put_uint32(base + BASE_MINOR_VERSION, 5);
+    put_uint32(base + BASE_FILE_FORMAT, 1);
+    put_uint32(base + BASE_ROOT_CELL, (uint32_t)rootKey);
+    put_uint32(base + BASE_BINS_SIZE, (uint32_t)binsSize);
+    put_uint32(base + BASE_CLUSTERING, 1);
+    put_uint32(base + BASE_CHECKSUM, base_block_checksum(base));
+}
+
+static void fill_bin_header(unsigned char *bin, size_t offset, size_t size)
+{
+    memcpy(bin, "hbin", 4);
+    put_uint32(bin + 4, (uint32_t)offset);
+    put_uint32(bin + 8, (uint32_t)size);
+}
+
+/* Cell payloads (everything after the size field) are laid out by the fill_*
+ * helpers into zeroed memory, shared by the serializer and in-place updates. */
+static void fill_value_cell(unsigned char *payload, const char *name, uint16_t nameLen, uint32_t regType,
+                            const unsigned char *data, uint32_t dataSize, int32_t dataOffset)
+{
+    payload[0] = 'v';
+    payload[1] = 'k';
+    put_uint16(payload + 0x02, nameLen);
+    if (dataSize <= 4) {
+        put_uint32(payload + 0x04, dataSize | VALUE_DATA_INLINE);
+        if (dataSize > 0) memcpy(payload + 0x08, data, dataSize);
+    } else {
+        put_uint32(payload + 0x04, dataSize);
+        put_uint32(payload + 0x08, (uint32_t)dataOffset);
+    }
+    put_uint32(payload + 0x0c, regType);
+    put_uint16(payload + 0x10, VALUE_COMP_NAME);
+    memcpy(payload + 0x14, name, nameLen);
+}
+
+struct subkey_entry {
+    int32_t offset;
+    uint32_t hash;
+    char name[BCD_ID_STRING_LENGTH + 1];
+};
+
+static int compare_subkey_entries(const void *a, const void *b)
+{
+    const struct subkey_entry *ea = (const struct subkey_entry *)a;
+    const struct subkey_entry *eb = (const struct subkey_entry *)b;
+    return RegfNameCompare(make_name(ea->name, strlen(ea->name)), make_name(eb->name, strlen(eb->name)));
+}
+
+/* One lh list holds at most SUBKEY_LIST_MAX keys (its count is 16 bits);
+ * longer sorted runs are split over several lists under an ri root. */
+#define SUBKEY_LIST_MAX 0xffffU
+
+static size_t subkey_list_count(size_t keyCount)
+{
+    return (keyCount + SUBKEY_LIST_MAX - 1) / SUBKEY_LIST_MAX;
+}
+
+static void fill_subkey_list_cell(unsigned char *payload, const struct subkey_entry *entries, size_t count)
+{
+    payload[0x00] = 'l';
+    payload[0x01] = 'h';
+    put_uint16(payload + 0x02, (uint16_t)count);
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char *entry = payload + 0x04 + i * 8;
+        put_uint32(entry, (uint32_t)entries[i].offset);
+        put_uint32(entry + 4, entries[i].hash);
+    }
+}
+
+/* Every key has a security cell and no class name. */
+static void fill_key_cell(unsigned char *payload, const char *name, uint16_t nameLen, uint16_t flags, int32_t parent,
+                          uint32_t subkeyCount, int32_t subkeyList, uint32_t valueCount, int32_t valueList,
+                          int32_t security)
+{
+    payload[0x00] = 'n';
+    payload[0x01] = 'k';
+    payload[0x02] = (unsigned char)(flags & 0xff);
+    payload[0x03] = (unsigned char)((flags >> 8) & 0xff);
+    put_uint32(payload + 0x10, (uint32_t)parent);
+    put_uint32(payload + 0x14, subkeyCount);
+    payload[0x1c] = (unsigned char)(subkeyList & 0xff);
+    payload[0x1d] = (unsigned char)((subkeyList >> 8) & 0xff);
+    payload[0x1e] = (unsigned char)((subkeyList >> 16) & 0xff);
+    payload[0x1f] = (unsigned char)((subkeyList >> 24) & 0xff);
+    payload[0x24] = (unsigned char)(valueCount & 0xff);
+    payload[0x25] = (unsigned char)((valueCount >> 8) & 0xff);
+    payload[0x26] = (unsigned char)((valueCount >> 16) & 0xff);
+    payload[0x27] = (unsigned char)((valueCount >> 24) & 0xff);
+    payload[0x28] = (unsigned char)(valueList & 0xff);
+    payload[0x29] = (unsigned char)((valueList >> 8) & 0xff);
+    payload[0x2a] = (unsigned char)((valueList >> 16) & 0xff);
+    payload[0x2b] = (unsigned char)((valueList >> 24) & 0xff);
+    put_uint32(payload + 0x2c, (uint32_t)security);
+    put_uint32(payload + 0x30, 0xffffffffU);
+    payload[0x48] = (unsigned char)(nameLen & 0xff);
+    payload[0x49] = (unsigned char)((nameLen >> 8) & 0xff);
+    memcpy(payload + 0x4c, name, nameLen);
+}
+
+/* Self-relative descriptor shared by every written key:
+ * O:BAG:SYD:(A;CI;KA;;;BA)(A;CI;KA;;;SY), full control for Administrators and
+ * SYSTEM, inherited by subkeys. */
+static const unsigned char g_keySecurity[] = {
+    0x01, 0x00, 0x04, 0x80,                         /* revision 1, self-relative, DACL present */
+    0x48, 0x00, 0x00, 0x00, 0x58, 0x00, 0x00, 0x00, /* owner, group */
+    0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, /* no SACL, DACL */
+    0x02, 0x00, 0x34, 0x00, 0x02, 0x00, 0x00, 0x00, /* ACL revision 2, 52 bytes, 2 ACEs */
+    0x00, 0x02, 0x18, 0x00, 0x3f, 0x00, 0x0f, 0x00, /* allow, container inherit, KEY_ALL_ACCESS */
+    0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x20, 0x00, 0x00, 0x00, 0x20, 0x02, 0x00, 0x00,
+    0x00, 0x02, 0x14, 0x00, 0x3f, 0x00, 0x0f, 0x00,
+    0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x12, 0x00, 0x00, 0x00,
+    0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x20, 0x00, 0x00, 0x00, 0x20, 0x02, 0x00, 0x00, /* BA */
+    0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x12, 0x00, 0x00, 0x00                          /* SY */
+};
+
+/* The only sk cell of a written hive: its Flink and Blink point at itself. */
+static void fill_security_cell(unsigned char *payload, int32_t offset, uint32_t references)
+{
+    payload[0x00] = 's';
+    payload[0x01] = 'k';
+    put_uint32(payload + 0x04, (uint32_t)offset);
+    put_uint32(payload + 0x08, (uint32_t)offset);
+    put_uint32(payload + 0x0c, references);
+    put_uint32(payload + 0x10, (uint32_t)sizeof(g_keySecurity));
+    memcpy(payload + 0x14, g_keySecurity, sizeof(g_keySecurity));
+}
+
+static uint32_t element_to_regtype(BCD_ELEMENT_KIND kind)
+{
+    switch (kind) {
+    case BCD_ELEMENT_STRING:
+        return REG_TYPE_SZ;
+    case BCD_ELEMENT_INTEGER:
+        return REG_TYPE_QWORD;
+    case BCD_ELEMENT_BOOLEAN:
+        return REG_TYPE_DWORD;
+    case BCD_ELEMENT_BINARY:
+    default:
+        return REG_TYPE_BINARY;
+    }
+}
+
+/* Registry encoding of an element: returns the value type and points *data at
+ * the bytes to store (scalars are encoded into scalarBuf). */
+static uint32_t element_value(const BCD_ELEMENT *el, unsigned char scalarBuf[8], const unsigned char **data, uint32_t *dataSize)
+{
+    switch (el->kind) {
+    case BCD_ELEMENT_STRING:
+        *data = (const unsigned char *)(el->data.stringValue ? el->data.stringValue : "");
+        *dataSize = (uint32_t)(strlen((const char *)*data) + 1);
+        break;
+    case BCD_ELEMENT_BOOLEAN: {
+        uint32_t val = el->data.boolValue ? 1U : 0U;
+        memcpy(scalarBuf, &val, sizeof(uint32_t));
+        *data = scalarBuf;
+        *dataSize = 4;
+        break;
+    }
+    case BCD_ELEMENT_INTEGER: {
+        uint64_t qv = el->data.integerValue;
+        memcpy(scalarBuf, &qv, sizeof(uint64_t));
+        *data = scalarBuf;
+        *dataSize = 8;
+        break;
+    }
+    case BCD_ELEMENT_BINARY:
+    default:
+        *data = el->data.binaryValue.data;
+        *dataSize = (uint32_t)el->data.binaryValue.size;
+        break;
+    }
+    return element_to_regtype(el->kind);
+}
+
+/* An object is stored as an optional leading "Type" DWORD value followed by
+ * one value per element, named by the element type in hex. data may point
+ * into scalarBuf, so an object_value must not be copied. */
+struct object_value {
+    char name[16];
+    uint32_t regType;
+    const unsigned char *data;
+    uint32_t dataSize;
+    unsigned char scalarBuf[8];
+};
+
+static size_t object_value_count(const BCD_OBJECT *obj)
+{
+    return obj->elementCount + (obj->objectType ? 1 : 0);
+}
+
+static void object_value_at(const BCD_OBJECT *obj, size_t index, struct object_value *out)
+{
+    if (obj->objectType) {
+        if (index == 0) {
+            strcpy(out->name, BCD_OBJECT_TYPE_VALUE);
+            put_uint32(out->scalarBuf, obj->objectType);
+            out->regType = REG_TYPE_DWORD;
+            out->data = out->scalarBuf;
+            out->dataSize = 4;
+            return;
+        }
+        --index;
+    }
+    const BCD_ELEMENT *el = &obj->elements[index];
+    snprintf(out->name, sizeof(out->name), "%08x", el->type);
+    out->regType = element_value(el, out->scalarBuf, &out->data, &out->dataSize);
+}
+
+/* Data above four bytes lives in its own cell, or as a db record over
+ * BIG_DATA_SEGMENT_SIZE segments when it does not fit in one. */
+#define MAX_VALUE_DATA (0xffffU * BIG_DATA_SEGMENT_SIZE)
+
+struct emitter {
+    unsigned char *out;     /* NULL during the sizing pass */
+    size_t pos;             /* file offset of the next cell */
+    size_t binEnd;          /* file offset where the current bin ends */
+};
+
+/* Leave the rest of the current bin as one free cell. */
+static void close_bin(struct emitter *e)
+{
+    if (e->out && e->pos < e->binEnd) put_uint32(e->out + e->pos, (uint32_t)(e->binEnd - e->pos));
+    e->pos = e->binEnd;
+}
+
+/* Claim the next cell, opening a new bin when it does not fit in the current
+ * one. Returns the zeroed payload, or NULL during the sizing pass. */
+static unsigned char *emit_cell(struct emitter *e, size_t payloadSize, int32_t *outOffset)
+{
+    size_t size = align8(payloadSize + 4);
+    if (size > e->binEnd - e->pos) {
+        close_bin(e);
+        size_t binSize = bin_size_for(size);
+        if (e->out) fill_bin_header(e->out + e->pos, e->pos - 0x1000, binSize);
+        e->binEnd = e->pos + binSize;
+        e->pos += HBIN_HEADER_SIZE;
+    }
+    *outOffset = (int32_t)(e->pos - 0x1000);
+    unsigned char *payload = NULL;
+    if (e->out) {
+        put_uint32(e->out + e->pos, (uint32_t)-(int32_t)size);
+        payload = e->out + e->pos + 4;
+    }
+    e->pos += size;
+    return payload;
+}
+
+static int32_t emit_value_data(struct emitter *e, const unsigned char *data, uint32_t dataSize)
+{
+    int32_t offset = 0;
+    if (dataSize <= BIG_DATA_SEGMENT_SIZE) {
+        unsigned char *payload = emit_cell(e, dataSize, &offset);
+        if (payload) memcpy(payload, data, dataSize);
+        return offset;
+    }
+    size_t segmentCount = (dataSize + BIG_DATA_SEGMENT_SIZE - 1) / BIG_DATA_SEGMENT_SIZE;
+    int32_t listOffset = 0;
+    unsigned char *record = emit_cell(e, 8, &offset);
+    unsigned char *list = emit_cell(e, segmentCount * 4, &listOffset);
+    if (record) {
+        record[0] = 'd';
+        record[1] = 'b';
+        put_uint16(record + 0x02, (uint16_t)segmentCount);
+        put_uint32(record + 0x04, (uint32_t)listOffset);
+    }
+    for (size_t i = 0; i < segmentCount; ++i) {
+        size_t chunk = dataSize - i * BIG_DATA_SEGMENT_SIZE;
+        if (chunk > BIG_DATA_SEGMENT_SIZE) chunk = BIG_DATA_SEGMENT_SIZE;
+        int32_t segment = 0;
+        unsigned char *payload = emit_cell(e, chunk, &segment);
+        if (payload) {
+            memcpy(payload, data + i * BIG_DATA_SEGMENT_SIZE, chunk);
+            put_uint32(list + i * 4, (uint32_t)segment);
+        }
+    }
+    return offset;
+}
+
+static int32_t emit_value(struct emitter *e, const struct object_value *value)
+{
+    uint16_t nameLen = (uint16_t)strlen(value->name);
+    int32_t offset = 0;
+    unsigned char *vk = emit_cell(e, 0x14 + (size_t)nameLen, &offset);
+    int32_t dataOffset = value->dataSize > 4 ? emit_value_data(e, value->data, value->dataSize) : 0;
+    if (vk) fill_value_cell(vk, value->name, nameLen, value->regType, value->data, value->dataSize, dataOffset);
+    return offset;
+}
+
+static void emit_object(struct emitter *e, const BCD_OBJECT *obj, struct subkey_entry *entry, int32_t parent,
+                        int32_t security)
+{
+    uint16_t nameLen = (uint16_t)strlen(entry->name);
+    unsigned char *nk = emit_cell(e, 0x4c + (size_t)nameLen, &entry->offset);
+    size_t valueCount = object_value_count(obj);
+    int32_t valueList = -1;
+    unsigned char *list = valueCount > 0 ? emit_cell(e, valueCount * 4, &valueList) : NULL;
+    for (size_t v = 0; v < valueCount; ++v) {
+        struct object_value value;
+        object_value_at(obj, v, &value);
+        int32_t offset = emit_value(e, &value);
+        if (list) put_uint32(list + v * 4, (uint32_t)offset);
+    }
+    if (nk) {
+        fill_key_cell(nk, entry->name, nameLen, KEY_COMP_NAME, parent, 0, -1, (uint32_t)valueCount, valueList,
+                      security);
+    }
+}
+
+/* Lay out the whole hive and return its size; writes it when out is set. */
+static size_t emit_hive(const BCD_STORE *store, struct subkey_entry *entries, unsigned char *out)
+{
+    static const char rootName[] = "Objects";
+    struct emitter e = {out, 0x1000, 0x1000};
+    int32_t rootKey = 0;
+    unsigned char *root = emit_cell(&e, 0x4c + sizeof(rootName) - 1, &rootKey);
+    int32_t security = 0;
+    unsigned char *sk = emit_cell(&e, 0x14 + sizeof(g_keySecurity), &security);
+    if (sk) fill_security_cell(sk, security, (uint32_t)store->objectCount + 1);
+    for (size_t i = 0; i < store->objectCount; ++i) emit_object(&e, &store->objects[i], &entries[i], rootKey, security);
+
+    int32_t subkeyList = -1;
+    size_t listCount = subkey_list_count(store->objectCount);
+    if (out) qsort(entries, store->objectCount, sizeof(struct subkey_entry), compare_subkey_entries);
+    unsigned char *index = listCount > 1 ? emit_cell(&e, 0x04 + listCount * 4, &subkeyList) : NULL;
+    if (index) {
+        index[0] = 'r';
+        index[1] = 'i';
+        put_uint16(index + 0x02, (uint16_t)listCount);
+    }
+    for (size_t l = 0; l < listCount; ++l) {
+        size_t first = l * SUBKEY_LIST_MAX;
+        size_t count = store->objectCount - first < SUBKEY_LIST_MAX ? store->objectCount - first : SUBKEY_LIST_MAX;
+        int32_t offset = 0;
+        unsigned char *list = emit_cell(&e, 0x04 + count * 8, &offset);
+        if (list) fill_subkey_list_cell(list, entries + first, count);
+        if (index) put_uint32(index + 0x04 + l * 4, (uint32_t)offset);
+        else if (listCount == 1) subkeyList = offset;
+    }
+    close_bin(&e);
+    if (out) {
+        fill_key_cell(root, rootName, (uint16_t)(sizeof(rootName) - 1), KEY_HIVE_ENTRY | KEY_COMP_NAME, 0,
+                      (uint32_t)store->objectCount, subkeyList, 0, -1, security);
+        fill_base_block(out, rootKey, e.pos - 0x1000);
+    }
+    return e.pos;
+}
 
+/* Name the objects' keys and size the whole hive; entries must hold
+ * store->objectCount slots. */
+static int prepare_hive(const BCD_STORE *store, struct subkey_entry **outEntries, size_t *outSize)
+{
+    struct subkey_entry *entries = (struct subkey_entry *)calloc(store->objectCount + 1, sizeof(struct subkey_entry));
+    if (!entries) return BCD_ERR_CAPACITY;
     for (size_t i = 0; i < store->objectCount; ++i) {
         const BCD_OBJECT *obj = &store->objects[i];
-        int32_t *valueOffsets = NULL;
-        if (obj->elementCount > 0) {
-            valueOffsets = (int32_t *)calloc(obj->elementCount, sizeof(int32_t));
-            if (!valueOffsets) { free(objectOffsets); return BCD_ERR_IO; }
-        }
-        for (size_t v = 0; v < obj->elementCount; ++v) {
-            const BCD_ELEMENT *el = &obj->elements[v];
-            char nameBuf[16];
-            snprintf(nameBuf, sizeof(nameBuf), "%08x", el->type);
-            uint32_t regType = element_to_regtype(el->kind);
-            unsigned char dataBuf[BCD_MAX_BINARY_SIZE + 16];
-            uint32_t dataSize = 0;
-            switch (el->kind) {
-            case BCD_ELEMENT_STRING:
-                dataSize = (uint32_t)(strlen(el->data.stringValue) + 1);
-                memcpy(dataBuf, el->data.stringValue, dataSize);
-                break;
-            case BCD_ELEMENT_BOOLEAN: {
-                uint32_t val = el->data.boolValue ? 1U : 0U;
-                memcpy(dataBuf, &val, sizeof(uint32_t));
-                dataSize = 4;
-                break;
-            }
-            case BCD_ELEMENT_INTEGER: {
-                uint64_t qv = el->data.integerValue;
-                memcpy(dataBuf, &qv, sizeof(uint64_t));
-                dataSize = 8;
-                regType = REG_TYPE_QWORD;
-                break;
-            }
-            case BCD_ELEMENT_BINARY:
-            default:
-                dataSize = (uint32_t)el->data.binaryValue.size;
-                memcpy(dataBuf, el->data.binaryValue.data, dataSize);
-                regType = REG_TYPE_BINARY;
-                break;
-            }
-            if (!append_value_cell(&w, nameBuf, regType, dataBuf, dataSize, &valueOffsets[v])) {
-                free(valueOffsets);
-                free(objectOffsets);
-                free(w.data);
-                return BCD_ERR_IO;
-            }
+        struct subkey_entry *entry = &entries[i];
+        int status = BCD_OK;
+        if (BcdFormatObjectId(&obj->id, entry->name, sizeof(entry->name)) != BCD_OK) status = BCD_ERR_IO;
+        entry->hash = RegfHashName(entry->name, strlen(entry->name));
+        size_t valueCount = object_value_count(obj);
+        for (size_t v = 0; v < valueCount && status == BCD_OK; ++v) {
+            struct object_value value;
+            object_value_at(obj, v, &value);
+            if (value.dataSize > MAX_VALUE_DATA) status = BCD_ERR_CAPACITY;
+        }
+        if (status != BCD_OK) {
+            free(entries);
+            return status;
         }
+    }
+    if (subkey_list_count(store->objectCount) > 0xffff) {
+        free(entries);
+        return BCD_ERR_CAPACITY;
+    }
+    size_t size = emit_hive(store, entries, NULL);
+    if (size - 0x1000 > 0x7fffffffU) {
+        free(entries);
+        return BCD_ERR_CAPACITY;
+    }
+    *outEntries = entries;
+    *outSize = size;
+    return BCD_OK;
+}
 
-        int32_t valueListOff = 0;
-        if (obj->elementCount > 0) {
-            if (!append_value_list(&w, valueOffsets, obj->elementCount, &valueListOff)) {
-                free(valueOffsets);
-                free(objectOffsets);
-                free(w.data);
-                return BCD_ERR_IO;
-            }
+int RegfMeasureBcdStore(const BCD_STORE *store, size_t *outSize)
+{
+    if (!store || !outSize) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_SERIALIZE);
+    struct subkey_entry *entries = NULL;
+    int status = prepare_hive(store, &entries, outSize);
+    free(entries);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+static int write_hive(const BCD_STORE *store, unsigned char *out, size_t size)
+{
+    struct subkey_entry *entries = NULL;
+    size_t needed = 0;
+    int status = prepare_hive(store, &entries, &needed);
+    if (status != BCD_OK) return status;
+    if (size != needed) {
+        free(entries);
+        return BCD_ERR_INVALID_ARG;
+    }
+    memset(out, 0, size);
+    emit_hive(store, entries, out);
+    free(entries);
+    return BCD_OK;
+}
+
+int RegfWriteBcdStore(const BCD_STORE *store, unsigned char *out, size_t size)
+{
+    if (!store || !out) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_SERIALIZE);
+    int status = write_hive(store, out, size);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+static int serialize_hive(const BCD_STORE *store, unsigned char **outBuffer, size_t *outSize)
+{
+    struct subkey_entry *entries = NULL;
+    size_t size = 0;
+    int status = prepare_hive(store, &entries, &size);
+    if (status != BCD_OK) return status;
+    unsigned char *buffer = (unsigned char *)calloc(1, size);
+    if (!buffer) {
+        free(entries);
+        return BCD_ERR_IO;
+    }
+    emit_hive(store, entries, buffer);
+    free(entries);
+    *outBuffer = buffer;
+    *outSize = size;
+    return BCD_OK;
+}
+
+int RegfSerializeBcdStore(const BCD_STORE *store, unsigned char **outBuffer, size_t *outSize)
+{
+    if (!store || !outBuffer || !outSize) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_SERIALIZE);
+    int status = serialize_hive(store, outBuffer, outSize);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+/* -------------------- In-place updates -------------------- */
+
+static int hive_reserve(REGF_HIVE *hive, size_t size)
+{
+    if (size > hive->capacity) {
+        size_t newCap = hive->capacity ? hive->capacity * 2 : HIVE_PAGE_SIZE;
+        while (newCap < size) newCap *= 2;
+        unsigned char *p = (unsigned char *)realloc(hive->owned, newCap);
+        if (!p) return 0;
+        hive->owned = p;
+        hive->buffer = p;
+        hive->capacity = newCap;
+    }
+    size_t oldPages = (hive->size + HIVE_PAGE_SIZE - 1) / HIVE_PAGE_SIZE;
+    size_t newPages = (size + HIVE_PAGE_SIZE - 1) / HIVE_PAGE_SIZE;
+    if (newPages > oldPages) {
+        unsigned char *pages = (unsigned char *)realloc(hive->dirtyPages, newPages);
+        if (!pages) return 0;
+        memset(pages + oldPages, 0, newPages - oldPages);
+        hive->dirtyPages = pages;
+    }
+    if (size > hive->size) hive->size = size;
+    return 1;
+}
+
+/* Writable view of len (> 0) bytes at a cell offset; the pages they cover are
+ * queued for RegfWriteChanges. */
+static unsigned char *hive_touch(REGF_HIVE *hive, int32_t offset, size_t len)
+{
+    size_t start = (size_t)offset + 0x1000;
+    for (size_t page = start / HIVE_PAGE_SIZE; page <= (start + len - 1) / HIVE_PAGE_SIZE; ++page) {
+        hive->dirtyPages[page] = 1;
+    }
+    return hive->owned + start;
+}
+
+static int push_free_cell(REGF_HIVE *hive, int32_t offset)
+{
+    if (hive->freeCount == hive->freeCapacity) {
+        size_t newCap = hive->freeCapacity ? hive->freeCapacity * 2 : 64;
+        int32_t *cells = (int32_t *)realloc(hive->freeCells, newCap * sizeof(int32_t));
+        if (!cells) return 0;
+        hive->freeCells = cells;
+        hive->freeCapacity = newCap;
+    }
+    hive->freeCells[hive->freeCount++] = offset;
+    return 1;
+}
+
+/* Walk the cells of every bin, collecting the free ones. Anything that does
+ * not tile exactly fails, so updates never build on a damaged image. */
+static int scan_free_cells(REGF_HIVE *hive)
+{
+    if (hive->binCount == 0) return 0;
+    for (size_t b = 0; b < hive->binCount; ++b) {
+        size_t pos = 0x1000 + (size_t)hive->bins[b].offset;
+        size_t end = pos + hive->bins[b].size;
+        for (size_t cell = pos + HBIN_HEADER_SIZE; cell < end;) {
+            int32_t raw = read_int32(hive->buffer + cell);
+            size_t size = raw < 0 ? (size_t)(-(int64_t)raw) : (size_t)raw;
+            if (size < MIN_CELL_SIZE || size % 8 || size > end - cell) return 0;
+            if (raw > 0 && !push_free_cell(hive, (int32_t)(cell - 0x1000))) return 0;
+            cell += size;
         }
-        free(valueOffsets);
+    }
+    return 1;
+}
+
+/* Append an hbin large enough for a cell of cellSize bytes; its space becomes
+ * one free cell at the end of the free list. */
+static int hive_append_bin(REGF_HIVE *hive, size_t cellSize)
+{
+    size_t binSize = bin_size_for(cellSize);
+    size_t binsSize = hive->binsSize;
+    if (binsSize + binSize > 0x7fffffffU) return 0;
+    if (!hive_reserve(hive, 0x1000 + binsSize + binSize)) return 0;
+    if (!push_bin(hive, (uint32_t)binsSize, (uint32_t)binSize)) return 0;
+    if (!push_free_cell(hive, (int32_t)(binsSize + HBIN_HEADER_SIZE))) {
+        hive->binCount--;
+        hive->binsSize = binsSize;
+        return 0;
+    }
+    unsigned char *bin = hive_touch(hive, (int32_t)binsSize, binSize);
+    memset(bin, 0, binSize);
+    fill_bin_header(bin, binsSize, binSize);
+    put_uint32(bin + HBIN_HEADER_SIZE, (uint32_t)(binSize - HBIN_HEADER_SIZE));
+    put_uint32(hive->owned + BASE_BINS_SIZE, (uint32_t)(binsSize + binSize));
+    hive->dirtyPages[0] = 1;
+    return 1;
+}
 
-        char nameBuf[64];
-        if (BcdFormatObjectId(&obj->id, nameBuf, sizeof(nameBuf)) != BCD_OK) {
-            free(objectOffsets);
-            free(w.data);
-            return BCD_ERR_IO;
+/* Allocate a zeroed cell with room for payloadSize bytes: best fit among the
+ * free cells, splitting off the remainder, else from a newly appended hbin.
+ * Best fit keeps small cells out of the large holes left by freed lists, so
+ * a list that grows can reuse them. Returns the cell offset or -1. May move
+ * the image. */
+static int32_t hive_alloc_cell(REGF_HIVE *hive, size_t payloadSize)
+{
+    size_t need = align8(payloadSize + 4);
+    size_t pick = hive->freeCount;
+    size_t pickSize = 0;
+    for (size_t i = 0; i < hive->freeCount && pickSize != need; ++i) {
+        size_t size = (size_t)read_int32(hive->buffer + 0x1000 + hive->freeCells[i]);
+        if (size >= need && (pick == hive->freeCount || size < pickSize)) {
+            pick = i;
+            pickSize = size;
         }
-        objectOffsets[i] = append_key(&w, nameBuf, 0, 0, (uint32_t)obj->elementCount, valueListOff);
-        if (objectOffsets[i] < 0) {
-            free(objectOffsets);
-            free(w.data);
-            return BCD_ERR_IO;
+    }
+    if (pick == hive->freeCount) {
+        if (!hive_append_bin(hive, need)) return -1;
+        pick = hive->freeCount - 1;
+    }
+    int32_t offset = hive->freeCells[pick];
+    size_t size = (size_t)read_int32(hive->buffer + 0x1000 + offset);
+    hive->freeCells[pick] = hive->freeCells[--hive->freeCount];
+    if (size - need >= MIN_CELL_SIZE) {
+        /* Just released a slot, so this push cannot fail. */
+        int32_t rest = offset + (int32_t)need;
+        put_uint32(hive_touch(hive, rest, 4), (uint32_t)(size - need));
+        push_free_cell(hive, rest);
+        size = need;
+    }
+    unsigned char *cell = hive_touch(hive, offset, size);
+    memset(cell, 0, size);
+    put_uint32(cell, (uint32_t)-(int32_t)size);
+    return offset;
+}
+
+/* Return an allocated cell to its bin, merging it with free neighbours. */
+static void hive_free_cell(REGF_HIVE *hive, int32_t offset)
+{
+    size_t size = 0;
+    const unsigned char *cell = get_cell(hive, offset, &size);
+    const struct hive_bin *bin = find_bin(hive, offset);
+    if (!cell || !bin || read_int32(cell) >= 0) return;
+    int32_t start = offset;
+    for (size_t i = 0; i < hive->freeCount;) {
+        int32_t other = hive->freeCells[i];
+        size_t otherSize = (size_t)read_int32(hive->buffer + 0x1000 + other);
+        int sameBin = (uint32_t)other - bin->offset < bin->size;
+        if (sameBin && ((size_t)other == (size_t)start + size || (size_t)other + otherSize == (size_t)start)) {
+            if (other < start) start = other;
+            size += otherSize;
+            hive->freeCells[i] = hive->freeCells[--hive->freeCount];
+            i = 0;
+            continue;
         }
+        ++i;
+    }
+    put_uint32(hive_touch(hive, start, 4), (uint32_t)size);
+    push_free_cell(hive, start);
+}
+
+static int32_t hive_put_cell(REGF_HIVE *hive, const unsigned char *payload, size_t payloadSize)
+{
+    int32_t offset = hive_alloc_cell(hive, payloadSize);
+    if (offset >= 0 && payloadSize > 0) memcpy(hive_touch(hive, offset + 4, payloadSize), payload, payloadSize);
+    return offset;
+}
+
+/* In-place counterpart of emit_value_data. */
+static int32_t hive_put_value_data(REGF_HIVE *hive, const unsigned char *data, uint32_t dataSize)
+{
+    if (dataSize <= BIG_DATA_SEGMENT_SIZE) return hive_put_cell(hive, data, dataSize);
+    size_t segmentCount = (dataSize + BIG_DATA_SEGMENT_SIZE - 1) / BIG_DATA_SEGMENT_SIZE;
+    if (segmentCount > 0xffff) return -1;
+    int32_t listOffset = hive_alloc_cell(hive, segmentCount * 4);
+    if (listOffset < 0) return -1;
+    for (size_t i = 0; i < segmentCount; ++i) {
+        size_t chunk = dataSize - i * BIG_DATA_SEGMENT_SIZE;
+        if (chunk > BIG_DATA_SEGMENT_SIZE) chunk = BIG_DATA_SEGMENT_SIZE;
+        int32_t segment = hive_put_cell(hive, data + i * BIG_DATA_SEGMENT_SIZE, chunk);
+        if (segment < 0) return -1;
+        put_uint32(hive_touch(hive, listOffset + 4 + (int32_t)(i * 4), 4), (uint32_t)segment);
     }
+    unsigned char record[8] = {'d', 'b'};
+    put_uint16(record + 0x02, (uint16_t)segmentCount);
+    put_uint32(record + 0x04, (uint32_t)listOffset);
+    return hive_put_cell(hive, record, sizeof(record));
+}
+
+static int32_t hive_put_value(REGF_HIVE *hive, const struct object_value *value)
+{
+    int32_t dataOffset = 0;
+    if (value->dataSize > 4 && (dataOffset = hive_put_value_data(hive, value->data, value->dataSize)) < 0) return -1;
+    uint16_t nameLen = (uint16_t)strlen(value->name);
+    int32_t offset = hive_alloc_cell(hive, 0x14 + (size_t)nameLen);
+    if (offset < 0) return -1;
+    fill_value_cell(hive_touch(hive, offset + 4, 0x14 + (size_t)nameLen), value->name, nameLen, value->regType,
+                    value->data, value->dataSize, dataOffset);
+    return offset;
+}
+
+static REGF_VALUE *value_at_offset(REGF_HIVE *hive, int32_t offset)
+{
+    size_t cellSize = 0;
+    const unsigned char *cell = get_cell(hive, offset, &cellSize);
+    return parse_value(hive, cell, cellSize);
+}
 
-    int32_t subkeyList = 0;
-    if (store->objectCount > 0) {
-        if (!append_subkey_list(&w, objectOffsets, store->objectCount, &subkeyList)) {
-            free(objectOffsets);
-            free(w.data);
-            return BCD_ERR_IO;
+/* Free the cells holding a value's data (a plain cell, or a db record with its
+ * segment list and segments); inline data has none. */
+static void hive_free_value_data(REGF_HIVE *hive, int32_t valueOffset)
+{
+    REGF_VALUE *value = value_at_offset(hive, valueOffset);
+    if (!value) return;
+    if (!(value->dataSize & VALUE_DATA_INLINE) && value->dataSize > 0) {
+        const unsigned char *segments = NULL;
+        int count = is_big_data(value) ? big_data_segments(value, &segments) : -1;
+        if (count > 0) {
+            const unsigned char *record = get_cell(hive, (int32_t)value->dataOffset, NULL);
+            for (int i = 0; i < count; ++i) hive_free_cell(hive, read_int32(segments + (size_t)i * 4));
+            hive_free_cell(hive, read_int32(record + 0x08));
         }
+        hive_free_cell(hive, (int32_t)value->dataOffset);
     }
-    free(objectOffsets);
+    RegfReleaseValue(value);
+}
 
-    int32_t rootKey = append_key(&w, "Objects", (uint16_t)store->objectCount, subkeyList, 0, 0);
-    if (rootKey < 0) {
-        free(w.data);
-        return BCD_ERR_IO;
+static void hive_free_value(REGF_HIVE *hive, int32_t valueOffset)
+{
+    hive_free_value_data(hive, valueOffset);
+    hive_free_cell(hive, valueOffset);
+}
+
+static int value_has_name(REGF_HIVE *hive, int32_t valueOffset, const char *name)
+{
+    REGF_VALUE *value = value_at_offset(hive, valueOffset);
+    int match = value && RegfNameEquals(RegfGetValueName(value), name);
+    RegfReleaseValue(value);
+    return match;
+}
+
+/* Values the BCD layer owns: "Type" and hex-named elements. Anything else on
+ * an object key is left untouched. */
+static int value_is_bcd_owned(REGF_HIVE *hive, int32_t valueOffset)
+{
+    REGF_VALUE *value = value_at_offset(hive, valueOffset);
+    if (!value) return 0;
+    uint32_t elementType = 0;
+    REGF_NAME name = RegfGetValueName(value);
+    int owned = RegfNameEquals(name, BCD_OBJECT_TYPE_VALUE) || RegfNameParseHex32(name, &elementType) == BCD_OK;
+    RegfReleaseValue(value);
+    return owned;
+}
+
+static int value_matches(REGF_HIVE *hive, int32_t valueOffset, const struct object_value *wanted)
+{
+    REGF_VALUE *value = value_at_offset(hive, valueOffset);
+    if (!value) return 0;
+    REGF_DATA_CURSOR cursor;
+    int same = value->type == wanted->regType && RegfGetValueDataSize(value) == wanted->dataSize &&
+               RegfValueDataBegin(value, &cursor) == BCD_OK;
+    size_t pos = 0;
+    const void *chunk = NULL;
+    size_t chunkSize = 0;
+    int rc = 0;
+    while (same && (rc = RegfValueDataNext(&cursor, &chunk, &chunkSize)) == 1) {
+        same = chunkSize <= wanted->dataSize - pos && memcmp(chunk, wanted->data + pos, chunkSize) == 0;
+        pos += chunkSize;
     }
+    RegfReleaseValue(value);
+    return same && rc == 0 && pos == wanted->dataSize;
+}
 
-    size_t hiveSize = 0x1000 + w.size;
-    size_t padded = align4(hiveSize);
-    unsigned char *buffer = (unsigned char *)calloc(1, padded);
-    if (!buffer) {
-        free(w.data);
-        return BCD_ERR_IO;
+/* Point an existing vk at new data, overwriting its data cell when the new
+ * bytes fit and allocating fresh cells otherwise. */
+static int hive_set_value_data(REGF_HIVE *hive, int32_t valueOffset, const struct object_value *wanted)
+{
+    REGF_VALUE *value = value_at_offset(hive, valueOffset);
+    if (!value) return BCD_ERR_PARSE;
+    int32_t dataOffset = 0;
+    int reuse = 0;
+    if (wanted->dataSize > 4 && wanted->dataSize <= BIG_DATA_SEGMENT_SIZE &&
+        !(value->dataSize & VALUE_DATA_INLINE) && value->dataSize > 0 && !is_big_data(value)) {
+        size_t dataCellSize = 0;
+        reuse = get_cell(hive, (int32_t)value->dataOffset, &dataCellSize) && dataCellSize - 4 >= wanted->dataSize;
+        dataOffset = (int32_t)value->dataOffset;
+    }
+    RegfReleaseValue(value);
+    if (reuse) {
+        memcpy(hive_touch(hive, dataOffset + 4, wanted->dataSize), wanted->data, wanted->dataSize);
+    } else {
+        hive_free_value_data(hive, valueOffset);
+        dataOffset = 0;
+        if (wanted->dataSize > 4 && (dataOffset = hive_put_value_data(hive, wanted->data, wanted->dataSize)) < 0) {
+            return BCD_ERR_CAPACITY;
+        }
+    }
+    unsigned char *vk = hive_touch(hive, valueOffset, VK_NAME);
+    if (wanted->dataSize <= 4) {
+        put_uint32(vk + VK_DATA_SIZE, wanted->dataSize | VALUE_DATA_INLINE);
+        memset(vk + VK_DATA_OFFSET, 0, 4);
+        if (wanted->dataSize > 0) memcpy(vk + VK_DATA_OFFSET, wanted->data, wanted->dataSize);
+    } else {
+        put_uint32(vk + VK_DATA_SIZE, wanted->dataSize);
+        put_uint32(vk + VK_DATA_OFFSET, (uint32_t)dataOffset);
+    }
+    put_uint32(vk + VK_TYPE, wanted->regType);
+    return BCD_OK;
+}
+
+/* Store a value list, reusing the old list cell when it is large enough. */
+static int32_t hive_put_value_list(REGF_HIVE *hive, int32_t oldList, int hadList, const int32_t *offsets, size_t count)
+{
+    size_t oldSize = 0;
+    int32_t list = -1;
+    if (hadList && count > 0 && get_cell(hive, oldList, &oldSize) && oldSize - 4 >= count * 4) {
+        list = oldList;
+    } else {
+        if (hadList) hive_free_cell(hive, oldList);
+        if (count > 0 && (list = hive_alloc_cell(hive, count * 4)) < 0) return -2;
+    }
+    if (count > 0) {
+        unsigned char *p = hive_touch(hive, list + 4, count * 4);
+        for (size_t i = 0; i < count; ++i) put_uint32(p + i * 4, (uint32_t)offsets[i]);
+    }
+    return list;
+}
+
+static void adjust_security_references(REGF_HIVE *hive, int32_t securityOffset, int delta)
+{
+    size_t size = 0;
+    const unsigned char *sk = get_cell(hive, securityOffset, &size);
+    if (!sk || size < SK_REFERENCES + 4 || sk[4] != 's' || sk[5] != 'k') return;
+    uint32_t refs = read_uint32(sk + SK_REFERENCES);
+    /* Never drop the last reference: unlinking descriptors is not supported. */
+    if (delta < 0 && refs <= 1) return;
+    put_uint32(hive_touch(hive, securityOffset + SK_REFERENCES, 4), refs + (uint32_t)delta);
+}
+
+/* Bring the values of an object's key in line with its elements. Unchanged
+ * values are left alone and changed ones are rewritten where they are; the
+ * value list is only rewritten when values come or go. */
+static int update_object_key(REGF_HIVE *hive, const BCD_OBJECT *obj)
+{
+    int32_t keyOffset = (int32_t)obj->sourceCell;
+    REGF_KEY *key = RegfGetKeyAtOffset(hive, keyOffset);
+    if (!key) return BCD_ERR_PARSE;
+    size_t oldCount = key->valueList ? (size_t)key->valueCount : 0;
+    int32_t oldList = read_int32(key->cell + NK_VALUE_LIST);
+    size_t wantedCount = object_value_count(obj);
+    int32_t *values = (int32_t *)malloc((oldCount + wantedCount + 1) * sizeof(int32_t));
+    unsigned char *used = (unsigned char *)calloc(oldCount + 1, 1);
+    if (!values || !used) {
+        RegfReleaseKey(key);
+        free(values);
+        free(used);
+        return BCD_ERR_CAPACITY;
     }
+    for (size_t j = 0; j < oldCount; ++j) values[j] = value_entry(key, (int)j);
+    RegfReleaseKey(key);
 
-    memcpy(buffer, "regf", 4);
-    buffer[0x24] = (unsigned char)(rootKey & 0xff);
-    buffer[0x25] = (unsigned char)((rootKey >> 8) & 0xff);
-    buffer[0x26] = (unsigned char)((rootKey >> 16) & 0xff);
-    buffer[0x27] = (unsigned char)((rootKey >> 24) & 0xff);
+    int status = BCD_OK;
+    int listChanged = 0;
+    size_t count = oldCount;
+    for (size_t v = 0; v < wantedCount && status == BCD_OK; ++v) {
+        struct object_value wanted;
+        object_value_at(obj, v, &wanted);
+        size_t match = 0;
+        while (match < oldCount && (used[match] || !value_has_name(hive, values[match], wanted.name))) ++match;
+        if (match < oldCount) {
+            used[match] = 1;
+            if (!value_matches(hive, values[match], &wanted)) status = hive_set_value_data(hive, values[match], &wanted);
+        } else if ((values[count] = hive_put_value(hive, &wanted)) >= 0) {
+            ++count;
+            listChanged = 1;
+        } else {
+            status = BCD_ERR_CAPACITY;
+        }
+    }
 
-    memcpy(buffer + 0x1000, w.data, w.size);
-    *outBuffer = buffer;
-    *outSize = padded;
-    free(w.data);
+    /* Drop values of removed elements, keeping the order of the rest. */
+    size_t kept = 0;
+    for (size_t j = 0; j < count && status == BCD_OK; ++j) {
+        if (j < oldCount && !used[j] && value_is_bcd_owned(hive, values[j])) {
+            hive_free_value(hive, values[j]);
+            listChanged = 1;
+            continue;
+        }
+        values[kept++] = values[j];
+    }
+    if (status == BCD_OK && listChanged) {
+        int32_t list = hive_put_value_list(hive, oldList, oldCount > 0, values, kept);
+        if (list == -2) {
+            status = BCD_ERR_CAPACITY;
+        } else {
+            unsigned char *nk = hive_touch(hive, keyOffset, NK_NAME);
+            put_uint32(nk + NK_VALUE_COUNT, (uint32_t)kept);
+            put_uint32(nk + NK_VALUE_LIST, (uint32_t)list);
+        }
+    }
+    free(values);
+    free(used);
+    return status;
+}
+
+/* Create the key for an object that has no cell yet; returns its offset or -1. */
+static int32_t hive_put_object_key(REGF_HIVE *hive, const BCD_OBJECT *obj, int32_t parent)
+{
+    char name[BCD_ID_STRING_LENGTH + 1];
+    if (BcdFormatObjectId(&obj->id, name, sizeof(name)) != BCD_OK) return -1;
+    size_t valueCount = object_value_count(obj);
+    int32_t *values = (int32_t *)malloc((valueCount + 1) * sizeof(int32_t));
+    if (!values) return -1;
+    int32_t offset = -1;
+    size_t v = 0;
+    while (v < valueCount) {
+        struct object_value value;
+        object_value_at(obj, v, &value);
+        if ((values[v] = hive_put_value(hive, &value)) < 0) break;
+        ++v;
+    }
+    int32_t list = v == valueCount ? hive_put_value_list(hive, 0, 0, values, valueCount) : -2;
+    uint16_t nameLen = (uint16_t)strlen(name);
+    if (list != -2 && (offset = hive_alloc_cell(hive, 0x4c + (size_t)nameLen)) >= 0) {
+        int32_t security = -1;
+        const unsigned char *parentCell = get_cell(hive, parent, NULL);
+        if (parentCell) security = read_int32(parentCell + NK_SECURITY);
+        unsigned char *nk = hive_touch(hive, offset, NK_NAME + (size_t)nameLen);
+        fill_key_cell(nk + 4, name, nameLen, KEY_COMP_NAME, parent, 0, -1, (uint32_t)valueCount, list, security);
+        adjust_security_references(hive, security, 1);
+    }
+    free(values);
+    return offset;
+}
+
+static void hive_free_subkey_list(REGF_HIVE *hive, int32_t listOffset)
+{
+    size_t size = 0;
+    const unsigned char *list = get_cell(hive, listOffset, &size);
+    if (!list) return;
+    if (size >= 8 && list[4] == 'r' && list[5] == 'i') {
+        size_t count = read_uint16(list + 0x06);
+        for (size_t i = 0; i < count && 8 + i * 4 + 4 <= size; ++i) hive_free_cell(hive, read_int32(list + 0x08 + i * 4));
+    }
+    hive_free_cell(hive, listOffset);
+}
+
+/* Free a key, its values and (recursively) its subkeys. */
+static void hive_free_key(REGF_HIVE *hive, int32_t offset, int depth)
+{
+    REGF_KEY *key = RegfGetKeyAtOffset(hive, offset);
+    if (!key) return;
+    if (depth < 64) {
+        for (int i = 0; i < key->subkeyCount; ++i) hive_free_key(hive, subkey_entry(key, i, NULL), depth + 1);
+    }
+    if (key->subkeyCount > 0) hive_free_subkey_list(hive, read_int32(key->cell + NK_SUBKEY_LIST));
+    if (key->valueList) {
+        for (int i = 0; i < key->valueCount; ++i) hive_free_value(hive, value_entry(key, i));
+        hive_free_cell(hive, read_int32(key->cell + NK_VALUE_LIST));
+    }
+    adjust_security_references(hive, read_int32(key->cell + NK_SECURITY), -1);
+    RegfReleaseKey(key);
+    hive_free_cell(hive, offset);
+}
+
+struct root_entry {
+    int32_t offset;
+    REGF_NAME name;
+};
+
+static int compare_root_entries(const void *a, const void *b)
+{
+    return RegfNameCompare(((const struct root_entry *)a)->name, ((const struct root_entry *)b)->name);
+}
+
+/* Room for count list entries and a quarter more, so keys added later fit
+ * in the same cell and a growing list is reallocated only geometrically. */
+static size_t subkey_list_capacity(size_t count)
+{
+    size_t capacity = count + count / 4 + 8;
+    return capacity < SUBKEY_LIST_MAX ? capacity : SUBKEY_LIST_MAX;
+}
+
+/* Keep the list cell at offset (-1 for none) when it has room for
+ * payloadSize bytes, else free it and allocate allocSize bytes. */
+static int32_t hive_resize_list_cell(REGF_HIVE *hive, int32_t offset, size_t payloadSize, size_t allocSize)
+{
+    if (offset >= 0) {
+        size_t size = 0;
+        if (get_cell(hive, offset, &size) && size - 4 >= payloadSize) return offset;
+        hive_free_cell(hive, offset);
+    }
+    return hive_alloc_cell(hive, allocSize);
+}
+
+/* The lists of a validated subkey list: the sublists of an ri root (whose
+ * offset goes to *index) or the list itself. subs holds 0xffff entries. */
+static size_t read_sublists(REGF_HIVE *hive, int32_t listOffset, int32_t *subs, int32_t *index)
+{
+    const unsigned char *list = get_cell(hive, listOffset, NULL);
+    *index = -1;
+    if (!list) return 0;
+    if (list[4] != 'r' || list[5] != 'i') {
+        subs[0] = listOffset;
+        return 1;
+    }
+    size_t count = read_uint16(list + 0x06);
+    for (size_t i = 0; i < count; ++i) subs[i] = read_int32(list + 0x08 + i * 4);
+    *index = listOffset;
+    return count;
+}
+
+/* Rewrite the root's subkey list as sorted lh lists (under an ri root when
+ * there is more than one) that drop the retired keys (already freed) and
+ * include the added ones. Each list is rewritten in its old cell when it
+ * still fits; new cells are allocated with room to grow. */
+static int update_root_list(REGF_HIVE *hive, const uint32_t *retired, size_t retiredCount,
+                            const int32_t *added, size_t addedCount)
+{
+    int32_t rootOffset = hive->root->offset;
+    REGF_KEY *root = RegfGetKeyAtOffset(hive, rootOffset);
+    if (!root) return BCD_ERR_PARSE;
+    size_t total = (size_t)root->subkeyCount + addedCount;
+    struct root_entry *entries = (struct root_entry *)malloc((total + 1) * sizeof(struct root_entry));
+    if (!entries) {
+        RegfReleaseKey(root);
+        return BCD_ERR_CAPACITY;
+    }
+    size_t count = 0;
+    for (int i = 0; i < root->subkeyCount; ++i) {
+        int32_t child = subkey_entry(root, i, NULL);
+        size_t r = 0;
+        while (r < retiredCount && (int32_t)retired[r] != child) ++r;
+        if (r == retiredCount) entries[count++].offset = child;
+    }
+    for (size_t i = 0; i < addedCount; ++i) entries[count++].offset = added[i];
+    int hadList = root->subkeyCount > 0;
+    int32_t oldList = read_int32(root->cell + NK_SUBKEY_LIST);
+    RegfReleaseKey(root);
+    for (size_t i = 0; i < count; ++i) {
+        if (!child_name(hive, entries[i].offset, &entries[i].name)) {
+            free(entries);
+            return BCD_ERR_PARSE;
+        }
+    }
+    size_t listCount = (count + SUBKEY_LIST_MAX - 1) / SUBKEY_LIST_MAX;
+    if (listCount > 0xffff) {
+        free(entries);
+        return BCD_ERR_CAPACITY;
+    }
+    qsort(entries, count, sizeof(struct root_entry), compare_root_entries);
+
+    /* Hashes are taken before any allocation can move the names. */
+    uint32_t *hashes = (uint32_t *)malloc((count + 1) * sizeof(uint32_t));
+    int32_t *subs = (int32_t *)malloc(0xffff * sizeof(int32_t));
+    if (!hashes || !subs) {
+        free(hashes);
+        free(subs);
+        free(entries);
+        return BCD_ERR_CAPACITY;
+    }
+    for (size_t i = 0; i < count; ++i) hashes[i] = hash_name(entries[i].name);
+    int32_t index = -1;
+    size_t oldCount = hadList ? read_sublists(hive, oldList, subs, &index) : 0;
+    int status = BCD_OK;
+    /* Cells may move the image, so each one is touched right after it is
+     * allocated. */
+    for (size_t l = 0; l < listCount && status == BCD_OK; ++l) {
+        size_t first = l * SUBKEY_LIST_MAX;
+        size_t n = count - first < SUBKEY_LIST_MAX ? count - first : SUBKEY_LIST_MAX;
+        int32_t sub = hive_resize_list_cell(hive, l < oldCount ? subs[l] : -1, 0x04 + n * 8,
+                                            0x04 + subkey_list_capacity(n) * 8);
+        if (sub < 0) {
+            status = BCD_ERR_CAPACITY;
+            break;
+        }
+        unsigned char *lh = hive_touch(hive, sub + 4, 0x04 + n * 8);
+        lh[0] = 'l';
+        lh[1] = 'h';
+        put_uint16(lh + 0x02, (uint16_t)n);
+        for (size_t i = 0; i < n; ++i) {
+            put_uint32(lh + 0x04 + i * 8, (uint32_t)entries[first + i].offset);
+            put_uint32(lh + 0x08 + i * 8, hashes[first + i]);
+        }
+        subs[l] = sub;
+    }
+    for (size_t l = listCount; l < oldCount && status == BCD_OK; ++l) hive_free_cell(hive, subs[l]);
+    int32_t list = listCount == 1 ? subs[0] : -1;
+    if (status == BCD_OK && listCount > 1) {
+        list = hive_resize_list_cell(hive, index, 0x04 + listCount * 4, 0x04 + (listCount + 4) * 4);
+        if (list < 0) status = BCD_ERR_CAPACITY;
+    } else if (status == BCD_OK && index >= 0) {
+        hive_free_cell(hive, index);
+    }
+    if (status == BCD_OK && listCount > 1) {
+        unsigned char *ri = hive_touch(hive, list + 4, 0x04 + listCount * 4);
+        ri[0] = 'r';
+        ri[1] = 'i';
+        put_uint16(ri + 0x02, (uint16_t)listCount);
+        for (size_t l = 0; l < listCount; ++l) put_uint32(ri + 0x04 + l * 4, (uint32_t)subs[l]);
+    }
+    if (status == BCD_OK) {
+        unsigned char *nk = hive_touch(hive, rootOffset, NK_NAME);
+        put_uint32(nk + NK_SUBKEY_COUNT, (uint32_t)count);
+        put_uint32(nk + NK_SUBKEY_LIST, (uint32_t)list);
+    }
+    free(subs);
+    free(hashes);
+    free(entries);
+    return status;
+}
+
+REGF_HIVE *RegfOpenFileForUpdate(const char *path)
+{
+    if (!path || strcmp(path, "-") == 0) return NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    int openStatus;
+    REGF_HIVE *hive = open_buffered(f, path, NULL, &openStatus);
+    fclose(f);
+    if (!hive) return NULL;
+    hive->capacity = hive->size;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_OPEN);
+    size_t pageCount = (hive->size + HIVE_PAGE_SIZE - 1) / HIVE_PAGE_SIZE;
+    hive->dirtyPages = (unsigned char *)calloc(pageCount, 1);
+    /* A recovered image is written back whole, which also retires the logs. */
+    if (hive->dirtyPages && hive->recovered) memset(hive->dirtyPages, 1, pageCount);
+    int ok = hive->dirtyPages && scan_free_cells(hive);
+    BCD_STATS_PHASE_END(outer);
+    if (!ok) {
+        RegfCloseFile(hive);
+        return NULL;
+    }
+    return hive;
+}
+
+static int update_hive(REGF_HIVE *hive, BCD_STORE *store)
+{
+    int32_t rootOffset = hive->root->offset;
+    int32_t *added = (int32_t *)malloc((store->objectCount + 1) * sizeof(int32_t));
+    if (!added) return BCD_ERR_CAPACITY;
+    size_t addedCount = 0;
+    int status = BCD_OK;
+    for (size_t i = 0; i < store->objectCount && status == BCD_OK; ++i) {
+        BCD_OBJECT *obj = &store->objects[i];
+        if (obj->pending) continue;
+        if (!obj->sourceCell) {
+            int32_t offset = hive_put_object_key(hive, obj, rootOffset);
+            if (offset < 0) {
+                status = BCD_ERR_CAPACITY;
+                break;
+            }
+            obj->sourceCell = (uint32_t)offset;
+            added[addedCount++] = offset;
+        } else if (obj->dirty) {
+            status = update_object_key(hive, obj);
+        }
+        obj->dirty = 0;
+    }
+    if (status == BCD_OK) {
+        for (size_t i = 0; i < store->retiredCount; ++i) hive_free_key(hive, (int32_t)store->retiredCells[i], 0);
+        if (addedCount > 0 || store->retiredCount > 0) {
+            status = update_root_list(hive, store->retiredCells, store->retiredCount, added, addedCount);
+        }
+        store->retiredCount = 0;
+    }
+    free(added);
+
+    /* Allocations may have moved the image; re-parse the cached root. */
+    REGF_KEY *root = RegfGetKeyAtOffset(hive, rootOffset);
+    if (root) {
+        RegfReleaseKey(hive->root);
+        hive->root = root;
+    } else if (status == BCD_OK) {
+        status = BCD_ERR_PARSE;
+    }
+    return status;
+}
+
+int RegfUpdateBcdStore(REGF_HIVE *hive, BCD_STORE *store)
+{
+    if (!hive || !store || !hive->dirtyPages || RegfIsLegacyBcdHive(hive)) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_SERIALIZE);
+    int status = update_hive(hive, store);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
+
+static int write_at(FILE *f, size_t offset, const unsigned char *data, size_t size)
+{
+    if (fseek(f, (long)offset, SEEK_SET) != 0) return BCD_ERR_IO;
+    if (fwrite(data, 1, size, f) != size) return BCD_ERR_IO;
+    BCD_STATS_ADD(BCD_STAT_BYTES_WRITTEN, size);
+    return BCD_OK;
+}
+
+static int flush_file(FILE *f)
+{
+    if (fflush(f) != 0) return BCD_ERR_IO;
+#ifndef _WIN32
+    if (fsync(fileno(f)) != 0) return BCD_ERR_IO;
+#endif
+    return BCD_OK;
+}
+
+#ifndef _WIN32
+int RegfSyncParentDirectory(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? (char *)malloc((size_t)(slash - path) + 2) : NULL;
+    if (slash && !dir) return BCD_ERR_CAPACITY;
+    if (dir) {
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+    int fd = open(dir ? dir : ".", O_RDONLY);
+    free(dir);
+    if (fd < 0) return BCD_ERR_IO;
+    int status = fsync(fd) == 0 || errno == EINVAL ? BCD_OK : BCD_ERR_IO;
+    close(fd);
+    return status;
+}
+#else
+int RegfSyncParentDirectory(const char *path)
+{
+    (void)path;
     return BCD_OK;
 }
+#endif
+
+#define LOG_FILE_TYPE 6
+
+/* A new-format log holding the dirty pages of the bins area as one HvLE entry
+ * with the given sequence number, behind a copy of the base block. Runs of
+ * adjacent dirty pages share one page reference. */
+static unsigned char *build_log(const REGF_HIVE *hive, uint32_t sequence, size_t *outSize)
+{
+    size_t pageCount = 1 + hive->binsSize / HIVE_PAGE_SIZE;
+    size_t runCount = 0;
+    size_t dirtyCount = 0;
+    for (size_t page = 1; page < pageCount; ++page) {
+        if (!hive->dirtyPages[page]) continue;
+        ++dirtyCount;
+        if (page == 1 || !hive->dirtyPages[page - 1]) ++runCount;
+    }
+    size_t entrySize = (LOG_ENTRY_PAGES + runCount * 8 + dirtyCount * HIVE_PAGE_SIZE + 0x1ff) & ~(size_t)0x1ff;
+    if (entrySize > 0xffffffffU) return NULL;
+    unsigned char *log = (unsigned char *)calloc(1, LOG_ENTRIES_START + entrySize);
+    if (!log) return NULL;
+    memcpy(log, hive->owned, LOG_ENTRIES_START);
+    put_uint32(log + BASE_SEQUENCE1, sequence);
+    put_uint32(log + BASE_SEQUENCE2, sequence);
+    put_uint32(log + BASE_FILE_TYPE, LOG_FILE_TYPE);
+    put_uint32(log + BASE_CHECKSUM, base_block_checksum(log));
+
+    unsigned char *entry = log + LOG_ENTRIES_START;
+    memcpy(entry, "HvLE", 4);
+    put_uint32(entry + LOG_ENTRY_SIZE, (uint32_t)entrySize);
+    put_uint32(entry + LOG_ENTRY_SEQUENCE, sequence);
+    put_uint32(entry + LOG_ENTRY_BINS_SIZE, (uint32_t)hive->binsSize);
+    put_uint32(entry + LOG_ENTRY_PAGE_COUNT, (uint32_t)runCount);
+    unsigned char *reference = entry + LOG_ENTRY_PAGES;
+    unsigned char *data = reference + runCount * 8;
+    for (size_t page = 1; page < pageCount;) {
+        if (!hive->dirtyPages[page]) {
+            ++page;
+            continue;
+        }
+        size_t run = page;
+        while (run < pageCount && hive->dirtyPages[run]) ++run;
+        size_t bytes = (run - page) * HIVE_PAGE_SIZE;
+        put_uint32(reference, (uint32_t)((page - 1) * HIVE_PAGE_SIZE));
+        put_uint32(reference + 4, (uint32_t)bytes);
+        memcpy(data, hive->owned + page * HIVE_PAGE_SIZE, bytes);
+        reference += 8;
+        data += bytes;
+        page = run;
+    }
+    uint64_t hash = marvin32(entry + LOG_ENTRY_PAGES, entrySize - LOG_ENTRY_PAGES);
+    put_uint32(entry + LOG_ENTRY_HASH1, (uint32_t)hash);
+    put_uint32(entry + LOG_ENTRY_HASH1 + 4, (uint32_t)(hash >> 32));
+    hash = marvin32(entry, LOG_ENTRY_HASH2);
+    put_uint32(entry + LOG_ENTRY_HASH2, (uint32_t)hash);
+    put_uint32(entry + LOG_ENTRY_HASH2 + 4, (uint32_t)(hash >> 32));
+    *outSize = LOG_ENTRIES_START + entrySize;
+    return log;
+}
+
+/* Replace path's .LOG1 with log and flush it, directory entry included. */
+static int write_log(const char *path, const unsigned char *log, size_t size)
+{
+    size_t pathLen = strlen(path);
+    char *name = (char *)malloc(pathLen + 6);
+    if (!name) return BCD_ERR_CAPACITY;
+    memcpy(name, path, pathLen);
+    memcpy(name + pathLen, ".LOG1", 6);
+    FILE *f = fopen(name, "wb");
+    int status = f ? write_at(f, 0, log, size) : BCD_ERR_IO;
+    if (status == BCD_OK) status = flush_file(f);
+    if (f && fclose(f) != 0 && status == BCD_OK) status = BCD_ERR_IO;
+    if (status == BCD_OK) status = RegfSyncParentDirectory(name);
+    free(name);
+    return status;
+}
+
+static int write_changes(REGF_HIVE *hive, const char *path)
+{
+    size_t pageCount = (hive->size + HIVE_PAGE_SIZE - 1) / HIVE_PAGE_SIZE;
+    size_t firstDirty = 1;
+    while (firstDirty < pageCount && !hive->dirtyPages[firstDirty]) ++firstDirty;
+    if (firstDirty == pageCount) return BCD_OK;
+
+    /* The base block is bumped in a copy and only stored back once the whole
+     * write succeeded, so a failed write can be retried with the same
+     * sequence number. */
+    unsigned char *base = hive->owned;
+    unsigned char header[HIVE_PAGE_SIZE];
+    memcpy(header, base, HIVE_PAGE_SIZE);
+    uint32_t sequence = read_uint32(header + BASE_SEQUENCE1) + 1;
+    size_t logSize = 0;
+    unsigned char *log = build_log(hive, sequence, &logSize);
+    if (!log) return BCD_ERR_CAPACITY;
+    int status = write_log(path, log, logSize);
+    free(log);
+    if (status != BCD_OK) return status;
+
+    FILE *f = fopen(path, "r+b");
+    if (!f) return BCD_ERR_IO;
+    put_uint32(header + BASE_SEQUENCE1, sequence);
+    put_uint32(header + BASE_CHECKSUM, base_block_checksum(header));
+    status = write_at(f, 0, header, HIVE_PAGE_SIZE);
+    if (status == BCD_OK) status = flush_file(f);
+    for (size_t page = firstDirty; page < pageCount && status == BCD_OK;) {
+        if (!hive->dirtyPages[page]) {
+            ++page;
+            continue;
+        }
+        size_t run = page;
+        while (run < pageCount && hive->dirtyPages[run]) ++run;
+        size_t end = run * HIVE_PAGE_SIZE < hive->size ? run * HIVE_PAGE_SIZE : hive->size;
+        status = write_at(f, page * HIVE_PAGE_SIZE, base + page * HIVE_PAGE_SIZE, end - page * HIVE_PAGE_SIZE);
+        page = run;
+    }
+    if (status == BCD_OK) status = flush_file(f);
+    if (status == BCD_OK) {
+        put_uint32(header + BASE_SEQUENCE2, sequence);
+        put_uint32(header + BASE_CHECKSUM, base_block_checksum(header));
+        status = write_at(f, 0, header, HIVE_PAGE_SIZE);
+        if (status == BCD_OK) status = flush_file(f);
+    }
+    if (fclose(f) != 0 && status == BCD_OK) status = BCD_ERR_IO;
+    if (status == BCD_OK) {
+        memcpy(base, header, HIVE_PAGE_SIZE);
+        memset(hive->dirtyPages, 0, pageCount);
+    }
+    return status;
+}
+
+int RegfWriteChanges(REGF_HIVE *hive, const char *path)
+{
+    if (!hive || !path || !hive->dirtyPages) return BCD_ERR_INVALID_ARG;
+    BCD_STATS_PHASE_BEGIN(outer, BCD_PHASE_WRITE);
+    int status = write_changes(hive, path);
+    BCD_STATS_PHASE_END(outer);
+    return status;
+}
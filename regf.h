@@ -8,15 +8,27 @@
 
 typedef struct REGF_HIVE REGF_HIVE;
 
+/* Borrowed view of a key or value name inside its cell. Not NUL-terminated;
+ * wide names are the raw UTF-16LE bytes (length counts bytes). Valid for as
+ * long as the hive is open. */
+typedef struct REGF_NAME {
+    const char *data;
+    size_t length;
+    int wide;
+} REGF_NAME;
+
 typedef struct REGF_KEY {
+    int32_t offset;
     const unsigned char *cell;
     size_t cellSize;
     const char *name;
     uint16_t nameLen;
     int subkeyCount;
     int valueCount;
-    int *subkeyOffsets;
-    int *valueOffsets;
+    /* Child and value offsets are read from the list cells on demand. */
+    const unsigned char *subkeyList;    /* li/lf/lh list, or an ri index of them */
+    int subkeyListKind;
+    const unsigned char *valueList;     /* NULL when the value list is unreadable */
     REGF_HIVE *hive;
 } REGF_KEY;
 
@@ -31,26 +43,191 @@ typedef struct REGF_VALUE {
     REGF_HIVE *hive;
 } REGF_VALUE;
 
+/* Open a hive image in place. The hbin chain is validated up front and cell
+ * offsets are then checked against the bin that holds them; images whose
+ * chain is broken are rejected. Binless images written by older versions of
+ * this tool are still accepted. */
 REGF_HIVE *RegfOpen(const unsigned char *buffer, size_t size);
 void RegfClose(REGF_HIVE *hive);
 
+/* Open a hive straight from disk. Regular files are mapped read-only and parsed
+ * in place; pipes and other non-seekable inputs (including "-" for stdin) fall
+ * back to a buffered read. Hives opened this way must be closed with
+ * RegfCloseFile, which also releases the mapping or buffer.
+ *
+ * A dirty hive (sequence numbers differ or the base block is torn) is brought
+ * up to date from path.LOG1/path.LOG2 when they hold new-format log entries:
+ * the entries' pages are applied over the private mapping, so only the dirty
+ * pages are copied, and the image gets a clean base block. The files on disk
+ * are left alone. Legacy-format logs are ignored. */
+REGF_HIVE *RegfOpenFile(const char *path);
+void RegfCloseFile(REGF_HIVE *hive);
+
+/* Spare key and value handles kept between hives. A hive opened with a cache
+ * takes its handle blocks and gives them back, warm, when it is closed, so a
+ * thread opening many hives in turn stops allocating handles after the first.
+ * Lend a cache to one open hive at a time; it must outlive the hive. */
+typedef struct REGF_HANDLE_CACHE REGF_HANDLE_CACHE;
+REGF_HANDLE_CACHE *RegfHandleCacheCreate(void);
+void RegfHandleCacheDestroy(REGF_HANDLE_CACHE *cache);
+/* RegfOpenFile drawing its handles from cache (which may be NULL). */
+REGF_HIVE *RegfOpenFileCached(const char *path, REGF_HANDLE_CACHE *cache);
+/* RegfOpenFileCached reporting why it failed: *outStatus is BCD_ERR_IO when
+ * path cannot be read and BCD_ERR_PARSE when it is not a valid hive. */
+REGF_HIVE *RegfOpenFileStatus(const char *path, REGF_HANDLE_CACHE *cache, int *outStatus);
+/* The same recovery for a hive image read from path into malloc'd memory;
+ * *image is reallocated when the logs grow the hive. Returns 1 when entries
+ * were applied, 0 when there was nothing to replay, or BCD_ERR_CAPACITY. */
+int RegfReplayLogs(const char *path, unsigned char **image, size_t *size);
+
 REGF_KEY *RegfGetRootKey(REGF_HIVE *hive);
+/* 1 for stores from the original serializer, recognised by the zero format
+ * version it left in the base block; their element ids predate the catalog
+ * and are remapped on load (BcdMigrateLegacyElementId). */
+int RegfIsLegacyBcdHive(const REGF_HIVE *hive);
+/* Case-insensitive lookup. Subkey lists are kept sorted by upper-cased name, so
+ * every list kind is binary searched; lf name hints settle most probes without
+ * touching the child cell, li and lh probes read the child's name. */
 REGF_KEY *RegfFindSubKey(REGF_KEY *parent, const char *name);
 int RegfGetSubKeyCount(REGF_KEY *key);
 REGF_KEY *RegfGetSubKeyAt(REGF_KEY *key, int index);
 int RegfGetValueCount(REGF_KEY *key);
 REGF_VALUE *RegfGetValueAt(REGF_KEY *key, int index);
+/* Case-insensitive lookup by value name. */
+REGF_VALUE *RegfFindValue(REGF_KEY *key, const char *name);
+
+/* Yields a key's children in list order, reading li/lf/lh lists and ri index
+ * roots in place. The parent must stay alive while the cursor is in use. */
+typedef struct REGF_SUBKEY_CURSOR {
+    REGF_KEY *parent;
+    const unsigned char *list;  /* list being read, NULL once exhausted */
+    int sublist;                /* position in the ri root, if any */
+    int entry;                  /* next entry of list */
+} REGF_SUBKEY_CURSOR;
+
+int RegfSubKeyCursorBegin(REGF_KEY *parent, REGF_SUBKEY_CURSOR *cursor);
+/* Returns 1 with the next child, or 0 once all were produced. A child whose
+ * cell is unreadable comes back as NULL; others are released by the caller. */
+int RegfSubKeyCursorNext(REGF_SUBKEY_CURSOR *cursor, REGF_KEY **child);
+
+typedef enum {
+    REGF_WALK_DEPTH_FIRST,
+    REGF_WALK_BREADTH_FIRST
+} REGF_WALK_ORDER;
+
+/* Visitor verdicts. SKIP from a key passes over its values and subtree; from
+ * a value it passes over the key's remaining values. */
+enum {
+    REGF_VISIT_CONTINUE,
+    REGF_VISIT_SKIP,
+    REGF_VISIT_STOP
+};
+
+/* Keys and values handed to a visitor are only valid during the call. Each
+ * key is reported before its values and subkeys; either callback may be NULL. */
+typedef struct REGF_WALK_VISITOR {
+    int (*key)(REGF_KEY *key, int depth, void *context);
+    int (*value)(REGF_KEY *key, REGF_VALUE *value, int depth, void *context);
+    void *context;
+} REGF_WALK_VISITOR;
+
+/* Registry keys nest at most this deep; it also bounds walks of damaged hives
+ * whose keys form cycles. */
+#define REGF_WALK_MAX_DEPTH 512
 
-const char *RegfGetKeyName(REGF_KEY *key);
-const char *RegfGetValueName(REGF_VALUE *value);
+/* Walk the tree under start (depth 0) down to maxDepth levels below it;
+ * values outside 1..REGF_WALK_MAX_DEPTH mean REGF_WALK_MAX_DEPTH. Depth-first
+ * walks hold one cursor per level and breadth-first walks one cell offset per
+ * queued key, never the keys themselves. Unreadable children are passed over.
+ * Returns BCD_OK when the walk finishes or a visitor stops it. */
+int RegfWalk(REGF_KEY *start, REGF_WALK_ORDER order, int maxDepth, const REGF_WALK_VISITOR *visitor);
+
+/* Cell offsets let callers come back to a key later without re-walking the tree. */
+int32_t RegfGetKeyOffset(REGF_KEY *key);
+REGF_KEY *RegfGetKeyAtOffset(REGF_HIVE *hive, int32_t offset);
+
+REGF_NAME RegfGetKeyName(REGF_KEY *key);
+REGF_NAME RegfGetValueName(REGF_VALUE *value);
+
+/* Name helpers operating on views; all are reentrant and allocation-free.
+ * Comparisons use registry ordering (upper-cased, shorter prefix first). */
+int RegfNameCompare(REGF_NAME a, REGF_NAME b);
+int RegfNameEquals(REGF_NAME name, const char *text);
+int RegfNameParseHex32(REGF_NAME name, uint32_t *out);
+/* Copies as narrow text (non-ASCII wide characters become '?'), always
+ * NUL-terminates, and returns the full name length in characters. */
+size_t RegfNameCopy(REGF_NAME name, char *buffer, size_t bufferSize);
 uint32_t RegfGetValueType(REGF_VALUE *value);
+/* Contiguous data only: returns NULL for big-data (db) values, which must be
+ * read with a data cursor. */
 const void *RegfGetValueData(REGF_VALUE *value, size_t *size);
 uint32_t RegfGetValueDataAsUint32(REGF_VALUE *value, int *ok);
+size_t RegfGetValueDataSize(REGF_VALUE *value);
+
+/* Streams value data in the pieces it is stored in: a single chunk for inline
+ * and single-cell data, one chunk per segment for big-data (db) values. */
+typedef struct REGF_DATA_CURSOR {
+    REGF_VALUE *value;
+    size_t remaining;
+    const unsigned char *segmentList;
+    int segmentCount;
+    int segmentIndex;
+} REGF_DATA_CURSOR;
 
+int RegfValueDataBegin(REGF_VALUE *value, REGF_DATA_CURSOR *cursor);
+/* Returns 1 with the next chunk, 0 once all data was produced, or
+ * BCD_ERR_PARSE if the chain is malformed or shorter than the value size. */
+int RegfValueDataNext(REGF_DATA_CURSOR *cursor, const void **chunk, size_t *chunkSize);
+
+/* Keys and values come from per-hive handle pools: releasing one recycles it,
+ * and RegfClose frees the pools, including any handles still outstanding. */
 void RegfReleaseKey(REGF_KEY *key);
 void RegfReleaseValue(REGF_VALUE *value);
 
-/* Serialization helpers */
+/* Name hash stored in lh subkey lists. */
+uint32_t RegfHashName(const char *name, size_t len);
+
+/* Serialization helpers. RegfMeasureBcdStore computes the exact size of the
+ * hive RegfWriteBcdStore lays out into caller memory of that size (a buffer or
+ * a mapping of the output file); RegfSerializeBcdStore does both into a new
+ * buffer the caller frees. Output is a complete primary hive: 8-byte aligned
+ * cells packed into 4 KB-aligned hbins, with a checksummed base block. */
+int RegfMeasureBcdStore(const BCD_STORE *store, size_t *outSize);
+int RegfWriteBcdStore(const BCD_STORE *store, unsigned char *out, size_t size);
 int RegfSerializeBcdStore(const BCD_STORE *store, unsigned char **outBuffer, size_t *outSize);
 
+/* In-place updates. RegfOpenFileForUpdate reads the hive into memory,
+ * replaying its transaction logs like RegfOpenFile, and indexes its hbins and
+ * free cells; a recovered image is written back in full by the next
+ * RegfWriteChanges; it returns NULL for inputs that cannot be
+ * updated in place (stdin, hives without hbins, damaged bin chains), which
+ * callers should treat as a cue to fall back to RegfSerializeBcdStore.
+ *
+ * RegfUpdateBcdStore applies the store's changes to the image: new objects
+ * get keys, dirty objects have only their changed values rewritten, and
+ * deleted objects (store->retiredCells) are freed, reusing free cells and
+ * appending hbins as needed. Pending (never touched) objects are skipped.
+ * Returns BCD_ERR_INVALID_ARG, without changing anything, for hives that were
+ * not opened for update and for legacy stores, which are migrated by writing
+ * them out whole with the current ids.
+ * Keys and values obtained from the hive earlier must not be used afterwards.
+ * On failure the image is inconsistent and must not be written.
+ *
+ * RegfWriteChanges writes the 4 KB pages touched since the last write back
+ * to path through its transaction log: the pages first go to path.LOG1 as
+ * one HvLE entry, which is flushed, and are then written over the primary,
+ * bracketed by base block updates (the primary sequence number is bumped and
+ * flushed first and the secondary one last). An interrupted write leaves
+ * either the old hive or a dirty one that the next open recovers from the
+ * log, so I/O per edit stays proportional to the pages it changed. The
+ * in-memory base block only takes the new sequence number once the write
+ * succeeded, so a failed write can be retried. */
+REGF_HIVE *RegfOpenFileForUpdate(const char *path);
+int RegfUpdateBcdStore(REGF_HIVE *hive, BCD_STORE *store);
+int RegfWriteChanges(REGF_HIVE *hive, const char *path);
+
+/* Flush the directory holding path so that a file just created or renamed
+ * there survives a crash; a no-op on Windows. */
+int RegfSyncParentDirectory(const char *path);
+
 #endif /* REGF_H */